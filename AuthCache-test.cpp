@@ -0,0 +1,58 @@
+#include "AuthCache.hpp"
+
+#include "osutil.hpp"
+
+#include <string>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+int main(int argc, char* argv[])
+{
+  auto const name = "/AuthCache-test-"s + std::to_string(getpid());
+
+  DNS::Resolver res{osutil::get_config_dir()};
+  SharedCache   shared(name.c_str(), 64);
+  CHECK(shared.is_open());
+
+  AuthCache auth{res, &shared};
+
+  std::string org;
+  auto const  dmarc = auth.dmarc_record("digilicious.com", org);
+  CHECK(dmarc);
+  CHECK_EQ(dmarc->substr(0, 8), "v=DMARC1");
+  CHECK(org.empty());
+
+  // No record of its own, so the organizational domain's.
+  auto const sub = auth.dmarc_record("no-such-host.digilicious.com", org);
+  CHECK(sub);
+  CHECK_EQ(*sub, *dmarc);
+  CHECK_EQ(org, "digilicious.com");
+
+  auto const key = auth.dkim_key("ghsmtp", "digilicious.com");
+  CHECK(key);
+  CHECK_NE(key->find("p="), std::string::npos);
+
+  // The key is parsed once, and handed out again from then on.
+  auto const record = auth.dkim_key_record("ghsmtp", "digilicious.com");
+  CHECK(record);
+  CHECK_EQ(record->text, *key);
+  CHECK(record->pkey);
+  CHECK(auth.dkim_key_record("ghsmtp", "digilicious.com")->pkey
+        == record->pkey);
+
+  auto const none = auth.dkim_key("no-such-selector", "digilicious.com");
+  CHECK(none);
+  CHECK(none->empty());
+
+  // A second cache in front of the same segment sees the first one's
+  // answers.
+  AuthCache other{res, &shared};
+  CHECK_EQ(*other.dkim_key("ghsmtp", "Digilicious.com"), *key);
+
+  shm_unlink(name.c_str());
+}
@@ -0,0 +1,164 @@
+#include "AuthCache.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <glog/logging.h>
+
+#include "iequal.hpp"
+
+AuthCache::AuthCache(DNS::Resolver& res, SharedCache* shared)
+  : res_(res)
+  , shared_(shared)
+{
+}
+
+std::optional<std::string> AuthCache::dkim_key(char const* selector,
+                                               char const* domain)
+{
+  CHECK_NOTNULL(selector);
+  CHECK_NOTNULL(domain);
+  return txt_(fmt::format("{}._domainkey.{}", selector, domain), "");
+}
+
+std::optional<DKIM::key_record>
+AuthCache::dkim_key_record(char const* selector, char const* domain)
+{
+  CHECK_NOTNULL(selector);
+  CHECK_NOTNULL(domain);
+
+  entry* kept = nullptr;
+  auto   record
+      = txt_(fmt::format("{}._domainkey.{}", selector, domain), "", &kept);
+  if (!record)
+    return {};
+  if (!kept || record->empty())
+    return DKIM::key_record{std::move(*record)};
+
+  if (!kept->parsed) {
+    kept->pkey   = DKIM::parse_key(*record, domain);
+    kept->parsed = true;
+  }
+  return DKIM::key_record{std::move(*record), kept->pkey};
+}
+
+std::optional<std::string> AuthCache::dmarc_record(char const* domain,
+                                                   std::string& org_domain)
+{
+  CHECK_NOTNULL(domain);
+  org_domain.clear();
+
+  auto record = txt_(fmt::format("_dmarc.{}", domain), "v=DMARC1");
+  if (!record || !record->empty())
+    return record;
+
+  auto const org = tld_.get_registered_domain(domain);
+  if (!org || iequal(org, domain))
+    return record;
+
+  record = txt_(fmt::format("_dmarc.{}", org), "v=DMARC1");
+  if (record && !record->empty())
+    org_domain = org;
+  return record;
+}
+
+void AuthCache::trace_hit_(std::string const& name, DNS::cache_outcome how)
+{
+  DNS::trace_record tr;
+  tr.qname = name;
+  tr.qtype = DNS::RR_type::TXT;
+  tr.cache = how;
+  res_.trace(std::move(tr));
+}
+
+// Room for one more local entry.
+void AuthCache::make_room_(std::chrono::system_clock::time_point now)
+{
+  if (local_.size() < Config::auth_cache_local_max)
+    return;
+
+  std::erase_if(local_,
+                [now](auto const& kv) { return kv.second.expires <= now; });
+
+  while (local_.size() >= Config::auth_cache_local_max) {
+    auto const soonest = std::min_element(
+        local_.begin(), local_.end(), [](auto const& a, auto const& b) {
+          return a.second.expires < b.second.expires;
+        });
+    local_.erase(soonest);
+  }
+}
+
+// Of the TXT records at name, the one that starts with tag.  No
+// matching record, or more than one, counts as none.  With kept, the
+// local entry for it, if there is one.
+std::optional<std::string> AuthCache::txt_(std::string const& name,
+                                           std::string_view   tag,
+                                           entry**            kept)
+{
+  auto key = name;
+  std::transform(key.begin(), key.end(), key.begin(),
+                 [](unsigned char ch) { return std::tolower(ch); });
+
+  auto const now = std::chrono::system_clock::now();
+
+  if (auto const it = local_.find(key); it != local_.end()) {
+    if (it->second.expires > now) {
+      trace_hit_(name, DNS::cache_outcome::local_hit);
+      if (kept)
+        *kept = &it->second;
+      return it->second.value;
+    }
+    local_.erase(it);
+  }
+  if (shared_) {
+    std::chrono::seconds ttl{0};
+    if (auto const value = shared_->get(key, &ttl)) {
+      trace_hit_(name, DNS::cache_outcome::shared_hit);
+      // Kept here too, for what's left of its TTL.
+      if (ttl.count() > 0) {
+        make_room_(now);
+        auto& e = local_[key] = entry{*value, now + ttl};
+        if (kept)
+          *kept = &e;
+      }
+      return value;
+    }
+  }
+
+  DNS::Query q{res_, DNS::RR_type::TXT, name};
+  if (q.bogus_or_indeterminate()) {
+    LOG(WARNING) << "TXT lookup for " << name << " failed";
+    return {};
+  }
+
+  std::vector<std::string> records;
+  for (auto& txt : q.get_strings()) {
+    if (std::string_view(txt).substr(0, tag.size()) == tag)
+      records.push_back(std::move(txt));
+  }
+  if (records.size() > 1)
+    LOG(WARNING) << records.size() << " records at " << name;
+
+  auto const value = (records.size() == 1) ? records[0] : std::string{};
+
+  std::chrono::seconds ttl = Config::auth_cache_neg_ttl;
+  if (!value.empty())
+    ttl = std::min<std::chrono::seconds>(std::chrono::seconds(q.min_ttl()),
+                                         Config::auth_cache_max_ttl);
+  if (ttl.count() == 0)
+    return value;
+
+  if (!local_.count(key))
+    make_room_(now);
+  auto& e = local_[key] = entry{value, now + ttl};
+  if (kept)
+    *kept = &e;
+  if (shared_)
+    shared_->put(key, value, ttl);
+
+  return value;
+}
@@ -0,0 +1,77 @@
+#ifndef AUTHCACHE_DOT_HPP
+#define AUTHCACHE_DOT_HPP
+
+// DKIM key records and DMARC policy records, kept for their DNS TTL
+// so mail from the same signer doesn't go back to the nameserver for
+// each message.  Entries live in this process and, given a
+// SharedCache, are shared with the others.  A DKIM key is parsed once
+// per process, and kept with its record.
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "DKIM-verify.hpp"
+#include "DNS.hpp"
+#include "SharedCache.hpp"
+#include "TLD.hpp"
+
+namespace Config {
+constexpr char const* auth_cache_name  = "/ghsmtp-auth";
+constexpr std::size_t auth_cache_slots = 4096;
+
+constexpr auto auth_cache_max_ttl = std::chrono::hours(1);
+constexpr auto auth_cache_neg_ttl = std::chrono::minutes(5);
+
+// Entries held in this process; past this, the expired ones are swept
+// out, and if that's not enough, those closest to expiring.
+constexpr std::size_t auth_cache_local_max = 1024;
+} // namespace Config
+
+class AuthCache {
+public:
+  AuthCache(AuthCache const&) = delete;
+  AuthCache& operator=(AuthCache const&) = delete;
+
+  explicit AuthCache(DNS::Resolver& res, SharedCache* shared = nullptr);
+
+  // The key record at <selector>._domainkey.<domain>; empty if there
+  // is none, nullopt if the lookup failed.
+  std::optional<std::string> dkim_key(char const* selector,
+                                      char const* domain);
+
+  // The same, with the key parsed, for DKIM::verify.
+  std::optional<DKIM::key_record> dkim_key_record(char const* selector,
+                                                  char const* domain);
+
+  // RFC 7489 section 6.6.3: the record for the From: domain, else for
+  // its organizational domain, which is then returned in org_domain.
+  std::optional<std::string> dmarc_record(char const* domain,
+                                          std::string& org_domain);
+
+private:
+  struct entry;
+
+  std::optional<std::string> txt_(std::string const& name,
+                                  std::string_view   tag,
+                                  entry**            kept = nullptr);
+  void trace_hit_(std::string const& name, DNS::cache_outcome how);
+  void make_room_(std::chrono::system_clock::time_point now);
+
+  DNS::Resolver& res_;
+  SharedCache*   shared_;
+  TLD            tld_;
+
+  struct entry {
+    std::string                           value;
+    std::chrono::system_clock::time_point expires;
+
+    std::shared_ptr<EVP_PKEY> pkey; // of a DKIM key record
+    bool                      parsed{false};
+  };
+  std::unordered_map<std::string, entry> local_;
+};
+
+#endif // AUTHCACHE_DOT_HPP
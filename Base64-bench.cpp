@@ -0,0 +1,73 @@
+#include "Base64.hpp"
+
+#include "Bench.hpp"
+
+#include <random>
+#include <string>
+
+#include <fmt/format.h>
+
+namespace {
+std::string random_octets(std::size_t n)
+{
+  std::mt19937 gen(n);
+  std::string  s(n, '\0');
+  for (auto& ch : s)
+    ch = static_cast<char>(gen());
+  return s;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Bench::suite suite("Base64", argc, argv);
+
+  // One line of a MIME part, a DKIM key, a large attachment.
+  for (std::size_t size : {57u, 1024u, 256u * 1024u}) {
+    auto const raw     = random_octets(size);
+    auto const encoded = Base64::enc(raw, 76);
+
+    suite.run(fmt::format("enc/{}", size), [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(Base64::enc(raw));
+    });
+    suite.run(fmt::format("enc-wrap76/{}", size), [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(Base64::enc(raw, 76));
+    });
+    suite.run(fmt::format("dec/{}", size), [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(Base64::dec(encoded));
+    });
+  }
+
+  // The streaming objects, fed in the pieces a socket read gives.
+  auto const raw     = random_octets(256 * 1024);
+  auto const encoded = Base64::enc(raw, 76);
+  constexpr std::size_t piece = 4096;
+
+  suite.run("encoder/262144", [&](std::uint64_t n) {
+    std::string out;
+    for (std::uint64_t i = 0; i < n; ++i) {
+      out.clear();
+      Base64::encoder e(76);
+      for (std::size_t p = 0; p < raw.size(); p += piece)
+        e.put(std::string_view(raw).substr(p, piece), out);
+      e.finish(out);
+      Bench::keep(out);
+    }
+  });
+  suite.run("decoder/262144", [&](std::uint64_t n) {
+    std::string out;
+    for (std::uint64_t i = 0; i < n; ++i) {
+      out.clear();
+      Base64::decoder d;
+      for (std::size_t p = 0; p < encoded.size(); p += piece)
+        d.put(std::string_view(encoded).substr(p, piece), out);
+      d.finish(out);
+      Bench::keep(out);
+    }
+  });
+
+  return suite.finish();
+}
@@ -1,7 +1,35 @@
 #include "Base64.hpp"
 
+#include <random>
+#include <stdexcept>
+
 #include <glog/logging.h>
 
+namespace {
+// Through the streaming objects, in pieces of at most chunk octets.
+std::string enc_chunked(std::string_view in,
+                        std::size_t      chunk,
+                        std::size_t      wrap = 0)
+{
+  std::string     out;
+  Base64::encoder e(wrap);
+  for (; !in.empty(); in.remove_prefix(std::min(chunk, in.size())))
+    e.put(in.substr(0, chunk), out);
+  e.finish(out);
+  return out;
+}
+
+std::string dec_chunked(std::string_view in, std::size_t chunk)
+{
+  std::string     out;
+  Base64::decoder d;
+  for (; !in.empty(); in.remove_prefix(std::min(chunk, in.size())))
+    d.put(in.substr(0, chunk), out);
+  d.finish(out);
+  return out;
+}
+} // namespace
+
 int main(int argc, char* argv[])
 {
   auto constexpr text{R"(
@@ -99,4 +127,33 @@ bmQgYXVndWUgc2FwaWVuLCBub24gYWNjdW1zYW4gbWkgcG9zdWVyZSB1dC4=)"};
 
   CHECK_EQ(Base64::dec(text_long_enc), text_long);
   CHECK_EQ(Base64::dec(Base64::enc(text_long, 72)), text_long);
+
+  CHECK_EQ(Base64::enc("foobar"), "Zm9vYmFy");
+  CHECK_EQ(Base64::enc("fooba"), "Zm9vYmE=");
+  CHECK_EQ(Base64::enc("foob"), "Zm9vYg==");
+  CHECK_EQ(Base64::enc("foobar", 4), "Zm9v\r\nYmFy\r\n");
+  CHECK_EQ(Base64::dec("Zm9v\r\nYmE="), "fooba");
+
+  auto bad = false;
+  try {
+    Base64::dec("Zm9v YmFy");
+  }
+  catch (std::invalid_argument const&) {
+    bad = true;
+  }
+  CHECK(bad);
+
+  // Every octet value, split every which way.
+  std::string bin;
+  std::mt19937 gen;
+  for (auto i = 0; i < 4096; ++i)
+    bin += static_cast<char>(gen());
+
+  auto const bin_enc = Base64::enc(bin, 76);
+  CHECK_EQ(Base64::dec(bin_enc), bin);
+  for (auto chunk : {1, 2, 3, 5, 16, 17, 100, 4096}) {
+    CHECK_EQ(enc_chunked(bin, chunk, 76), bin_enc);
+    CHECK_EQ(enc_chunked(bin, chunk), Base64::enc(bin));
+    CHECK_EQ(dec_chunked(bin_enc, chunk), bin);
+  }
 }
@@ -1,9 +1,13 @@
 #include "Base64.hpp"
 
 #include <algorithm>
-#include <cctype>
+#include <array>
 #include <stdexcept>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <glog/logging.h>
 
 namespace Base64 {
@@ -12,148 +16,264 @@ constexpr char const CHARSET[]{
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
 
 namespace {
-auto CHARSET_find(unsigned char ch)
+constexpr unsigned char BAD  = 0x80;
+constexpr unsigned char SKIP = 0x81; // CR and LF
+constexpr unsigned char PAD  = 0x82;
+
+// The 6-bit value of each character, or one of the above.
+constexpr auto DECODE = [] {
+  std::array<unsigned char, 256> t{};
+  t.fill(BAD);
+  for (unsigned i = 0; i < 64; ++i)
+    t[static_cast<unsigned char>(CHARSET[i])] = i;
+  t['\r'] = SKIP;
+  t['\n'] = SKIP;
+  t['=']  = PAD;
+  return t;
+}();
+
+// Three octets to four characters, for each of n groups.
+void encode(unsigned char const* p, std::size_t n, char* o)
 {
-  return static_cast<unsigned char>(
-      std::find(std::begin(CHARSET), std::end(CHARSET), ch)
-      - std::begin(CHARSET));
+  for (; n; --n, p += 3, o += 4) {
+    auto const v = (p[0] << 16) | (p[1] << 8) | p[2];
+    o[0]         = CHARSET[v >> 18];
+    o[1]         = CHARSET[(v >> 12) & 0x3f];
+    o[2]         = CHARSET[(v >> 6) & 0x3f];
+    o[3]         = CHARSET[v & 0x3f];
+  }
 }
+
+#if defined(__SSE2__)
+// Sixteen characters at a time for as long as they're all in the
+// alphabet: each range of characters has its own offset to its 6-bit
+// values, and the values are packed four to a 32-bit lane.
+unsigned char const*
+decode16(unsigned char const* p, unsigned char const* end, char*& o)
+{
+  auto const in_range = [](__m128i c, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+  };
+  auto const lo_byte = _mm_set1_epi32(0xff);
+
+  for (; end - p >= 16; p += 16) {
+    auto const c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+
+    auto const upper = in_range(c, 'A', 'Z');
+    auto const lower = in_range(c, 'a', 'z');
+    auto const digit = in_range(c, '0', '9');
+    auto const plus  = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+    auto const slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+
+    auto const valid = _mm_or_si128(
+        _mm_or_si128(upper, lower),
+        _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+    if (_mm_movemask_epi8(valid) != 0xffff)
+      break;
+
+    auto const offset = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+                     _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+        _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+                     _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(62 - '+')),
+                                  _mm_and_si128(slash,
+                                                _mm_set1_epi8(63 - '/')))));
+    auto const v = _mm_add_epi8(c, offset);
+
+    // The first character of each group is the lane's low byte.
+    auto const a = _mm_and_si128(v, lo_byte);
+    auto const b = _mm_and_si128(_mm_srli_epi32(v, 8), lo_byte);
+    auto const d = _mm_and_si128(_mm_srli_epi32(v, 16), lo_byte);
+    auto const e = _mm_srli_epi32(v, 24);
+    auto const w = _mm_or_si128(
+        _mm_or_si128(_mm_slli_epi32(a, 18), _mm_slli_epi32(b, 12)),
+        _mm_or_si128(_mm_slli_epi32(d, 6), e));
+
+    alignas(16) std::uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), w);
+    for (auto const l : lanes) {
+      *o++ = static_cast<char>(l >> 16);
+      *o++ = static_cast<char>(l >> 8);
+      *o++ = static_cast<char>(l);
+    }
+  }
+  return p;
+}
+#endif
 } // namespace
 
-std::string enc(std::string_view text, std::string::size_type wrap)
+encoder::encoder(std::string::size_type wrap)
+  : wrap_(wrap)
 {
-  unsigned char group_8bit[3];
-  unsigned char group_6bit[4];
-  int           count_3_chars = 0;
+}
 
-  auto const input_size       = text.length();
-  auto const padding          = ((input_size % 3) ? (3 - (input_size % 3)) : 0);
-  auto const code_padded_size = ((input_size + padding) / 3) * 4;
-  auto const newline_size     = wrap ? ((code_padded_size) / wrap) * 2 : 0;
-  auto const total_size       = code_padded_size + newline_size;
+void encoder::put(std::string_view in, std::string& out)
+{
+  auto p = reinterpret_cast<unsigned char const*>(in.data());
+  auto n = in.size();
 
-  std::string enc_text;
-  enc_text.reserve(total_size);
-  std::string::size_type line_len = 0;
-
-  for (std::string::size_type ch = 0; ch < text.length(); ch++) {
-    group_8bit[count_3_chars++] = text[ch];
-    if (count_3_chars == 3) {
-      group_6bit[0] = (group_8bit[0] & 0xfc) >> 2;
-      group_6bit[1]
-          = ((group_8bit[0] & 0x03) << 4) + ((group_8bit[1] & 0xf0) >> 4);
-      group_6bit[2]
-          = ((group_8bit[1] & 0x0f) << 2) + ((group_8bit[2] & 0xc0) >> 6);
-      group_6bit[3] = group_8bit[2] & 0x3f;
-
-      for (int i = 0; i < 4; i++)
-        enc_text += CHARSET[group_6bit[i]];
-      count_3_chars = 0;
-      line_len += 4;
+  if (n_pend_) {
+    while (n && (n_pend_ < 3)) {
+      pend_[n_pend_++] = *p++;
+      --n;
     }
+    if (n_pend_ < 3)
+      return;
+    char q[4];
+    encode(pend_, 1, q);
+    emit_(q, 4, out);
+    n_pend_ = 0;
+  }
 
-    if (wrap && (line_len == wrap)) {
-      enc_text += "\r\n";
-      line_len = 0;
-    }
+  auto const groups = n / 3;
+  if (wrap_) {
+    buf_.resize(groups * 4);
+    encode(p, groups, buf_.data());
+    emit_(buf_.data(), buf_.size(), out);
+  }
+  else {
+    auto const start = out.size();
+    out.resize(start + groups * 4);
+    encode(p, groups, out.data() + start);
   }
+  p += groups * 3;
+  n -= groups * 3;
 
-  // encode remaining characters if any
+  while (n--)
+    pend_[n_pend_++] = *p++;
+}
 
-  if (count_3_chars > 0) {
-    for (int i = count_3_chars; i < 3; i++)
-      group_8bit[i] = '\0';
+void encoder::finish(std::string& out)
+{
+  if (n_pend_) {
+    std::fill(pend_ + n_pend_, pend_ + 3, 0);
+    char q[4];
+    encode(pend_, 1, q);
+    std::fill(q + n_pend_ + 1, q + 4, '=');
+    emit_(q, 4, out);
+  }
+  n_pend_   = 0;
+  line_len_ = 0;
+}
 
-    group_6bit[0] = (group_8bit[0] & 0xfc) >> 2;
-    group_6bit[1]
-        = ((group_8bit[0] & 0x03) << 4) + ((group_8bit[1] & 0xf0) >> 4);
-    group_6bit[2]
-        = ((group_8bit[1] & 0x0f) << 2) + ((group_8bit[2] & 0xc0) >> 6);
-    group_6bit[3] = group_8bit[2] & 0x3f;
+void encoder::emit_(char const* p, std::string::size_type n, std::string& out)
+{
+  if (!wrap_) {
+    out.append(p, n);
+    return;
+  }
+  while (n) {
+    auto const len = std::min(n, wrap_ - line_len_);
+    out.append(p, len);
+    p += len;
+    n -= len;
+    line_len_ += len;
+    if (line_len_ == wrap_) {
+      out += "\r\n";
+      line_len_ = 0;
+    }
+  }
+}
 
-    for (int i = 0; i < count_3_chars + 1; i++) {
-      if (wrap && (line_len == wrap)) {
-        enc_text += "\r\n";
-        line_len = 0;
+void decoder::put(std::string_view in, std::string& out)
+{
+  if (done_)
+    return;
+
+  auto       p   = reinterpret_cast<unsigned char const*>(in.data());
+  auto const end = p + in.size();
+
+  // Room for the most this could decode to.
+  auto const start = out.size();
+  out.resize(start + (in.size() + n_acc_) / 4 * 3);
+  auto o = out.data() + start;
+
+  while (p < end) {
+    if (n_acc_ == 0) {
+#if defined(__SSE2__)
+      p = decode16(p, end, o);
+#endif
+      for (; end - p >= 4; p += 4) {
+        auto const a = DECODE[p[0]];
+        auto const b = DECODE[p[1]];
+        auto const c = DECODE[p[2]];
+        auto const d = DECODE[p[3]];
+        if ((a | b | c | d) & 0x80)
+          break;
+        auto const v = (a << 18) | (b << 12) | (c << 6) | d;
+        *o++         = static_cast<char>(v >> 16);
+        *o++         = static_cast<char>(v >> 8);
+        *o++         = static_cast<char>(v);
       }
-      enc_text += CHARSET[group_6bit[i]];
-      line_len++;
+      if (p == end)
+        break;
     }
 
-    while (count_3_chars++ < 3) {
-      if (wrap && (line_len == wrap)) {
-        enc_text += "\r\n";
-        line_len = 0;
+    // One at a time, over line breaks and up to a group boundary.
+    auto const v = DECODE[*p++];
+    if (v < 64) {
+      acc_ = (acc_ << 6) | v;
+      if (++n_acc_ == 4) {
+        *o++   = static_cast<char>(acc_ >> 16);
+        *o++   = static_cast<char>(acc_ >> 8);
+        *o++   = static_cast<char>(acc_);
+        acc_   = 0;
+        n_acc_ = 0;
       }
-      enc_text += '=';
-      line_len++;
+    }
+    else if (v == PAD) {
+      done_ = true;
+      break;
+    }
+    else if (v == BAD) {
+      out.resize(o - out.data());
+      throw std::invalid_argument("bad character in decode");
     }
   }
 
-  CHECK_EQ(enc_text.length(), total_size);
-
-  return enc_text;
+  out.resize(o - out.data());
 }
 
-bool is_base64char(char ch)
+void decoder::finish(std::string& out)
 {
-  return std::isalnum(ch) || ch == '+' || ch == '/';
+  // Two characters make one octet, three make two; one alone is
+  // nothing.
+  if (n_acc_ > 1) {
+    auto const v = acc_ << (6 * (4 - n_acc_));
+    out += static_cast<char>(v >> 16);
+    if (n_acc_ == 3)
+      out += static_cast<char>(v >> 8);
+  }
+  acc_   = 0;
+  n_acc_ = 0;
+  done_  = false;
 }
 
-std::string dec(std::string_view text)
+std::string enc(std::string_view text, std::string::size_type wrap)
 {
-  auto const input_size = text.length();
-  auto const max_size   = (input_size / 4) * 3;
-
-  std::string dec_text;
-  dec_text.reserve(max_size);
-  unsigned char group_6bit[4];
-  unsigned char group_8bit[3];
-  int           count_4_chars = 0;
-
-  for (std::string::size_type ch = 0; ch < text.length(); ch++) {
-    if (text[ch] == '=')
-      break;
-
-    if ((text[ch] == '\r') || (text[ch] == '\n'))
-      continue;
-
-    if (!is_base64char(text[ch]))
-      throw std::invalid_argument("bad character in decode");
-
-    group_6bit[count_4_chars++] = text[ch];
-    if (count_4_chars == 4) {
-      for (int i = 0; i < 4; i++)
-        group_6bit[i] = CHARSET_find(group_6bit[i]);
+  auto const code_size  = (text.size() + 2) / 3 * 4;
+  auto const total_size = code_size + (wrap ? (code_size / wrap) * 2 : 0);
 
-      group_8bit[0] = (group_6bit[0] << 2) + ((group_6bit[1] & 0x30) >> 4);
-      group_8bit[1]
-          = ((group_6bit[1] & 0xf) << 4) + ((group_6bit[2] & 0x3c) >> 2);
-      group_8bit[2] = ((group_6bit[2] & 0x3) << 6) + group_6bit[3];
-
-      for (int i = 0; i < 3; i++)
-        dec_text += group_8bit[i];
-      count_4_chars = 0;
-    }
-  }
+  std::string enc_text;
+  enc_text.reserve(total_size);
 
-  // decode remaining characters if any
+  encoder e(wrap);
+  e.put(text, enc_text);
+  e.finish(enc_text);
 
-  if (count_4_chars > 0) {
-    for (int i = count_4_chars; i < 4; i++)
-      group_6bit[i] = '\0';
+  CHECK_EQ(enc_text.length(), total_size);
 
-    for (int i = 0; i < 4; i++)
-      group_6bit[i] = CHARSET_find(group_6bit[i]);
+  return enc_text;
+}
 
-    group_8bit[0] = (group_6bit[0] << 2) + ((group_6bit[1] & 0x30) >> 4);
-    group_8bit[1]
-        = ((group_6bit[1] & 0xf) << 4) + ((group_6bit[2] & 0x3c) >> 2);
-    group_8bit[2] = ((group_6bit[2] & 0x3) << 6) + group_6bit[3];
+std::string dec(std::string_view text)
+{
+  std::string dec_text;
 
-    for (int i = 0; i < count_4_chars - 1; i++)
-      dec_text += group_8bit[i];
-  }
+  decoder d;
+  d.put(text, dec_text);
+  d.finish(dec_text);
 
   return dec_text;
 }
@@ -1,12 +1,50 @@
 #ifndef BASE64_H
 #define BASE64_H
 
+#include <cstdint>
 #include <string>
 #include <string_view>
 
 namespace Base64 {
 std::string enc(std::string_view in, std::string::size_type wrap = 0);
 std::string dec(std::string_view in);
+
+// The same, a piece at a time: the output of each call is appended to
+// out, and groups and lines split between pieces carry over to the
+// next.  Output is the same however the input is split.
+
+class encoder {
+public:
+  // A CRLF after every wrap characters, as enc() does.
+  explicit encoder(std::string::size_type wrap = 0);
+
+  void put(std::string_view in, std::string& out);
+  void finish(std::string& out); // the last group, with padding
+
+private:
+  void emit_(char const* p, std::string::size_type n, std::string& out);
+
+  std::string::size_type wrap_;
+  std::string::size_type line_len_{0};
+
+  unsigned char pend_[3];
+  unsigned      n_pend_{0};
+
+  std::string buf_; // for wrapping
+};
+
+class decoder {
+public:
+  // Throws std::invalid_argument on a character that's not base64, CR
+  // or LF; anything after the first '=' is ignored.
+  void put(std::string_view in, std::string& out);
+  void finish(std::string& out);
+
+private:
+  std::uint32_t acc_{0}; // 6 bits a character
+  unsigned      n_acc_{0};
+  bool          done_{false};
+};
 } // namespace Base64
 
 #endif // BASE64_H
@@ -0,0 +1,69 @@
+#include "Batch.hpp"
+
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+int main(int argc, char* argv[])
+{
+  CHECK_EQ(Batch::json_str("plain"), R"("plain")");
+  CHECK_EQ(Batch::json_str("a \"b\" \\ c\r\n\x01"),
+           R"("a \"b\" \\ c\r\n\u0001")");
+
+  // A Maildir with a subfolder and the usual clutter.
+  auto const dir =
+      fs::temp_directory_path() / ("Batch-test-"s + std::to_string(getpid()));
+  for (auto const sub : {"cur", "new", "tmp", ".Sent/cur", ".Sent/new"})
+    fs::create_directories(dir / sub);
+
+  auto const touch = [&dir](char const* name) {
+    std::ofstream(dir / name) << name;
+  };
+  touch("cur/1:2,S");
+  touch("new/2");
+  touch("tmp/3");
+  touch(".Sent/cur/4:2,S");
+  touch("dovecot-uidlist");
+
+  auto const dir_arg = dir.string();
+  char*      args[]{const_cast<char*>("Batch-test"),
+               const_cast<char*>(dir_arg.c_str())};
+
+  auto const files = Batch::files(2, args);
+  CHECK_EQ(files.size(), 3u);
+  for (auto const& f : files)
+    CHECK(f.parent_path().filename() != "tmp");
+
+  // Every file once, one line each; exceptions become error lines.
+  std::ostringstream out;
+  Batch::run(
+      files, 3,
+      [](unsigned thread, fs::path const& file) {
+        CHECK_LT(thread, 3u);
+        if (file.filename() == "2")
+          throw std::runtime_error("no good");
+        return Batch::json_str(file.filename().string());
+      },
+      out);
+
+  std::set<std::string> lines;
+  std::istringstream    in(out.str());
+  for (std::string line; std::getline(in, line);)
+    lines.insert(line);
+
+  CHECK_EQ(lines.size(), 3u);
+  CHECK_EQ(lines.count(R"("1:2,S")"), 1u);
+  CHECK_EQ(lines.count(R"("4:2,S")"), 1u);
+  auto const error = R"({"file":)" + Batch::json_str((dir / "new/2").string()) +
+                     R"(,"error":"no good"})";
+  CHECK_EQ(lines.count(error), 1u);
+
+  fs::remove_all(dir);
+}
@@ -0,0 +1,144 @@
+#include "Batch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include <gflags/gflags.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+DEFINE_uint64(jobs,
+              0,
+              "batch mode: run the messages in the named files and"
+              " directories, or those listed on stdin, on this many threads"
+              " and write one JSON line per message");
+
+namespace {
+bool in_maildir(fs::path const& file)
+{
+  auto const dir = file.parent_path().filename();
+  return (dir == "cur") || (dir == "new");
+}
+
+void add(std::vector<fs::path>& files, fs::path const& name)
+{
+  if (!fs::is_directory(name)) {
+    files.push_back(name);
+    return;
+  }
+
+  std::vector<fs::path> found;
+  for (auto const& ent : fs::recursive_directory_iterator(
+           name, fs::directory_options::skip_permission_denied)) {
+    // Dot files, such as MIME part indexes, are never messages.
+    if (ent.is_regular_file() &&
+        !ent.path().filename().string().starts_with('.'))
+      found.push_back(ent.path());
+  }
+
+  // In a Maildir, tmp/ holds deliveries in progress and the rest is
+  // bookkeeping, not mail.
+  if (std::any_of(found.begin(), found.end(), in_maildir)) {
+    found.erase(std::remove_if(found.begin(), found.end(),
+                               [](auto const& f) { return !in_maildir(f); }),
+                found.end());
+  }
+  std::sort(found.begin(), found.end());
+
+  files.insert(files.end(), found.begin(), found.end());
+}
+} // namespace
+
+namespace Batch {
+
+std::vector<fs::path> files(int argc, char* argv[])
+{
+  std::vector<fs::path> ret;
+
+  if ((argc < 2) || ((argc == 2) && (argv[1] == "-"s))) {
+    for (std::string name; std::getline(std::cin, name);) {
+      if (!name.empty())
+        add(ret, name);
+    }
+  }
+  else {
+    for (auto a = 1; a < argc; ++a)
+      add(ret, argv[a]);
+  }
+
+  return ret;
+}
+
+void run(std::vector<fs::path> const& files,
+         unsigned                     jobs,
+         std::function<std::string(unsigned thread, fs::path const& file)>
+                       work,
+         std::ostream& out)
+{
+  jobs = std::clamp<std::size_t>(jobs, 1,
+                                 std::max<std::size_t>(files.size(), 1));
+
+  std::atomic<std::size_t> next{0};
+  std::mutex               out_mutex;
+
+  auto const worker = [&](unsigned thread) {
+    for (std::size_t i; (i = next++) < files.size();) {
+      std::string line;
+      try {
+        line = work(thread, files[i]);
+      }
+      catch (std::exception const& e) {
+        LOG(WARNING) << files[i] << ": " << e.what();
+        line = fmt::format(R"({{"file":{},"error":{}}})",
+                           json_str(files[i].string()), json_str(e.what()));
+      }
+      if (line.empty())
+        continue;
+      line += '\n';
+
+      std::lock_guard<std::mutex> lock(out_mutex);
+      out << line;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (auto j = 1u; j < jobs; ++j)
+    workers.emplace_back(worker, j);
+  worker(0);
+  for (auto& w : workers)
+    w.join();
+
+  out.flush();
+}
+
+std::string json_str(std::string_view s)
+{
+  std::string ret{'"'};
+  for (auto ch : s) {
+    switch (ch) {
+    case '"': ret += "\\\""; break;
+    case '\\': ret += "\\\\"; break;
+    case '\b': ret += "\\b"; break;
+    case '\f': ret += "\\f"; break;
+    case '\n': ret += "\\n"; break;
+    case '\r': ret += "\\r"; break;
+    case '\t': ret += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(ch) < 0x20)
+        ret += fmt::format("\\u{:04x}", static_cast<unsigned>(ch));
+      else
+        ret += ch;
+    }
+  }
+  ret += '"';
+  return ret;
+}
+
+} // namespace Batch
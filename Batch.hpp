@@ -0,0 +1,39 @@
+#ifndef BATCH_DOT_HPP
+#define BATCH_DOT_HPP
+
+// Batch mode for the message tools (arcsign, arcverify, msg): a list of
+// message files run through a pool of threads, with one line of output
+// per message.
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fs.hpp"
+
+namespace Batch {
+
+// The message files named by argv[1..argc).  Directories are walked;
+// in a Maildir tree only the files under cur/ and new/ are taken.  With
+// no names, or just "-", the names are read from stdin, one per line.
+std::vector<fs::path> files(int argc, char* argv[]);
+
+// Calls work(thread, file) for every file on jobs threads, thread being
+// in [0, jobs) for any state kept per thread, and writes each non-empty
+// result to out as a line of its own.  A thread takes the next file as
+// soon as it's done with one, so a few huge messages don't hold up the
+// rest.  An exception from work becomes an {"file", "error"} line.
+void run(std::vector<fs::path> const& files,
+         unsigned                     jobs,
+         std::function<std::string(unsigned thread, fs::path const& file)>
+                       work,
+         std::ostream& out);
+
+// s as a JSON string, quotes and all.
+std::string json_str(std::string_view s);
+
+} // namespace Batch
+
+#endif // BATCH_DOT_HPP
@@ -0,0 +1,175 @@
+#include "Bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include <fmt/format.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+DEFINE_string(json, "", "write results to this file");
+DEFINE_string(baseline, "", "compare with results saved in this file");
+DEFINE_double(threshold, 0.10, "slowdown, as a fraction, that fails");
+DEFINE_double(min_time, 0.1, "seconds each run should take, at least");
+DEFINE_uint64(runs, 5, "runs to take the median of");
+DEFINE_string(filter, "", "run only benchmarks with this in their name");
+
+namespace Config {
+// A loop that can't take --min_time even so is a broken benchmark.
+constexpr std::uint64_t bench_max_iterations = 1'000'000'000;
+} // namespace Config
+
+namespace Bench {
+
+namespace {
+double seconds(std::function<void(std::uint64_t)> const& loop,
+               std::uint64_t                            n)
+{
+  using namespace std::chrono;
+  auto const start = steady_clock::now();
+  loop(n);
+  return duration<double>(steady_clock::now() - start).count();
+}
+} // namespace
+
+suite::suite(char const* name, int argc, char* argv[])
+  : name_(name)
+{
+  { // Need to work with either namespace.
+    using namespace gflags;
+    using namespace google;
+    ParseCommandLineFlags(&argc, &argv, true);
+  }
+  CHECK_GE(FLAGS_runs, 1u);
+
+  std::cout << fmt::format("{:<40} {:>14} {:>14} {:>12}\n", name_,
+                           "ns/op", "min ns/op", "iterations");
+}
+
+void suite::run(std::string_view name,
+                std::function<void(std::uint64_t n)> loop)
+{
+  // Names go into the JSON as they are.
+  CHECK(name.find_first_of("\"\\") == std::string_view::npos) << name;
+
+  if (name.find(FLAGS_filter) == std::string_view::npos)
+    return;
+
+  // Aim a little past --min_time, growing by at most 10x a step, since
+  // the first few runs may be all cold caches and page faults.
+  std::uint64_t n = 1;
+  for (;;) {
+    auto const t = seconds(loop, n);
+    if ((t >= FLAGS_min_time) || (n >= Config::bench_max_iterations))
+      break;
+    auto const scale = (t > 0) ? std::min(FLAGS_min_time * 1.2 / t, 10.0)
+                               : 10.0;
+    n = std::max(n + 1, static_cast<std::uint64_t>(n * scale));
+  }
+
+  std::vector<double> ns;
+  for (std::uint64_t r = 0; r < FLAGS_runs; ++r)
+    ns.push_back(seconds(loop, n) * 1e9 / n);
+  std::sort(ns.begin(), ns.end());
+
+  result res;
+  res.name          = name;
+  res.ns_per_op     = ns[ns.size() / 2];
+  res.min_ns_per_op = ns.front();
+  res.iterations    = n;
+
+  std::cout << fmt::format("{:<40} {:>14.1f} {:>14.1f} {:>12}\n", res.name,
+                           res.ns_per_op, res.min_ns_per_op, res.iterations)
+            << std::flush;
+
+  results_.push_back(std::move(res));
+}
+
+int suite::finish() const
+{
+  if (!FLAGS_json.empty())
+    write_json_(FLAGS_json);
+
+  if (!FLAGS_baseline.empty())
+    return compare_(FLAGS_baseline) ? 0 : 1;
+
+  return 0;
+}
+
+void suite::write_json_(std::string const& path) const
+{
+  fmt::memory_buffer buf;
+  fmt::format_to(buf, "{{\n  \"suite\": \"{}\",\n  \"results\": [\n", name_);
+  for (std::size_t i = 0; i < results_.size(); ++i) {
+    auto const& r = results_[i];
+    fmt::format_to(buf,
+                   "    {{\"name\": \"{}\", \"ns_per_op\": {:.3f}, "
+                   "\"min_ns_per_op\": {:.3f}, \"iterations\": {}}}{}\n",
+                   r.name, r.ns_per_op, r.min_ns_per_op, r.iterations,
+                   (i + 1 < results_.size()) ? "," : "");
+  }
+  fmt::format_to(buf, "  ]\n}}\n");
+
+  std::ofstream ofs(path);
+  ofs.write(buf.data(), buf.size());
+  if (!ofs.flush())
+    LOG(ERROR) << "can't write " << path;
+}
+
+// This reads back what write_json_() writes, a result to a line, and
+// nothing more general.
+bool suite::compare_(std::string const& path) const
+{
+  std::ifstream ifs(path);
+  if (!ifs) {
+    LOG(WARNING) << "no baseline " << path << ", nothing to compare";
+    return true;
+  }
+
+  std::map<std::string, double, std::less<>> baseline;
+
+  constexpr std::string_view name_key{"\"name\": \""};
+  constexpr std::string_view ns_key{"\"ns_per_op\": "};
+
+  std::string line;
+  while (std::getline(ifs, line)) {
+    auto const name_pos = line.find(name_key);
+    auto const ns_pos   = line.find(ns_key);
+    if ((name_pos == std::string::npos) || (ns_pos == std::string::npos))
+      continue;
+    auto const start = name_pos + name_key.size();
+    auto const quote = line.find('"', start);
+    if (quote == std::string::npos)
+      continue;
+    baseline.emplace(line.substr(start, quote - start),
+                     std::strtod(line.c_str() + ns_pos + ns_key.size(),
+                                 nullptr));
+  }
+
+  std::cout << fmt::format("\n{:<40} {:>14} {:>14} {:>8}\n", path,
+                           "baseline ns", "ns/op", "change");
+
+  auto ok = true;
+  for (auto const& r : results_) {
+    auto const b = baseline.find(r.name);
+    if ((b == baseline.end()) || (b->second <= 0)) {
+      std::cout << fmt::format("{:<40} {:>14} {:>14.1f}\n", r.name, "-",
+                               r.ns_per_op);
+      continue;
+    }
+    auto const change = (r.ns_per_op - b->second) / b->second;
+    auto const slower = change > FLAGS_threshold;
+    std::cout << fmt::format("{:<40} {:>14.1f} {:>14.1f} {:>+7.1f}%{}\n",
+                             r.name, b->second, r.ns_per_op, change * 100,
+                             slower ? "  SLOWER" : "");
+    ok = ok && !slower;
+  }
+  return ok;
+}
+
+} // namespace Bench
@@ -0,0 +1,63 @@
+#ifndef BENCH_DOT_HPP
+#define BENCH_DOT_HPP
+
+// What the *-bench programs share: time a loop, print a line for it,
+// and at the end write the results as JSON and compare them with a
+// baseline saved by an earlier run.
+//
+// Each function timed runs its own loop of n iterations.  The n is
+// grown until a run takes --min_time seconds, then --runs runs are
+// made, and the median is the result.
+//
+//   --json=path      write the results there
+//   --baseline=path  compare with results --json wrote before, and
+//                    fail if any is slower by more than --threshold
+//   --filter=text    run only what has text in its name
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Bench {
+
+// Make the compiler believe value is used, so the work that computed
+// it isn't optimized away.
+template <typename T>
+inline void keep(T const& value)
+{
+  asm volatile("" : : "m"(value) : "memory");
+}
+
+struct result {
+  std::string   name;
+  double        ns_per_op{0};     // median of the runs
+  double        min_ns_per_op{0}; // fastest run
+  std::uint64_t iterations{0};    // in each run
+};
+
+class suite {
+public:
+  suite(suite const&) = delete;
+  suite& operator=(suite const&) = delete;
+
+  // Parses the command line.
+  suite(char const* name, int argc, char* argv[]);
+
+  void run(std::string_view name, std::function<void(std::uint64_t n)> loop);
+
+  // Write the JSON, compare with the baseline; the exit code for main.
+  int finish() const;
+
+private:
+  void write_json_(std::string const& path) const;
+  bool compare_(std::string const& path) const;
+
+  std::string         name_;
+  std::vector<result> results_;
+};
+
+} // namespace Bench
+
+#endif // BENCH_DOT_HPP
@@ -0,0 +1,44 @@
+#include "Bloom.hpp"
+
+#include <iostream>
+#include <string>
+
+#include <glog/logging.h>
+
+int main(int argc, char* argv[])
+{
+  auto constexpr n_keys = 10'000;
+
+  Bloom::builder bld(n_keys);
+  for (auto i = 0; i < n_keys; ++i)
+    bld.add("host-" + std::to_string(i) + ".example.com");
+
+  Bloom bloom;
+  CHECK(!bloom.is_open());
+  CHECK(bloom.maybe_contains("anything")); // closed filter passes all
+
+  CHECK(!bloom.set("short"));
+  CHECK(bloom.set(bld.data()));
+  CHECK_EQ(bloom.size(), n_keys);
+
+  // No false negatives.
+  for (auto i = 0; i < n_keys; ++i)
+    CHECK(bloom.maybe_contains("host-" + std::to_string(i) + ".example.com"));
+
+  // False positives near the design rate.
+  auto fp = 0;
+  for (auto i = 0; i < n_keys; ++i)
+    if (bloom.maybe_contains("host-" + std::to_string(i) + ".example.net"))
+      ++fp;
+  CHECK_LT(fp, n_keys / 20);
+
+  auto const path = fs::temp_directory_path() / "Bloom-test.bloom";
+  CHECK(bld.write(path));
+
+  Bloom mapped;
+  CHECK(mapped.open(path));
+  CHECK(mapped.maybe_contains("host-0.example.com"));
+  fs::remove(path);
+
+  std::cout << "false positives: " << fp << " of " << n_keys << '\n';
+}
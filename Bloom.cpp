@@ -0,0 +1,176 @@
+#include "Bloom.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include <glog/logging.h>
+
+namespace {
+// Filter image, all native-endian 64 bit words:
+//
+//   [0] magic   [1] k   [2] n_blocks   [3] n_keys   [4...] blocks
+//
+// each block being eight words (512 bits, one cache line).
+
+constexpr std::uint64_t magic        = 0x3130'4642'4853'4847; // "GHSHBF01"
+constexpr std::uint64_t hdr_words    = 4;
+constexpr std::uint64_t block_words  = 8;
+constexpr std::uint64_t block_bits   = block_words * 64;
+constexpr unsigned      bit_idx_bits = 9; // log2(block_bits)
+
+constexpr std::uint64_t fmix64(std::uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+constexpr std::uint64_t rotr(std::uint64_t v, unsigned n)
+{
+  return (v >> n) | (v << (64 - n));
+}
+
+inline std::uint64_t block_of(std::uint64_t h, std::uint64_t n_blocks)
+{
+  return static_cast<std::uint64_t>(
+      (static_cast<unsigned __int128>(h) * n_blocks) >> 64);
+}
+} // namespace
+
+std::uint64_t Bloom::hash(std::string_view key)
+{
+  // FNV-1a, then a murmur3 finalizer to spread the bits.
+  std::uint64_t h = 0xcbf29ce484222325ULL;
+  for (auto ch : key) {
+    h ^= static_cast<unsigned char>(ch);
+    h *= 0x100000001b3ULL;
+  }
+  return fmix64(h);
+}
+
+bool Bloom::open(fs::path path)
+{
+  error_code ec;
+  if (!fs::exists(path, ec))
+    return false;
+
+  try {
+    file_.open(path.string());
+  }
+  catch (std::exception const& ex) {
+    LOG(WARNING) << "unable to map " << path << ": " << ex.what();
+    return false;
+  }
+
+  if (!set(std::string_view(file_.data(), file_.size()))) {
+    LOG(WARNING) << "ignoring malformed Bloom filter " << path;
+    file_.close();
+    return false;
+  }
+  return true;
+}
+
+bool Bloom::set(std::string_view image)
+{
+  blocks_ = nullptr;
+
+  if (image.size() < hdr_words * sizeof(std::uint64_t))
+    return false;
+
+  auto const words = reinterpret_cast<std::uint64_t const*>(image.data());
+  if (words[0] != magic)
+    return false;
+
+  auto const k        = words[1];
+  auto const n_blocks = words[2];
+  if ((k == 0) || (k > 64 / bit_idx_bits) || (n_blocks == 0))
+    return false;
+
+  auto const n_words = image.size() / sizeof(std::uint64_t);
+  if ((n_words - hdr_words) / block_words < n_blocks)
+    return false;
+
+  k_        = static_cast<std::uint32_t>(k);
+  n_blocks_ = n_blocks;
+  n_keys_   = words[3];
+  blocks_   = words + hdr_words;
+  return true;
+}
+
+bool Bloom::maybe_contains(std::string_view key) const
+{
+  if (!is_open())
+    return true;
+
+  auto const h   = hash(key);
+  auto const blk = blocks_ + block_of(h, n_blocks_) * block_words;
+
+  auto g = fmix64(h ^ 0x9e3779b97f4a7c15ULL);
+  for (auto i = 0u; i < k_; ++i) {
+    auto const bit = g & (block_bits - 1);
+    if ((blk[bit / 64] & (1ULL << (bit % 64))) == 0)
+      return false;
+    g = rotr(g, bit_idx_bits);
+  }
+  return true;
+}
+
+Bloom::builder::builder(std::uint64_t n_keys)
+{
+  auto const bits     = std::max<std::uint64_t>(n_keys, 1) *
+                    Config::bloom_bits_per_key;
+  auto const n_blocks = (bits + block_bits - 1) / block_bits;
+
+  image_.resize(hdr_words + n_blocks * block_words, 0);
+  image_[0] = magic;
+  image_[1] = Config::bloom_k;
+  image_[2] = n_blocks;
+  image_[3] = 0;
+}
+
+void Bloom::builder::add(std::string_view key)
+{
+  auto const h   = hash(key);
+  auto const blk = &image_[hdr_words + block_of(h, image_[2]) * block_words];
+
+  auto g = fmix64(h ^ 0x9e3779b97f4a7c15ULL);
+  for (auto i = 0u; i < Config::bloom_k; ++i) {
+    auto const bit = g & (block_bits - 1);
+    blk[bit / 64] |= 1ULL << (bit % 64);
+    g = rotr(g, bit_idx_bits);
+  }
+  ++image_[3];
+}
+
+std::string_view Bloom::builder::data() const
+{
+  return std::string_view(reinterpret_cast<char const*>(image_.data()),
+                          image_.size() * sizeof(std::uint64_t));
+}
+
+bool Bloom::builder::write(fs::path path) const
+{
+  auto tmp = path;
+  tmp += ".tmp";
+
+  auto const img = data();
+  {
+    std::ofstream out(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.write(img.data(), img.size()) || !out.flush()) {
+      LOG(WARNING) << "unable to write " << tmp;
+      return false;
+    }
+  }
+
+  error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    LOG(WARNING) << "rename " << tmp << " to " << path << " failed: "
+                 << ec.message();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,71 @@
+#ifndef BLOOM_DOT_HPP
+#define BLOOM_DOT_HPP
+
+// A blocked Bloom filter used as a negative cache in front of a CDB.
+// All the probe bits for a key live in a single 64 octet block, so a
+// miss costs one cache line rather than a walk of the CDB hash table.
+//
+// The filter is written as a sidecar file next to the database,
+// <db>.bloom, and mapped read-only at open time.
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "fs.hpp"
+
+namespace Config {
+constexpr std::uint32_t bloom_bits_per_key = 10; // ≈1% false positives
+constexpr std::uint32_t bloom_k            = 7;  // probes per key
+} // namespace Config
+
+class Bloom {
+public:
+  Bloom(Bloom const&) = delete;
+  Bloom& operator=(Bloom const&) = delete;
+
+  Bloom() = default;
+
+  // Map an existing filter file.
+  bool open(fs::path path);
+
+  // Use a filter image already in memory, as made by builder::data().
+  bool set(std::string_view image);
+
+  bool is_open() const { return blocks_ != nullptr; }
+
+  // False means the key is certainly not in the set.
+  bool maybe_contains(std::string_view key) const;
+
+  std::uint64_t size() const { return n_keys_; }
+
+  class builder {
+  public:
+    explicit builder(std::uint64_t n_keys);
+
+    void add(std::string_view key);
+
+    std::string_view data() const;
+
+    // Write to a temp file and rename(2) it into place.
+    bool write(fs::path path) const;
+
+  private:
+    std::vector<std::uint64_t> image_;
+  };
+
+  static std::uint64_t hash(std::string_view key);
+
+private:
+  boost::iostreams::mapped_file_source file_;
+
+  std::uint64_t const* blocks_{nullptr};
+  std::uint64_t        n_blocks_{0};
+  std::uint64_t        n_keys_{0};
+  std::uint32_t        k_{0};
+};
+
+#endif // BLOOM_DOT_HPP
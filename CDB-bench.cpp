@@ -0,0 +1,114 @@
+#include "CDB.hpp"
+
+#include "Bench.hpp"
+#include "Bloom.hpp"
+
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+namespace Config {
+// About the size of a domain block list.
+constexpr std::size_t bench_cdb_keys = 100'000;
+} // namespace Config
+
+namespace {
+std::string key(std::size_t i) { return fmt::format("host{}.example.com", i); }
+
+// Write <path>.cdb, and <path>.bloom if asked, as cdb-gen would.
+void make_db(fs::path const& path, bool bloom)
+{
+  auto db_path = path;
+  db_path += ".cdb";
+
+  auto const fd = open(db_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  PCHECK(fd != -1) << db_path;
+
+  cdb_make cdbm;
+  CHECK_EQ(cdb_make_start(&cdbm, fd), 0);
+  for (std::size_t i = 0; i < Config::bench_cdb_keys; ++i) {
+    auto const k = key(i);
+    CHECK_EQ(cdb_make_add(&cdbm, k.data(), k.size(), "", 0), 0);
+  }
+  CHECK_EQ(cdb_make_finish(&cdbm), 0);
+  close(fd);
+
+  if (bloom) {
+    auto bloom_path = path;
+    bloom_path += ".bloom";
+    Bloom::builder b(Config::bench_cdb_keys);
+    for (std::size_t i = 0; i < Config::bench_cdb_keys; ++i)
+      b.add(key(i));
+    CHECK(b.write(bloom_path));
+  }
+}
+
+void remove_db(fs::path const& path)
+{
+  for (auto ext : {".cdb", ".bloom"}) {
+    auto p = path;
+    p += ext;
+    fs::remove(p);
+  }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Bench::suite suite("CDB", argc, argv);
+
+  auto const dir   = fs::temp_directory_path();
+  auto const pid   = std::to_string(getpid());
+  auto const plain = dir / ("CDB-bench-"s + pid);
+  auto const bloom = dir / ("CDB-bench-bloom-"s + pid);
+
+  make_db(plain, false);
+  make_db(bloom, true);
+
+  // The lookups, made up ahead of time, hits and misses both spread
+  // over the whole table.
+  std::vector<std::string> hits;
+  std::vector<std::string> misses;
+  for (std::size_t i = 0; i < 1024; ++i) {
+    hits.push_back(key(i * 97 % Config::bench_cdb_keys));
+    misses.push_back(fmt::format("nohost{}.example.org", i));
+  }
+
+  struct {
+    char const* name;
+    fs::path    path;
+  } const dbs[]{{"plain", plain}, {"bloom", bloom}};
+
+  for (auto const& d : dbs) {
+    CDB db;
+    CHECK(db.open(d.path));
+    CHECK(db.contains(hits.front()));
+    CHECK(!db.contains(misses.front()));
+
+    suite.run(fmt::format("contains/hit/{}", d.name), [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(db.contains(hits[i % hits.size()]));
+    });
+    suite.run(fmt::format("contains/miss/{}", d.name), [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(db.contains(misses[i % misses.size()]));
+    });
+    suite.run(fmt::format("find/hit/{}", d.name), [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(db.find(hits[i % hits.size()]));
+    });
+  }
+
+  remove_db(plain);
+  remove_db(bloom);
+
+  return suite.finish();
+}
@@ -16,6 +16,9 @@ CDB::~CDB()
 
 bool CDB::open(fs::path db_path)
 {
+  auto bloom_path = db_path;
+  bloom_path += ".bloom";
+
   db_path += ".cdb";
   auto const db_fn = db_path.string();
 
@@ -27,6 +30,18 @@ bool CDB::open(fs::path db_path)
     return false;
   }
   cdb_init(&cdb_, fd_);
+
+  // A filter older than its database may be missing keys, and a false
+  // negative would be a wrong answer, so a stale one is ignored.
+  error_code ec;
+  if (fs::exists(bloom_path, ec)) {
+    if (fs::last_write_time(bloom_path, ec) >=
+        fs::last_write_time(db_path, ec))
+      bloom_.open(bloom_path);
+    else
+      LOG(WARNING) << "ignoring stale " << bloom_path;
+  }
+
   return true;
 }
 
@@ -35,6 +50,9 @@ std::optional<std::string> CDB::find(std::string_view key)
   if (!is_open())
     return {};
 
+  if (!bloom_.maybe_contains(key))
+    return {};
+
   CHECK_LT(key.length(), std::numeric_limits<unsigned int>::max());
   if (cdb_find(&cdb_, key.data(), static_cast<unsigned int>(key.length())) >
       0) {
@@ -54,6 +72,9 @@ bool CDB::contains(std::string_view key)
   if (!is_open())
     return false;
 
+  if (!bloom_.maybe_contains(key))
+    return false;
+
   CHECK_LT(key.length(), std::numeric_limits<unsigned int>::max());
   return cdb_find(&cdb_, key.data(), static_cast<unsigned int>(key.length())) >
          0;
@@ -10,6 +10,7 @@ extern "C" {
 #include <cdb.h>
 }
 
+#include "Bloom.hpp"
 #include "fs.hpp"
 
 class CDB {
@@ -28,6 +29,9 @@ public:
 private:
   int fd_{-1};
   cdb cdb_{0};
+
+  // Optional <db>.bloom sidecar, checked before the hash table.
+  Bloom bloom_;
 };
 
 constexpr bool CDB::is_open() const { return fd_ != -1; }
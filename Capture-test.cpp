@@ -0,0 +1,72 @@
+#include "Capture.hpp"
+
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+int main(int argc, char* argv[])
+{
+  auto const dir = fs::temp_directory_path()
+                   / ("Capture-test-"s + std::to_string(getpid()));
+  fs::create_directories(dir);
+
+  auto const before = std::chrono::system_clock::now();
+  {
+    Capture::writer w(dir);
+    w.write(Capture::direction::server, "220 hi\r\n", 8);
+    w.write(Capture::direction::client, "STARTTLS\r\n", 10);
+    w.write(Capture::direction::server, "220 go\r\n", 8);
+    w.write(Capture::direction::tls, nullptr, 0);
+    w.write(Capture::direction::client, "QUIT\r\n", 6);
+  }
+
+  auto const it = fs::directory_iterator(dir);
+  CHECK(it != fs::directory_iterator());
+  auto const path = it->path();
+  CHECK_EQ(path.extension(), ".cap");
+
+  Capture::capture cap;
+  CHECK(Capture::read_header(path, cap));
+  CHECK_EQ(cap.path, path);
+  CHECK(cap.start >= before);
+  CHECK(cap.records.empty());
+  auto const start = cap.start;
+
+  CHECK(Capture::read(path, cap));
+  CHECK_EQ(cap.path, path);
+  CHECK(cap.start == start);
+  CHECK_EQ(cap.records.size(), 5u);
+  CHECK(cap.records[0].dir == Capture::direction::server);
+  CHECK_EQ(cap.records[0].data, "220 hi\r\n");
+  CHECK(cap.records[1].dir == Capture::direction::client);
+  CHECK_EQ(cap.records[1].data, "STARTTLS\r\n");
+  CHECK(cap.records[3].dir == Capture::direction::tls);
+  CHECK(cap.records[3].data.empty());
+  CHECK_EQ(cap.records[4].data, "QUIT\r\n");
+  for (auto i = 1u; i < cap.records.size(); ++i)
+    CHECK(cap.records[i - 1].offset <= cap.records[i].offset);
+
+  // A crash mid-write: the last record is left off, the rest kept.
+  auto const size = fs::file_size(path);
+  fs::resize_file(path, size - 2);
+  CHECK(Capture::read(path, cap));
+  CHECK_EQ(cap.records.size(), 4u);
+  CHECK_EQ(cap.records[2].data, "220 go\r\n");
+
+  // Cut into the last record's header, too.
+  fs::resize_file(path, size - 6 - sizeof(Capture::record_header) / 2);
+  CHECK(Capture::read(path, cap));
+  CHECK_EQ(cap.records.size(), 4u);
+
+  // Not a capture at all.
+  std::ofstream(path, std::ios::trunc) << "From: someone";
+  CHECK(!Capture::read(path, cap));
+  CHECK(!Capture::read_header(path, cap));
+
+  fs::remove_all(dir);
+}
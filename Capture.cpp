@@ -0,0 +1,158 @@
+#include "Capture.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <glog/logging.h>
+
+namespace Capture {
+
+namespace {
+constexpr char magic[8]{'g', 'h', 'c', 'a', 'p', '\0', '\0', '\1'};
+
+// All of it, or log why not.
+bool write_all(int fd, void const* data, std::size_t n)
+{
+  auto p = static_cast<char const*>(data);
+  while (n) {
+    auto const written = ::write(fd, p, n);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      PLOG(WARNING) << "capture write failed";
+      return false;
+    }
+    p += written;
+    n -= written;
+  }
+  return true;
+}
+} // namespace
+
+writer::writer(fs::path const& dir)
+  : start_(std::chrono::steady_clock::now())
+{
+  using namespace std::chrono;
+  auto const start_ns
+      = duration_cast<nanoseconds>(system_clock::now().time_since_epoch())
+            .count();
+
+  auto const path = dir / fmt::format("{}.{}.cap", start_ns, getpid());
+
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd_ == -1) {
+    PLOG(WARNING) << "can't create capture " << path;
+    return;
+  }
+
+  file_header hdr;
+  std::memcpy(hdr.magic, magic, sizeof(magic));
+  hdr.start_ns = start_ns;
+  if (!write_all(fd_, &hdr, sizeof(hdr))) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+writer::~writer()
+{
+  if (fd_ != -1)
+    ::close(fd_);
+}
+
+// Unbuffered: smtp leaves by way of exit(), and what's written is all
+// there should it crash.
+void writer::write(direction dir, char const* data, std::size_t n)
+{
+  if (fd_ == -1)
+    return;
+
+  using namespace std::chrono;
+  record_header hdr{};
+  hdr.offset_ns
+      = duration_cast<nanoseconds>(steady_clock::now() - start_).count();
+  hdr.size = n;
+  hdr.dir  = static_cast<std::uint8_t>(dir);
+
+  if (!write_all(fd_, &hdr, sizeof(hdr)) || !write_all(fd_, data, n)) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+namespace {
+bool check_header(fs::path const&    path,
+                  std::string const& buf,
+                  capture&           cap)
+{
+  file_header hdr;
+  if ((buf.size() < sizeof(hdr))
+      || std::memcmp(buf.data(), magic, sizeof(magic))) {
+    LOG(WARNING) << path << " is not a capture";
+    return false;
+  }
+  std::memcpy(&hdr, buf.data(), sizeof(hdr));
+
+  cap.path  = path;
+  cap.start = std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::nanoseconds(hdr.start_ns)));
+  cap.records.clear();
+  return true;
+}
+} // namespace
+
+bool read_header(fs::path const& path, capture& cap)
+{
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    LOG(WARNING) << "can't open " << path;
+    return false;
+  }
+  std::string buf(sizeof(file_header), '\0');
+  ifs.read(buf.data(), buf.size());
+  buf.resize(ifs.gcount());
+  return check_header(path, buf, cap);
+}
+
+bool read(fs::path const& path, capture& cap)
+{
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    LOG(WARNING) << "can't open " << path;
+    return false;
+  }
+  std::string const buf{std::istreambuf_iterator<char>(ifs),
+                        std::istreambuf_iterator<char>()};
+
+  if (!check_header(path, buf, cap))
+    return false;
+
+  auto pos = sizeof(file_header);
+  while (buf.size() - pos >= sizeof(record_header)) {
+    record_header rh;
+    std::memcpy(&rh, buf.data() + pos, sizeof(rh));
+    pos += sizeof(rh);
+    if (rh.dir > static_cast<std::uint8_t>(direction::tls)) {
+      LOG(WARNING) << path << ": bad record at offset " << pos - sizeof(rh);
+      return false;
+    }
+    if (buf.size() - pos < rh.size)
+      break;
+    cap.records.push_back({static_cast<direction>(rh.dir),
+                           std::chrono::nanoseconds(rh.offset_ns),
+                           buf.substr(pos, rh.size)});
+    pos += rh.size;
+  }
+
+  return true;
+}
+
+} // namespace Capture
@@ -0,0 +1,83 @@
+#ifndef CAPTURE_DOT_HPP
+#define CAPTURE_DOT_HPP
+
+// A binary record of one connection's protocol data, for smtp-replay.
+//
+// A capture file is a header, then a record for each read or write on
+// the connection: when it happened, which way the octets went, and
+// the octets.  Data is captured as the session sees it, so after
+// STARTTLS it's the plain text; a record with no data marks where TLS
+// started.  Everything is in host byte order, as with EventLog.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fs.hpp"
+
+namespace Capture {
+
+enum class direction : std::uint8_t {
+  client, // octets read, from the client
+  server, // octets written, to the client
+  tls,    // TLS started, no octets
+};
+
+// clang-format off
+struct file_header {
+  char         magic[8];  // "ghcap\0\0\1"
+  std::int64_t start_ns;  // since the epoch
+};
+static_assert(sizeof(file_header) == 16);
+
+struct record_header {
+  std::int64_t  offset_ns; // since start_ns
+  std::uint32_t size;      // of the data that follows
+  std::uint8_t  dir;
+  std::uint8_t  reserved[3];
+};
+static_assert(sizeof(record_header) == 16);
+// clang-format on
+
+class writer {
+public:
+  writer(writer const&) = delete;
+  writer& operator=(writer const&) = delete;
+
+  // A new file in dir, named for the time and our pid.  If it can't be
+  // created, the reason is logged and nothing is written.
+  explicit writer(fs::path const& dir);
+  ~writer();
+
+  void write(direction dir, char const* data, std::size_t n);
+
+private:
+  int                                   fd_{-1};
+  std::chrono::steady_clock::time_point start_;
+};
+
+struct record {
+  direction                dir;
+  std::chrono::nanoseconds offset;
+  std::string              data;
+};
+
+struct capture {
+  fs::path                              path;
+  std::chrono::system_clock::time_point start;
+  std::vector<record>                   records;
+};
+
+// Read a whole capture; false, with the reason logged, if path isn't
+// one.  A last record cut short, by a crash say, is left off.
+bool read(fs::path const& path, capture& cap);
+
+// Just the path and start time, with no records: enough to put many
+// captures in order without holding them all.
+bool read_header(fs::path const& path, capture& cap);
+
+} // namespace Capture
+
+#endif // CAPTURE_DOT_HPP
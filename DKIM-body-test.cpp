@@ -0,0 +1,122 @@
+#include "DKIM-body.hpp"
+
+#include "Base64.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <openssl/sha.h>
+
+#include <glog/logging.h>
+
+namespace {
+std::string b64_sha256(std::string_view s)
+{
+  unsigned char md[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<unsigned char const*>(s.data()), s.size(), md);
+  return Base64::enc(
+      std::string_view(reinterpret_cast<char const*>(md), sizeof(md)));
+}
+
+// RFC 6376 section 3.4.3 and 3.4.4, the obvious way.
+std::string canonicalize(std::string_view body, DKIM::canon c)
+{
+  std::vector<std::string> lines;
+  while (!body.empty()) {
+    auto const eol = body.find("\r\n");
+    lines.emplace_back(body.substr(0, eol));
+    body.remove_prefix((eol == std::string_view::npos) ? body.size()
+                                                       : eol + 2);
+  }
+
+  if (c == DKIM::canon::relaxed) {
+    for (auto& line : lines) {
+      std::string out;
+      auto        wsp = false;
+      for (auto ch : line) {
+        if (ch == ' ' || ch == '\t') {
+          wsp = true;
+          continue;
+        }
+        if (wsp)
+          out += ' ';
+        wsp = false;
+        out += ch;
+      }
+      line = out;
+    }
+  }
+
+  while (!lines.empty() && lines.back().empty())
+    lines.pop_back();
+
+  std::string ret;
+  for (auto const& line : lines) {
+    ret += line;
+    ret += "\r\n";
+  }
+  if ((c == DKIM::canon::simple) && ret.empty())
+    ret = "\r\n";
+  return ret;
+}
+
+std::string bh(std::string_view body, DKIM::canon c, std::size_t chunk)
+{
+  DKIM::body_hash h(c);
+  while (!body.empty()) {
+    h.update(body.substr(0, chunk));
+    body.remove_prefix(std::min(chunk, body.size()));
+  }
+  return h.final();
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  // RFC 6376 section 3.4.5
+  auto const example = " C \r\nD \t E\r\n\r\n\r\n";
+  CHECK_EQ(bh(example, DKIM::canon::relaxed, 100), b64_sha256(" C\r\nD E\r\n"));
+  CHECK_EQ(bh(example, DKIM::canon::simple, 100),
+           b64_sha256(" C \r\nD \t E\r\n"));
+
+  CHECK_EQ(bh("", DKIM::canon::relaxed, 1), b64_sha256(""));
+  CHECK_EQ(bh("", DKIM::canon::simple, 1), b64_sha256("\r\n"));
+  CHECK_EQ(bh("\r\n\r\n", DKIM::canon::simple, 1), b64_sha256("\r\n"));
+  CHECK_EQ(bh("no newline", DKIM::canon::relaxed, 3),
+           b64_sha256("no newline\r\n"));
+  CHECK_EQ(bh("bare\rcr\r", DKIM::canon::simple, 2),
+           b64_sha256("bare\rcr\r\r\n"));
+
+  // l= counts canonical octets.
+  DKIM::body_hash limited(DKIM::canon::relaxed, 5);
+  limited.update("a  b  c\r\n");
+  CHECK_EQ(limited.final(), b64_sha256("a b c"));
+  CHECK_EQ(limited.length(), 5u);
+
+  // Random bodies, heavy in the characters that matter, in random
+  // pieces, against the obvious implementation.
+  std::mt19937 gen(1);
+
+  char const alphabet[] = "ab  \t\t\r\r\n\n";
+  std::uniform_int_distribution<std::size_t> pick(0, sizeof(alphabet) - 2);
+  std::uniform_int_distribution<std::size_t> len(0, 600);
+  std::uniform_int_distribution<std::size_t> piece(1, 70);
+
+  for (auto i = 0; i < 2000; ++i) {
+    std::string body;
+    auto const  n = len(gen);
+    for (auto j = 0u; j < n; ++j) {
+      // Long plain runs now and then, for the vector path.
+      if (j % 97 == 0)
+        body += "Lorem ipsum dolor sit amet, consectetur adipiscing elit.";
+      body += alphabet[pick(gen)];
+    }
+
+    for (auto c : {DKIM::canon::simple, DKIM::canon::relaxed}) {
+      auto const chunk = piece(gen);
+      CHECK_EQ(bh(body, c, chunk), b64_sha256(canonicalize(body, c)))
+          << "chunk " << chunk << " body «" << body << "»";
+    }
+  }
+}
@@ -0,0 +1,237 @@
+#include "DKIM-body.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <glog/logging.h>
+
+#include "Base64.hpp"
+
+namespace {
+constexpr std::size_t buf_max    = 4 * 1024; // flush at this size
+constexpr std::size_t direct_min = 256;      // hash runs this long in place
+
+bool is_wsp(char ch) { return (ch == ' ') || (ch == '\t'); }
+
+// In relaxed mode a lone SP between two other characters passes
+// through unchanged; every other WSP, and every CR, needs a look.
+bool special(char const* p, std::size_t i, std::size_t n)
+{
+  switch (p[i]) {
+  case '\r':
+  case '\t': return true;
+  case ' ':
+    return (i + 1 == n) || is_wsp(p[i + 1]) || (p[i + 1] == '\r');
+  }
+  return false;
+}
+
+// Length of the run at p that canonicalization leaves alone.
+std::size_t plain_run(char const* p, std::size_t n, bool relaxed)
+{
+  if (!relaxed) {
+    auto const cr = static_cast<char const*>(std::memchr(p, '\r', n));
+    return cr ? (cr - p) : n;
+  }
+
+  std::size_t i = 0;
+
+#if defined(__SSE2__)
+  auto const cr = _mm_set1_epi8('\r');
+  auto const sp = _mm_set1_epi8(' ');
+  auto const ht = _mm_set1_epi8('\t');
+
+  for (; i + 17 <= n; i += 16) {
+    // v is this block, w the same shifted by one to see what follows
+    // each SP.
+    auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+    auto const w =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i + 1));
+
+    auto const v_cr  = _mm_cmpeq_epi8(v, cr);
+    auto const v_ht  = _mm_cmpeq_epi8(v, ht);
+    auto const v_sp  = _mm_cmpeq_epi8(v, sp);
+    auto const w_any = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(w, cr), _mm_cmpeq_epi8(w, ht)),
+        _mm_cmpeq_epi8(w, sp));
+
+    auto const m =
+        _mm_or_si128(_mm_or_si128(v_cr, v_ht), _mm_and_si128(v_sp, w_any));
+
+    auto const mask = _mm_movemask_epi8(m);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; i < n; ++i) {
+    if (special(p, i, n))
+      return i;
+  }
+  return n;
+}
+} // namespace
+
+namespace DKIM {
+
+body_hash::body_hash(canon c, std::optional<std::size_t> limit)
+  : ctx_(EVP_MD_CTX_new(), EVP_MD_CTX_free)
+  , limit_(limit)
+  , relaxed_(c == canon::relaxed)
+{
+  CHECK(ctx_);
+  CHECK_EQ(EVP_DigestInit_ex(ctx_.get(), EVP_sha256(), nullptr), 1);
+  buf_.reserve(buf_max);
+}
+
+void body_hash::update(std::string_view chunk)
+{
+  auto       p   = chunk.data();
+  auto const end = p + chunk.size();
+
+  while (p < end) {
+    // Within a line, runs of ordinary text go straight through.
+    if (line_ && !cr_ && !wsp_) {
+      auto const n = plain_run(p, end - p, relaxed_);
+      if (n >= direct_min) {
+        flush_();
+        hash_(p, n);
+      }
+      else if (n) {
+        buf_.append(p, n);
+        if (buf_.size() >= buf_max)
+          flush_();
+      }
+      p += n;
+      if (p == end)
+        break;
+    }
+
+    auto const ch = *p++;
+    if (cr_) {
+      cr_ = false;
+      if (ch == '\n') {
+        eol_();
+        continue;
+      }
+      content_('\r'); // a CR on its own is just another character
+    }
+    if (ch == '\r') {
+      cr_ = true;
+      continue;
+    }
+    if (relaxed_ && is_wsp(ch)) {
+      wsp_ = true;
+      continue;
+    }
+    content_(ch);
+  }
+}
+
+std::string body_hash::final()
+{
+  if (cr_) {
+    cr_ = false;
+    content_('\r');
+  }
+  if (line_)
+    eol_(); // supply the missing CRLF
+  if (!relaxed_ && !any_)
+    put_("\r\n"); // an empty body is a single CRLF
+  flush_();
+
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int  md_len = 0;
+  CHECK_EQ(EVP_DigestFinal_ex(ctx_.get(), md, &md_len), 1);
+  return Base64::enc(
+      std::string_view(reinterpret_cast<char const*>(md), md_len));
+}
+
+void body_hash::content_(char ch)
+{
+  if (!line_) {
+    // Empty lines only count if something follows them.
+    for (; blanks_; --blanks_)
+      put_("\r\n");
+    line_ = true;
+  }
+  if (wsp_) {
+    buf_ += ' ';
+    wsp_ = false;
+  }
+  buf_ += ch;
+  if (buf_.size() >= buf_max)
+    flush_();
+}
+
+void body_hash::eol_()
+{
+  if (line_)
+    put_("\r\n");
+  else
+    ++blanks_;
+  line_ = false;
+  wsp_  = false; // trailing white space is dropped
+}
+
+void body_hash::put_(std::string_view s)
+{
+  buf_ += s;
+  any_ = true;
+  if (buf_.size() >= buf_max)
+    flush_();
+}
+
+void body_hash::flush_()
+{
+  hash_(buf_.data(), buf_.size());
+  buf_.clear();
+}
+
+void body_hash::hash_(char const* data, std::size_t len)
+{
+  if (limit_)
+    len = std::min(len, *limit_ - length_);
+  if (len)
+    CHECK_EQ(EVP_DigestUpdate(ctx_.get(), data, len), 1);
+  length_ += len;
+}
+
+std::string relaxed_header(std::string_view field)
+{
+  auto const colon = field.find(':');
+  CHECK_NE(colon, std::string_view::npos) << "not a header field: " << field;
+
+  auto name = field.substr(0, colon);
+  while (!name.empty() && is_wsp(name.back()))
+    name.remove_suffix(1);
+
+  std::string out;
+  out.reserve(field.size());
+  for (auto ch : name)
+    out += std::tolower(static_cast<unsigned char>(ch));
+  out += ':';
+
+  auto const start = out.size();
+  auto       wsp   = false;
+  for (auto ch : field.substr(colon + 1)) {
+    if ((ch == '\r') || (ch == '\n'))
+      continue; // unfold
+    if (is_wsp(ch)) {
+      wsp = true;
+      continue;
+    }
+    if (wsp && (out.size() > start))
+      out += ' ';
+    wsp = false;
+    out += ch;
+  }
+  return out;
+}
+
+} // namespace DKIM
@@ -0,0 +1,67 @@
+#ifndef DKIM_BODY_DOT_HPP
+#define DKIM_BODY_DOT_HPP
+
+// The DKIM body hash, RFC 6376 sections 3.4.3, 3.4.4 and 3.7.  The body
+// is canonicalized as it streams through and fed to SHA-256 in place;
+// runs of ordinary text are found a vector at a time and never copied.
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <openssl/evp.h>
+
+namespace DKIM {
+
+enum class canon : bool {
+  simple,
+  relaxed,
+};
+
+class body_hash {
+public:
+  // With a limit, only that many octets of canonical body are hashed,
+  // as for the l= tag.
+  explicit body_hash(canon                      c,
+                     std::optional<std::size_t> limit = std::nullopt);
+
+  // Any piece of the body, split anywhere.
+  void update(std::string_view chunk);
+
+  // The bh= value, base64 encoded.
+  std::string final();
+
+  // Octets of canonical body hashed so far.
+  std::size_t length() const { return length_; }
+
+private:
+  void content_(char ch);
+  void eol_();
+  void put_(std::string_view s);
+  void flush_();
+  void hash_(char const* data, std::size_t len);
+
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx_;
+
+  std::string buf_;
+  std::size_t blanks_{0};
+  std::size_t length_{0};
+
+  std::optional<std::size_t> limit_;
+
+  bool relaxed_;
+  bool cr_{false};
+  bool wsp_{false};
+  bool line_{false};
+  bool any_{false};
+};
+
+// RFC 6376 section 3.4.2 relaxed header canonicalization of a whole
+// "Name: value" field, without the trailing CRLF.
+std::string relaxed_header(std::string_view field);
+
+} // namespace DKIM
+
+#endif // DKIM_BODY_DOT_HPP
@@ -0,0 +1,66 @@
+#ifndef DKIM_TEST_KEYS_DOT_HPP
+#define DKIM_TEST_KEYS_DOT_HPP
+
+// Throwaway signing keys for the DKIM tests and benchmarks, and the
+// TXT records that would publish them.
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <glog/logging.h>
+
+#include "Base64.hpp"
+#include "fs.hpp"
+
+// A new EVP_PKEY_RSA, of bits, or EVP_PKEY_ED25519 key.
+inline EVP_PKEY* gen_key(int type, int bits = 2048)
+{
+  std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx(
+      EVP_PKEY_CTX_new_id(type, nullptr), EVP_PKEY_CTX_free);
+  CHECK_EQ(EVP_PKEY_keygen_init(ctx.get()), 1);
+  if (type == EVP_PKEY_RSA)
+    CHECK_EQ(EVP_PKEY_CTX_set_rsa_keygen_bits(ctx.get(), bits), 1);
+  EVP_PKEY* key = nullptr;
+  CHECK_EQ(EVP_PKEY_keygen(ctx.get(), &key), 1);
+  return key;
+}
+
+// The private key as PEM, for DkimSigner::add_key().
+inline void write_key(EVP_PKEY* key, fs::path const& path)
+{
+  std::unique_ptr<BIO, decltype(&BIO_free)> bio(
+      BIO_new_file(path.c_str(), "w"), BIO_free);
+  CHECK(bio);
+  CHECK_EQ(PEM_write_bio_PrivateKey(bio.get(), key, nullptr, nullptr, 0,
+                                    nullptr, nullptr),
+           1);
+}
+
+// The TXT record a domain would publish for key.
+inline std::string key_record(EVP_PKEY* key)
+{
+  if (EVP_PKEY_id(key) == EVP_PKEY_ED25519) {
+    unsigned char raw[32];
+    std::size_t   len = sizeof(raw);
+    CHECK_EQ(EVP_PKEY_get_raw_public_key(key, raw, &len), 1);
+    return fmt::format(
+        "v=DKIM1; k=ed25519; p={}",
+        Base64::enc(std::string_view(reinterpret_cast<char*>(raw), len)));
+  }
+  unsigned char* der = nullptr;
+  auto const     len = i2d_PUBKEY(key, &der);
+  CHECK_GT(len, 0);
+  auto const p =
+      Base64::enc(std::string_view(reinterpret_cast<char*>(der), len));
+  OPENSSL_free(der);
+  return fmt::format("v=DKIM1; k=rsa; p={}", p);
+}
+
+#endif // DKIM_TEST_KEYS_DOT_HPP
@@ -0,0 +1,258 @@
+#include "DKIM-verify.hpp"
+
+#include "Base64.hpp"
+#include "DKIM-body.hpp"
+#include "DKIM-test-keys.hpp"
+#include "DkimSigner.hpp"
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+namespace {
+// An RSA-SHA256 b= value for data.
+std::string sign(EVP_PKEY* key, std::string const& data)
+{
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(
+      EVP_MD_CTX_new(), EVP_MD_CTX_free);
+  CHECK_EQ(EVP_DigestSignInit(ctx.get(), nullptr, EVP_sha256(), nullptr, key),
+           1);
+  auto const  dp  = reinterpret_cast<unsigned char const*>(data.data());
+  std::size_t len = 0;
+  CHECK_EQ(EVP_DigestSign(ctx.get(), nullptr, &len, dp, data.size()), 1);
+  std::string b(len, '\0');
+  CHECK_EQ(EVP_DigestSign(ctx.get(), reinterpret_cast<unsigned char*>(b.data()),
+                          &len, dp, data.size()),
+           1);
+  b.resize(len);
+  return Base64::enc(b);
+}
+
+struct result {
+  std::vector<std::pair<std::string, std::string>> sigs; // selector, result
+  std::string                                      arc;
+  std::string                                      custody;
+};
+
+// A selector not in keys has no key record; one mapped to nullopt is
+// a lookup that failed.
+using key_map = std::map<std::string, std::optional<std::string>>;
+
+result check(std::vector<std::string> const& headers,
+             std::string const&              body,
+             key_map const&                  keys)
+{
+  DKIM::verify v([&keys](char const* selector, char const* domain) {
+    auto const key = keys.find(selector);
+    return (key == keys.end()) ? std::optional<std::string>{""s}
+                               : key->second;
+  });
+  for (auto const& header : headers)
+    v.header(header);
+  auto const b = std::string_view(body);
+  v.body(b.substr(0, 10));
+  v.body(b.substr(10));
+  v.eom();
+
+  result res;
+  v.foreach_result([&res](char const* domain, char const* result,
+                          char const* identity, char const* selector,
+                          char const* b) {
+    CHECK_EQ(std::string(domain), "example.com");
+    CHECK_EQ(std::string(identity), "@example.com");
+    res.sigs.emplace_back(selector, result);
+  });
+  auto n = 0u;
+  v.foreach_sig([&res, &n](char const* domain, bool passed,
+                           char const* identity, char const* selector,
+                           char const* b) {
+    CHECK_EQ(passed, res.sigs[n++].second == "pass");
+  });
+  CHECK_EQ(n, res.sigs.size());
+  res.arc     = v.arc_status();
+  res.custody = v.arc_custody();
+  return res;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  auto const dir      = fs::temp_directory_path();
+  auto const pid      = std::to_string(getpid());
+  auto const rsa_file = dir / ("DKIM-verify-test-rsa-"s + pid);
+  auto const ed_file  = dir / ("DKIM-verify-test-ed-"s + pid);
+
+  auto const rsa_key = gen_key(EVP_PKEY_RSA);
+  auto const ed_key  = gen_key(EVP_PKEY_ED25519);
+  write_key(rsa_key, rsa_file);
+  write_key(ed_key, ed_file);
+
+  DkimSigner signer;
+  signer.add_key("rsa", rsa_file);
+  signer.add_key("ed", ed_file);
+  fs::remove(rsa_file);
+  fs::remove(ed_file);
+
+  key_map keys{
+      {"rsa", key_record(rsa_key)},
+      {"ed", key_record(ed_key)},
+      {"arc", key_record(rsa_key)},
+  };
+
+  std::vector<std::string> headers{
+      "From: Alice <alice@example.com>\r\n",
+      "To: bob@example.com\r\n",
+      "Subject: Hello\r\n\t there \r\n",
+  };
+  auto const body = "Hi  Bob,\t \r\n\r\nHow are you?\r\n\r\n"s;
+
+  DkimSigner::input in;
+  for (auto const& h : headers)
+    in.headers.emplace_back(h);
+  in.body.emplace_back(body);
+
+  auto const rsa_sig = signer.sign("rsa", "example.com", in);
+  in.typ             = DkimSigner::body_type::binary;
+  auto const ed_sig  = signer.sign("ed", "example.com", in);
+
+  headers.insert(headers.begin(), "DKIM-Signature: " + ed_sig + "\r\n");
+  headers.insert(headers.begin(), "DKIM-Signature: " + rsa_sig + "\r\n");
+
+  auto res = check(headers, body, keys);
+  CHECK_EQ(res.sigs.size(), 2u);
+  CHECK_EQ(res.sigs[0].first, "rsa");
+  CHECK_EQ(res.sigs[0].second, "pass");
+  CHECK_EQ(res.sigs[1].first, "ed");
+  CHECK_EQ(res.sigs[1].second, "pass");
+  CHECK_EQ(res.arc, "none");
+
+  // A changed body, a changed header, a missing key.
+  res = check(headers, body + "P.S.\r\n", keys);
+  CHECK_EQ(res.sigs[0].second, "fail");
+  CHECK_EQ(res.sigs[1].second, "fail");
+
+  auto changed = headers;
+  changed.back() = "Subject: Goodbye\r\n";
+  res            = check(changed, body, keys);
+  CHECK_EQ(res.sigs[0].second, "fail");
+  CHECK_EQ(res.sigs[1].second, "fail");
+
+  res = check(headers, body, {{"rsa", keys["rsa"]}});
+  CHECK_EQ(res.sigs[0].second, "pass");
+  CHECK_EQ(res.sigs[1].second, "fail");
+
+  // A key we couldn't look up is a temporary error, not a failure.
+  res = check(headers, body, {{"rsa", keys["rsa"]}, {"ed", std::nullopt}});
+  CHECK_EQ(res.sigs[0].second, "pass");
+  CHECK_EQ(res.sigs[1].second, "temperror");
+
+  // Keys we won't use: too short, not for email, or for a domain that
+  // signs for itself only, and i= is a subdomain.
+  auto const short_key = gen_key(EVP_PKEY_RSA, 512);
+  res = check(headers, body, {{"rsa", key_record(short_key)}, {"ed", ""}});
+  CHECK_EQ(res.sigs[0].second, "permerror");
+  EVP_PKEY_free(short_key);
+
+  res = check(headers, body,
+              {{"rsa", key_record(rsa_key) + "; s=tlsrpt"}, {"ed", ""}});
+  CHECK_EQ(res.sigs[0].second, "permerror");
+  res = check(headers, body,
+              {{"rsa", key_record(rsa_key) + "; s=email:*; t=s"}, {"ed", ""}});
+  CHECK_EQ(res.sigs[0].second, "pass");
+
+  // A key record that doesn't decode, and one that has k=rsa but
+  // isn't an RSA key.
+  res = check(headers, body, {{"rsa", "v=DKIM1; k=rsa; p=!!!!"}, {"ed", ""}});
+  CHECK_EQ(res.sigs[0].second, "permerror");
+
+  unsigned char* der = nullptr;
+  auto const     len = i2d_PUBKEY(ed_key, &der);
+  CHECK_GT(len, 0);
+  auto const ed_der =
+      Base64::enc(std::string_view(reinterpret_cast<char*>(der), len));
+  OPENSSL_free(der);
+  res = check(headers, body,
+              {{"rsa", "v=DKIM1; k=rsa; p=" + ed_der}, {"ed", ""}});
+  CHECK_EQ(res.sigs[0].second, "permerror");
+
+  // A key in testing: a failure is no worse than no signature.
+  res = check(headers, body + "P.S.\r\n",
+              {{"rsa", key_record(rsa_key) + "; t=y"}, {"ed", ""}});
+  CHECK_EQ(res.sigs[0].second, "neutral");
+
+  // RFC 8301: rsa-sha1 is no good, and is reported with anything else
+  // that doesn't parse.
+  auto sha1 = headers;
+  auto const a = sha1[0].find("a=rsa-sha256");
+  CHECK_NE(a, std::string::npos);
+  sha1[0].replace(a, 12, "a=rsa-sha1");
+  res = check(sha1, body, keys);
+  CHECK_EQ(res.sigs.size(), 2u);
+  CHECK_EQ(res.sigs[0].second, "permerror");
+  CHECK_EQ(res.sigs[1].second, "pass");
+
+  // Trailing blank lines don't count, and white space doesn't for the
+  // relaxed signature.
+  res = check(headers, "Hi Bob, \r\n\r\nHow are you?\r\n", keys);
+  CHECK_EQ(res.sigs[0].second, "pass");
+  CHECK_EQ(res.sigs[1].second, "fail");
+
+  // One ARC set over the same message.
+  DKIM::body_hash bh(DKIM::canon::relaxed);
+  bh.update(body);
+
+  auto const aar =
+      "ARC-Authentication-Results: i=1; example.org; dkim=pass"s;
+  auto ams = fmt::format("ARC-Message-Signature: i=1; a=rsa-sha256;"
+                         " c=relaxed/relaxed; d=example.org; s=arc;\r\n"
+                         "\th=from:to:subject; bh={}; b=",
+                         bh.final());
+  auto data = DKIM::relaxed_header(headers[2]) + "\r\n" +
+              DKIM::relaxed_header(headers[3]) + "\r\n" +
+              DKIM::relaxed_header(headers[4]) + "\r\n" +
+              DKIM::relaxed_header(ams);
+  ams += sign(rsa_key, data);
+
+  auto const seal = [&](char const* cv) {
+    auto as = fmt::format(
+        "ARC-Seal: i=1; a=rsa-sha256; cv={}; d=example.org; s=arc; b=", cv);
+    auto const data = DKIM::relaxed_header(aar) + "\r\n" +
+                      DKIM::relaxed_header(ams) + "\r\n" +
+                      DKIM::relaxed_header(as);
+    return as + sign(rsa_key, data);
+  };
+
+  auto arc = headers;
+  arc.insert(arc.begin(), {seal("none"), ams, aar});
+  res = check(arc, body, keys);
+  CHECK_EQ(res.sigs.size(), 2u);
+  CHECK_EQ(res.arc, "pass");
+  CHECK_EQ(res.custody, "example.org");
+
+  res = check(arc, body + "P.S.\r\n", keys);
+  CHECK_EQ(res.arc, "fail");
+
+  // The first seal must say cv=none.
+  arc[0] = seal("pass");
+  CHECK_EQ(check(arc, body, keys).arc, "fail");
+
+  // A set with a part missing.
+  arc.erase(arc.begin());
+  CHECK_EQ(check(arc, body, keys).arc, "fail");
+
+  EVP_PKEY_free(rsa_key);
+  EVP_PKEY_free(ed_key);
+}
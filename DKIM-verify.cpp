@@ -0,0 +1,699 @@
+#include "DKIM-verify.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <ctime>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <openssl/x509.h>
+
+#include <glog/logging.h>
+
+#include "Base64.hpp"
+#include "DKIM-body.hpp"
+#include "iequal.hpp"
+#include "task-pool.hpp"
+
+namespace {
+auto constexpr npos = std::string_view::npos;
+
+bool is_wsp(char ch) { return (ch == ' ') || (ch == '\t'); }
+bool is_fws(char ch) { return is_wsp(ch) || (ch == '\r') || (ch == '\n'); }
+
+std::string_view trim(std::string_view s)
+{
+  while (!s.empty() && is_fws(s.front()))
+    s.remove_prefix(1);
+  while (!s.empty() && is_fws(s.back()))
+    s.remove_suffix(1);
+  return s;
+}
+
+std::string strip_fws(std::string_view s)
+{
+  std::string ret;
+  std::copy_if(s.begin(), s.end(), std::back_inserter(ret),
+               [](char ch) { return !is_fws(ch); });
+  return ret;
+}
+
+std::string_view field_name(std::string_view field)
+{
+  auto name = field.substr(0, field.find(':'));
+  while (!name.empty() && is_wsp(name.back()))
+    name.remove_suffix(1);
+  return name;
+}
+
+std::string_view field_value(std::string_view field)
+{
+  auto const colon = field.find(':');
+  return (colon == npos) ? std::string_view{} : field.substr(colon + 1);
+}
+
+std::optional<unsigned long long> number(std::string_view s)
+{
+  unsigned long long n   = 0;
+  auto const         end = s.data() + s.size();
+  auto const [ptr, ec]   = std::from_chars(s.data(), end, n);
+  if (s.empty() || (ec != std::errc{}) || (ptr != end))
+    return {};
+  return n;
+}
+
+using tag_list = std::map<std::string, std::string, std::less<>>;
+
+// RFC 6376 section 3.2; false on bad syntax or a repeated tag.
+bool parse_tags(std::string_view value, tag_list& tags)
+{
+  while (!value.empty()) {
+    auto const semi = value.find(';');
+    auto const spec = trim(value.substr(0, semi));
+    value.remove_prefix((semi == npos) ? value.size() : semi + 1);
+    if (spec.empty())
+      continue;
+    auto const eq = spec.find('=');
+    if (eq == npos)
+      return false;
+    auto const name = trim(spec.substr(0, eq));
+    if (name.empty() || !tags.emplace(name, trim(spec.substr(eq + 1))).second)
+      return false;
+  }
+  return true;
+}
+
+std::optional<std::string_view> tag(tag_list const& tags, std::string_view name)
+{
+  auto const t = tags.find(name);
+  if (t == tags.end())
+    return {};
+  return t->second;
+}
+
+// The field with the value of its b= tag, and the white space around
+// it, taken out; RFC 6376 section 3.7.
+std::string strip_b(std::string_view field)
+{
+  auto const colon = field.find(':');
+  std::string ret(field.substr(0, colon + 1));
+
+  auto rest = field.substr(colon + 1);
+  while (!rest.empty()) {
+    auto const semi = rest.find(';');
+    auto const spec = rest.substr(0, (semi == npos) ? rest.size() : semi + 1);
+    rest.remove_prefix(spec.size());
+
+    auto const eq = spec.find('=');
+    if ((eq != npos) && (trim(spec.substr(0, eq)) == "b")) {
+      ret.append(spec.substr(0, eq + 1));
+      if (spec.back() == ';')
+        ret += ';';
+    }
+    else {
+      ret.append(spec);
+    }
+  }
+  return ret;
+}
+
+std::string canon_header(std::string_view field, bool relaxed)
+{
+  if (relaxed)
+    return DKIM::relaxed_header(field);
+  return std::string(field);
+}
+
+// The i= of an ARC-Authentication-Results field, which is not a
+// tag-list past its first element; RFC 8617 section 4.1.1.
+std::optional<unsigned long long> aar_instance(std::string_view value)
+{
+  tag_list tags;
+  if (!parse_tags(value.substr(0, value.find(';')), tags))
+    return {};
+  return number(tag(tags, "i").value_or(""));
+}
+
+// Whether a colon separated list, such as a key record's s= or t=, has
+// item in it.
+bool has_item(std::string_view list, std::string_view item)
+{
+  auto const items = ":" + strip_fws(list) + ":";
+  return items.find(":" + std::string(item) + ":") != std::string::npos;
+}
+
+// RFC 6376 section 3.6.1, and RFC 8463 for k=ed25519: whether the key
+// in a record may be used to check a signature made with algo by
+// domain, for an identity in idom.  Sets testing for t=y.
+bool key_fits(std::string_view record,
+              std::string_view algo,
+              std::string_view domain,
+              std::string_view idom,
+              bool&            testing)
+{
+  tag_list tags;
+  if (!parse_tags(record, tags))
+    return false;
+  if (auto const v = tag(tags, "v"); v && (*v != "DKIM1"))
+    return false;
+
+  auto const k    = tag(tags, "k").value_or("rsa");
+  auto const dash = algo.find('-');
+  if (algo.substr(0, dash) != k)
+    return false;
+  if (auto const h = tag(tags, "h"); h && !has_item(*h, algo.substr(dash + 1)))
+    return false;
+
+  if (auto const st = tag(tags, "s");
+      st && !has_item(*st, "*") && !has_item(*st, "email"))
+    return false;
+
+  auto const t = tag(tags, "t").value_or("");
+  testing      = has_item(t, "y");
+  if (has_item(t, "s") && !idom.empty() && !iequal(idom, domain))
+    return false; // no subdomains
+
+  return true;
+}
+
+bool check_b(EVP_PKEY*          key,
+             std::string_view   algo,
+             std::string const& data,
+             std::string const& b64)
+{
+  auto const b  = Base64::dec(b64);
+  auto const bp = reinterpret_cast<unsigned char const*>(b.data());
+
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(
+      EVP_MD_CTX_new(), EVP_MD_CTX_free);
+  CHECK(ctx);
+
+  auto tbs     = reinterpret_cast<unsigned char const*>(data.data());
+  auto tbs_len = data.size();
+
+  // RFC 8463 section 3: Ed25519 signs the SHA-256 hash of the data.
+  unsigned char md[SHA256_DIGEST_LENGTH];
+  EVP_MD const* digest = nullptr;
+  if (algo == "ed25519-sha256") {
+    SHA256(tbs, tbs_len, md);
+    tbs     = md;
+    tbs_len = sizeof(md);
+  }
+  else {
+    digest = EVP_sha256();
+  }
+
+  if (EVP_DigestVerifyInit(ctx.get(), nullptr, digest, nullptr, key) != 1)
+    return false;
+  return EVP_DigestVerify(ctx.get(), bp, b.size(), tbs, tbs_len) == 1;
+}
+
+// Run every task, a few at a time.
+void run(std::vector<std::function<void()>> const& tasks)
+{
+  static task_pool pool(Config::dkim_verify_threads - 1);
+  pool.run(tasks);
+}
+} // namespace
+
+namespace DKIM {
+
+std::shared_ptr<EVP_PKEY> parse_key(std::string_view record,
+                                    std::string_view domain)
+{
+  tag_list tags;
+  if (!parse_tags(record, tags))
+    return {};
+
+  auto const p = tag(tags, "p");
+  if (!p || p->empty())
+    return {}; // revoked
+
+  std::string der;
+  try {
+    der = Base64::dec(strip_fws(*p));
+  }
+  catch (std::exception const& e) {
+    LOG(WARNING) << "bad key record from " << domain << ": " << e.what();
+    return {};
+  }
+  auto dp = reinterpret_cast<unsigned char const*>(der.data());
+
+  auto const k = tag(tags, "k").value_or("rsa");
+  if (k == "ed25519") {
+    return {EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, dp,
+                                        der.size()),
+            EVP_PKEY_free};
+  }
+  if (k != "rsa")
+    return {};
+
+  std::shared_ptr<EVP_PKEY> key(d2i_PUBKEY(nullptr, &dp, der.size()),
+                                EVP_PKEY_free);
+  if (!key)
+    return {};
+  if (EVP_PKEY_id(key.get()) != EVP_PKEY_RSA) {
+    LOG(WARNING) << "k=rsa key from " << domain << " is not RSA";
+    return {};
+  }
+  if (EVP_PKEY_bits(key.get()) < int(Config::dkim_min_rsa_bits)) {
+    LOG(WARNING) << "RSA key from " << domain << " is only "
+                 << EVP_PKEY_bits(key.get()) << " bits";
+    return {};
+  }
+  return key;
+}
+
+struct verify::sig {
+  enum class kind { dkim, ams, as };
+
+  sig(std::size_t f, kind k)
+    : field(f)
+    , typ(k)
+  {
+  }
+
+  bool parse(std::string_view value, std::time_t now);
+
+  std::size_t field; // index into headers_
+  kind        typ;
+
+  unsigned long long instance{0}; // ARC only
+
+  std::string algo;
+  std::string b;
+  std::string bh;
+  std::string domain;
+  std::string selector;
+  std::string identity;
+  std::string cv;
+
+  std::vector<std::string> h;
+
+  bool                       relaxed_hdr{false};
+  canon                      body_canon{canon::simple};
+  std::optional<std::size_t> limit;
+  bool                       expired{false};
+
+  bool malformed{false};
+
+  // Filled in by eom().
+  std::optional<key_record> const* key{nullptr};
+  std::string const*                body_bh{nullptr};
+
+  bool key_ok{false};  // fit for this signature
+  bool testing{false}; // t=y
+  bool header_ok{false};
+  bool passed{false};
+
+  char const* result{"permerror"}; // as RFC 8601 has it
+};
+
+// False for anything malformed, or using an algorithm or
+// canonicalization we don't know.
+bool verify::sig::parse(std::string_view value, std::time_t now)
+{
+  tag_list tags;
+  if (!parse_tags(value, tags))
+    return false;
+
+  auto const a  = tag(tags, "a");
+  auto const bv = tag(tags, "b");
+  auto const d  = tag(tags, "d");
+  auto const s  = tag(tags, "s");
+
+  // What there is, to report even if the rest is no good.
+  b        = strip_fws(bv.value_or(""));
+  domain   = d.value_or("");
+  selector = s.value_or("");
+  if (typ == kind::dkim) {
+    auto const i = tag(tags, "i");
+    identity     = i ? std::string(*i) : ("@" + domain);
+  }
+
+  if (!a || !bv || !d || !s || d->empty() || s->empty())
+    return false;
+
+  // RFC 8301 section 3.1: rsa-sha1 is not to be accepted.
+  if ((*a != "rsa-sha256") && (*a != "ed25519-sha256"))
+    return false;
+  algo = *a;
+
+  if (typ == kind::dkim) {
+    if (tag(tags, "v") != "1")
+      return false;
+  }
+  else {
+    auto const i = number(tag(tags, "i").value_or(""));
+    if (!i || (*i < 1) || (*i > Config::arc_max_instances))
+      return false;
+    instance = *i;
+  }
+
+  if (typ == kind::as) {
+    // RFC 8617 section 4.1.3: always relaxed, and no h=.
+    auto const c = tag(tags, "cv");
+    if (!c || tag(tags, "h"))
+      return false;
+    cv          = *c;
+    relaxed_hdr = true;
+    return true;
+  }
+
+  auto const bhv = tag(tags, "bh");
+  auto const hv  = tag(tags, "h");
+  if (!bhv || !hv)
+    return false;
+  bh = strip_fws(*bhv);
+
+  auto const      hs    = strip_fws(*hv);
+  std::string_view names = hs;
+  while (!names.empty()) {
+    auto const colon = names.find(':');
+    auto const name  = names.substr(0, colon);
+    if (name.empty())
+      return false;
+    h.emplace_back(name);
+    names.remove_prefix((colon == npos) ? names.size() : colon + 1);
+  }
+  if (h.empty())
+    return false;
+
+  auto const c     = tag(tags, "c").value_or("simple/simple");
+  auto const slash = c.find('/');
+  auto const hc    = c.substr(0, slash);
+  auto const bc =
+      (slash == npos) ? std::string_view("simple") : c.substr(slash + 1);
+  if (((hc != "simple") && (hc != "relaxed")) ||
+      ((bc != "simple") && (bc != "relaxed")))
+    return false;
+  relaxed_hdr = hc == "relaxed";
+  body_canon  = (bc == "relaxed") ? canon::relaxed : canon::simple;
+
+  if (auto const l = tag(tags, "l")) {
+    auto const n = number(*l);
+    if (!n)
+      return false;
+    limit = *n;
+  }
+
+  if (typ == kind::ams)
+    return true;
+
+  // RFC 6376 section 6.1.1
+  if (std::none_of(h.begin(), h.end(),
+                   [](auto const& name) { return iequal(name, "from"); }))
+    return false;
+
+  auto const at = identity.rfind('@');
+  if (at == std::string::npos)
+    return false;
+  std::string_view const idom = std::string_view(identity).substr(at + 1);
+  if (!iequal(idom, domain) &&
+      !(iends_with(idom, domain) &&
+        (idom[idom.size() - domain.size() - 1] == '.')))
+    return false;
+
+  if (auto const x = tag(tags, "x")) {
+    auto const t = number(*x);
+    if (!t)
+      return false;
+    expired = *t < static_cast<unsigned long long>(now);
+  }
+
+  return true;
+}
+
+verify::verify(key_lookup lookup)
+  : lookup_(std::move(lookup))
+{
+  CHECK(lookup_);
+}
+
+verify::~verify() {}
+
+void verify::header(std::string_view field)
+{
+  if (field.ends_with("\r\n"))
+    field.remove_suffix(2);
+  headers_.push_back(field);
+}
+
+void verify::body(std::string_view body) { body_.push_back(body); }
+
+void verify::eom()
+{
+  auto const now = std::time(nullptr);
+
+  for (auto i = 0u; i < headers_.size(); ++i) {
+    if (!iequal(field_name(headers_[i]), "DKIM-Signature"))
+      continue;
+    auto s = std::make_unique<sig>(i, sig::kind::dkim);
+    if (s->parse(field_value(headers_[i]), now)) {
+      s->result = "fail"; // until it's checked
+    }
+    else {
+      LOG(WARNING) << "malformed DKIM-Signature";
+      s->malformed = true;
+    }
+    sigs_.push_back(std::move(s));
+  }
+
+  auto const arc = arc_sets_();
+
+  std::vector<sig*> checks;
+  for (auto const& s : sigs_) {
+    if (s->malformed)
+      continue;
+    if (s->expired)
+      LOG(INFO) << "DKIM signature from " << s->domain << " has expired";
+    else
+      checks.push_back(s.get());
+  }
+  if (arc) {
+    checks.push_back(ams_.back().get());
+    for (auto const& s : as_)
+      checks.push_back(s.get());
+  }
+
+  // Keys first, on this thread: the lookup is likely to use DNS.
+  std::map<std::pair<std::string, std::string>, std::optional<key_record>>
+      keys;
+  for (auto s : checks) {
+    auto const name = std::make_pair(s->selector, s->domain);
+    auto       key  = keys.find(name);
+    if (key == keys.end())
+      key = keys.emplace(name, lookup_(s->selector.c_str(), s->domain.c_str()))
+                .first;
+    s->key = &key->second;
+  }
+
+  // One body hash for each c= and l= in use.
+  std::map<std::pair<canon, std::optional<std::size_t>>, std::string> hashes;
+  for (auto s : checks) {
+    if (s->typ != sig::kind::as)
+      s->body_bh = &hashes[{s->body_canon, s->limit}];
+  }
+
+  std::vector<std::function<void()>> tasks;
+  for (auto& [group, hash] : hashes) {
+    tasks.emplace_back([this, group = group, hash = &hash] {
+      body_hash bh(group.first, group.second);
+      for (auto piece : body_)
+        bh.update(piece);
+      *hash = bh.final();
+    });
+  }
+  for (auto s : checks) {
+    if (!*s->key || s->key->value().text.empty())
+      continue; // no key, no pass
+    tasks.emplace_back([this, s] {
+      auto const at   = s->identity.rfind('@');
+      auto const idom = (at == std::string::npos)
+                            ? std::string_view{}
+                            : std::string_view(s->identity).substr(at + 1);
+      try {
+        auto const& record = s->key->value();
+        if (!key_fits(record.text, s->algo, s->domain, idom, s->testing))
+          return;
+        auto const key =
+            record.pkey ? record.pkey : parse_key(record.text, s->domain);
+        if (!key)
+          return;
+        s->key_ok = true;
+
+        auto const data = (s->typ == sig::kind::as) ? seal_data_(s->instance)
+                                                    : header_data_(*s);
+        s->header_ok = check_b(key.get(), s->algo, data, s->b);
+      }
+      catch (std::exception const& e) {
+        LOG(WARNING) << "bad key or signature from " << s->domain << ": "
+                     << e.what();
+      }
+    });
+  }
+
+  run(tasks);
+
+  for (auto s : checks) {
+    s->passed = s->header_ok && (!s->body_bh || (*s->body_bh == s->bh));
+    s->result = s->passed                      ? "pass"
+                : !*s->key                     ? "temperror"
+                : s->key->value().text.empty() ? "fail" // no key record
+                : !s->key_ok                   ? "permerror"
+                : s->testing                   ? "neutral"
+                                               : "fail";
+  }
+
+  if (arc) {
+    // AMS(N) and every AS, the tail of checks.
+    auto const pass =
+        std::all_of(checks.end() - (as_.size() + 1), checks.end(),
+                    [](auto s) { return s->passed; });
+    arc_status_ = pass ? "pass" : "fail";
+  }
+}
+
+void verify::foreach_sig(std::function<void(char const* domain,
+                                            bool        passed,
+                                            char const* identity,
+                                            char const* selector,
+                                            char const* b)> func) const
+{
+  for (auto const& s : sigs_) {
+    func(s->domain.c_str(), s->passed, s->identity.c_str(),
+         s->selector.c_str(), s->b.c_str());
+  }
+}
+
+void verify::foreach_result(std::function<void(char const* domain,
+                                               char const* result,
+                                               char const* identity,
+                                               char const* selector,
+                                               char const* b)> func) const
+{
+  for (auto const& s : sigs_) {
+    func(s->domain.c_str(), s->result, s->identity.c_str(),
+         s->selector.c_str(), s->b.c_str());
+  }
+}
+
+std::string verify::arc_custody() const
+{
+  std::string custody;
+  for (auto i = as_.size(); i--;) {
+    if (!as_[i])
+      continue;
+    if (!custody.empty())
+      custody += ':';
+    custody += as_[i]->domain;
+  }
+  return custody;
+}
+
+// RFC 6376 section 5.4.2: each field named in h= is taken from the bottom
+// up, then comes the signature itself, less b= and the final CRLF.
+std::string verify::header_data_(sig const& s) const
+{
+  std::string       data;
+  std::vector<bool> used(headers_.size());
+  for (auto const& name : s.h) {
+    for (auto i = headers_.size(); i--;) {
+      if (!used[i] && iequal(field_name(headers_[i]), name)) {
+        used[i] = true;
+        data += canon_header(headers_[i], s.relaxed_hdr);
+        data += "\r\n";
+        break;
+      }
+    }
+  }
+  data += canon_header(strip_b(headers_[s.field]), s.relaxed_hdr);
+  return data;
+}
+
+// RFC 8617 section 5.1.1: every ARC set up to this instance, in order,
+// then this ARC-Seal less b= and the final CRLF.
+std::string verify::seal_data_(std::size_t instance) const
+{
+  std::string data;
+  for (auto i = 0u; i < instance; ++i) {
+    data += relaxed_header(aar_[i]);
+    data += "\r\n";
+    data += relaxed_header(headers_[ams_[i]->field]);
+    data += "\r\n";
+    if (i + 1 < instance) {
+      data += relaxed_header(headers_[as_[i]->field]);
+      data += "\r\n";
+    }
+  }
+  data += relaxed_header(strip_b(headers_[as_[instance - 1]->field]));
+  return data;
+}
+
+// Sort the ARC fields into sets and check the shape of the chain, RFC
+// 8617 section 5.2 steps 1 to 3.  True if there are signatures to check.
+bool verify::arc_sets_()
+{
+  auto const fail = [this] {
+    arc_status_ = "fail";
+    return false;
+  };
+
+  auto const slot = [](auto& sets, unsigned long long instance) -> auto& {
+    if (sets.size() < instance)
+      sets.resize(instance);
+    return sets[instance - 1];
+  };
+
+  auto const now = std::time(nullptr);
+
+  for (auto i = 0u; i < headers_.size(); ++i) {
+    auto const name  = field_name(headers_[i]);
+    auto const value = field_value(headers_[i]);
+
+    if (iequal(name, "ARC-Authentication-Results")) {
+      auto const n = aar_instance(value);
+      if (!n || (*n < 1) || (*n > Config::arc_max_instances))
+        return fail();
+      auto& aar = slot(aar_, *n);
+      if (aar.data())
+        return fail();
+      aar = headers_[i];
+      continue;
+    }
+
+    auto const kind = iequal(name, "ARC-Message-Signature") ? sig::kind::ams
+                      : iequal(name, "ARC-Seal")            ? sig::kind::as
+                                                            : sig::kind::dkim;
+    if (kind == sig::kind::dkim)
+      continue; // not ARC
+
+    auto s = std::make_unique<sig>(i, kind);
+    if (!s->parse(value, now))
+      return fail();
+    auto& set = slot((kind == sig::kind::ams) ? ams_ : as_, s->instance);
+    if (set)
+      return fail();
+    set = std::move(s);
+  }
+
+  auto const n = std::max({aar_.size(), ams_.size(), as_.size()});
+  if (n == 0)
+    return false;
+
+  aar_.resize(n);
+  ams_.resize(n);
+  as_.resize(n);
+  for (auto i = 0u; i < n; ++i) {
+    if (!aar_[i].data() || !ams_[i] || !as_[i])
+      return fail();
+    if (as_[i]->cv != (i ? "pass" : "none"))
+      return fail();
+  }
+  return true;
+}
+
+} // namespace DKIM
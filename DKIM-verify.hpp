@@ -0,0 +1,123 @@
+#ifndef DKIM_VERIFY_DOT_HPP
+#define DKIM_VERIFY_DOT_HPP
+
+// Checks every DKIM-Signature on a message, and its ARC chain (RFC 8617),
+// in one pass.  The body is canonicalized and hashed once for each
+// distinct c= and l= among the signatures, and the body hashes and
+// signatures are then checked on a few threads at once, from a pool
+// kept for the life of the process.
+//
+// As RFC 8301 has it, rsa-sha1 signatures and RSA keys under 1024 bits
+// are not accepted.
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <openssl/evp.h>
+
+namespace Config {
+constexpr unsigned dkim_verify_threads = 4;
+constexpr unsigned dkim_min_rsa_bits   = 1024;
+constexpr int      arc_max_instances   = 50;
+} // namespace Config
+
+namespace DKIM {
+
+// A key record as found at <selector>._domainkey.<domain>, with the key
+// from its p= if whoever looked it up has that parsed already, say
+// from a cache.  Without it the key is parsed for each signature.
+struct key_record {
+  key_record(std::string t, std::shared_ptr<EVP_PKEY> k = {})
+    : text(std::move(t))
+    , pkey(std::move(k))
+  {
+  }
+
+  std::string               text;
+  std::shared_ptr<EVP_PKEY> pkey;
+};
+
+// The key in a record, by its k= and p=, if it's one we'll use: RSA of
+// at least Config::dkim_min_rsa_bits, or Ed25519.  Null if not, or if
+// the key has been revoked.  Domain is for the log.
+std::shared_ptr<EVP_PKEY> parse_key(std::string_view record,
+                                    std::string_view domain);
+
+class verify {
+  // no copy
+  verify(verify const&) = delete;
+  verify& operator=(verify const&) = delete;
+
+public:
+  // As OpenDKIM::verify::key_lookup, but with no library lookup to fall
+  // back on: an empty record fails the signature, and nullopt, a failed
+  // lookup, makes it a temperror.  Called only from eom(), on the
+  // calling thread, once per selector and domain.
+  using key_lookup = std::function<std::optional<key_record>(
+      char const* selector, char const* domain)>;
+
+  explicit verify(key_lookup lookup);
+  ~verify();
+
+  // Each header field, top to bottom, as "Name: value" with or without
+  // the trailing CRLF.  Fields and body must stay put until eom().
+  void header(std::string_view field);
+  void body(std::string_view body);
+  void eom();
+
+  // DKIM results in the order the signatures appear, as for
+  // OpenDKIM::verify::foreach_sig().
+  void foreach_sig(std::function<void(char const* domain,
+                                      bool        passed,
+                                      char const* identity,
+                                      char const* selector,
+                                      char const* b)> func) const;
+
+  // The same, with the result as RFC 8601 writes it: "pass", "fail",
+  // "neutral" for a failure under a t=y key, "temperror" when the key
+  // lookup failed, or "permerror" for a signature that doesn't parse or
+  // a key that can't be used for it.  Fields that don't parse have
+  // whatever of d=, i=, s= and b= could be found, or "".
+  void foreach_result(std::function<void(char const* domain,
+                                         char const* result,
+                                         char const* identity,
+                                         char const* selector,
+                                         char const* b)> func) const;
+
+  // "none", "pass" or "fail", as OpenARC::verify::chain_status_str().
+  char const* arc_status() const { return arc_status_; }
+
+  // The d= of each ARC-Seal, newest first, separated by colons, as
+  // OpenARC::verify::chain_custody_str().
+  std::string arc_custody() const;
+
+  struct sig;
+
+private:
+  std::string header_data_(sig const& s) const;
+  std::string seal_data_(std::size_t instance) const;
+  bool        arc_sets_();
+
+  key_lookup lookup_;
+
+  std::vector<std::string_view> headers_;
+  std::vector<std::string_view> body_;
+
+  std::vector<std::unique_ptr<sig>> sigs_; // DKIM-Signature fields
+
+  // ARC sets, indexed by instance - 1.
+  std::vector<std::string_view>     aar_;
+  std::vector<std::unique_ptr<sig>> ams_;
+  std::vector<std::unique_ptr<sig>> as_;
+
+  char const* arc_status_ = "none";
+};
+
+} // namespace DKIM
+
+#endif // DKIM_VERIFY_DOT_HPP
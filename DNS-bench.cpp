@@ -0,0 +1,227 @@
+#include "DNS-message.hpp"
+
+#include "Bench.hpp"
+#include "DNS-iostream.hpp"
+#include "DNS.hpp"
+#include "osutil.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+DECLARE_string(nameserver);
+
+namespace {
+using octet = DNS::message::octet;
+
+// Answers as a resolver sends them, built here rather than read from
+// captures so the bench needs no files: the question, then each answer
+// with its owner name a pointer back to the question's.
+class packet {
+public:
+  packet(char const* name, DNS::RR_type type)
+    : type_(type)
+  {
+    put16(0x1234); // ID
+    put16(0x8180); // QR RD RA
+    put16(1);      // QDCOUNT
+    put16(0);      // ANCOUNT, filled in as answers are added
+    put16(0);      // NSCOUNT
+    put16(0);      // ARCOUNT
+    put_name(name);
+    put16(static_cast<std::uint16_t>(type));
+    put16(1); // IN
+  }
+
+  void answer(std::vector<octet> const& rdata)
+  {
+    put16(0xC00C); // the question's name
+    put16(static_cast<std::uint16_t>(type_));
+    put16(1);     // IN
+    put16(0);     // TTL, high
+    put16(3600);  // TTL, low
+    put16(rdata.size());
+    bfr_.insert(bfr_.end(), rdata.begin(), rdata.end());
+
+    auto const ancount = (bfr_[6] << 8) + bfr_[7] + 1;
+    bfr_[6]            = ancount >> 8;
+    bfr_[7]            = ancount & 0xFF;
+  }
+
+  DNS::message message() const
+  {
+    DNS::message::container_t bfr(bfr_.size());
+    std::memcpy(bfr.data(), bfr_.data(), bfr_.size());
+    return DNS::message{std::move(bfr)};
+  }
+
+  static void put_name(std::vector<octet>& v, std::string_view name)
+  {
+    while (!name.empty()) {
+      auto const dot   = name.find('.');
+      auto const label = name.substr(0, dot);
+      v.push_back(label.size());
+      v.insert(v.end(), label.begin(), label.end());
+      if (dot == std::string_view::npos)
+        break;
+      name.remove_prefix(dot + 1);
+    }
+    v.push_back(0);
+  }
+
+private:
+  void put16(std::uint16_t n)
+  {
+    bfr_.push_back(n >> 8);
+    bfr_.push_back(n & 0xFF);
+  }
+  void put_name(std::string_view name) { put_name(bfr_, name); }
+
+  DNS::RR_type       type_;
+  std::vector<octet> bfr_;
+};
+
+DNS::message a_answer()
+{
+  packet p("example.com", DNS::RR_type::A);
+  for (octet i = 1; i <= 4; ++i)
+    p.answer({192, 0, 2, i});
+  return p.message();
+}
+
+DNS::message aaaa_answer()
+{
+  packet p("example.com", DNS::RR_type::AAAA);
+  for (octet i = 1; i <= 4; ++i)
+    p.answer({0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, i});
+  return p.message();
+}
+
+DNS::message mx_answer()
+{
+  packet p("gmail.com", DNS::RR_type::MX);
+  char const* const mxs[]{
+      "gmail-smtp-in.l.google.com",
+      "alt1.gmail-smtp-in.l.google.com",
+      "alt2.gmail-smtp-in.l.google.com",
+      "alt3.gmail-smtp-in.l.google.com",
+      "alt4.gmail-smtp-in.l.google.com",
+  };
+  std::uint16_t pref = 5;
+  for (auto mx : mxs) {
+    std::vector<octet> rdata{0, static_cast<octet>(pref)};
+    packet::put_name(rdata, mx);
+    p.answer(rdata);
+    pref += 5;
+  }
+  return p.message();
+}
+
+DNS::message txt_answer()
+{
+  packet p("digilicious.com", DNS::RR_type::TXT);
+  for (std::string_view txt :
+       {"v=spf1 ip4:192.0.2.0/24 ip6:2001:db8::/32 include:_spf.google.com "
+        "include:mailgun.org ~all",
+        "google-site-verification=abcdefghijklmnopqrstuvwxyz0123456789ABCDEF",
+        "MS=ms12345678"}) {
+    std::vector<octet> rdata{static_cast<octet>(txt.size())};
+    rdata.insert(rdata.end(), txt.begin(), txt.end());
+    p.answer(rdata);
+  }
+  return p.message();
+}
+
+DNS::message ptr_answer()
+{
+  packet p("1.2.0.192.in-addr.arpa", DNS::RR_type::PTR);
+  std::vector<octet> rdata;
+  packet::put_name(rdata, "mail.example.com");
+  p.answer(rdata);
+  return p.message();
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Bench::suite suite("DNS", argc, argv);
+
+  struct {
+    char const*  name;
+    DNS::message pkt;
+    std::size_t  n_rrs;
+  } const answers[]{
+      {"A", a_answer(), 4},     {"AAAA", aaaa_answer(), 4},
+      {"MX", mx_answer(), 5},   {"TXT", txt_answer(), 3},
+      {"PTR", ptr_answer(), 1},
+  };
+
+  for (auto const& a : answers) {
+    auto bogus = false;
+    CHECK_EQ(DNS::get_records(a.pkt, bogus).size(), a.n_rrs) << a.name;
+    CHECK(!bogus) << a.name;
+
+    suite.run(std::string("get_records/") + a.name, [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i) {
+        auto bogus = false;
+        Bench::keep(DNS::get_records(a.pkt, bogus));
+      }
+    });
+    suite.run(std::string("min_ttl/") + a.name, [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(DNS::min_ttl(a.pkt));
+    });
+  }
+
+  suite.run("create_question", [](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i)
+      Bench::keep(DNS::create_question("gmail-smtp-in.l.google.com",
+                                       DNS::RR_type::A, 1, i & 0xFFFF));
+  });
+
+  // Round trips, only when pointed at a nameserver that answers the
+  // same way every time: dns-stub serving dns-fixture.zone, as
+  //
+  //   DNS-bench --nameserver=127.0.0.1@5353/udp
+  if (!FLAGS_nameserver.empty() || getenv("GHSMTP_NAMESERVER")) {
+    DNS::Resolver res{osutil::get_config_dir()};
+
+    std::vector<DNS::Query::question> const questions{
+        {DNS::RR_type::A, "mx1.example.com"},
+        {DNS::RR_type::AAAA, "mx1.example.com"},
+        {DNS::RR_type::MX, "example.com"},
+        {DNS::RR_type::TXT, "example.com"},
+        {DNS::RR_type::TXT, "_dmarc.example.com"},
+        {DNS::RR_type::PTR, "25.2.0.192.in-addr.arpa"},
+        {DNS::RR_type::TLSA, "_25._tcp.mx1.example.com"},
+        {DNS::RR_type::A, "2.0.0.127.sbl.spamhaus.org"},
+    };
+    for (auto const& [type, name] : questions)
+      CHECK(DNS::has_record(res, type, name)) << name << '/' << type;
+
+    suite.run("query/MX", [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(res.get_records(DNS::RR_type::MX, "example.com"));
+    });
+    suite.run("query/nx_domain", [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(DNS::has_record(res, DNS::RR_type::A, "no.example.com"));
+    });
+    suite.run("query/sequential", [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        for (auto const& [type, name] : questions)
+          Bench::keep(res.get_records(type, name));
+    });
+    suite.run("query/batch", [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(DNS::Query::batch(res, questions));
+    });
+  }
+
+  return suite.finish();
+}
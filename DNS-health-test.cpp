@@ -0,0 +1,170 @@
+#include "DNS-health.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+int main(int argc, char* argv[])
+{
+  auto const name = "/DNS-health-test-"s + std::to_string(getpid());
+
+  {
+    DNS::health h(name.c_str());
+    CHECK(h.is_shared());
+
+    CHECK(!h.get("fast").known);
+    CHECK_EQ(h.hedge_delay("fast"), Config::hedge_unknown);
+
+    // The first sample sets srtt, and rttvar to half of it.
+    h.sample("fast", milliseconds(10));
+    auto e = h.get("fast");
+    CHECK(e.known);
+    CHECK(e.healthy());
+    CHECK_EQ(e.srtt, milliseconds(10));
+    CHECK_EQ(e.rttvar, milliseconds(5));
+    CHECK_EQ(h.hedge_delay("fast"), milliseconds(30));
+
+    // Steady answers settle rttvar down.
+    for (auto i = 0; i < 50; ++i)
+      h.sample("fast", milliseconds(10));
+    CHECK_EQ(h.hedge_delay("fast"), Config::hedge_min);
+
+    for (auto i = 0; i < 10; ++i)
+      h.sample("slow", milliseconds(300));
+
+    h.sample("failing", milliseconds(1));
+    for (auto i = 0; i < 3; ++i)
+      h.failure("failing");
+    CHECK(!h.get("failing").healthy());
+
+    // A second mapping, as another smtp process would have, agrees:
+    // the healthy by speed, then the unknown, then the rest; but now
+    // and then the unknown goes first, to be measured.
+    DNS::health other(name.c_str());
+    auto probes = 0;
+    for (auto i = 0; i < 1000; ++i) {
+      auto const order = other.rank({"failing", "slow", "new", "fast"});
+      CHECK_EQ(order.size(), 4);
+      if (order[0] == 2) {
+        ++probes;
+        CHECK_EQ(order[1], 3);
+        CHECK_EQ(order[2], 1);
+      }
+      else {
+        CHECK_EQ(order[0], 3);
+        CHECK_EQ(order[1], 1);
+        CHECK_EQ(order[2], 2);
+      }
+      CHECK_EQ(order[3], 0);
+    }
+    CHECK_GT(probes, 0);
+    CHECK_LT(probes, 200);
+
+    // Recovery takes a run of answers.
+    for (auto i = 0; i < 10; ++i)
+      h.sample("failing", milliseconds(1));
+    CHECK(h.get("failing").healthy());
+  }
+
+  shm_unlink(name.c_str());
+
+  // Left alone, a server's errors fade, while what's known of its RTT
+  // is kept.  The clock can't be wound on, so the segment is written
+  // as if the last sample were two half-lives ago.
+  {
+    DNS::health h(name.c_str());
+    h.sample("down", milliseconds(40));
+    for (auto i = 0; i < 8; ++i)
+      h.failure("down");
+    auto e = h.get("down");
+    CHECK(!e.healthy());
+    auto const err = e.error_rate;
+
+    auto const fd = shm_open(name.c_str(), O_RDWR, 0600);
+    PCHECK(fd != -1);
+    auto const sz = lseek(fd, 0, SEEK_END);
+    auto const p  = static_cast<char*>(
+        mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    PCHECK(p != MAP_FAILED);
+    close(fd);
+
+    // The slot's last field is updated_ns, a steady_clock count.
+    auto const ago
+        = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              2 * Config::ns_error_half_life)
+              .count();
+    std::int64_t updated;
+    auto const   slot_sz = sz / 32;
+    std::memcpy(&updated, p + slot_sz - sizeof updated, sizeof updated);
+    updated -= ago;
+    std::memcpy(p + slot_sz - sizeof updated, &updated, sizeof updated);
+    munmap(p, sz);
+
+    e = h.get("down");
+    CHECK(e.known);
+    CHECK(e.healthy());
+    CHECK_LT(std::abs(e.error_rate - err / 4), 0.01);
+    CHECK_EQ(e.srtt, milliseconds(40));
+  }
+
+  shm_unlink(name.c_str());
+
+  // A process that died adding a server leaves the lock taken and a
+  // slot claimed: the lock holds up others only for a while, and the
+  // slot is used again.
+  {
+    DNS::health h(name.c_str());
+
+    auto const fd = shm_open(name.c_str(), O_RDWR, 0600);
+    PCHECK(fd != -1);
+    auto const sz = lseek(fd, 0, SEEK_END);
+    auto const p  = static_cast<char*>(
+        mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    PCHECK(p != MAP_FAILED);
+    close(fd);
+
+    // The segment ends with the lock; a slot starts with its state.
+    auto const now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count();
+    std::int64_t  taken   = now;
+    std::uint32_t claimed = 1;
+    std::memcpy(p + sz - sizeof taken, &taken, sizeof taken);
+    std::memcpy(p, &claimed, sizeof claimed);
+
+    h.sample("new", milliseconds(10));
+    CHECK(!h.get("new").known);
+
+    taken = now
+            - std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  2 * Config::ns_claim_timeout)
+                  .count();
+    std::memcpy(p + sz - sizeof taken, &taken, sizeof taken);
+
+    h.sample("new", milliseconds(10));
+    CHECK(h.get("new").known);
+    CHECK_EQ(std::string(p + sizeof claimed), "new");
+
+    // Another mapping adds no second slot for it.
+    DNS::health other(name.c_str());
+    other.sample("new", milliseconds(10));
+    std::memcpy(&taken, p + sz - sizeof taken, sizeof taken);
+    CHECK_EQ(taken, 0);
+    CHECK_EQ(std::strlen(p + sz / 32 + sizeof claimed), 0u);
+    munmap(p, sz);
+  }
+
+  shm_unlink(name.c_str());
+}
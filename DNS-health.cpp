@@ -0,0 +1,319 @@
+#include "DNS-health.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+namespace {
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+constexpr std::size_t n_slots  = 32;
+constexpr std::size_t key_size = 64;
+
+// The error rate is kept in parts per million.
+constexpr std::int64_t ppm = 1'000'000;
+
+std::int64_t now_ns()
+{
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+namespace DNS {
+
+// clang-format off
+struct health::slot {
+  enum : std::uint32_t { empty, claimed, ready };
+
+  std::atomic<std::uint32_t> state;
+  char                       key[key_size];
+
+  std::atomic<std::int64_t>  srtt_us;
+  std::atomic<std::int64_t>  rttvar_us;
+  std::atomic<std::int64_t>  error_ppm;
+  std::atomic<std::int64_t>  samples;
+  std::atomic<std::int64_t>  updated_ns;  // steady_clock, so system wide
+};
+
+struct health::segment {
+  slot slots[n_slots];
+
+  std::atomic<std::int64_t>  claim_ns;    // when the lock was taken, or 0
+
+  static_assert(std::atomic<std::int64_t>::is_always_lock_free);
+};
+// clang-format on
+
+health::health(char const* name)
+{
+  auto const sz = sizeof(segment);
+
+  auto const fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+  if (fd == -1) {
+    PLOG(WARNING) << "shm_open " << name << " failed";
+  }
+  else {
+    struct stat st;
+    PCHECK(fstat(fd, &st) == 0);
+
+    // A new segment is zero filled, which is every slot empty.  The
+    // size stands in for a version check.
+    if ((st.st_size == 0) && (ftruncate(fd, sz) == -1)) {
+      PLOG(WARNING) << "ftruncate " << name << " failed";
+    }
+    else if (st.st_size && (std::size_t(st.st_size) != sz)) {
+      LOG(WARNING) << "nameserver table " << name << " is " << st.st_size
+                   << " octets, expecting " << sz << "; not using it";
+    }
+    else {
+      auto const p
+          = mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED) {
+        PLOG(WARNING) << "mmap " << name << " failed";
+      }
+      else {
+        seg_    = static_cast<segment*>(p);
+        shared_ = true;
+      }
+    }
+    close(fd);
+  }
+
+  if (!seg_)
+    seg_ = new segment{};
+}
+
+health::~health()
+{
+  if (shared_)
+    munmap(seg_, sizeof(segment));
+  else
+    delete seg_;
+}
+
+// Slots are claimed only by the holder of the segment's lock, which
+// looks again for the key once it has the lock, so no two processes
+// add the same server.  The lock holds the time it was taken: one held
+// past Config::ns_claim_timeout is taken to be a dead process's and
+// broken, and a slot left claimed but never made ready is reused by
+// the next holder.  While another holds the lock, the sample is lost.
+health::slot* health::find_(std::string_view key, bool create) const
+{
+  if (key.size() >= key_size) {
+    LOG(WARNING) << "nameserver key too long: " << key;
+    return nullptr;
+  }
+
+  auto const ready = [this, key]() -> slot* {
+    for (auto& s : seg_->slots) {
+      auto const state = s.state.load(std::memory_order_acquire);
+      if ((state == slot::ready) && (key == s.key))
+        return &s;
+    }
+    return nullptr;
+  };
+
+  if (auto const s = ready(); s || !create)
+    return s;
+
+  auto const now     = now_ns();
+  auto const timeout = duration_cast<nanoseconds>(Config::ns_claim_timeout);
+  auto       held    = seg_->claim_ns.load(std::memory_order_acquire);
+  if ((held && (now - held < timeout.count()))
+      || !seg_->claim_ns.compare_exchange_strong(held, now,
+                                                 std::memory_order_acq_rel))
+    return nullptr;
+
+  auto found = ready();
+  if (!found) {
+    for (auto& s : seg_->slots) {
+      if (s.state.load(std::memory_order_acquire) == slot::ready)
+        continue;
+      s.state.store(slot::claimed, std::memory_order_relaxed);
+      std::memcpy(s.key, key.data(), key.size());
+      s.key[key.size()] = '\0';
+      s.samples.store(0, std::memory_order_relaxed);
+      s.state.store(slot::ready, std::memory_order_release);
+      found = &s;
+      break;
+    }
+  }
+
+  seg_->claim_ns.store(0, std::memory_order_release);
+
+  if (!found)
+    LOG_FIRST_N(WARNING, 1) << "nameserver table is full";
+  return found;
+}
+
+namespace {
+// The error rate, let fade for the time since it was last updated.
+std::int64_t decayed(std::int64_t error_ppm, std::int64_t updated_ns)
+{
+  auto const age = now_ns() - updated_ns;
+  if (age <= 0)
+    return error_ppm;
+  auto const half_life
+      = duration_cast<nanoseconds>(Config::ns_error_half_life).count();
+  return std::int64_t(double(error_ppm)
+                      * std::exp2(-double(age) / double(half_life)));
+}
+} // namespace
+
+void health::sample(std::string_view key, microseconds rtt)
+{
+  auto const s = find_(key, true);
+  if (!s)
+    return;
+
+  auto const r = std::max<std::int64_t>(rtt.count(), 0);
+
+  auto       srtt    = s->srtt_us.load(std::memory_order_relaxed);
+  auto       rttvar  = s->rttvar_us.load(std::memory_order_relaxed);
+  auto       err     = decayed(s->error_ppm.load(std::memory_order_relaxed),
+                         s->updated_ns.load(std::memory_order_relaxed));
+  auto const samples = s->samples.load(std::memory_order_relaxed);
+
+  if (!samples) {
+    // RFC 6298 section 2.2
+    srtt   = r;
+    rttvar = r / 2;
+    err    = 0;
+  }
+  else {
+    // RFC 6298 section 2.3, alpha 1/8 and beta 1/4
+    rttvar += (std::abs(srtt - r) - rttvar) / 4;
+    srtt += (r - srtt) / 8;
+    err -= err / 8;
+  }
+
+  s->srtt_us.store(srtt, std::memory_order_relaxed);
+  s->rttvar_us.store(rttvar, std::memory_order_relaxed);
+  s->error_ppm.store(err, std::memory_order_relaxed);
+  s->samples.store(samples + 1, std::memory_order_relaxed);
+  s->updated_ns.store(now_ns(), std::memory_order_relaxed);
+}
+
+std::string health::key(std::string_view addr,
+                        std::uint16_t    port,
+                        std::string_view transport)
+{
+  std::string k(addr);
+  k += '@';
+  k += std::to_string(port);
+  k += '/';
+  k += transport;
+  return k;
+}
+
+// Each failure moves the error rate an eighth of the way to one: three
+// in a row and the server is no longer healthy.  A server whose first
+// word is a failure is taken to be as slow as we'll wait for.
+void health::failure(std::string_view key)
+{
+  auto const s = find_(key, true);
+  if (!s)
+    return;
+
+  auto       err     = decayed(s->error_ppm.load(std::memory_order_relaxed),
+                         s->updated_ns.load(std::memory_order_relaxed));
+  auto const samples = s->samples.load(std::memory_order_relaxed);
+
+  if (!samples) {
+    auto const slow = duration_cast<microseconds>(Config::hedge_max).count();
+    s->srtt_us.store(slow, std::memory_order_relaxed);
+    s->rttvar_us.store(0, std::memory_order_relaxed);
+  }
+  err += (ppm - err) / 8;
+
+  s->error_ppm.store(err, std::memory_order_relaxed);
+  s->samples.store(samples + 1, std::memory_order_relaxed);
+  s->updated_ns.store(now_ns(), std::memory_order_relaxed);
+}
+
+health::estimate health::get(std::string_view key) const
+{
+  estimate e;
+
+  auto const s = find_(key, false);
+  if (!s)
+    return e;
+
+  if (!s->samples.load(std::memory_order_relaxed))
+    return e;
+
+  e.known      = true;
+  e.srtt       = microseconds(s->srtt_us.load(std::memory_order_relaxed));
+  e.rttvar     = microseconds(s->rttvar_us.load(std::memory_order_relaxed));
+  e.error_rate = double(decayed(s->error_ppm.load(std::memory_order_relaxed),
+                                s->updated_ns.load(std::memory_order_relaxed)))
+                 / double(ppm);
+  return e;
+}
+
+std::vector<std::size_t>
+health::rank(std::vector<std::string> const& keys) const
+{
+  std::vector<std::size_t> order(keys.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+
+  thread_local std::minstd_rand rng{std::random_device{}()};
+  std::shuffle(order.begin(), order.end(), rng);
+
+  std::vector<estimate> est;
+  est.reserve(keys.size());
+  for (auto const& key : keys)
+    est.push_back(get(key));
+
+  auto const score = [&est](std::size_t i) {
+    auto const& e    = est[i];
+    auto const tier = !e.known ? 1 : e.healthy() ? 0 : 2;
+    return std::make_tuple(tier, e.srtt);
+  };
+  std::stable_sort(order.begin(), order.end(),
+                   [&score](std::size_t a, std::size_t b) {
+                     return score(a) < score(b);
+                   });
+
+  if (std::uniform_int_distribution<unsigned>(1, Config::ns_probe_odds)(rng)
+      == 1) {
+    auto const unknown = std::find_if(order.begin(), order.end(),
+                                      [&est](std::size_t i) {
+                                        return !est[i].known;
+                                      });
+    if (unknown != order.end())
+      std::rotate(order.begin(), unknown, unknown + 1);
+  }
+
+  return order;
+}
+
+milliseconds health::hedge_delay(std::string_view key) const
+{
+  auto const e = get(key);
+  if (!e.known)
+    return Config::hedge_unknown;
+
+  auto const delay = duration_cast<milliseconds>(e.srtt + 4 * e.rttvar);
+  return std::clamp<milliseconds>(delay, Config::hedge_min, Config::hedge_max);
+}
+
+} // namespace DNS
@@ -0,0 +1,104 @@
+#ifndef DNS_HEALTH_DOT_HPP
+#define DNS_HEALTH_DOT_HPP
+
+// How each nameserver has been doing lately: a smoothed round trip
+// time and its variation, as TCP keeps for its retransmission timer
+// (RFC 6298), and a smoothed error rate.  The numbers are kept in a
+// POSIX shared memory segment so every smtp process learns from the
+// others' queries; if that can't be had, a table private to this
+// process is used.
+//
+// Updates are relaxed loads and stores, not atomic read-modify-write:
+// two processes updating the same server at once may lose a sample,
+// which a smoothed estimate doesn't miss.  A server is added to the
+// table by one process at a time, under a lock that a crashed process
+// can't leave held for long.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Config {
+constexpr char const* ns_health_name = "/ghsmtp-nameservers";
+
+// A server's error rate halves for each this long without a sample,
+// so one that failed a while ago is given another try.  Its RTT is kept
+// as the best guess until new samples move it.
+constexpr auto ns_error_half_life = std::chrono::minutes(5);
+
+// One in this many rankings puts a server we know nothing about first,
+// to measure it.
+constexpr unsigned ns_probe_odds = 16;
+
+constexpr double ns_max_error_rate = 0.25;
+
+// A lock on adding servers held longer than this was left by a process
+// that died holding it.
+constexpr auto ns_claim_timeout = std::chrono::seconds(1);
+
+// Bounds on how long to wait for an answer before asking another
+// server, and the wait for a server we know nothing about.
+constexpr auto hedge_min     = std::chrono::milliseconds(20);
+constexpr auto hedge_max     = std::chrono::milliseconds(2000);
+constexpr auto hedge_unknown = std::chrono::milliseconds(250);
+} // namespace Config
+
+namespace DNS {
+
+class health {
+public:
+  health(health const&) = delete;
+  health& operator=(health const&) = delete;
+
+  // The name is as for shm_open(3).
+  explicit health(char const* name = Config::ns_health_name);
+  ~health();
+
+  bool is_shared() const { return shared_; }
+
+  // Servers are known by a key, such as "127.0.0.1@53/tcp", from
+  // key(): the port is a number, so that "domain-s" and "853" are the
+  // same server.  A sample is the time for one answer, a failure is no
+  // usable answer.
+  static std::string
+  key(std::string_view addr, std::uint16_t port, std::string_view transport);
+
+  void sample(std::string_view key, std::chrono::microseconds rtt);
+  void failure(std::string_view key);
+
+  struct estimate {
+    bool                      known{false}; // any samples at all
+    std::chrono::microseconds srtt{0};
+    std::chrono::microseconds rttvar{0};
+    double                    error_rate{0};
+
+    bool healthy() const { return error_rate <= Config::ns_max_error_rate; }
+  };
+  estimate get(std::string_view key) const;
+
+  // Indexes into keys, best first: the healthy ones by smoothed RTT,
+  // then servers we know nothing about, then the rest.  Now and then,
+  // one in Config::ns_probe_odds, an unknown server goes first instead.
+  // Ties are broken at random.
+  std::vector<std::size_t> rank(std::vector<std::string> const& keys) const;
+
+  // How long to wait for an answer before asking another server:
+  // srtt + 4 * rttvar, the point past which few answers arrive.
+  std::chrono::milliseconds hedge_delay(std::string_view key) const;
+
+private:
+  struct slot;
+  struct segment;
+
+  slot* find_(std::string_view key, bool create) const;
+
+  segment* seg_{nullptr};
+  bool     shared_{false};
+};
+
+} // namespace DNS
+
+#endif // DNS_HEALTH_DOT_HPP
@@ -0,0 +1,129 @@
+// The Resolver against two dns-stubs serving dns-fixture.zone, one of
+// them slow: a query to the slow one is hedged to the other, which
+// answers first and is asked from then on.
+
+#include "DNS-health.hpp"
+#include "DNS.hpp"
+#include "osutil.hpp"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <csignal>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+using std::chrono::milliseconds;
+
+namespace {
+pid_t start_stub(uint16_t port, milliseconds latency)
+{
+  auto const port_flag    = "--port="s + std::to_string(port);
+  auto const latency_flag = "--latency_ms="s + std::to_string(latency.count());
+
+  auto const pid = fork();
+  PCHECK(pid != -1);
+  if (pid == 0) {
+    execl("./dns-stub", "dns-stub", port_flag.c_str(), latency_flag.c_str(),
+          nullptr);
+    PLOG(FATAL) << "exec ./dns-stub failed";
+  }
+
+  // It binds UDP before it listens on TCP: once TCP takes a connection,
+  // both are up.
+  for (auto tries = 0; tries < 50; ++tries) {
+    auto const fd = socket(AF_INET, SOCK_STREAM, 0);
+    PCHECK(fd >= 0);
+    auto in4{sockaddr_in{}};
+    in4.sin_family      = AF_INET;
+    in4.sin_port        = htons(port);
+    in4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    auto const up
+        = connect(fd, reinterpret_cast<sockaddr*>(&in4), sizeof in4) == 0;
+    close(fd);
+    if (up)
+      return pid;
+    std::this_thread::sleep_for(milliseconds(100));
+  }
+  LOG(FATAL) << "dns-stub on port " << port << " never came up";
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  uint16_t const slow_port = 20000 + getpid() % 20000;
+  uint16_t const fast_port = slow_port + 1;
+
+  auto const slow = start_stub(slow_port, milliseconds(600));
+  auto const fast = start_stub(fast_port, milliseconds(0));
+
+  setenv("GHSMTP_NAMESERVER",
+         ("127.0.0.1@"s + std::to_string(slow_port) + "/udp,127.0.0.1@"
+          + std::to_string(fast_port) + "/udp")
+             .c_str(),
+         1);
+
+  // Rank the slow one first, as if it had been quick until now, and the
+  // fast one second: both known, so neither is picked to be probed.
+  {
+    DNS::health h;
+    auto const  slow_key = DNS::health::key("127.0.0.1", slow_port, "udp");
+    auto const  fast_key = DNS::health::key("127.0.0.1", fast_port, "udp");
+    for (auto i = 0; i < 10; ++i)
+      h.sample(slow_key, milliseconds(1));
+    h.sample(fast_key, milliseconds(1));
+    for (auto i = 0; i < 3; ++i)
+      h.failure(fast_key);
+  }
+
+  auto const config_path = osutil::get_config_dir();
+
+  {
+    DNS::Resolver res(config_path);
+
+    CHECK(DNS::has_record(res, DNS::RR_type::A, "example.com"));
+    CHECK(DNS::has_record(res, DNS::RR_type::MX, "example.com"));
+
+    auto const& tr = res.trace();
+    CHECK_EQ(tr.size(), 2);
+
+    // Asked of both, answered by the fast one.
+    CHECK(tr[0].hedged);
+    CHECK_EQ(tr[0].ns, 1);
+    CHECK_LT(tr[0].latency, milliseconds(600));
+
+    // Which is now the one asked first.
+    CHECK(!tr[1].hedged);
+    CHECK_EQ(tr[1].ns, 1);
+  }
+
+  // A batch goes to the primary alone, slow or not, and every answer
+  // comes within the one read timeout.
+  {
+    DNS::Resolver res(config_path);
+
+    std::vector<DNS::Query::question> const questions{
+        {DNS::RR_type::A, "mx1.example.com"},
+        {DNS::RR_type::AAAA, "mx1.example.com"},
+        {DNS::RR_type::MX, "example.com"},
+        {DNS::RR_type::TXT, "_dmarc.example.com"},
+    };
+    auto const qs = DNS::Query::batch(res, questions);
+    CHECK_EQ(qs.size(), questions.size());
+    for (auto const& q : qs)
+      CHECK(!q->get_records().empty());
+  }
+
+  kill(slow, SIGTERM);
+  kill(fast, SIGTERM);
+  waitpid(slow, nullptr, 0);
+  waitpid(fast, nullptr, 0);
+}
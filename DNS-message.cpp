@@ -3,6 +3,8 @@
 #include "DNS-iostream.hpp"
 #include "Domain.hpp"
 
+#include <algorithm>
+
 #include <arpa/nameser.h>
 
 namespace {
@@ -423,6 +425,12 @@ uint16_t message::id() const
   return hdr_p->id();
 }
 
+bool message::truncation() const
+{
+  auto const hdr_p = reinterpret_cast<header const*>(begin());
+  return hdr_p->truncation();
+}
+
 size_t min_message_sz() { return sizeof(header); }
 
 DNS::message
@@ -824,4 +832,39 @@ RR_collection get_records(message const& pkt, bool& bogus_or_indeterminate)
   return ret;
 }
 
+uint32_t min_ttl(message const& pkt)
+{
+  if (size(pkt) < sizeof(header))
+    return 0;
+
+  auto const hdr_p = reinterpret_cast<header const*>(begin(pkt));
+
+  auto p = begin(pkt) + sizeof(header);
+
+  for (auto i = 0; i < hdr_p->qdcount(); ++i) {
+    std::string qname;
+    auto        enc_len = 0;
+    if (!expand_name(p, pkt, qname, enc_len))
+      return 0;
+    p += enc_len + sizeof(question);
+  }
+
+  auto ttl = std::numeric_limits<uint32_t>::max();
+
+  for (auto i = 0; i < hdr_p->ancount(); ++i) {
+    std::string name;
+    auto        enc_len = 0;
+    if (!expand_name(p, pkt, name, enc_len))
+      return 0;
+    p += enc_len;
+    if ((p + sizeof(rr)) > end(pkt))
+      return 0;
+    auto rr_p = reinterpret_cast<rr const*>(p);
+    ttl       = std::min(ttl, rr_p->rr_ttl());
+    p         = rr_p->next_rr_name();
+  }
+
+  return hdr_p->ancount() ? ttl : 0;
+}
+
 } // namespace DNS
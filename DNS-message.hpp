@@ -44,6 +44,7 @@ public:
   // clang-format on
 
   uint16_t id() const;
+  bool     truncation() const; // TC
 
 private:
   container_t bfr_;
@@ -74,6 +75,9 @@ void check_answer(bool&          nx_domain,
 
 RR_collection get_records(message const& pkt, bool& bogus_or_indeterminate);
 
+// Smallest TTL in the answer section, zero if there are no answers.
+uint32_t min_ttl(message const& pkt);
+
 } // namespace DNS
 
 #endif // DNS_MESSAGE_DOT_HPP
@@ -0,0 +1,109 @@
+#ifndef DNS_NAMESERVERS_DOT_HPP
+#define DNS_NAMESERVERS_DOT_HPP
+
+// The nameservers the Resolver asks, best first by DNS::health; dns-pool
+// keeps connections open to the DNS over TLS ones, those on port
+// "domain-s".
+
+namespace Config {
+enum class sock_type : bool { stream, dgram };
+
+struct nameserver {
+  char const* host; // name used to match cert
+  char const* addr;
+  char const* port;
+  sock_type   typ;
+};
+
+constexpr nameserver nameservers[]{
+    {
+        "localhost",
+        "127.0.0.1",
+        "domain",
+        sock_type::stream,
+    },
+    {
+        "localhost",
+        "::1",
+        "domain",
+        sock_type::stream,
+    },
+    /*
+    {
+        "one.one.one.one",
+        "1.1.1.1",
+        "domain",
+        sock_type::dgram,
+    },
+    {
+        "dns.google",
+        "8.8.8.8",
+        "domain",
+        sock_type::dgram,
+    },
+    {
+        "dns.google",
+        "8.8.4.4",
+        "domain",
+        sock_type::dgram,
+    },
+
+    {
+        "dns.google",
+        "2001:4860:4860::8888",
+        "domain",
+        sock_type::dgram,
+    },
+    {
+        "dns.google",
+        "2001:4860:4860::8844",
+        "domain",
+        sock_type::dgram,
+    },
+    {
+        "1dot1dot1dot1.cloudflare-dns.com",
+        "1.0.0.1",
+        "domain-s",
+        sock_type::stream,
+    },
+    {
+        "1dot1dot1dot1.cloudflare-dns.com",
+        "2606:4700:4700::1111",
+        "domain-s",
+        sock_type::stream,
+    },
+    {
+        "1dot1dot1dot1.cloudflare-dns.com",
+        "2606:4700:4700::1001",
+        "domain-s",
+        sock_type::stream,
+    },
+    {
+        "dns9.quad9.net",
+        "9.9.9.9",
+        "domain-s",
+        sock_type::stream,
+    },
+    {
+        "dns10.quad9.net",
+        "9.9.9.10",
+        "domain-s",
+        sock_type::stream,
+    },
+    {
+        "dns10.quad9.net",
+        "149.112.112.10",
+        "domain-s",
+        sock_type::stream,
+    },
+    {
+        "dns10.quad9.net",
+        "2620:fe::10",
+        "domain-s",
+        sock_type::stream,
+    },
+    */
+};
+} // namespace Config
+
+#endif // DNS_NAMESERVERS_DOT_HPP
@@ -1,16 +1,22 @@
 #include "DNS.hpp"
 
 #include "DNS-iostream.hpp"
+#include "DNS-nameservers.hpp"
 #include "IP4.hpp"
 #include "IP6.hpp"
 #include "Sock.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <limits>
 #include <memory>
+#include <string>
 #include <tuple>
+#include <unordered_set>
+#include <vector>
 
 #include <arpa/nameser.h>
+#include <sys/un.h>
 
 #include <experimental/random>
 
@@ -19,6 +25,10 @@
 #include "osutil.hpp"
 
 DEFINE_bool(log_dns_data, false, "log all DNS TCP protocol data");
+DEFINE_string(nameserver,
+              "",
+              "use only these nameservers, as addr[@port][/tcp|/udp|/tls],..."
+              " or the path of a Unix socket to ask first");
 
 namespace Config {
 // The default timeout in glibc is 5 seconds.  My setup with unbound
@@ -27,104 +37,8 @@ namespace Config {
 
 auto constexpr read_timeout{std::chrono::seconds(7)};
 
-enum class sock_type : bool { stream, dgram };
-
-struct nameserver {
-  char const* host; // name used to match cert
-  char const* addr;
-  char const* port;
-  sock_type   typ;
-};
-
-constexpr nameserver nameservers[]{
-    {
-        "localhost",
-        "127.0.0.1",
-        "domain",
-        sock_type::stream,
-    },
-    {
-        "localhost",
-        "::1",
-        "domain",
-        sock_type::stream,
-    },
-    /*
-    {
-        "one.one.one.one",
-        "1.1.1.1",
-        "domain",
-        sock_type::dgram,
-    },
-    {
-        "dns.google",
-        "8.8.8.8",
-        "domain",
-        sock_type::dgram,
-    },
-    {
-        "dns.google",
-        "8.8.4.4",
-        "domain",
-        sock_type::dgram,
-    },
-
-    {
-        "dns.google",
-        "2001:4860:4860::8888",
-        "domain",
-        sock_type::dgram,
-    },
-    {
-        "dns.google",
-        "2001:4860:4860::8844",
-        "domain",
-        sock_type::dgram,
-    },
-    {
-        "1dot1dot1dot1.cloudflare-dns.com",
-        "1.0.0.1",
-        "domain-s",
-        sock_type::stream,
-    },
-    {
-        "1dot1dot1dot1.cloudflare-dns.com",
-        "2606:4700:4700::1111",
-        "domain-s",
-        sock_type::stream,
-    },
-    {
-        "1dot1dot1dot1.cloudflare-dns.com",
-        "2606:4700:4700::1001",
-        "domain-s",
-        sock_type::stream,
-    },
-    {
-        "dns9.quad9.net",
-        "9.9.9.9",
-        "domain-s",
-        sock_type::stream,
-    },
-    {
-        "dns10.quad9.net",
-        "9.9.9.10",
-        "domain-s",
-        sock_type::stream,
-    },
-    {
-        "dns10.quad9.net",
-        "149.112.112.10",
-        "domain-s",
-        sock_type::stream,
-    },
-    {
-        "dns10.quad9.net",
-        "2620:fe::10",
-        "domain-s",
-        sock_type::stream,
-    },
-    */
-};
+// Trace records kept per Resolver, a session's worth and then some.
+auto constexpr max_trace{std::size_t(1024)};
 } // namespace Config
 
 template <typename T, std::size_t N>
@@ -133,139 +47,438 @@ constexpr std::size_t countof(T const (&)[N]) noexcept
   return N;
 }
 
+namespace {
+// Nameservers given by --nameserver or GHSMTP_NAMESERVER, separated by
+// commas.  Addresses replace the whole Config::nameservers list; this is
+// how the tests and benchmarks point at a dns-stub serving a zone
+// fixture, like so:
+//
+//   GHSMTP_NAMESERVER=127.0.0.1@5353/udp
+//
+// The port defaults to "domain" and the transport to TCP; a fixture
+// server is spoken to in the clear unless /tls is given.  A path, one
+// starting with a slash, is a Unix socket such as dns-pool listens on:
+//
+//   GHSMTP_NAMESERVER=/run/ghsmtp-dns.sock
+//
+// Given alone, that one is put ahead of the list, not in place of it,
+// so sessions carry on without the pool while it's down.
+struct nameserver_override {
+  std::string       addr;
+  std::string       port{"domain"};
+  Config::sock_type typ{Config::sock_type::stream};
+  bool              tls{false};
+
+  bool is_socket() const { return addr[0] == '/'; }
+};
+
+nameserver_override parse_override(std::string spec)
+{
+  nameserver_override ovr;
+
+  if (spec[0] == '/') {
+    ovr.addr = spec;
+    return ovr;
+  }
+
+  auto const slash = spec.find('/');
+  if (slash != std::string::npos) {
+    auto const transport = spec.substr(slash + 1);
+    spec.erase(slash);
+    if (transport == "udp") {
+      ovr.typ = Config::sock_type::dgram;
+    }
+    else if (transport == "tls") {
+      ovr.tls = true;
+    }
+    else {
+      CHECK_EQ(transport, "tcp") << "bad transport in nameserver " << spec;
+    }
+  }
+
+  auto const at = spec.find('@');
+  if (at != std::string::npos) {
+    ovr.port = spec.substr(at + 1);
+    spec.erase(at);
+  }
+
+  CHECK(IP4::is_address(spec) || IP6::is_address(spec))
+      << "nameserver " << spec << " must be an IP address";
+  ovr.addr = spec;
+
+  return ovr;
+}
+
+std::vector<nameserver_override> get_overrides()
+{
+  std::string spec = FLAGS_nameserver;
+  if (spec.empty()) {
+    auto const spec_from_env{getenv("GHSMTP_NAMESERVER")};
+    if (spec_from_env)
+      spec = spec_from_env;
+  }
+
+  std::vector<nameserver_override> ovrs;
+
+  std::string::size_type pos = 0;
+  while (pos < spec.size()) {
+    auto end = spec.find(',', pos);
+    if (end == std::string::npos)
+      end = spec.size();
+    if (end > pos)
+      ovrs.push_back(parse_override(spec.substr(pos, end - pos)));
+    pos = end + 1;
+  }
+
+  return ovrs;
+}
+
+std::vector<nameserver_override> const& the_overrides()
+{
+  // Read once; the flags and environment don't change under us.
+  static auto const ovrs{get_overrides()};
+  return ovrs;
+}
+
+// Just a Unix socket, to be put ahead of the list.
+bool only_socket()
+{
+  auto const& ovrs = the_overrides();
+  return (ovrs.size() == 1) && ovrs.front().is_socket();
+}
+
+std::vector<Config::nameserver> const& nameservers()
+{
+  static auto const nss = [] {
+    std::vector<Config::nameserver> nss;
+    auto const& ovrs = the_overrides();
+    for (auto const& ovr : ovrs) {
+      nss.push_back(
+          {ovr.addr.c_str(), ovr.addr.c_str(), ovr.port.c_str(), ovr.typ});
+    }
+    if (ovrs.empty() || only_socket()) {
+      nss.insert(nss.end(), std::begin(Config::nameservers),
+                 std::end(Config::nameservers));
+    }
+    return nss;
+  }();
+  return nss;
+}
+
+bool is_stream(Config::nameserver const& ns)
+{
+  return ns.typ == Config::sock_type::stream;
+}
+
+uint16_t port_of(Config::nameserver const& ns)
+{
+  return osutil::get_port(ns.port, is_stream(ns) ? "tcp" : "udp");
+}
+
+bool uses_tls(Config::nameserver const& ns)
+{
+  for (auto const& ovr : the_overrides()) {
+    if ((ovr.addr == ns.addr) && (ovr.port == ns.port))
+      return is_stream(ns) && ovr.tls;
+  }
+  return is_stream(ns) && (port_of(ns) != 53);
+}
+
+// What DNS::health knows the nameserver by; with tcp, a UDP nameserver
+// spoken to over TCP.
+std::string key_of(Config::nameserver const& ns, bool tcp = false)
+{
+  auto const stream    = tcp || is_stream(ns);
+  auto const transport = !stream ? "udp" : uses_tls(ns) ? "tls" : "tcp";
+  return DNS::health::key(
+      ns.addr, osutil::get_port(ns.port, stream ? "tcp" : "udp"), transport);
+}
+
+uint16_t random_id()
+{
+  static_assert(std::numeric_limits<uint16_t>::min() == 0);
+  static_assert(std::numeric_limits<uint16_t>::max() == 65535);
+
+  return std::experimental::randint(std::numeric_limits<uint16_t>::min(),
+                                    std::numeric_limits<uint16_t>::max());
+}
+} // namespace
+
 namespace DNS {
 
 Resolver::Resolver(fs::path config_path)
+  : config_path_(config_path)
 {
-  auto tries = countof(Config::nameservers);
-
-  ns_ = std::experimental::randint(
-      0, static_cast<int>(countof(Config::nameservers) - 1));
-
-  while (tries--) {
-
-    // try the next one, with wrap
-    if (++ns_ == countof(Config::nameservers))
-      ns_ = 0;
-
-    auto const& nameserver = Config::nameservers[ns_];
-
-    auto typ = (nameserver.typ == Config::sock_type::stream) ? SOCK_STREAM
-                                                             : SOCK_DGRAM;
-    uint16_t port =
-        osutil::get_port(nameserver.port, (typ == SOCK_STREAM) ? "tcp" : "udp");
-    ns_fd_ = -1;
-
-    if (IP4::is_address(nameserver.addr)) {
-      ns_fd_ = socket(AF_INET, typ, 0);
-      PCHECK(ns_fd_ >= 0) << "socket() failed";
-
-      auto in4{sockaddr_in{}};
-      in4.sin_family = AF_INET;
-      in4.sin_port   = htons(port);
-      CHECK_EQ(inet_pton(AF_INET, nameserver.addr,
-                         reinterpret_cast<void*>(&in4.sin_addr)),
-               1);
-      if (connect(ns_fd_, reinterpret_cast<const sockaddr*>(&in4),
-                  sizeof(in4))) {
-        PLOG(INFO) << "connect failed " << nameserver.host << '['
-                   << nameserver.addr << "]:" << nameserver.port;
-        close(ns_fd_);
-        ns_fd_ = -1;
-        continue;
-      }
+  auto const& nss = nameservers();
+
+  std::vector<std::string> keys;
+  for (auto const& ns : nss)
+    keys.push_back(key_of(ns));
+  order_ = health_.rank(keys);
+
+  // dns-pool first, however it's been doing: the list is for when it's
+  // not there at all.
+  if (only_socket()) {
+    std::stable_partition(begin(order_), end(order_),
+                          [](std::size_t ns) { return ns == 0; });
+  }
+
+  while (next_ < order_.size()) {
+    auto const ns = order_[next_++];
+    if (connect_(primary_, ns))
+      return;
+    health_.failure(keys[ns]);
+  }
+
+  LOG(FATAL) << "no nameservers left to try";
+}
+
+Resolver::~Resolver()
+{
+  close_(primary_);
+  close_(hedge_);
+  close_(tcp_);
+}
+
+bool Resolver::connect_(connection& c, std::size_t ns, bool tcp)
+{
+  auto const& nameserver = nameservers()[ns];
+  auto const  stream     = tcp || is_stream(nameserver);
+
+  close_(c);
+  c.ns    = ns;
+  c.key   = key_of(nameserver, tcp);
+  c.stale.clear();
+  c.via   = stream ? transport::tcp : transport::udp;
+
+  auto const     typ = stream ? SOCK_STREAM : SOCK_DGRAM;
+  uint16_t const port
+      = osutil::get_port(nameserver.port, stream ? "tcp" : "udp");
+
+  if (IP4::is_address(nameserver.addr)) {
+    c.fd = socket(AF_INET, typ, 0);
+    PCHECK(c.fd >= 0) << "socket() failed";
+
+    auto in4{sockaddr_in{}};
+    in4.sin_family = AF_INET;
+    in4.sin_port   = htons(port);
+    CHECK_EQ(inet_pton(AF_INET, nameserver.addr,
+                       reinterpret_cast<void*>(&in4.sin_addr)),
+             1);
+    if (connect(c.fd, reinterpret_cast<const sockaddr*>(&in4), sizeof(in4))) {
+      PLOG(INFO) << "connect failed " << nameserver.host << '['
+                 << nameserver.addr << "]:" << nameserver.port;
+      close_(c);
+      return false;
     }
-    else if (IP6::is_address(nameserver.addr)) {
-      ns_fd_ = socket(AF_INET6, typ, 0);
-      PCHECK(ns_fd_ >= 0) << "socket() failed";
-
-      auto in6{sockaddr_in6{}};
-      in6.sin6_family = AF_INET6;
-      in6.sin6_port   = htons(port);
-      CHECK_EQ(inet_pton(AF_INET6, nameserver.addr,
-                         reinterpret_cast<void*>(&in6.sin6_addr)),
-               1);
-      if (connect(ns_fd_, reinterpret_cast<const sockaddr*>(&in6),
-                  sizeof(in6))) {
-        PLOG(INFO) << "connect failed " << nameserver.host << '['
-                   << nameserver.addr << "]:" << nameserver.port;
-        close(ns_fd_);
-        ns_fd_ = -1;
-        continue;
-      }
+  }
+  else if (IP6::is_address(nameserver.addr)) {
+    c.fd = socket(AF_INET6, typ, 0);
+    PCHECK(c.fd >= 0) << "socket() failed";
+
+    auto in6{sockaddr_in6{}};
+    in6.sin6_family = AF_INET6;
+    in6.sin6_port   = htons(port);
+    CHECK_EQ(inet_pton(AF_INET6, nameserver.addr,
+                       reinterpret_cast<void*>(&in6.sin6_addr)),
+             1);
+    if (connect(c.fd, reinterpret_cast<const sockaddr*>(&in6), sizeof(in6))) {
+      PLOG(INFO) << "connect failed " << nameserver.host << '['
+                 << nameserver.addr << "]:" << nameserver.port;
+      close_(c);
+      return false;
     }
+  }
+  else if (nameserver.addr[0] == '/') {
+    c.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    PCHECK(c.fd >= 0) << "socket() failed";
+
+    auto un{sockaddr_un{}};
+    un.sun_family = AF_UNIX;
+    if (strlen(nameserver.addr) >= sizeof(un.sun_path)) {
+      LOG(WARNING) << "nameserver path " << nameserver.addr << " too long";
+      close_(c);
+      return false;
+    }
+    strcpy(un.sun_path, nameserver.addr);
+    if (connect(c.fd, reinterpret_cast<const sockaddr*>(&un), sizeof(un))) {
+      PLOG(INFO) << "connect failed " << nameserver.addr;
+      close_(c);
+      return false;
+    }
+  }
+  else {
+    LOG(WARNING) << "nameserver " << nameserver.addr << " is not an address";
+    return false;
+  }
 
-    POSIX::set_nonblocking(ns_fd_);
+  POSIX::set_nonblocking(c.fd);
 
-    if (nameserver.typ == Config::sock_type::stream) {
-      ns_sock_ = std::make_unique<Sock>(ns_fd_, ns_fd_);
-      if (FLAGS_log_dns_data) {
-        ns_sock_->log_data_on();
-      }
-      else {
-        ns_sock_->log_data_off();
-      }
+  if (stream) {
+    c.sock = std::make_unique<Sock>(c.fd, c.fd);
+    if (FLAGS_log_dns_data) {
+      c.sock->log_data_on();
+    }
+    else {
+      c.sock->log_data_off();
+    }
 
-      if (port != 53) {
-        DNS::RR_collection tlsa_rrs; // empty FIXME!
-        ns_sock_->starttls_client(config_path, nullptr, nameserver.host,
-                                  tlsa_rrs, false);
-        if (ns_sock_->verified()) {
-          ns_fd_ = -1;
-          return;
-        }
-        close(ns_fd_);
-        ns_fd_ = -1;
-        continue;
+    if (uses_tls(nameserver)) {
+      DNS::RR_collection tlsa_rrs; // empty FIXME!
+      c.sock->starttls_client(config_path_, nullptr, nameserver.host, tlsa_rrs,
+                              false);
+      if (!c.sock->verified()) {
+        close_(c);
+        return false;
       }
-      ns_fd_ = -1;
+      c.via = transport::tls;
     }
+  }
 
+  return true;
+}
+
+void Resolver::close_(connection& c)
+{
+  if (c.sock) {
+    c.sock->close_fds();
+    c.sock.reset();
+  }
+  else if (c.fd != -1) {
+    close(c.fd);
+  }
+  c.fd = -1;
+}
+
+// Answers still owed on c that we've stopped waiting for.  A stream
+// that failed part way through may be out of step, so it's replaced;
+// late datagrams are passed over by answer_.  With no nameserver left
+// to replace it, the primary is left closed until reopen_ finds one.
+void Resolver::lost_(connection& c)
+{
+  if (!c.sock)
+    return;
+
+  if (connect_(c, c.ns))
+    return;
+  health_.failure(c.key);
+
+  if (&c != &primary_)
+    return;
+  if (hedge_.fd != -1) {
+    std::swap(primary_, hedge_);
     return;
   }
+  while (next_ < order_.size()) {
+    auto const ns = order_[next_++];
+    if (connect_(primary_, ns))
+      return;
+    health_.failure(key_of(nameservers()[ns]));
+  }
+  LOG(WARNING) << "no nameservers left to try";
+}
 
-  LOG(FATAL) << "no nameservers left to try";
+// A primary left closed by lost_, connected again before an exchange:
+// to the hedge if that's open, else to the best of the nameservers that
+// will have us, as they may have come back.  False if none will.
+bool Resolver::reopen_()
+{
+  if (primary_.fd != -1)
+    return true;
+  if (hedge_.fd != -1) {
+    std::swap(primary_, hedge_);
+    return true;
+  }
+  for (auto const ns : order_) {
+    if (connect_(primary_, ns))
+      return true;
+    health_.failure(key_of(nameservers()[ns]));
+  }
+  return false;
 }
 
-message Resolver::xchg(message const& q)
+// An owed answer that hasn't come within the read timeout is a
+// failure; should it come after all, it's passed over unasked for.
+void Resolver::expire_(connection& c)
+{
+  auto const now = std::chrono::steady_clock::now();
+  std::erase_if(c.stale, [&](auto const& owed) {
+    if (now - owed.second < Config::read_timeout)
+      return false;
+    health_.failure(c.key);
+    return true;
+  });
+}
+
+// The next best nameserver after the one we have, connected the first
+// time it's needed.
+bool Resolver::open_hedge_()
 {
-  if (Config::nameservers[ns_].typ == Config::sock_type::stream) {
-    CHECK_EQ(ns_fd_, -1);
+  if (hedge_.fd != -1)
+    return true;
+  if (hedge_tried_)
+    return false;
+  hedge_tried_ = true;
+
+  while (next_ < order_.size()) {
+    auto const ns = order_[next_++];
+    if (connect_(hedge_, ns))
+      return true;
+    health_.failure(key_of(nameservers()[ns]));
+  }
+  return false;
+}
 
+void Resolver::send_(connection& c, message const& q, bool flush)
+{
+  if (c.sock) {
     uint16_t sz = htons(std::size(q));
+    c.sock->out().write(reinterpret_cast<char const*>(&sz), sizeof sz);
+    c.sock->out().write(reinterpret_cast<char const*>(begin(q)), size(q));
+    if (flush)
+      c.sock->out().flush();
+  }
+  else {
+    CHECK_EQ(send(c.fd, std::begin(q), std::size(q), 0), std::size(q));
+  }
+  c.sent = std::chrono::steady_clock::now();
+}
 
-    ns_sock_->out().write(reinterpret_cast<char const*>(&sz), sizeof sz);
-    ns_sock_->out().write(reinterpret_cast<char const*>(begin(q)), size(q));
-    ns_sock_->out().flush();
+// An answer may already be sitting in the stream's buffer, where
+// select(2) can't see it.
+bool Resolver::ready_(connection& c, std::chrono::milliseconds wait)
+{
+  if (c.sock)
+    return (c.sock->in().rdbuf()->in_avail() > 0) || c.sock->input_ready(wait);
+  return POSIX::input_ready(c.fd, wait);
+}
 
-    sz = 0;
-    ns_sock_->in().read(reinterpret_cast<char*>(&sz), sizeof sz);
+message Resolver::read_one_(connection& c)
+{
+  if (c.sock) {
+    uint16_t sz = 0;
+    c.sock->in().read(reinterpret_cast<char*>(&sz), sizeof sz);
     sz = ntohs(sz);
 
     DNS::message::container_t bfr(sz);
-    ns_sock_->in().read(reinterpret_cast<char*>(bfr.data()), sz);
-    CHECK_EQ(ns_sock_->in().gcount(), std::streamsize(sz));
+    c.sock->in().read(reinterpret_cast<char*>(bfr.data()), sz);
 
-    if (!ns_sock_->in()) {
+    if (!c.sock->in() || (c.sock->in().gcount() != sz)) {
       LOG(WARNING) << "Resolver::xchg was able to read only "
-                   << ns_sock_->in().gcount() << " octets";
+                   << c.sock->in().gcount() << " octets";
+      return message{0};
     }
 
     return message{std::move(bfr)};
   }
 
-  CHECK(Config::nameservers[ns_].typ == Config::sock_type::dgram);
-  CHECK_GE(ns_fd_, 0);
-
-  CHECK_EQ(send(ns_fd_, std::begin(q), std::size(q), 0), std::size(q));
-
   DNS::message::container_t bfr(Config::max_udp_sz);
 
   auto constexpr hook{[]() {}};
   auto       t_o{false};
-  auto const a_buf = reinterpret_cast<char*>(bfr.data());
-  auto const a_buflen = POSIX::read(ns_fd_, a_buf, int(Config::max_udp_sz),
-                                    hook, Config::read_timeout, t_o);
+  auto const a_buf    = reinterpret_cast<char*>(bfr.data());
+  auto const a_buflen = POSIX::read(c.fd, a_buf, int(Config::max_udp_sz), hook,
+                                    Config::read_timeout, t_o);
 
   if (a_buflen < 0) {
     LOG(WARNING) << "DNS read failed";
@@ -283,85 +496,438 @@ message Resolver::xchg(message const& q)
   return message{std::move(bfr)};
 }
 
-RR_collection Resolver::get_records(RR_type typ, char const* name)
+// The first answer to one of ids to come on any of cs.  Answers owed
+// to queries we stopped waiting for are passed over, timed as they go;
+// so are any we never asked for.  A connection that fails to read is
+// left out from then on.  Null if nothing comes by the deadline.
+Resolver::connection*
+Resolver::answer_(std::vector<connection*>              cs,
+                  std::unordered_set<uint16_t> const&   ids,
+                  std::chrono::steady_clock::time_point deadline,
+                  message&                              a)
 {
-  Query q(*this, typ, name);
-  return q.get_records();
+  using namespace std::chrono;
+
+  while (!cs.empty()) {
+    for (auto it = cs.begin(); it != cs.end();) {
+      auto const c = *it;
+      if (!ready_(*c, milliseconds(0))) {
+        ++it;
+        continue;
+      }
+      a = read_one_(*c);
+      if (!size(a)) {
+        it = cs.erase(it);
+        continue;
+      }
+      if (size(a) < min_message_sz())
+        continue;
+      if (ids.count(a.id()))
+        return c;
+      if (auto const owed = c->stale.find(a.id()); owed != c->stale.end()) {
+        health_.sample(c->key, duration_cast<microseconds>(steady_clock::now()
+                                                           - owed->second));
+        c->stale.erase(owed);
+      }
+    }
+    if (cs.empty())
+      break;
+
+    auto const now = steady_clock::now();
+    if (now >= deadline)
+      break;
+    auto const wait = duration_cast<microseconds>(deadline - now);
+
+    auto fds{fd_set{}};
+    FD_ZERO(&fds);
+    auto nfds = 0;
+    for (auto c : cs) {
+      FD_SET(c->fd, &fds);
+      nfds = std::max(nfds, c->fd + 1);
+    }
+
+    auto tv{timeval{}};
+    tv.tv_sec  = duration_cast<seconds>(wait).count();
+    tv.tv_usec = wait.count() % 1'000'000;
+
+    PCHECK(select(nfds, &fds, nullptr, nullptr, &tv) != -1);
+  }
+
+  a = message{0};
+  return nullptr;
 }
 
-std::vector<std::string> Resolver::get_strings(RR_type typ, char const* name)
+// RFC 7766 section 5: a truncated answer over UDP means ask again over
+// TCP.  The questions go out together, on a connection kept for this.
+void Resolver::retry_truncated_(std::vector<message> const& qs,
+                                std::vector<message>&       as)
 {
-  Query q(*this, typ, name);
-  return q.get_strings();
+  if (answered_->sock)
+    return;
+
+  auto const truncated = [](message const& a) {
+    return (size(a) >= min_message_sz()) && a.truncation();
+  };
+
+  std::unordered_set<uint16_t> ids;
+  for (auto const& a : as) {
+    if (truncated(a))
+      ids.insert(a.id());
+  }
+  if (ids.empty())
+    return;
+
+  if (((tcp_.fd == -1) || (tcp_.ns != answered_->ns))
+      && !connect_(tcp_, answered_->ns, true)) {
+    LOG(WARNING) << "unable to ask again over TCP for truncated answers";
+    return;
+  }
+
+  for (auto const& q : qs) {
+    if (ids.count(q.id())) {
+      send_(tcp_, q, false);
+      ++retries_[q.id()];
+    }
+  }
+  tcp_.sock->out().flush();
+
+  for (auto n = ids.size(); n; --n) {
+    auto t = read_one_(tcp_);
+    if (size(t) < min_message_sz()) {
+      close_(tcp_);
+      return;
+    }
+    auto const a = std::find_if(begin(as), end(as), [&](auto const& a) {
+      return truncated(a) && (a.id() == t.id());
+    });
+    if (a != end(as)) {
+      over_tcp_.insert(t.id());
+      *a = std::move(t);
+    }
+  }
 }
 
-bool Query::xchg_(Resolver& res, uint16_t id)
+// If the answer hasn't come by the time most answers from this server
+// would have, ask the next best one too and take whichever comes first.
+// Each is timed from its own query.
+message Resolver::xchg(message const& q)
 {
-  auto tries = 3;
+  using namespace std::chrono;
+
+  answered_ = &primary_;
+  hedged_   = false;
+  retries_.clear();
+  over_tcp_.clear();
+
+  if (!reopen_()) {
+    LOG(WARNING) << "no nameserver to ask";
+    return message{0};
+  }
 
-  while (tries) {
+  std::unordered_set<uint16_t> const ids{q.id()};
+
+  send_(primary_, q);
+  auto const deadline = primary_.sent + Config::read_timeout;
+
+  auto a = message{0};
+  auto c = answer_({&primary_}, ids,
+                   primary_.sent + health_.hedge_delay(primary_.key), a);
+  auto const broken = [](connection const& c) {
+    return c.sock && !c.sock->in();
+  };
+
+  if (!c) {
+    std::vector<connection*> cs;
+    if (!broken(primary_))
+      cs.push_back(&primary_);
+    if (open_hedge_()) {
+      send_(hedge_, q);
+      hedged_ = true;
+      ++retries_[q.id()];
+      cs.push_back(&hedge_);
+    }
+    c = answer_(cs, ids, deadline, a);
+  }
 
-    a_ = res.xchg(q_);
+  if (c) {
+    health_.sample(c->key,
+                   duration_cast<microseconds>(steady_clock::now() - c->sent));
 
-    if (!size(a_)) {
-      bogus_or_indeterminate_ = true;
-      LOG(WARNING) << "no reply from nameserver";
-      return false;
+    // The faster one gets the questions from now on.
+    if (c == &hedge_) {
+      std::swap(primary_, hedge_);
+      c = &primary_;
     }
+    answered_ = c;
+  }
 
-    if (size(a_) < min_message_sz()) {
-      bogus_or_indeterminate_ = true;
-      LOG(WARNING) << "packet too small";
-      return false;
+  // Those that didn't answer still owe us one: a failure if it doesn't
+  // come in time, its real latency if it does.  A broken stream is
+  // replaced.
+  for (auto o : {&hedge_, &primary_}) {
+    if ((o == c) || ((o == &hedge_) && !hedged_))
+      continue;
+    if (broken(*o)) {
+      health_.failure(o->key);
+      lost_(*o);
+      continue;
     }
+    o->stale.emplace(q.id(), o->sent);
+  }
+  expire_(primary_);
+  expire_(hedge_);
+
+  if (!c) {
+    LOG(WARNING) << "DNS read timed out";
+    return a;
+  }
+
+  if (!answered_->sock) {
+    std::vector<message> as;
+    as.push_back(std::move(a));
+    retry_truncated_({q}, as);
+    a = std::move(as.front());
+  }
+
+  return a;
+}
+
+// Batches go only to the primary, which works on them all at once.
+std::vector<message> Resolver::xchg(std::vector<message> const& qs)
+{
+  using namespace std::chrono;
+
+  auto const start = steady_clock::now();
+
+  answered_ = &primary_;
+  hedged_   = false;
+  retries_.clear();
+  over_tcp_.clear();
+
+  if (!reopen_()) {
+    LOG(WARNING) << "no nameserver to ask";
+    return {};
+  }
 
-    if (a_.id() == id)
+  std::unordered_set<uint16_t> ids;
+
+  // RFC 7766 section 6.2.1.1, query pipelining.
+  for (auto const& q : qs) {
+    send_(primary_, q, false);
+    ids.insert(q.id());
+  }
+  if (primary_.sock)
+    primary_.sock->out().flush();
+
+  std::vector<message> as;
+  as.reserve(qs.size());
+
+  // The whole batch gets one read timeout, and an answer that comes
+  // twice counts once.
+  auto const deadline = start + Config::read_timeout;
+  while (as.size() < qs.size()) {
+    auto a = message{0};
+    if (!answer_({&primary_}, ids, deadline, a))
       break;
+    ids.erase(a.id());
+    as.push_back(std::move(a));
+  }
 
-    LOG(WARNING) << "packet out of order; ids don't match, got " << a_.id()
-                 << " expecting " << id;
-    --tries;
+  if (as.size() == qs.size()) {
+    health_.sample(primary_.key,
+                   duration_cast<microseconds>(steady_clock::now() - start));
+  }
+  else {
+    health_.failure(primary_.key);
+    lost_(primary_);
   }
 
-  if (tries)
-    return true;
+  retry_truncated_(qs, as);
 
-  bogus_or_indeterminate_ = true;
-  LOG(WARNING) << "no tries left, giving up";
+  return as;
+}
 
-  return false;
+transport Resolver::via(uint16_t id) const
+{
+  return over_tcp_.count(id) ? transport::tcp : answered_->via;
 }
 
-Query::Query(Resolver& res, RR_type type, char const* name)
-  : type_(type)
+int Resolver::retries(uint16_t id) const
 {
-  static_assert(std::numeric_limits<uint16_t>::min() == 0);
-  static_assert(std::numeric_limits<uint16_t>::max() == 65535);
+  auto const r = retries_.find(id);
+  return (r == retries_.end()) ? 0 : r->second;
+}
+
+void Resolver::trace(trace_record&& tr)
+{
+  if (trace_.size() < Config::max_trace)
+    trace_.push_back(std::move(tr));
+  else
+    ++trace_dropped_;
+}
+
+void Resolver::log_trace() const
+{
+  if (trace_.empty())
+    return;
+
+  auto cached  = 0;
+  auto failed  = 0;
+  auto total   = std::chrono::microseconds{0};
+  auto slowest = trace_.begin();
+  for (auto it = trace_.begin(); it != trace_.end(); ++it) {
+    if (it->cache != cache_outcome::miss)
+      ++cached;
+    if (it->bogus_or_indeterminate)
+      ++failed;
+    total += it->latency;
+    if (it->latency > slowest->latency)
+      slowest = it;
+  }
+
+  LOG(INFO) << "DNS " << trace_.size() << " queries, " << cached
+            << " from cache, " << failed << " failed, " << total.count() / 1000
+            << " ms in all; slowest " << *slowest;
+  if (trace_dropped_)
+    LOG(INFO) << "DNS " << trace_dropped_ << " more queries not traced";
+}
+
+RR_collection Resolver::get_records(RR_type typ, char const* name)
+{
+  Query q(*this, typ, name);
+  return q.get_records();
+}
 
-  uint16_t id =
-      std::experimental::randint(std::numeric_limits<uint16_t>::min(),
-                                 std::numeric_limits<uint16_t>::max());
+std::vector<std::string> Resolver::get_strings(RR_type typ, char const* name)
+{
+  Query q(*this, typ, name);
+  return q.get_strings();
+}
 
+// The Resolver hands back only the answer to our id, having passed
+// over any others.
+bool Query::xchg_(Resolver& res)
+{
+  a_ = res.xchg(q_);
+
+  if (!size(a_)) {
+    bogus_or_indeterminate_ = true;
+    LOG(WARNING) << "no reply from nameserver";
+    return false;
+  }
+
+  if (size(a_) < min_message_sz()) {
+    bogus_or_indeterminate_ = true;
+    LOG(WARNING) << "packet too small";
+    return false;
+  }
+
+  return true;
+}
+
+Query::Query(RR_type type, char const* name, uint16_t id)
+  : type_(type)
+{
   uint16_t cls = ns_c_in;
 
   q_ = create_question(name, type, cls, id);
+}
 
-  if (!xchg_(res, id))
-    return;
+Query::Query(Resolver& res, RR_type type, char const* name)
+  : Query(type, name, random_id())
+{
+  auto const start = std::chrono::steady_clock::now();
+
+  if (xchg_(res))
+    answer_(name);
+
+  trace_(res, name, start);
+}
+
+void Query::trace_(Resolver&                             res,
+                   char const*                           name,
+                   std::chrono::steady_clock::time_point start) const
+{
+  using namespace std::chrono;
+  trace_record tr;
+  tr.qname                  = name;
+  tr.qtype                  = type_;
+  tr.via                    = res.via(q_.id());
+  tr.ns                     = res.ns();
+  tr.hedged                 = res.hedged();
+  tr.retries                = res.retries(q_.id());
+  tr.rcode                  = rcode_;
+  tr.authentic_data         = authentic_data_;
+  tr.bogus_or_indeterminate = bogus_or_indeterminate_;
+  tr.answer_size            = size(a_);
+  tr.latency = duration_cast<microseconds>(steady_clock::now() - start);
+  res.trace(std::move(tr));
+}
+
+std::vector<std::unique_ptr<Query>>
+Query::batch(Resolver& res, std::vector<question> const& questions)
+{
+  std::vector<std::unique_ptr<Query>> queries;
+  std::vector<message>                qs;
+  std::unordered_set<uint16_t>        ids;
+
+  for (auto const& [type, name] : questions) {
+    auto id = random_id();
+    while (!ids.insert(id).second)
+      id = random_id();
+    queries.emplace_back(new Query(type, name.c_str(), id));
+    qs.push_back(queries.back()->q_);
+  }
+
+  auto const start = std::chrono::steady_clock::now();
+
+  auto answers = res.xchg(qs);
+
+  for (auto& a : answers) {
+    if (size(a) < min_message_sz()) {
+      LOG(WARNING) << "packet too small";
+      continue;
+    }
+    auto const q = std::find_if(begin(queries), end(queries), [&a](auto& q) {
+      return (q->q_.id() == a.id()) && !size(q->a_);
+    });
+    if (q == end(queries)) {
+      LOG(WARNING) << "unexpected answer with id " << a.id();
+      continue;
+    }
+    (*q)->a_ = std::move(a);
+  }
 
+  for (auto i = 0u; i < queries.size(); ++i) {
+    if (!size(queries[i]->a_)) {
+      queries[i]->bogus_or_indeterminate_ = true;
+      LOG(WARNING) << "no reply from nameserver for " << questions[i].second
+                   << '/' << questions[i].first;
+    }
+    else {
+      queries[i]->answer_(questions[i].second.c_str());
+    }
+    queries[i]->trace_(res, questions[i].second.c_str(), start);
+  }
+
+  return queries;
+}
+
+void Query::answer_(char const* name)
+{
   if (size(a_) < min_message_sz()) {
     bogus_or_indeterminate_ = true;
-    LOG(INFO) << "bad (or no) reply for " << name << '/' << type;
+    LOG(INFO) << "bad (or no) reply for " << name << '/' << type_;
     return;
   }
 
   check_answer(nx_domain_, bogus_or_indeterminate_, rcode_, extended_rcode_,
-               truncation_, authentic_data_, has_record_, q_, a_, type, name);
+               truncation_, authentic_data_, has_record_, q_, a_, type_, name);
 
   if (truncation_) {
-    // if UDP, retry with TCP
+    // Even after the Resolver asked again over TCP.
     bogus_or_indeterminate_ = true;
-    LOG(INFO) << "truncated answer for " << name << '/' << type;
+    LOG(INFO) << "truncated answer for " << name << '/' << type_;
   }
 }
 
@@ -395,3 +961,28 @@ std::vector<std::string> Query::get_strings()
 }
 
 } // namespace DNS
+
+std::ostream& operator<<(std::ostream& os, DNS::trace_record const& tr)
+{
+  os << tr.qname << '/' << tr.qtype;
+
+  switch (tr.cache) {
+  case DNS::cache_outcome::local_hit: return os << " cached";
+  case DNS::cache_outcome::shared_hit: return os << " cached (shared)";
+  case DNS::cache_outcome::miss: break;
+  }
+
+  constexpr char const* via_names[]{"udp", "tcp", "tls"};
+  os << ' ' << via_names[static_cast<int>(tr.via)] << " ns" << tr.ns;
+  if (tr.hedged)
+    os << " hedged";
+  if (tr.bogus_or_indeterminate)
+    os << " failed";
+  os << " rcode " << tr.rcode;
+  if (tr.authentic_data)
+    os << " AD";
+  os << ' ' << tr.answer_size << " octets";
+  if (tr.retries)
+    os << ' ' << tr.retries << " retries";
+  return os << ' ' << tr.latency.count() / 1000.0 << " ms";
+}
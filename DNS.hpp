@@ -1,8 +1,16 @@
 #ifndef DNS_DOT_HPP
 #define DNS_DOT_HPP
 
+#include <chrono>
 #include <memory>
-
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "DNS-health.hpp"
 #include "DNS-message.hpp"
 #include "DNS-rrs.hpp"
 #include "Sock.hpp"
@@ -12,12 +20,39 @@
 
 namespace DNS {
 
+enum class transport : uint8_t { udp, tcp, tls };
+
+enum class cache_outcome : uint8_t {
+  miss,       // asked the nameserver
+  local_hit,  // answered from a cache in this process
+  shared_hit, // answered from a SharedCache
+};
+
+// One query, as the Resolver saw it.  For a batch, the latency is the
+// time for the whole batch.
+struct trace_record {
+  std::string               qname;
+  RR_type                   qtype;
+  transport                 via{transport::tcp};
+  cache_outcome             cache{cache_outcome::miss};
+  int                       ns{-1};      // index into the nameserver list
+  int                       retries{0};  // hedged, or asked again over TCP
+  uint16_t                  rcode{0};
+  bool                      authentic_data{false};
+  bool                      bogus_or_indeterminate{false};
+  bool                      hedged{false}; // also asked another server
+  uint16_t                  answer_size{0};
+  std::chrono::microseconds latency{0};
+};
+
 class Resolver {
 public:
   Resolver(Resolver const&) = delete;
   Resolver& operator=(Resolver const&) = delete;
 
+  // Connects to the best of the nameservers by DNS::health.
   Resolver(fs::path config_path);
+  ~Resolver();
 
   RR_collection get_records(RR_type typ, char const* name);
   RR_collection get_records(RR_type typ, std::string const& name)
@@ -33,10 +68,82 @@ public:
 
   message xchg(message const& q);
 
+  // Send all the questions before reading any answer, so the
+  // nameserver can work on them concurrently.  Answers are returned
+  // in the order they arrive, match them up by id.
+  std::vector<message> xchg(std::vector<message> const& qs);
+
+  // Every query made through this Resolver, and any answered from a
+  // cache in front of it, as reported by the cache.
+  void trace(trace_record&& tr);
+  std::vector<trace_record> const& trace() const { return trace_; }
+
+  // One line for the lot: how many, how long, the slowest.
+  void log_trace() const;
+
+  // Of the last exchange: which nameserver answered, and whether the
+  // question went to a second one as well.  For the question with id,
+  // how its answer came, and how many more times it was asked: of
+  // another server, or over TCP after a truncated answer.
+  transport via(uint16_t id) const;
+  int       retries(uint16_t id) const;
+  int       ns() const { return answered_->ns; }
+  bool      hedged() const { return hedged_; }
+
 private:
-  std::unique_ptr<Sock> ns_sock_;
-  int                   ns_;
-  int                   ns_fd_;
+  // A nameserver, over a Sock for TCP and TLS, or a connected UDP
+  // socket.
+  struct connection {
+    std::unique_ptr<Sock> sock;
+    int                   fd{-1};
+    int                   ns{-1};
+    transport             via{transport::tcp};
+    std::string           key; // in health_
+
+    std::chrono::steady_clock::time_point sent; // the last query
+
+    // Answers owed to queries we stopped waiting for, by id, with when
+    // each was sent: a late one is timed as it's passed over.
+    std::unordered_map<uint16_t, std::chrono::steady_clock::time_point>
+        stale;
+  };
+
+  // With tcp, a UDP nameserver is connected to over TCP instead.
+  bool connect_(connection& c, std::size_t ns, bool tcp = false);
+  void close_(connection& c);
+  void lost_(connection& c);
+  bool reopen_();
+  void expire_(connection& c);
+  bool open_hedge_();
+
+  void send_(connection& c, message const& q, bool flush = true);
+  bool ready_(connection& c, std::chrono::milliseconds wait);
+  message     read_one_(connection& c);
+  connection* answer_(std::vector<connection*>              cs,
+                      std::unordered_set<uint16_t> const&   ids,
+                      std::chrono::steady_clock::time_point deadline,
+                      message&                              a);
+  void        retry_truncated_(std::vector<message> const& qs,
+                               std::vector<message>&       as);
+
+  fs::path config_path_;
+
+  health                   health_;
+  std::vector<std::size_t> order_;   // of the nameservers, best first
+  std::size_t              next_{0}; // in order_, to try next
+
+  connection  primary_;
+  connection  hedge_; // connected the first time it's needed
+  bool        hedge_tried_{false};
+  connection  tcp_; // for answers too big for a datagram
+  connection* answered_{&primary_};
+  bool        hedged_{false};
+
+  std::unordered_map<uint16_t, int> retries_;  // by id, of the last exchange
+  std::unordered_set<uint16_t>      over_tcp_; // answers retry_truncated_ got
+
+  std::vector<trace_record> trace_;
+  std::size_t               trace_dropped_{0};
 };
 
 class Query {
@@ -62,9 +169,27 @@ public:
   uint16_t rcode() const { return rcode_; }
   uint16_t extended_rcode() const { return extended_rcode_; }
 
+  uint32_t min_ttl() const
+  {
+    return bogus_or_indeterminate_ ? 0 : DNS::min_ttl(a_);
+  }
+
+  using question = std::pair<RR_type, std::string>;
+
+  // Ask all the questions at once; the queries are returned in the
+  // same order as the questions.
+  static std::vector<std::unique_ptr<Query>>
+  batch(Resolver& res, std::vector<question> const& questions);
+
 private:
-  bool xchg_(Resolver& res, uint16_t id);
+  Query(RR_type type, char const* name, uint16_t id);
+
+  bool xchg_(Resolver& res);
+  void answer_(char const* name);
   void check_answer_(Resolver& res, RR_type type, char const* name);
+  void trace_(Resolver&                             res,
+              char const*                           name,
+              std::chrono::steady_clock::time_point start) const;
 
   uint16_t rcode_{0};
   uint16_t extended_rcode_{0};
@@ -105,4 +230,7 @@ inline bool has_record(Resolver& res, RR_type type, std::string const& name)
 }
 } // namespace DNS
 
+// As dns_tool --trace prints them.
+std::ostream& operator<<(std::ostream& os, DNS::trace_record const& tr);
+
 #endif // DNS_DOT_HPP
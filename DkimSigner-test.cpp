@@ -0,0 +1,174 @@
+#include "DkimSigner.hpp"
+
+#include "Base64.hpp"
+#include "DKIM-test-keys.hpp"
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <fmt/format.h>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+namespace {
+std::string b64_sha256(std::string_view s)
+{
+  unsigned char md[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<unsigned char const*>(s.data()), s.size(), md);
+  return Base64::enc(
+      std::string_view(reinterpret_cast<char const*>(md), sizeof(md)));
+}
+
+// The value of tag in a DKIM-Signature, less any folding white space.
+std::string tag(std::string_view sig, std::string_view name)
+{
+  auto const t   = fmt::format("{}=", name);
+  auto       pos = sig.find(t);
+  while ((pos != std::string_view::npos) && pos &&
+         !std::strchr(" \t;", sig[pos - 1]))
+    pos = sig.find(t, pos + 1);
+  CHECK_NE(pos, std::string_view::npos) << "no " << name << "= in " << sig;
+  auto val = sig.substr(pos + t.size());
+  val      = val.substr(0, val.find(';'));
+
+  std::string ret;
+  for (auto ch : val)
+    if (!isspace(static_cast<unsigned char>(ch)))
+      ret += ch;
+  return ret;
+}
+
+// Good enough for the simple fields in these tests.
+std::string relaxed(std::string_view name, std::string_view value)
+{
+  std::string ret(name);
+  ret += ':';
+  auto wsp = false;
+  for (auto ch : value) {
+    if (ch == '\r' || ch == '\n')
+      continue;
+    if (ch == ' ' || ch == '\t') {
+      wsp = true;
+      continue;
+    }
+    if (wsp && ret.back() != ':')
+      ret += ' ';
+    wsp = false;
+    ret += ch;
+  }
+  return ret;
+}
+
+bool verify(EVP_PKEY* key, std::string const& data, std::string const& sig)
+{
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(
+      EVP_MD_CTX_new(), EVP_MD_CTX_free);
+
+  auto const b  = Base64::dec(tag(sig, "b"));
+  auto const bp = reinterpret_cast<unsigned char const*>(b.data());
+  auto const dp = reinterpret_cast<unsigned char const*>(data.data());
+
+  if (EVP_PKEY_id(key) == EVP_PKEY_ED25519) {
+    unsigned char md[SHA256_DIGEST_LENGTH];
+    SHA256(dp, data.size(), md);
+    CHECK_EQ(EVP_DigestVerifyInit(ctx.get(), nullptr, nullptr, nullptr, key),
+             1);
+    return EVP_DigestVerify(ctx.get(), bp, b.size(), md, sizeof(md)) == 1;
+  }
+  CHECK_EQ(
+      EVP_DigestVerifyInit(ctx.get(), nullptr, EVP_sha256(), nullptr, key), 1);
+  return EVP_DigestVerify(ctx.get(), bp, b.size(), dp, data.size()) == 1;
+}
+
+void check_sig(EVP_PKEY* key, std::string const& sig)
+{
+  CHECK_EQ(tag(sig, "d"), "example.com");
+  CHECK_EQ(tag(sig, "h"), "from:to:subject");
+
+  // The signed data: the fields named in h=, then this one, less b=.
+  auto data = "from:Alice <alice@example.com>\r\n"
+              "to:bob@example.com\r\n"
+              "subject:Hello there\r\n"s;
+  data += relaxed("dkim-signature", sig.substr(0, sig.rfind("\tb=") + 3));
+
+  CHECK(verify(key, data, sig)) << sig;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  auto const dir = fs::temp_directory_path();
+  auto const pid      = std::to_string(getpid());
+  auto const rsa_file = dir / ("DkimSigner-test-rsa-"s + pid);
+  auto const ed_file  = dir / ("DkimSigner-test-ed-"s + pid);
+
+  auto const rsa_key = gen_key(EVP_PKEY_RSA);
+  auto const ed_key  = gen_key(EVP_PKEY_ED25519);
+  write_key(rsa_key, rsa_file);
+  write_key(ed_key, ed_file);
+
+  DkimSigner signer;
+  signer.add_key("rsa", rsa_file);
+  signer.add_key("ed", ed_file);
+  CHECK(signer.has_key("rsa"));
+  CHECK(signer.has_key("ed"));
+  CHECK(!signer.has_key("nope"));
+
+  fs::remove(rsa_file);
+  fs::remove(ed_file);
+
+  // Empty bodies, RFC 6376 section 3.4.3 and 3.4.4.
+  DkimSigner::input empty;
+  empty.headers = {"From: alice@example.com\r\n"};
+  CHECK_EQ(tag(signer.sign("rsa", "example.com", empty), "bh"),
+           b64_sha256(""));
+  empty.typ = DkimSigner::body_type::binary;
+  CHECK_EQ(tag(signer.sign("rsa", "example.com", empty), "bh"),
+           b64_sha256("\r\n"));
+
+  DkimSigner::input in;
+  in.headers = {
+      "Received: from somewhere\r\n",
+      "From:  Alice <alice@example.com>\r\n",
+      "To: bob@example.com\r\n",
+      "Subject: Hello\r\n\t there \r\n",
+  };
+  // Split mid-line and between CR and LF.
+  in.body = {"Hi  Bob,\t \r", "\n\r\nHow are", " you? \r\n\r\n\r\n"};
+
+  auto const body_relaxed = "Hi Bob,\r\n\r\nHow are you?\r\n";
+  auto const body_simple  = "Hi  Bob,\t \r\n\r\nHow are you? \r\n";
+
+  auto const rsa_sig = signer.sign("rsa", "example.com", in);
+  CHECK_EQ(tag(rsa_sig, "a"), "rsa-sha256");
+  CHECK_EQ(tag(rsa_sig, "c"), "relaxed/relaxed");
+  CHECK_EQ(tag(rsa_sig, "bh"), b64_sha256(body_relaxed));
+  check_sig(rsa_key, rsa_sig);
+
+  auto const ed_sig = signer.sign("ed", "example.com", in);
+  CHECK_EQ(tag(ed_sig, "a"), "ed25519-sha256");
+  check_sig(ed_key, ed_sig);
+
+  in.typ = DkimSigner::body_type::binary;
+  auto const simple_sig = signer.sign("rsa", "example.com", in);
+  CHECK_EQ(tag(simple_sig, "c"), "relaxed/simple");
+  CHECK_EQ(tag(simple_sig, "bh"), b64_sha256(body_simple));
+  check_sig(rsa_key, simple_sig);
+
+  std::vector<DkimSigner::input> batch(17, in);
+  auto const sigs = signer.sign_many("ed", "example.com", batch);
+  CHECK_EQ(sigs.size(), batch.size());
+  for (auto const& sig : sigs)
+    check_sig(ed_key, sig);
+
+  EVP_PKEY_free(rsa_key);
+  EVP_PKEY_free(ed_key);
+}
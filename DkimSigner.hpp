@@ -0,0 +1,64 @@
+#ifndef DKIMSIGNER_DOT_HPP
+#define DKIMSIGNER_DOT_HPP
+
+// DKIM signatures (RFC 6376) made with private keys that are read and
+// parsed once per selector, then kept for the life of the process.
+// RSA keys sign with rsa-sha256, Ed25519 keys with ed25519-sha256
+// (RFC 8463).
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fs.hpp"
+
+struct evp_pkey_st;
+
+class DkimSigner {
+public:
+  DkimSigner(DkimSigner const&) = delete;
+  DkimSigner& operator=(DkimSigner const&) = delete;
+
+  DkimSigner() = default;
+  ~DkimSigner();
+
+  enum class body_type : bool {
+    binary, // c=relaxed/simple
+    text,   // c=relaxed/relaxed
+  };
+
+  struct input {
+    std::vector<std::string_view> headers; // whole fields, "Name: value"
+    std::vector<std::string_view> body;    // in as many pieces as you like
+    body_type                     typ{body_type::text};
+  };
+
+  // Load the PEM private key for a selector; the first key loaded for
+  // a selector is the one kept.
+  void add_key(std::string_view selector, fs::path const& key_file);
+  bool has_key(std::string_view selector) const;
+
+  // The value of a DKIM-Signature field for d=domain and s=selector.
+  std::string
+  sign(std::string_view selector, std::string_view domain, input const& msg);
+
+  // As sign() for each message, spread over a few threads.
+  std::vector<std::string> sign_many(std::string_view          selector,
+                                     std::string_view          domain,
+                                     std::vector<input> const& msgs);
+
+private:
+  std::string sign_(evp_pkey_st*     key,
+                    std::string_view selector,
+                    std::string_view domain,
+                    std::time_t      now,
+                    input const&     msg) const;
+
+  evp_pkey_st* key_(std::string_view selector) const;
+
+  std::map<std::string, evp_pkey_st*, std::less<>> keys_;
+};
+
+#endif // DKIMSIGNER_DOT_HPP
@@ -0,0 +1,62 @@
+#include "Domain.hpp"
+
+#include "Bench.hpp"
+#include "TLD.hpp"
+
+#include <string>
+
+#include <glog/logging.h>
+
+int main(int argc, char* argv[])
+{
+  Bench::suite suite("Domain", argc, argv);
+
+  struct {
+    char const* name;
+    char const* domain;
+  } const domains[]{
+      {"ascii", "mail.digilicious.com"},
+      {"upper", "MTA122B.PMX1.EPSL1.COM"},
+      {"utf8", "黒川.日本"},
+      {"a-label", "xn--5rtw95l.xn--wgv71a"},
+      {"literal", "[127.0.0.1]"},
+  };
+
+  for (auto const& d : domains) {
+    suite.run(std::string("set/") + d.name, [&](std::uint64_t n) {
+      Domain dom;
+      for (std::uint64_t i = 0; i < n; ++i) {
+        dom.set(d.domain);
+        Bench::keep(dom);
+      }
+    });
+  }
+
+  suite.run("match", [&](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i)
+      Bench::keep(
+          Domain::match("Mail.Digilicious.COM.", "mail.digilicious.com"));
+  });
+
+  TLD tld;
+
+  struct {
+    char const* name;
+    char const* domain;
+  } const hosts[]{
+      {"short", "digilicious.com"},
+      {"deep", "outmail14.phi.meetup.com"},
+      {"private", "foo.blogspot.com.ar"},
+      {"none", "not_a_domain_at_all"},
+  };
+
+  for (auto const& h : hosts) {
+    suite.run(std::string("registered_domain/") + h.name,
+              [&](std::uint64_t n) {
+                for (std::uint64_t i = 0; i < n; ++i)
+                  Bench::keep(tld.get_registered_domain(h.domain));
+              });
+  }
+
+  return suite.finish();
+}
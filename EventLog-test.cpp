@@ -0,0 +1,117 @@
+#include "EventLog.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <csignal>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+int main(int argc, char* argv[])
+{
+  using EventLog::event;
+
+  {
+    std::array<EventLog::field, 2> const f{"<>"sv, " BODY=8BITMIME"sv};
+    CHECK_EQ(EventLog::render(event::mail_from, f),
+             "MAIL FROM:<<>> BODY=8BITMIME");
+  }
+  {
+    std::array<EventLog::field, 2> const f{std::uint64_t{3},
+                                           std::uint64_t{1234}};
+    CHECK_EQ(EventLog::render(event::cpu_time, f),
+             "CPU time 3.000001234 seconds");
+  }
+  CHECK_EQ(EventLog::render(event::rset, {}), "RSET");
+
+  // Before open(), this goes to LOG(INFO).
+  EventLog::log(event::connect, "localhost [127.0.0.1]");
+
+  // A child timed out by SIGALRM, as smtp is, writes out what it logged
+  // before it goes, drain thread or no.  One the drain thread was
+  // writing as the signal came may go out twice.
+  {
+    auto const exit_path
+        = "/tmp/EventLog-test-exit-"s + std::to_string(getpid());
+    auto const pid       = fork();
+    PCHECK(pid != -1);
+    if (pid == 0) {
+      std::signal(SIGALRM, [](int) {
+        EventLog::flush_for_exit();
+        _Exit(1);
+      });
+      CHECK(EventLog::open(exit_path.c_str()));
+      for (auto i = 0; i < 10; ++i)
+        EventLog::log(event::rset);
+      raise(SIGALRM);
+    }
+    int status;
+    PCHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+
+    std::ifstream     exit_ifs(exit_path, std::ios::binary);
+    std::string const exit_file{std::istreambuf_iterator<char>(exit_ifs), {}};
+    std::string_view  buf{exit_file};
+    EventLog::record  rec;
+    auto n_recs = 0;
+    while (!buf.empty()) {
+      auto const n = EventLog::decode(buf, rec);
+      CHECK_NE(n, 0) << "at record " << n_recs;
+      CHECK(rec.type == event::rset);
+      buf.remove_prefix(n);
+      ++n_recs;
+    }
+    CHECK_GE(n_recs, 10);
+
+    unlink(exit_path.c_str());
+  }
+
+  auto const path = "/tmp/EventLog-test-"s + std::to_string(getpid());
+  CHECK(EventLog::open(path.c_str()));
+
+  // Enough to go round the ring a few times, with flushes along the
+  // way so nothing is dropped.
+  auto const n_events = 100'000;
+  for (auto i = 0; i < n_events; ++i) {
+    EventLog::log(event::delivered, i, "message-id-"s + std::to_string(i));
+    if (i % 1000 == 999)
+      EventLog::flush();
+  }
+  EventLog::log(event::quit);
+  EventLog::flush();
+  CHECK_EQ(EventLog::dropped(), 0);
+
+  std::ifstream     ifs(path, std::ios::binary);
+  std::string const file{std::istreambuf_iterator<char>(ifs), {}};
+  std::string_view  buf{file};
+  EventLog::record  rec;
+
+  for (auto i = 0; i < n_events; ++i) {
+    auto const n = EventLog::decode(buf, rec);
+    CHECK_NE(n, 0) << "at record " << i;
+    CHECK(rec.type == event::delivered);
+    CHECK_EQ(rec.pid, static_cast<std::uint32_t>(getpid()));
+    CHECK_EQ(EventLog::render(rec.type, rec.args()),
+             "message delivered, "s + std::to_string(i)
+                 + " octets, with id message-id-" + std::to_string(i));
+    buf.remove_prefix(n);
+  }
+  auto const n = EventLog::decode(buf, rec);
+  CHECK_NE(n, 0);
+  CHECK(rec.type == event::quit);
+  buf.remove_prefix(n);
+  CHECK(buf.empty());
+
+  // A short or damaged record isn't one.
+  CHECK_EQ(EventLog::decode(std::string_view(file).substr(0, 20), rec), 0);
+  CHECK_EQ(EventLog::decode(std::string(32, '\xFF'), rec), 0);
+
+  unlink(path.c_str());
+}
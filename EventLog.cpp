@@ -0,0 +1,450 @@
+#include "EventLog.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+namespace Config {
+// Enough for a few thousand events, to ride out a slow disk.
+constexpr std::size_t event_ring_size      = 1024 * 1024;
+constexpr auto        event_drain_interval = std::chrono::milliseconds{100};
+} // namespace Config
+
+namespace EventLog {
+
+namespace {
+// clang-format off
+constexpr std::string_view templates[]{
+  "",
+  "connect from {}",
+  "IP address okay",
+  "{} {}",
+  "{} {} from {}",
+  "MAIL FROM:<{}>{}",
+  "RCPT TO:<{}>",
+  "spf_received_ == {}",
+  "{} {}",
+  "{} since {}",
+  "Spam-Status: {}, {}",
+  "DATA",
+  "BDAT {}",
+  "BDAT {} LAST",
+  "waiting at {} {} seconds",
+  "done waiting",
+  "Message-ID: {}",
+  "From: {}",
+  "message delivered, {} octets, with id {}",
+  "RSET",
+  "QUIT",
+  "CPU time {}.{:09} seconds",
+};
+// clang-format on
+
+static_assert(std::size(templates) == static_cast<std::size_t>(event::end));
+
+// A record is this header, then each field as a tag octet followed by
+// either a number, eight octets, or a string, two octets of length and
+// the octets, all padded out to a multiple of eight.  Everything is in
+// host byte order; the file is read back on the machine that wrote it.
+struct header {
+  std::uint32_t size;
+  std::uint16_t type;
+  std::uint16_t n_fields;
+  std::uint32_t pid;
+  std::uint32_t reserved;
+  std::int64_t  time_ns;
+};
+static_assert(sizeof(header) == 24);
+
+constexpr std::size_t   align      = 8;
+constexpr std::size_t   max_string = 0xFFFF;
+constexpr std::size_t   max_fields = record{}.fields.size();
+constexpr std::uint8_t  tag_string = 's';
+constexpr std::uint8_t  tag_number = 'n';
+constexpr std::uint16_t pad_type   = static_cast<std::uint16_t>(event::pad);
+
+std::size_t encoded_size(std::span<field const> fields)
+{
+  auto size = sizeof(header);
+  for (auto const& f : fields) {
+    if (auto const s = std::get_if<std::string_view>(&f))
+      size += 1 + 2 + std::min(s->size(), max_string);
+    else
+      size += 1 + 8;
+  }
+  return (size + align - 1) & ~(align - 1);
+}
+
+char* encode(char* p, header const& h, std::span<field const> fields)
+{
+  std::memcpy(p, &h, sizeof(h));
+  p += sizeof(h);
+  for (auto const& f : fields) {
+    if (auto const s = std::get_if<std::string_view>(&f)) {
+      auto const len = static_cast<std::uint16_t>(
+          std::min(s->size(), max_string));
+      *p++ = tag_string;
+      std::memcpy(p, &len, sizeof(len));
+      std::memcpy(p + sizeof(len), s->data(), len);
+      p += sizeof(len) + len;
+    }
+    else {
+      auto const n = std::get<std::uint64_t>(f);
+      *p++         = tag_number;
+      std::memcpy(p, &n, sizeof(n));
+      p += sizeof(n);
+    }
+  }
+  return p;
+}
+
+// One writer, the thread calling log(), and one reader at a time,
+// either the drain thread or flush(), plus flush_for_exit() from a
+// signal handler, which takes no lock.  That last writes out all that
+// hasn't been drained, including any the drain thread is part way
+// through writing, so a record may go out twice as the process exits
+// but none is lost.  The positions only ever go up; a record never
+// wraps, the space left at the end of the ring is filled with a pad
+// record instead.
+class ring {
+public:
+  ~ring() { close(); }
+
+  bool open(char const* path);
+  bool is_open() const { return fd_ != -1; }
+
+  void put(event e, std::span<field const> fields);
+
+  void flush()
+  {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    drain_();
+  }
+
+  void flush_for_exit();
+
+  void close();
+
+  std::uint64_t dropped() const
+  {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr std::size_t cap = Config::event_ring_size;
+
+  struct size_type {
+    std::uint32_t size;
+    std::uint16_t type;
+  };
+  size_type peek_(std::uint64_t pos) const
+  {
+    size_type st;
+    std::memcpy(&st.size, buf_.get() + pos % cap, sizeof(st.size));
+    std::memcpy(&st.type, buf_.get() + pos % cap + 4, sizeof(st.type));
+    return st;
+  }
+
+  void drain_();
+  bool write_out_(std::uint64_t tail, std::uint64_t head) const;
+  bool write_(char const* p, std::size_t n) const;
+  void run_();
+
+  std::unique_ptr<char[]> buf_;
+
+  std::atomic<std::uint64_t> head_{0}; // written up to
+  std::atomic<std::uint64_t> tail_{0}; // drained up to
+  std::atomic<std::uint64_t> dropped_{0};
+
+  std::mutex              drain_mutex_; // never taken by the writer
+  std::condition_variable stop_cv_;
+  bool                    stop_{false};
+  std::thread             drainer_;
+  int                     fd_{-1};
+  std::uint32_t           pid_{0};
+};
+
+bool ring::open(char const* path)
+{
+  CHECK(!is_open()) << "event log already open";
+
+  fd_ = ::open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+  if (fd_ == -1) {
+    PLOG(WARNING) << "can't open event log " << path;
+    return false;
+  }
+
+  buf_ = std::make_unique<char[]>(cap);
+  pid_ = getpid();
+
+  drainer_ = std::thread(&ring::run_, this);
+  return true;
+}
+
+void ring::close()
+{
+  if (!is_open())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    stop_ = true;
+  }
+  stop_cv_.notify_one();
+  drainer_.join();
+  flush();
+
+  if (auto const n = dropped())
+    LOG(WARNING) << n << " events dropped, ring full";
+
+  ::close(fd_);
+  fd_ = -1;
+}
+
+void ring::put(event e, std::span<field const> fields)
+{
+  fields          = fields.first(std::min(fields.size(), max_fields));
+  auto const size = encoded_size(fields);
+
+  auto const head = head_.load(std::memory_order_relaxed);
+  auto const tail = tail_.load(std::memory_order_acquire);
+
+  auto       off  = head % cap;
+  auto const left = cap - off;
+  auto const need = (size <= left) ? size : left + size;
+
+  if ((size > cap / 4) || (head + need - tail > cap)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  if (size > left) {
+    std::uint32_t const pad_size = left;
+    std::memcpy(buf_.get() + off, &pad_size, sizeof(pad_size));
+    std::memcpy(buf_.get() + off + 4, &pad_type, sizeof(pad_type));
+    off = 0;
+  }
+
+  using namespace std::chrono;
+  header const h{
+      .size     = static_cast<std::uint32_t>(size),
+      .type     = static_cast<std::uint16_t>(e),
+      .n_fields = static_cast<std::uint16_t>(fields.size()),
+      .pid      = pid_,
+      .reserved = 0,
+      .time_ns  = duration_cast<nanoseconds>(
+                     system_clock::now().time_since_epoch())
+                     .count(),
+  };
+  auto const p = buf_.get() + off;
+  auto const q = encode(p, h, fields);
+  std::memset(q, 0, size - (q - p));
+
+  head_.store(head + need, std::memory_order_release);
+}
+
+// Caller holds drain_mutex_.
+void ring::drain_()
+{
+  auto const head = head_.load(std::memory_order_acquire);
+  auto const tail = tail_.load(std::memory_order_relaxed);
+
+  if (!write_out_(tail, head))
+    PLOG(WARNING) << "event log write failed";
+  tail_.store(head, std::memory_order_release);
+}
+
+// Only atomics and write(2), to be called from a signal handler: the
+// process is on its way out, so nothing is logged and tail_ is left.
+// Everything from tail_ goes out, since the drain thread may have
+// stopped, or be stopped, anywhere short of advancing it; the writer
+// doesn't reuse the space until it has.
+void ring::flush_for_exit()
+{
+  if (!is_open())
+    return;
+  auto const head = head_.load(std::memory_order_acquire);
+  auto const tail = tail_.load(std::memory_order_acquire);
+  write_out_(tail, head);
+}
+
+bool ring::write_out_(std::uint64_t tail, std::uint64_t const head) const
+{
+  // Each run of records up to a pad or the end of the ring goes out in
+  // one write(2), so with O_APPEND it lands whole, between the writes
+  // of other processes.
+  while (tail != head) {
+    if (peek_(tail).type == pad_type) {
+      tail += peek_(tail).size;
+      continue;
+    }
+    auto const start = tail;
+    do {
+      tail += peek_(tail).size;
+    } while ((tail != head) && (tail % cap) &&
+             (peek_(tail).type != pad_type));
+
+    if (!write_(buf_.get() + start % cap, tail - start))
+      return false;
+  }
+  return true;
+}
+
+bool ring::write_(char const* p, std::size_t n) const
+{
+  while (n) {
+    auto const w = ::write(fd_, p, n);
+    if (w == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+void ring::run_()
+{
+  std::unique_lock<std::mutex> lock(drain_mutex_);
+  while (!stop_) {
+    stop_cv_.wait_for(lock, Config::event_drain_interval);
+    drain_();
+  }
+}
+
+// Drained, and the file closed, when the process exits by way of
+// std::exit() or a return from main().
+ring events;
+} // namespace
+
+bool open(char const* path) { return events.open(path); }
+
+void flush()
+{
+  if (events.is_open())
+    events.flush();
+}
+
+void flush_for_exit() { events.flush_for_exit(); }
+
+std::uint64_t dropped() { return events.dropped(); }
+
+std::string render(event e, std::span<field const> fields)
+{
+  auto const ix = static_cast<std::size_t>(e);
+  if (ix >= std::size(templates))
+    return "unknown event " + std::to_string(ix);
+
+  std::string text;
+
+  auto       tmpl = templates[ix];
+  auto       arg  = fields.begin();
+  auto const put  = [&](std::size_t width) {
+    if (arg == fields.end())
+      return;
+    if (auto const s = std::get_if<std::string_view>(&*arg)) {
+      text.append(*s);
+    }
+    else {
+      auto const n = std::to_string(std::get<std::uint64_t>(*arg));
+      if (n.size() < width)
+        text.append(width - n.size(), '0');
+      text.append(n);
+    }
+    ++arg;
+  };
+
+  // Just "{}" and "{:09}", all the templates need.
+  while (!tmpl.empty()) {
+    if (tmpl.starts_with("{}")) {
+      put(0);
+      tmpl.remove_prefix(2);
+    }
+    else if (tmpl.starts_with("{:09}")) {
+      put(9);
+      tmpl.remove_prefix(5);
+    }
+    else {
+      text.push_back(tmpl.front());
+      tmpl.remove_prefix(1);
+    }
+  }
+  return text;
+}
+
+std::size_t decode(std::string_view buf, record& rec)
+{
+  header h;
+  if (buf.size() < sizeof(h))
+    return 0;
+  std::memcpy(&h, buf.data(), sizeof(h));
+
+  auto const n_types = static_cast<std::uint16_t>(event::end);
+  if ((h.size < sizeof(h)) || (h.size % align) || (h.size > buf.size()) ||
+      (h.type == pad_type) || (h.type >= n_types) ||
+      (h.n_fields > max_fields))
+    return 0;
+
+  rec.type     = static_cast<event>(h.type);
+  rec.pid      = h.pid;
+  rec.time_ns  = h.time_ns;
+  rec.n_fields = h.n_fields;
+
+  auto       p   = buf.data() + sizeof(h);
+  auto const end = buf.data() + h.size;
+  for (std::size_t i = 0; i < h.n_fields; ++i) {
+    if (p == end)
+      return 0;
+    auto const tag = static_cast<std::uint8_t>(*p++);
+    if (tag == tag_string) {
+      std::uint16_t len;
+      if (end - p < std::ptrdiff_t(sizeof(len)))
+        return 0;
+      std::memcpy(&len, p, sizeof(len));
+      p += sizeof(len);
+      if (end - p < len)
+        return 0;
+      rec.fields[i] = std::string_view(p, len);
+      p += len;
+    }
+    else if (tag == tag_number) {
+      std::uint64_t n;
+      if (end - p < std::ptrdiff_t(sizeof(n)))
+        return 0;
+      std::memcpy(&n, p, sizeof(n));
+      p += sizeof(n);
+      rec.fields[i] = n;
+    }
+    else {
+      return 0;
+    }
+  }
+
+  return h.size;
+}
+
+namespace detail {
+void log(event e, std::span<field const> fields)
+{
+  if (events.is_open())
+    events.put(e, fields);
+  else
+    LOG(INFO) << render(e, fields);
+}
+} // namespace detail
+
+} // namespace EventLog
@@ -0,0 +1,117 @@
+#ifndef EVENTLOG_DOT_HPP
+#define EVENTLOG_DOT_HPP
+
+// Structured events for the lines a session logs on every message.
+//
+// Each event is a fixed-schema binary record: a type and a few string
+// or number fields, no formatting.  Records go into a per-process ring
+// that a background thread drains, in whole records, to a file opened
+// for append, so smtp processes can share one file.  smtp-events turns
+// the file back into the text these lines have always had.
+//
+// The ring has one writer, the session's thread, and never blocks it:
+// a record that doesn't fit is dropped and counted.  Until open() has
+// been called the events go to LOG(INFO) as text, as before.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
+namespace EventLog {
+
+// clang-format off
+enum class event : std::uint16_t {
+  pad,            // filler at the end of the ring, never written out
+
+  connect,        // client
+  ip_okay,        //
+  helo,           // verb, identity
+  helo_from,      // verb, identity, client
+  mail_from,      // reverse path, parameters
+  rcpt_to,        // forward path
+  spf_received,   // Received-SPF: field
+  spf_result,     // result, comment
+  spam_verdict,   // "ham" or "spam", reason
+  spam_status,    // "Yes" or "No", reason
+  data,           //
+  bdat,           // size
+  bdat_last,      // size
+  waiting,        // "DATA" or "BDAT", seconds
+  done_waiting,   //
+  message_id,     // Message-ID: field body
+  from,           // From: field body
+  delivered,      // size, id
+  rset,           //
+  quit,           //
+  cpu_time,       // seconds, nanoseconds
+
+  end,
+};
+// clang-format on
+
+// A field is a string or an unsigned number.
+using field = std::variant<std::string_view, std::uint64_t>;
+
+// Append events to the file at path from now on.  False, with the
+// reason logged, if it can't be opened.
+bool open(char const* path);
+
+// Write out everything logged so far.
+void flush();
+
+// The same, best-effort, from a signal handler about to _Exit(): no
+// locks taken and nothing logged.  Records the drain thread was in the
+// middle of writing are written again.
+void flush_for_exit();
+
+// Events lost to a full ring.
+std::uint64_t dropped();
+
+// The text of the LOG(INFO) line an event stands for.
+std::string render(event e, std::span<field const> fields);
+
+// One record as read back from a file.  The strings point into the
+// buffer it was read from.
+struct record {
+  event                type{event::pad};
+  std::uint32_t        pid{0};
+  std::int64_t         time_ns{0}; // since the epoch
+  std::array<field, 8> fields;
+  std::size_t          n_fields{0};
+
+  std::span<field const> args() const { return {fields.data(), n_fields}; }
+};
+
+// Decode the record at the front of buf, returning its size, or zero if
+// buf holds less than a whole record or something that isn't one.
+std::size_t decode(std::string_view buf, record& rec);
+
+namespace detail {
+void log(event e, std::span<field const> fields);
+
+inline field to_field(std::string_view s) { return s; }
+inline field to_field(std::string const& s) { return std::string_view{s}; }
+inline field to_field(char const* s) { return std::string_view{s}; }
+
+template <typename T>
+requires std::is_integral_v<T> field to_field(T n)
+{
+  return static_cast<std::uint64_t>(n);
+}
+} // namespace detail
+
+template <typename... Args>
+void log(event e, Args const&... args)
+{
+  std::array<field, sizeof...(Args)> const fields{detail::to_field(args)...};
+  detail::log(e, fields);
+}
+
+} // namespace EventLog
+
+#endif // EVENTLOG_DOT_HPP
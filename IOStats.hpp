@@ -0,0 +1,106 @@
+#ifndef IOSTATS_DOT_HPP
+#define IOSTATS_DOT_HPP
+
+// Counts of the system calls, TLS records and waits a connection
+// takes, for sizing the buffers.  Sizes are kept in log2 buckets:
+// bucket b holds sizes from 2^(b-1) up to 2^b - 1, with zero in bucket
+// 0 and anything too big in the last.
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace IOStats {
+
+constexpr std::size_t n_buckets = 32;
+
+constexpr std::size_t bucket_of(std::uint64_t n)
+{
+  if (n == 0)
+    return 0;
+  auto const b = std::size_t(64 - __builtin_clzll(n));
+  return (b < n_buckets) ? b : n_buckets - 1;
+}
+
+// The largest size that lands in bucket b.
+constexpr std::uint64_t bucket_max(std::size_t b)
+{
+  return (std::uint64_t{1} << b) - 1;
+}
+
+static_assert(bucket_of(0) == 0);
+static_assert(bucket_of(1) == 1);
+static_assert(bucket_of(4096) == 13);
+static_assert(bucket_max(bucket_of(4096)) >= 4096);
+static_assert(bucket_of(~std::uint64_t{0}) == n_buckets - 1);
+
+struct sizes {
+  std::uint64_t                        calls{0};
+  std::uint64_t                        octets{0};
+  std::array<std::uint64_t, n_buckets> buckets{};
+
+  void add(std::uint64_t n)
+  {
+    ++calls;
+    octets += n;
+    ++buckets[bucket_of(n)];
+  }
+};
+
+struct timing {
+  std::uint64_t            calls{0};
+  std::chrono::nanoseconds total{0};
+};
+
+// clang-format off
+struct stats {
+  sizes  reads;       // read(2) or SSL_read calls that returned
+  sizes  writes;      // write(2) or SSL_write calls that wrote
+  sizes  records_in;  // TLS records, by length
+  sizes  records_out;
+
+  std::uint64_t again{0};       // EAGAIN from read(2) or write(2)
+  std::uint64_t want_read{0};   // SSL_ERROR_WANT_READ
+  std::uint64_t want_write{0};  // SSL_ERROR_WANT_WRITE
+
+  timing wait;        // blocked in POSIX::input_ready or output_ready
+  timing read_hook;
+};
+// clang-format on
+
+// Adds the time from construction to destruction to t, if not null.
+class timer {
+public:
+  timer(timer const&) = delete;
+  timer& operator=(timer const&) = delete;
+
+  explicit timer(timing* t)
+    : t_(t)
+  {
+    if (t_)
+      start_ = std::chrono::steady_clock::now();
+  }
+  ~timer()
+  {
+    if (t_) {
+      ++t_->calls;
+      t_->total += std::chrono::steady_clock::now() - start_;
+    }
+  }
+
+private:
+  timing*                               t_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+template <typename F>
+auto timed(timing* t, F&& f)
+{
+  timer tm(t);
+  return f();
+}
+
+} // namespace IOStats
+
+#endif // IOSTATS_DOT_HPP
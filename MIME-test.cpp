@@ -0,0 +1,134 @@
+#include "MIME.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+namespace {
+std::string_view body_of(std::string_view msg, MIME::part const& p)
+{
+  return msg.substr(p.body_offset, p.body_length());
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  auto const msg = "From: Alice <alice@example.com>\r\n"
+                   "Content-Type: Multipart/Mixed;\r\n"
+                   "\tboundary=\"outer; b\"\r\n"
+                   "\r\n"
+                   "This is the preamble.\r\n"
+                   "--outer; b\r\n"
+                   "\r\n"
+                   "Plain text, no header fields.\r\n"
+                   "--outer; b  \r\n"
+                   "Content-Type: multipart/alternative; boundary=inner\r\n"
+                   "\r\n"
+                   "--inner\r\n"
+                   "Content-Type: text/plain; charset=utf-8\r\n"
+                   "\r\n"
+                   "Hello\r\n"
+                   "--inner\r\n"
+                   "Content-Type: text/html\r\n"
+                   "Content-Transfer-Encoding: Quoted-Printable\r\n"
+                   "\r\n"
+                   "<p>Hello</p>\r\n"
+                   "--inner--\r\n"
+                   "--outer; b\r\n"
+                   "Content-Type: application/octet-stream\r\n"
+                   "Content-Transfer-Encoding: base64\r\n"
+                   "\r\n"
+                   "AAECAw==\r\n"
+                   "--outer; b--\r\n"
+                   "This is the epilogue.\r\n"s;
+
+  auto const parts = MIME::walk(msg);
+  CHECK_EQ(parts.size(), 6);
+
+  CHECK_EQ(parts[0].offset, 0);
+  CHECK_EQ(parts[0].length, msg.size());
+  CHECK_EQ(parts[0].depth, 0);
+  CHECK_EQ(parts[0].content_type, "multipart/mixed");
+  CHECK_EQ(parts[0].encoding, "7bit");
+
+  CHECK_EQ(parts[1].depth, 1);
+  CHECK_EQ(parts[1].content_type, "text/plain");
+  CHECK_EQ(parts[1].body_offset, parts[1].offset + 2);
+  CHECK_EQ(body_of(msg, parts[1]), "Plain text, no header fields.");
+
+  CHECK_EQ(parts[2].depth, 1);
+  CHECK_EQ(parts[2].content_type, "multipart/alternative");
+
+  CHECK_EQ(parts[3].depth, 2);
+  CHECK_EQ(parts[3].content_type, "text/plain");
+  CHECK_EQ(body_of(msg, parts[3]), "Hello");
+
+  CHECK_EQ(parts[4].depth, 2);
+  CHECK_EQ(parts[4].content_type, "text/html");
+  CHECK_EQ(parts[4].encoding, "quoted-printable");
+  CHECK_EQ(body_of(msg, parts[4]), "<p>Hello</p>");
+
+  CHECK_EQ(parts[5].depth, 1);
+  CHECK_EQ(parts[5].content_type, "application/octet-stream");
+  CHECK_EQ(parts[5].encoding, "base64");
+  CHECK_EQ(body_of(msg, parts[5]), "AAECAw==");
+  CHECK_EQ(msg.substr(parts[5].offset, parts[5].length),
+           "Content-Type: application/octet-stream\r\n"
+           "Content-Transfer-Encoding: base64\r\n"
+           "\r\n"
+           "AAECAw==");
+
+  // A digest, with bare LF line endings, a boundary that also shows up
+  // mid-line, and no close delimiter.
+  auto const digest = "Content-Type: multipart/digest; boundary=d\n"
+                      "\n"
+                      "--d\n"
+                      "\n"
+                      "Subject: one\n"
+                      "\n"
+                      "not a --d delimiter\n"
+                      "--d\n"
+                      "Content-Type: text/plain\n"
+                      "\n"
+                      "two\n"s;
+
+  auto const dparts = MIME::walk(digest);
+  CHECK_EQ(dparts.size(), 4);
+  CHECK_EQ(dparts[1].content_type, "message/rfc822");
+  CHECK_EQ(dparts[2].depth, 2);
+  CHECK_EQ(dparts[2].content_type, "text/plain");
+  CHECK_EQ(body_of(digest, dparts[2]), "not a --d delimiter");
+  CHECK_EQ(dparts[3].content_type, "text/plain");
+  CHECK_EQ(body_of(digest, dparts[3]), "two\n");
+
+  // No MIME at all, and no body.
+  auto const plain = MIME::walk("Subject: hi\r\n");
+  CHECK_EQ(plain.size(), 1);
+  CHECK_EQ(plain[0].content_type, "text/plain");
+  CHECK_EQ(plain[0].body_length(), 0);
+
+  // Nesting stops at the limit.
+  std::string deep;
+  for (auto i = 0u; i < 2 * Config::mime_max_depth; ++i)
+    deep += "Content-Type: message/rfc822\r\n\r\n";
+  CHECK_EQ(MIME::walk(deep).size(), Config::mime_max_depth + 1);
+
+  // Index round trip.
+  auto const dir = fs::temp_directory_path() / "MIME-test";
+  fs::create_directories(dir);
+  auto const file = dir / "1234.M1P2.host:2,S";
+  std::ofstream(file) << msg;
+
+  CHECK(!MIME::read_index(file));
+  CHECK(MIME::write_index(file, parts));
+  CHECK_EQ(MIME::index_path(file), dir / ".1234.M1P2.host.mime");
+  auto const read = MIME::read_index(file);
+  CHECK(read);
+  CHECK(*read == parts);
+
+  fs::remove_all(dir);
+}
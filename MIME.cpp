@@ -0,0 +1,322 @@
+#include "MIME.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+#include <glog/logging.h>
+
+#include "iequal.hpp"
+
+namespace {
+auto constexpr npos = std::string_view::npos;
+
+auto constexpr index_magic = "MIME-index 1";
+
+bool is_wsp(char ch) { return (ch == ' ') || (ch == '\t'); }
+bool is_space(char ch) { return isspace(static_cast<unsigned char>(ch)); }
+
+std::string_view trim(std::string_view s)
+{
+  while (!s.empty() && is_space(s.front()))
+    s.remove_prefix(1);
+  while (!s.empty() && is_space(s.back()))
+    s.remove_suffix(1);
+  return s;
+}
+
+// A single token, lower case, with any white space squeezed out.
+std::string token(std::string_view s)
+{
+  std::string ret;
+  for (auto ch : s) {
+    if (!is_space(ch))
+      ret += std::tolower(static_cast<unsigned char>(ch));
+  }
+  return ret;
+}
+
+// Where the body starts: just past the empty line that ends the header
+// section, or the end if there is none.
+std::size_t body_start(std::string_view text)
+{
+  if (text.starts_with("\r\n"))
+    return 2;
+  if (text.starts_with("\n"))
+    return 1;
+  for (auto nl = text.find('\n'); nl != npos; nl = text.find('\n', nl + 1)) {
+    auto const next = text.substr(nl + 1);
+    if (next.starts_with("\r\n"))
+      return nl + 3;
+    if (next.starts_with("\n"))
+      return nl + 2;
+  }
+  return text.size();
+}
+
+// The unfolded value of the first field with this name.
+std::optional<std::string> field(std::string_view hdrs, std::string_view name)
+{
+  for (std::size_t pos = 0; pos < hdrs.size();) {
+    auto end = pos;
+    do {
+      auto const nl = hdrs.find('\n', end);
+      end           = (nl == npos) ? hdrs.size() : nl + 1;
+    } while ((end < hdrs.size()) && is_wsp(hdrs[end]));
+
+    auto f = hdrs.substr(pos, end - pos);
+    pos    = end;
+
+    if (!istarts_with(f, name))
+      continue;
+    f.remove_prefix(name.size());
+    while (!f.empty() && is_wsp(f.front()))
+      f.remove_prefix(1);
+    if (f.empty() || (f.front() != ':'))
+      continue;
+
+    std::string value;
+    std::copy_if(f.begin() + 1, f.end(), std::back_inserter(value),
+                 [](char ch) { return (ch != '\r') && (ch != '\n'); });
+    return value;
+  }
+  return {};
+}
+
+struct content_type {
+  std::string type;
+  std::string boundary;
+};
+
+// RFC 2045 section 5.1, enough of it to find the type and boundary.
+content_type parse_content_type(std::string_view value)
+{
+  content_type ct;
+
+  auto const semi = value.find(';');
+  ct.type         = token(value.substr(0, semi));
+  if ((ct.type.find('/') == std::string::npos) || (ct.type.back() == '/'))
+    ct.type.clear();
+
+  // Parameters, split on the semicolons not inside quotes.
+  auto params = (semi == npos) ? std::string_view{} : value.substr(semi + 1);
+  while (!params.empty()) {
+    std::size_t end = 0;
+    for (auto quoted = false; end < params.size(); ++end) {
+      if (params[end] == '"')
+        quoted = !quoted;
+      else if (quoted && (params[end] == '\\'))
+        ++end;
+      else if (!quoted && (params[end] == ';'))
+        break;
+    }
+    auto const param = params.substr(0, end);
+    params.remove_prefix(std::min(end + 1, params.size()));
+
+    auto const eq = param.find('=');
+    if ((eq == npos) || !iequal(trim(param.substr(0, eq)), "boundary"))
+      continue;
+
+    auto const val = trim(param.substr(eq + 1));
+    if (val.starts_with('"')) {
+      for (auto i = 1u; (i < val.size()) && (val[i] != '"'); ++i) {
+        if ((val[i] == '\\') && (i + 1 < val.size()))
+          ++i;
+        ct.boundary += val[i];
+      }
+    }
+    else {
+      ct.boundary = val;
+    }
+  }
+
+  return ct;
+}
+
+class walker {
+public:
+  walker(std::string_view msg, std::vector<MIME::part>& parts)
+    : msg_(msg)
+    , parts_(parts)
+  {
+  }
+
+  void walk(std::size_t      offset,
+            std::size_t      length,
+            unsigned         depth,
+            std::string_view default_type);
+
+private:
+  void multipart_(std::size_t      body,
+                  std::size_t      length,
+                  unsigned         depth,
+                  std::string_view boundary,
+                  std::string_view default_type);
+
+  std::string_view          msg_;
+  std::vector<MIME::part>& parts_;
+};
+
+void walker::walk(std::size_t      offset,
+                  std::size_t      length,
+                  unsigned         depth,
+                  std::string_view default_type)
+{
+  auto const text = msg_.substr(offset, length);
+  auto const body = body_start(text);
+  auto const hdrs = text.substr(0, body);
+
+  auto ct = parse_content_type(field(hdrs, "Content-Type").value_or(""));
+  if (ct.type.empty())
+    ct.type = default_type; // RFC 2045 section 5.2
+
+  auto enc = token(field(hdrs, "Content-Transfer-Encoding").value_or(""));
+  if (enc.empty())
+    enc = "7bit";
+
+  parts_.push_back({offset, length, offset + body, depth, ct.type, enc});
+
+  if (depth >= Config::mime_max_depth)
+    return;
+
+  if (ct.type.starts_with("multipart/") && !ct.boundary.empty()) {
+    // RFC 2046 section 5.1.5
+    auto const digest = ct.type == "multipart/digest";
+    multipart_(offset + body, length - body, depth + 1, ct.boundary,
+               digest ? "message/rfc822" : "text/plain");
+  }
+  else if ((ct.type == "message/rfc822") &&
+           ((enc == "7bit") || (enc == "8bit") || (enc == "binary"))) {
+    walk(offset + body, length - body, depth + 1, "text/plain");
+  }
+}
+
+// RFC 2046 section 5.1.1: the body parts lie between delimiter lines,
+// "--" boundary at the start of a line, and the line ending before each
+// delimiter belongs to the delimiter.  Anything before the first is
+// preamble and anything after the close delimiter, "--" boundary "--",
+// is epilogue.
+void walker::multipart_(std::size_t      body,
+                        std::size_t      length,
+                        unsigned         depth,
+                        std::string_view boundary,
+                        std::string_view default_type)
+{
+  auto const b     = msg_.substr(body, length);
+  auto const delim = "--" + std::string(boundary);
+
+  std::boyer_moore_horspool_searcher const search(delim.begin(), delim.end());
+
+  auto const find_delim = [&](std::size_t pos) -> std::size_t {
+    while (pos < b.size()) {
+      auto const it = std::search(b.begin() + pos, b.end(), search);
+      if (it == b.end())
+        break;
+      auto const d = static_cast<std::size_t>(it - b.begin());
+      if ((d == 0) || (b[d - 1] == '\n'))
+        return d;
+      pos = d + 1;
+    }
+    return npos;
+  };
+
+  std::optional<std::size_t> start; // of the part being read
+
+  for (auto pos = std::size_t{0};;) {
+    auto const d = find_delim(pos);
+    if (d == npos) {
+      if (start) // no close delimiter; take what there is
+        walk(body + *start, b.size() - *start, depth, default_type);
+      return;
+    }
+
+    if (start) {
+      auto end = d;
+      if ((end > *start) && (b[end - 1] == '\n'))
+        --end;
+      if ((end > *start) && (b[end - 1] == '\r'))
+        --end;
+      walk(body + *start, end - *start, depth, default_type);
+    }
+
+    auto const after = d + delim.size();
+    if (b.substr(after).starts_with("--"))
+      return; // close delimiter
+
+    auto const nl = b.find('\n', after);
+    if (nl == npos)
+      return;
+    start = pos = nl + 1;
+  }
+}
+} // namespace
+
+namespace MIME {
+
+std::vector<part> walk(std::string_view message)
+{
+  std::vector<part> parts;
+  walker(message, parts).walk(0, message.size(), 0, "text/plain");
+  return parts;
+}
+
+fs::path index_path(fs::path const& message)
+{
+  auto const name   = message.filename().string();
+  auto const unique = name.substr(0, name.find(':'));
+  return message.parent_path() / ("." + unique + ".mime");
+}
+
+bool write_index(fs::path const& message, std::vector<part> const& parts)
+{
+  auto const path = index_path(message);
+  auto       tmp  = path;
+  tmp += ".tmp";
+
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out << index_magic << '\n';
+    for (auto const& p : parts) {
+      out << p.offset << ' ' << p.length << ' ' << p.body_offset << ' '
+          << p.depth << ' ' << p.content_type << ' ' << p.encoding << '\n';
+    }
+    if (!out.flush()) {
+      LOG(WARNING) << "can't write " << tmp;
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    LOG(WARNING) << "can't rename " << tmp << " to " << path << ": "
+                 << ec.message();
+    fs::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+std::optional<std::vector<part>> read_index(fs::path const& message)
+{
+  std::ifstream in(index_path(message), std::ios::binary);
+
+  std::string line;
+  if (!std::getline(in, line) || (line != index_magic))
+    return {};
+
+  std::vector<part> parts;
+  while (std::getline(in, line)) {
+    std::istringstream is(line);
+    part               p;
+    if (!(is >> p.offset >> p.length >> p.body_offset >> p.depth >>
+          p.content_type >> p.encoding))
+      return {};
+    parts.push_back(std::move(p));
+  }
+  return parts;
+}
+
+} // namespace MIME
@@ -0,0 +1,52 @@
+#ifndef MIME_DOT_HPP
+#define MIME_DOT_HPP
+
+// The MIME structure of a message (RFC 2045, 2046) as a flat list of
+// parts, for content filters and tools that want to go straight to one
+// part.  Only the header fields MIME needs are looked at, and boundaries
+// are found by substring search rather than a grammar, so a walk costs
+// little more than reading the message once.
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fs.hpp"
+
+namespace Config {
+constexpr unsigned mime_max_depth = 20;
+} // namespace Config
+
+namespace MIME {
+
+struct part {
+  std::size_t offset;      // of the part's header section, in the message
+  std::size_t length;      // header section and body
+  std::size_t body_offset; // of the body, in the message
+  unsigned    depth;       // 0 for the message itself
+
+  std::string content_type; // "type/subtype", lower case
+  std::string encoding;     // Content-Transfer-Encoding, lower case
+
+  std::size_t body_length() const { return offset + length - body_offset; }
+
+  bool operator==(part const&) const = default;
+};
+
+// Every part, the message first, then each part before its children;
+// multipart bodies are taken apart, and so are message/rfc822 ones.
+std::vector<part> walk(std::string_view message);
+
+// An index is kept in a dot file beside the message, named for the
+// unique part of a Maildir file name so it survives flag changes.
+fs::path index_path(fs::path const& message);
+
+bool write_index(fs::path const& message, std::vector<part> const& parts);
+
+std::optional<std::vector<part>> read_index(fs::path const& message);
+
+} // namespace MIME
+
+#endif // MIME_DOT_HPP
@@ -0,0 +1,63 @@
+#include "Mailbox.hpp"
+
+#include "Bench.hpp"
+#include "RFC5321-verbs.hpp"
+
+#include <string_view>
+
+#include <glog/logging.h>
+
+int main(int argc, char* argv[])
+{
+  Bench::suite suite("Mailbox", argc, argv);
+
+  // The command grammar proper is in smtp.cpp, with its actions on the
+  // Session; what it does for each line that's worth timing alone is
+  // pick the verb and parse the paths.
+  constexpr std::string_view lines[]{
+      "EHLO mail.example.com\r\n",
+      "MAIL FROM:<alice@example.com> BODY=8BITMIME SIZE=4096\r\n",
+      "RCPT TO:<bob@digilicious.com>\r\n",
+      "DATA\r\n",
+      "BDAT 4096 LAST\r\n",
+      "RSET\r\n",
+      "NOOP\r\n",
+      "STARTTLS\r\n",
+      "QUIT\r\n",
+      "XYZZY\r\n",
+  };
+  suite.run("verb_of", [&](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i)
+      Bench::keep(RFC5321::verb_of(lines[i % std::size(lines)]));
+  });
+
+  struct {
+    char const*      name;
+    std::string_view address;
+  } const addresses[]{
+      {"simple", "gene@digilicious.com"},
+      {"dotted", "disposable.style.email.with+symbol@mail.example.com"},
+      {"quoted", "\"john..doe\"@example.org"},
+      {"utf8", "실례@실례.테스트"},
+      {"literal", "postmaster@[127.0.0.1]"},
+  };
+
+  for (auto const& a : addresses) {
+    CHECK(Mailbox::validate(a.address)) << a.address;
+
+    suite.run(std::string("parse/") + a.name, [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(Mailbox::parse(a.address));
+    });
+    suite.run(std::string("validate/") + a.name, [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(Mailbox::validate(a.address));
+    });
+    suite.run(std::string("construct/") + a.name, [&](std::uint64_t n) {
+      for (std::uint64_t i = 0; i < n; ++i)
+        Bench::keep(Mailbox(a.address));
+    });
+  }
+
+  return suite.finish();
+}
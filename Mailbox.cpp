@@ -7,6 +7,8 @@
 
 #include <glog/logging.h>
 
+#include "UTF8.hpp"
+
 using namespace tao::pegtl;
 using namespace tao::pegtl::abnf;
 
@@ -15,22 +17,8 @@ namespace RFC3629 {
 
 // 4.  Syntax of UTF-8 Byte Sequences
 
-struct UTF8_tail : range<'\x80', '\xBF'> {};
-
-struct UTF8_1 : range<0x00, 0x7F> {};
-
-struct UTF8_2 : seq<range<'\xC2', '\xDF'>, UTF8_tail> {};
-
-struct UTF8_3 : sor<seq<one<'\xE0'>, range<'\xA0', '\xBF'>, UTF8_tail>,
-                    seq<range<'\xE1', '\xEC'>, rep<2, UTF8_tail>>,
-                    seq<one<'\xED'>, range<'\x80', '\x9F'>, UTF8_tail>,
-                    seq<range<'\xEE', '\xEF'>, rep<2, UTF8_tail>>> {};
-
-struct UTF8_4 : sor<seq<one<'\xF0'>, range<'\x90', '\xBF'>, rep<2, UTF8_tail>>,
-                    seq<range<'\xF1', '\xF3'>, rep<3, UTF8_tail>>,
-                    seq<one<'\xF4'>, range<'\x80', '\x8F'>, rep<2, UTF8_tail>>> {};
-
-struct non_ascii : sor<UTF8_2, UTF8_3, UTF8_4> {};
+// Checked in one go rather than by the grammar.
+struct non_ascii : UTF8::non_ascii {};
 
 } // namespace RFC3629
 
@@ -121,7 +109,7 @@ struct graphic : range<32, 126> {};
 struct quoted_pairSMTP : seq<one<'\\'>, graphic> {};
 struct qcontentSMTP : sor<qtextSMTP, quoted_pairSMTP> {};
 
-struct atom : plus<Chars::atext> {};
+struct atom : plus<sor<UTF8::atext_run, Chars::atext>> {};
 struct dot_string : list<atom, dot> {};
 struct quoted_string : seq<one<'"'>, star<qcontentSMTP>, one<'"'>> {};
 struct local_part : sor<dot_string, quoted_string> {};
@@ -30,9 +30,8 @@ void MessageStore::open(std::string_view fqdn,
     maildir /= folder;
   }
 
-  newfn_  = maildir / "new";
-  tmpfn_  = maildir / "tmp";
-  tmp2fn_ = maildir / "tmp";
+  newfn_ = maildir / "new";
+  tmpfn_ = maildir / "tmp";
 
   error_code ec;
   create_directories(newfn_, ec);
@@ -43,9 +42,6 @@ void MessageStore::open(std::string_view fqdn,
   newfn_ /= uniq;
   tmpfn_ /= uniq;
 
-  auto const uniq2{fmt::format("{}.R{}2.{}", then_.sec(), s_, fqdn)};
-  tmp2fn_ /= uniq2;
-
   // open
   ofs_.exceptions(std::ifstream::failbit | std::ifstream::badbit);
   ofs_.open(tmpfn_);
@@ -80,26 +76,6 @@ void MessageStore::try_close_()
   }
 }
 
-std::string_view MessageStore::freeze()
-{
-  try_close_();
-  error_code ec;
-  if (fs::exists(tmp2fn_)) {
-    fs::remove(tmp2fn_, ec);
-    if (ec) {
-      LOG(WARNING) << "problem removing " << tmp2fn_ << ": " << ec;
-    }
-  }
-  rename(tmpfn_, tmp2fn_, ec);
-  if (ec) {
-    LOG(ERROR) << "can't rename " << tmpfn_ << " to " << tmp2fn_ << ": " << ec;
-  }
-  ofs_.open(tmpfn_);
-  mapping_.open(tmp2fn_);
-  size_ = 0;
-  return std::string_view(mapping_.data(), mapping_.size());
-}
-
 void MessageStore::deliver()
 {
   if (size_error()) {
@@ -132,13 +108,4 @@ void MessageStore::close()
   if (ec) {
     LOG(ERROR) << "can't remove " << tmpfn_ << ": " << ec;
   }
-  if (fs::exists(tmp2fn_)) {
-    fs::remove(tmp2fn_, ec);
-    if (ec) {
-      LOG(ERROR) << "can't remove " << tmp2fn_ << ": " << ec;
-    }
-  }
-  if (mapping_.is_open()) {
-    mapping_.close();
-  }
 }
@@ -4,8 +4,6 @@
 #include <fstream>
 #include <string_view>
 
-#include <boost/iostreams/device/mapped_file.hpp>
-
 #include "Now.hpp"
 #include "Pill.hpp"
 
@@ -30,8 +28,6 @@ public:
   void close();
   void trash() { close(); }
 
-  std::string_view freeze();
-
   bool            size_error() const { return size_error_; }
   std::streamsize size() const { return size_; }
   std::streamsize max_size() const { return max_size_; }
@@ -47,12 +43,9 @@ private:
 
   fs::path newfn_;
   fs::path tmpfn_;
-  fs::path tmp2fn_;
 
   bool size_error_{false};
 
-  boost::iostreams::mapped_file_source mapping_;
-
   void try_close_();
 };
 
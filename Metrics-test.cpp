@@ -0,0 +1,97 @@
+#include "Metrics.hpp"
+
+#include <sstream>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+int main(int argc, char* argv[])
+{
+  // Every value lands in a bucket that holds it, and the buckets are
+  // in order.
+  for (std::uint64_t us = 0; us < 1'000'000; us += 1 + us / 64) {
+    auto const b = Metrics::bucket_of(us);
+    CHECK_LT(b, Metrics::n_buckets);
+    CHECK_GE(Metrics::bucket_max(b), us);
+    if (b)
+      CHECK_LT(Metrics::bucket_max(b - 1), us);
+  }
+  CHECK_EQ(Metrics::bucket_of(~std::uint64_t{0}), Metrics::n_buckets - 1);
+
+  auto const name = "/Metrics-test-"s + std::to_string(getpid());
+
+  {
+    Metrics::store store(name.c_str());
+    CHECK(store.is_open());
+
+    using namespace std::chrono;
+    for (auto ms = 1; ms <= 100; ++ms)
+      store.record(Metrics::phase::rcpt, milliseconds(ms));
+    store.count(Metrics::outcome::ham);
+    store.count(Metrics::outcome::ham);
+
+    { Metrics::timer t(store, Metrics::phase::deliver); }
+
+    IOStats::stats io;
+    io.reads.add(10);
+    io.reads.add(4096);
+    io.want_read = 3;
+    store.add(io);
+
+    // A second mapping, as smtp-metrics would have, sees the same.
+    Metrics::store other(name.c_str());
+
+    auto const h = other.get(Metrics::phase::rcpt);
+    CHECK_EQ(h.count, 100);
+    CHECK_EQ(h.sum_us, 5'050'000);
+
+    // Within the 12.5% of a bucket.
+    auto const p50 = h.quantile(0.5);
+    CHECK_GE(p50, 50'000);
+    CHECK_LE(p50, 50'000 * 9 / 8);
+    auto const p100 = h.quantile(1.0);
+    CHECK_GE(p100, 100'000);
+    CHECK_LE(p100, 100'000 * 9 / 8);
+
+    CHECK_EQ(other.get(Metrics::phase::deliver).count, 1);
+    CHECK_EQ(other.get(Metrics::phase::greeting).count, 0);
+    CHECK_EQ(other.get(Metrics::outcome::ham), 2);
+    CHECK_EQ(other.get(Metrics::outcome::spam), 0);
+
+    auto const reads = other.get(Metrics::io::read);
+    CHECK_EQ(reads.count, 2);
+    CHECK_EQ(reads.sum_octets, 4106);
+    CHECK_EQ(reads.buckets[IOStats::bucket_of(4096)], 1);
+    CHECK_EQ(other.get(Metrics::io::record_in).count, 0);
+    CHECK_EQ(other.get(Metrics::retry::want_read), 3);
+    CHECK_EQ(other.get(Metrics::phase::io_wait).count, 1);
+
+    std::ostringstream os;
+    other.write_prometheus(os);
+    auto const text = os.str();
+    CHECK_NE(text.find("# TYPE ghsmtp_phase_seconds histogram\n"),
+             std::string::npos);
+    CHECK_NE(text.find("ghsmtp_phase_seconds_bucket{phase=\"rcpt\","
+                       "le=\"+Inf\"} 100\n"),
+             std::string::npos);
+    CHECK_NE(text.find("ghsmtp_phase_seconds_count{phase=\"rcpt\"} 100\n"),
+             std::string::npos);
+    CHECK_NE(text.find("ghsmtp_phase_seconds_sum{phase=\"rcpt\"} 5.05\n"),
+             std::string::npos);
+    CHECK_NE(text.find("ghsmtp_outcomes_total{outcome=\"ham\"} 2\n"),
+             std::string::npos);
+    CHECK_NE(text.find("ghsmtp_io_octets_bucket{op=\"read\",le=\"15\"} 1\n"),
+             std::string::npos);
+    CHECK_NE(text.find("ghsmtp_io_octets_count{op=\"read\"} 2\n"),
+             std::string::npos);
+    CHECK_NE(text.find("ghsmtp_io_retries_total{cause=\"want_read\"} 3\n"),
+             std::string::npos);
+  }
+
+  shm_unlink(name.c_str());
+}
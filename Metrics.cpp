@@ -0,0 +1,351 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <glog/logging.h>
+
+namespace Metrics {
+
+namespace {
+// clang-format off
+constexpr std::string_view phase_names[]{
+  "greeting",
+  "fcrdns",
+  "dnsbl",
+  "helo",
+  "spf",
+  "rcpt",
+  "data",
+  "bdat",
+  "deliver",
+  "io_wait",
+  "read_hook",
+};
+
+constexpr std::string_view outcome_names[]{
+  "ham",
+  "spam",
+  "delivered",
+  "spf_pass",
+  "spf_fail",
+  "spf_other",
+  "ip_blocklisted",
+  "fcrdns_blocklisted",
+  "dnsbl_listed",
+  "early_talker",
+  "client_rejected",
+  "sender_rejected",
+  "recipient_rejected",
+  "too_many_recipients",
+  "size_exceeded",
+  "bare_lf",
+  "unrecognized_commands",
+  "auth",
+  "time_out",
+};
+
+constexpr std::string_view io_names[]{
+  "read",
+  "write",
+  "record_in",
+  "record_out",
+};
+
+constexpr std::string_view retry_names[]{
+  "again",
+  "want_read",
+  "want_write",
+};
+// clang-format on
+
+static_assert(std::size(phase_names) == n_phases);
+static_assert(std::size(outcome_names) == n_outcomes);
+static_assert(std::size(io_names) == n_ios);
+static_assert(std::size(retry_names) == n_retries);
+
+// Prometheus gets a bucket per power of two, everything under 2^7
+// microseconds on up; the finer buckets are kept for quantile().
+constexpr int first_exported_octave = 7;
+} // namespace
+
+std::string_view name_of(phase p)
+{
+  return phase_names[static_cast<std::size_t>(p)];
+}
+
+std::string_view name_of(outcome o)
+{
+  return outcome_names[static_cast<std::size_t>(o)];
+}
+
+std::string_view name_of(io i)
+{
+  return io_names[static_cast<std::size_t>(i)];
+}
+
+std::string_view name_of(retry r)
+{
+  return retry_names[static_cast<std::size_t>(r)];
+}
+
+std::uint64_t histogram::quantile(double q) const
+{
+  if (count == 0)
+    return 0;
+
+  auto const rank = std::max<std::uint64_t>(1, std::ceil(q * count));
+
+  std::uint64_t seen = 0;
+  for (std::size_t b = 0; b < n_buckets; ++b) {
+    seen += buckets[b];
+    if (seen >= rank)
+      return bucket_max(b);
+  }
+  return bucket_max(n_buckets - 1);
+}
+
+struct store::segment {
+  std::atomic<std::uint64_t> buckets[n_phases][n_buckets];
+  std::atomic<std::uint64_t> sum_us[n_phases];
+  std::atomic<std::uint64_t> outcomes[n_outcomes];
+  std::atomic<std::uint64_t> io_buckets[n_ios][IOStats::n_buckets];
+  std::atomic<std::uint64_t> io_octets[n_ios];
+  std::atomic<std::uint64_t> retries[n_retries];
+
+  static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+};
+
+store::store(char const* name)
+{
+  auto const sz = sizeof(segment);
+
+  auto const fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+  if (fd == -1) {
+    PLOG(WARNING) << "shm_open " << name << " failed";
+    return;
+  }
+
+  struct stat st;
+  PCHECK(fstat(fd, &st) == 0);
+
+  // A new segment is zero filled, which is every count at zero.  The
+  // size stands in for a version check.
+  if ((st.st_size == 0) && (ftruncate(fd, sz) == -1)) {
+    PLOG(WARNING) << "ftruncate " << name << " failed";
+    close(fd);
+    return;
+  }
+  if (st.st_size && (std::size_t(st.st_size) != sz)) {
+    LOG(WARNING) << "metrics segment " << name << " is " << st.st_size
+                 << " octets, expecting " << sz << "; not using it";
+    close(fd);
+    return;
+  }
+
+  auto const p = mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    PLOG(WARNING) << "mmap " << name << " failed";
+    return;
+  }
+
+  seg_ = static_cast<segment*>(p);
+}
+
+store::~store()
+{
+  if (seg_)
+    munmap(seg_, sizeof(segment));
+}
+
+void store::record(phase p, std::chrono::steady_clock::duration d)
+{
+  if (!is_open())
+    return;
+
+  using namespace std::chrono;
+  auto const us = static_cast<std::uint64_t>(
+      std::max<std::int64_t>(0, duration_cast<microseconds>(d).count()));
+
+  auto const i = static_cast<std::size_t>(p);
+  seg_->buckets[i][bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+  seg_->sum_us[i].fetch_add(us, std::memory_order_relaxed);
+}
+
+void store::count(outcome o)
+{
+  if (!is_open())
+    return;
+  seg_->outcomes[static_cast<std::size_t>(o)].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+void store::add(IOStats::stats const& s)
+{
+  if (!is_open())
+    return;
+
+  auto const add_sizes = [this](io i, IOStats::sizes const& sz) {
+    auto const n = static_cast<std::size_t>(i);
+    for (std::size_t b = 0; b < IOStats::n_buckets; ++b) {
+      if (sz.buckets[b])
+        seg_->io_buckets[n][b].fetch_add(sz.buckets[b],
+                                         std::memory_order_relaxed);
+    }
+    seg_->io_octets[n].fetch_add(sz.octets, std::memory_order_relaxed);
+  };
+  add_sizes(io::read, s.reads);
+  add_sizes(io::write, s.writes);
+  add_sizes(io::record_in, s.records_in);
+  add_sizes(io::record_out, s.records_out);
+
+  auto const add_retries = [this](retry r, std::uint64_t n) {
+    seg_->retries[static_cast<std::size_t>(r)].fetch_add(
+        n, std::memory_order_relaxed);
+  };
+  add_retries(retry::again, s.again);
+  add_retries(retry::want_read, s.want_read);
+  add_retries(retry::want_write, s.want_write);
+
+  record(phase::io_wait, s.wait.total);
+  record(phase::read_hook, s.read_hook.total);
+}
+
+histogram store::get(phase p) const
+{
+  histogram h;
+  if (!is_open())
+    return h;
+
+  // The count is the sum of the buckets as read, so the cumulative
+  // buckets never run past it.
+  auto const i = static_cast<std::size_t>(p);
+  for (std::size_t b = 0; b < n_buckets; ++b) {
+    h.buckets[b] = seg_->buckets[i][b].load(std::memory_order_relaxed);
+    h.count += h.buckets[b];
+  }
+  h.sum_us = seg_->sum_us[i].load(std::memory_order_relaxed);
+  return h;
+}
+
+std::uint64_t store::get(outcome o) const
+{
+  if (!is_open())
+    return 0;
+  return seg_->outcomes[static_cast<std::size_t>(o)].load(
+      std::memory_order_relaxed);
+}
+
+size_histogram store::get(io i) const
+{
+  size_histogram h;
+  if (!is_open())
+    return h;
+
+  auto const n = static_cast<std::size_t>(i);
+  for (std::size_t b = 0; b < IOStats::n_buckets; ++b) {
+    h.buckets[b] = seg_->io_buckets[n][b].load(std::memory_order_relaxed);
+    h.count += h.buckets[b];
+  }
+  h.sum_octets = seg_->io_octets[n].load(std::memory_order_relaxed);
+  return h;
+}
+
+std::uint64_t store::get(retry r) const
+{
+  if (!is_open())
+    return 0;
+  return seg_->retries[static_cast<std::size_t>(r)].load(
+      std::memory_order_relaxed);
+}
+
+void store::write_prometheus(std::ostream& os) const
+{
+  fmt::memory_buffer buf;
+
+  fmt::format_to(buf, "# HELP ghsmtp_phase_seconds Time taken by each phase "
+                      "of an SMTP session.\n"
+                      "# TYPE ghsmtp_phase_seconds histogram\n");
+
+  for (std::size_t i = 0; i < n_phases; ++i) {
+    auto const name = phase_names[i];
+    auto const h    = get(static_cast<phase>(i));
+
+    // Each exported bound is the top of an octave, so the cumulative
+    // count up to it is exact.  The last bucket also holds whatever
+    // was too big for it, so that one is left to +Inf.
+    std::uint64_t cum = 0;
+    std::size_t   b   = 0;
+    for (auto oct = first_exported_octave; oct < max_octave; ++oct) {
+      auto const top = (std::uint64_t{1} << oct) - 1;
+      for (; (b < n_buckets) && (bucket_max(b) <= top); ++b)
+        cum += h.buckets[b];
+      fmt::format_to(buf,
+                     "ghsmtp_phase_seconds_bucket{{phase=\"{}\",le=\"{}\"}} "
+                     "{}\n",
+                     name, top / 1e6, cum);
+    }
+    fmt::format_to(buf,
+                   "ghsmtp_phase_seconds_bucket{{phase=\"{}\",le=\"+Inf\"}} "
+                   "{}\n",
+                   name, h.count);
+    fmt::format_to(buf, "ghsmtp_phase_seconds_sum{{phase=\"{}\"}} {}\n", name,
+                   h.sum_us / 1e6);
+    fmt::format_to(buf, "ghsmtp_phase_seconds_count{{phase=\"{}\"}} {}\n",
+                   name, h.count);
+  }
+
+  fmt::format_to(buf, "# HELP ghsmtp_outcomes_total Sessions, messages and "
+                      "rejections, by outcome.\n"
+                      "# TYPE ghsmtp_outcomes_total counter\n");
+
+  for (std::size_t i = 0; i < n_outcomes; ++i) {
+    fmt::format_to(buf, "ghsmtp_outcomes_total{{outcome=\"{}\"}} {}\n",
+                   outcome_names[i], get(static_cast<outcome>(i)));
+  }
+
+  fmt::format_to(buf, "# HELP ghsmtp_io_octets Sizes of reads, writes and "
+                      "TLS records.\n"
+                      "# TYPE ghsmtp_io_octets histogram\n");
+
+  for (std::size_t i = 0; i < n_ios; ++i) {
+    auto const name = io_names[i];
+    auto const h    = get(static_cast<io>(i));
+
+    // As above, the last bucket is left to +Inf.
+    std::uint64_t cum = 0;
+    for (std::size_t b = 0; b + 1 < IOStats::n_buckets; ++b) {
+      cum += h.buckets[b];
+      fmt::format_to(buf, "ghsmtp_io_octets_bucket{{op=\"{}\",le=\"{}\"}} {}\n",
+                     name, IOStats::bucket_max(b), cum);
+    }
+    fmt::format_to(buf, "ghsmtp_io_octets_bucket{{op=\"{}\",le=\"+Inf\"}} {}\n",
+                   name, h.count);
+    fmt::format_to(buf, "ghsmtp_io_octets_sum{{op=\"{}\"}} {}\n", name,
+                   h.sum_octets);
+    fmt::format_to(buf, "ghsmtp_io_octets_count{{op=\"{}\"}} {}\n", name,
+                   h.count);
+  }
+
+  fmt::format_to(buf, "# HELP ghsmtp_io_retries_total Reads and writes "
+                      "that had to wait, by cause.\n"
+                      "# TYPE ghsmtp_io_retries_total counter\n");
+
+  for (std::size_t i = 0; i < n_retries; ++i) {
+    fmt::format_to(buf, "ghsmtp_io_retries_total{{cause=\"{}\"}} {}\n",
+                   retry_names[i], get(static_cast<retry>(i)));
+  }
+
+  os.write(buf.data(), buf.size());
+}
+
+} // namespace Metrics
@@ -0,0 +1,216 @@
+#ifndef METRICS_DOT_HPP
+#define METRICS_DOT_HPP
+
+// Phase latencies and outcome counts for smtp sessions, kept in a POSIX
+// shared memory segment that every smtp process adds to, and read back
+// out by smtp-metrics in the Prometheus text format.
+//
+// The histograms are log-linear, as in HdrHistogram: each power of two
+// of microseconds is cut into eight buckets, so a value is placed to
+// within 12.5% from a microsecond up to hours.  The sizes of reads,
+// writes and TLS records are kept in the log2 buckets of IOStats, and
+// added in once a session is over.  Every update is a relaxed atomic
+// add; a reader may see counts a moment apart from one another, which
+// is all a scrape needs.
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+#include "IOStats.hpp"
+
+namespace Metrics {
+
+// clang-format off
+enum class phase : std::uint8_t {
+  greeting,   // connection to the 220 greeting
+  fcrdns,     // forward confirmed reverse DNS of the client
+  dnsbl,      // each DNS block list query
+  helo,       // HELO/EHLO, through the reply
+  spf,        // SPF evaluation at MAIL FROM
+  rcpt,       // each RCPT TO, through the reply
+  data,       // 354 to the end of the data
+  bdat,       // first BDAT to the end of the LAST chunk
+  deliver,    // do_deliver_
+  io_wait,    // blocked on the client, over a whole session
+  read_hook,  // in the read hook, over a whole session
+
+  end,
+};
+
+enum class outcome : std::uint8_t {
+  ham,
+  spam,
+  delivered,
+
+  spf_pass,
+  spf_fail,
+  spf_other,
+
+  ip_blocklisted,
+  fcrdns_blocklisted,
+  dnsbl_listed,
+  early_talker,           // input before the greeting
+  client_rejected,        // HELO/EHLO identity
+  sender_rejected,
+  recipient_rejected,
+  too_many_recipients,
+  size_exceeded,
+  bare_lf,
+  unrecognized_commands,
+  auth,
+  time_out,
+
+  end,
+};
+
+enum class io : std::uint8_t {
+  read,       // read(2) or SSL_read
+  write,      // write(2) or SSL_write
+  record_in,  // TLS records
+  record_out,
+
+  end,
+};
+
+enum class retry : std::uint8_t {
+  again,      // EAGAIN
+  want_read,  // SSL_ERROR_WANT_READ
+  want_write, // SSL_ERROR_WANT_WRITE
+
+  end,
+};
+// clang-format on
+
+constexpr auto n_phases   = static_cast<std::size_t>(phase::end);
+constexpr auto n_outcomes = static_cast<std::size_t>(outcome::end);
+constexpr auto n_ios      = static_cast<std::size_t>(io::end);
+constexpr auto n_retries  = static_cast<std::size_t>(retry::end);
+
+std::string_view name_of(phase p);
+std::string_view name_of(outcome o);
+std::string_view name_of(io i);
+std::string_view name_of(retry r);
+
+// Bucket geometry, values in microseconds.
+constexpr int           sub_bucket_bits = 3;
+constexpr std::uint64_t sub_buckets     = 1 << sub_bucket_bits;
+constexpr int           max_octave      = 36; // 2^36 us is 19 hours
+constexpr std::size_t   n_buckets =
+    (max_octave - sub_bucket_bits + 1) * sub_buckets;
+
+constexpr std::size_t bucket_of(std::uint64_t us)
+{
+  if (us < sub_buckets)
+    return us;
+  auto const octave = 63 - __builtin_clzll(us);
+  if (octave >= max_octave)
+    return n_buckets - 1;
+  auto const sub = (us >> (octave - sub_bucket_bits)) & (sub_buckets - 1);
+  return (octave - sub_bucket_bits + 1) * sub_buckets + sub;
+}
+
+// The largest value that lands in bucket b.
+constexpr std::uint64_t bucket_max(std::size_t b)
+{
+  if (b < sub_buckets)
+    return b;
+  auto const octave = b / sub_buckets + sub_bucket_bits - 1;
+  auto const shift  = octave - sub_bucket_bits;
+  auto const lo     = (sub_buckets + b % sub_buckets) << shift;
+  return lo + (std::uint64_t{1} << shift) - 1;
+}
+
+static_assert(bucket_of(7) == 7);
+static_assert(bucket_of(8) == 8);
+static_assert(bucket_of(17) == 16);
+static_assert(bucket_max(bucket_of(1000)) >= 1000);
+static_assert(bucket_max(bucket_of(1000)) < 1000 * 9 / 8);
+
+// A copy of one histogram, to read from.
+struct histogram {
+  std::array<std::uint64_t, n_buckets> buckets{};
+  std::uint64_t                        count{0};
+  std::uint64_t                        sum_us{0};
+
+  // The value, in microseconds, at or below which a fraction q of the
+  // samples fall, to within the bucket width.
+  std::uint64_t quantile(double q) const;
+};
+
+// A copy of one size histogram, in IOStats buckets.
+struct size_histogram {
+  std::array<std::uint64_t, IOStats::n_buckets> buckets{};
+  std::uint64_t                                 count{0};
+  std::uint64_t                                 sum_octets{0};
+};
+
+class store {
+public:
+  store(store const&) = delete;
+  store& operator=(store const&) = delete;
+
+  // The name is as for shm_open(3), e.g. "/ghsmtp-metrics".  If it
+  // can't be opened, everything here does nothing.
+  explicit store(char const* name);
+  ~store();
+
+  bool is_open() const { return seg_ != nullptr; }
+
+  void record(phase p, std::chrono::steady_clock::duration d);
+  void count(outcome o);
+
+  // One session's I/O: the sizes, the retries, and the time spent
+  // waiting and in the read hook as the io_wait and read_hook phases.
+  void add(IOStats::stats const& s);
+
+  histogram      get(phase p) const;
+  std::uint64_t  get(outcome o) const;
+  size_histogram get(io i) const;
+  std::uint64_t  get(retry r) const;
+
+  // The Prometheus text exposition format, version 0.0.4.
+  void write_prometheus(std::ostream& os) const;
+
+private:
+  struct segment;
+
+  segment* seg_{nullptr};
+};
+
+// Records the time from construction to stop(), or to destruction if
+// not stopped before.
+class timer {
+public:
+  timer(timer const&) = delete;
+  timer& operator=(timer const&) = delete;
+
+  timer(store& s, phase p)
+    : store_(s)
+    , phase_(p)
+    , start_(std::chrono::steady_clock::now())
+  {
+  }
+  ~timer() { stop(); }
+
+  void stop()
+  {
+    if (!stopped_) {
+      store_.record(phase_, std::chrono::steady_clock::now() - start_);
+      stopped_ = true;
+    }
+  }
+
+private:
+  store&                                store_;
+  phase                                 phase_;
+  std::chrono::steady_clock::time_point start_;
+  bool                                  stopped_{false};
+};
+
+} // namespace Metrics
+
+#endif // METRICS_DOT_HPP
@@ -6,6 +6,8 @@
 
 #include <dkim.h>
 
+#include <cstring>
+
 #include <glog/logging.h>
 
 namespace {
@@ -19,6 +21,33 @@ char const* c(unsigned char* ucp) { return reinterpret_cast<char const*>(ucp); }
 
 constexpr unsigned char id_v[]{"DKIM::verify"};
 constexpr unsigned char id_s[]{"DKIM::sign"};
+
+// libopendkim calls this for each signature's key; the user context
+// is the verify object's lookup function.
+DKIM_CBSTAT key_lookup_cb(DKIM* dkim, DKIM_SIGINFO* sig, u_char* buf,
+                          size_t buflen)
+{
+  auto const lookup = static_cast<OpenDKIM::verify::key_lookup const*>(
+      dkim_get_user_context(dkim));
+  if (!lookup || !*lookup)
+    return DKIM_CBSTAT_DEFAULT;
+
+  auto const key =
+      (*lookup)(c(dkim_sig_getselector(sig)), c(dkim_sig_getdomain(sig)));
+  if (!key)
+    return DKIM_CBSTAT_DEFAULT;
+  if (key->empty())
+    return DKIM_CBSTAT_NOTFOUND;
+  if (key->size() >= buflen) {
+    LOG(WARNING) << "key record for " << c(dkim_sig_getdomain(sig))
+                 << " too long";
+    return DKIM_CBSTAT_ERROR;
+  }
+
+  std::memcpy(buf, key->data(), key->size());
+  buf[key->size()] = '\0';
+  return DKIM_CBSTAT_CONTINUE;
+}
 } // namespace
 
 namespace OpenDKIM {
@@ -231,6 +260,14 @@ verify::verify()
   dkim_ = CHECK_NOTNULL(dkim_verify(lib_, id_v, nullptr, &status_));
 }
 
+verify::verify(key_lookup lookup)
+  : lookup_(std::move(lookup))
+{
+  CHECK_EQ(dkim_set_key_lookup(lib_, key_lookup_cb), DKIM_STAT_OK);
+  dkim_ = CHECK_NOTNULL(dkim_verify(lib_, id_v, nullptr, &status_));
+  CHECK_EQ(dkim_set_user_context(dkim_, &lookup_), DKIM_STAT_OK);
+}
+
 bool verify::check()
 {
   int            nsigs = 0;
@@ -2,6 +2,7 @@
 #define OPENDKIM_DOT_HPP
 
 #include <functional>
+#include <optional>
 #include <string>
 #include <string_view>
 
@@ -52,7 +53,14 @@ public:
 
 class verify : public lib {
 public:
+  // Returns the key record for <selector>._domainkey.<domain>, an
+  // empty string if there is none, or nullopt to have libopendkim do
+  // its own lookup.
+  using key_lookup = std::function<std::optional<std::string>(
+      char const* selector, char const* domain)>;
+
   verify();
+  explicit verify(key_lookup lookup);
 
   bool check();
   bool sig_syntax(std::string_view sig);
@@ -61,6 +69,9 @@ public:
                                       char const* identity,
                                       char const* selector,
                                       char const* b)> func);
+
+private:
+  key_lookup lookup_;
 };
 
 } // namespace OpenDKIM
@@ -111,6 +111,39 @@ bool policy::query_dmarc(char const* domain)
   return true;
 }
 
+bool policy::query_dmarc(char const* domain, record_lookup const& lookup)
+{
+  CHECK_NOTNULL(domain);
+  if (!lookup)
+    return query_dmarc(domain);
+
+  std::string org_domain;
+  auto const  record = lookup(domain, org_domain);
+  if (!record)
+    return query_dmarc(domain);
+  if (record->empty()) {
+    LOG(WARNING) << domain << ": no DMARC record";
+    return false;
+  }
+  return store_dmarc(record->c_str(), domain,
+                     org_domain.empty() ? nullptr : org_domain.c_str());
+}
+
+bool policy::store_dmarc(char const* record,
+                         char const* domain,
+                         char const* org_domain)
+{
+  CHECK_NOTNULL(record);
+  CHECK_NOTNULL(domain);
+  auto const status = opendmarc_policy_store_dmarc(
+      pctx_, uc(record), uc(domain), org_domain ? uc(org_domain) : nullptr);
+  if (status != DMARC_PARSE_OKAY) {
+    LOG(WARNING) << domain << ": " << opendmarc_policy_status_to_str(status);
+    return false;
+  }
+  return true;
+}
+
 advice policy::get_advice()
 {
   auto const status = opendmarc_get_policy_to_enforce(pctx_);
@@ -3,6 +3,10 @@
 
 #include "IP6.hpp"
 
+#include <functional>
+#include <optional>
+#include <string>
+
 #include <opendmarc/dmarc.h>
 
 #include <glog/logging.h>
@@ -35,6 +39,13 @@ class policy {
   policy& operator=(policy const&) = delete;
 
 public:
+  // Returns the DMARC record for a domain, or for its organizational
+  // domain in which case that is stored in org_domain; an empty string
+  // if there is none, or nullopt to have libopendmarc do its own
+  // lookup.
+  using record_lookup = std::function<std::optional<std::string>(
+      char const* domain, std::string& org_domain)>;
+
   policy() = default;
 
   // move
@@ -54,6 +65,10 @@ public:
                    int         origin,
                    char const* human_readable);
   bool   query_dmarc(char const* domain);
+  bool   query_dmarc(char const* domain, record_lookup const& lookup);
+  bool   store_dmarc(char const* record,
+                     char const* domain,
+                     char const* org_domain);
   advice get_advice();
 
 private:
@@ -57,7 +57,8 @@ std::streamsize POSIX::read(int                       fd,
                             std::streamsize           n,
                             std::function<void(void)> read_hook,
                             std::chrono::milliseconds timeout,
-                            bool&                     t_o)
+                            bool&                     t_o,
+                            IOStats::stats*           stats)
 {
   auto const start    = system_clock::now();
   auto const end_time = start + timeout;
@@ -76,17 +77,22 @@ std::streamsize POSIX::read(int                       fd,
       default:
         PCHECK((errno == EWOULDBLOCK) || (errno == EAGAIN))
             << "error from read(2)";
+        if (stats)
+          ++stats->again;
       }
     }
     else if (n_ret >= 0) {
+      if (stats)
+        stats->reads.add(n_ret);
       return n_ret;
     }
 
     auto const now = system_clock::now();
     if (now < end_time) {
       auto const time_left = duration_cast<milliseconds>(end_time - now);
-      read_hook();
-      if (input_ready(fd, time_left))
+      IOStats::timed(stats ? &stats->read_hook : nullptr, read_hook);
+      if (IOStats::timed(stats ? &stats->wait : nullptr,
+                         [&] { return input_ready(fd, time_left); }))
         continue; // try read again
     }
     t_o = true;
@@ -99,7 +105,8 @@ std::streamsize POSIX::write(int                       fd,
                              const char*               s,
                              std::streamsize           n,
                              std::chrono::milliseconds timeout,
-                             bool&                     t_o)
+                             bool&                     t_o,
+                             IOStats::stats*           stats)
 {
   auto const start    = system_clock::now();
   auto const end_time = start + timeout;
@@ -120,11 +127,15 @@ std::streamsize POSIX::write(int                       fd,
       default:
         PCHECK((errno == EWOULDBLOCK) || (errno == EAGAIN))
             << "error from write(2)";
+        if (stats)
+          ++stats->again;
       }
     }
     else if (n_ret == 0) {
       LOG(WARNING) << "zero write";
     } else {
+      if (stats)
+        stats->writes.add(n_ret);
       s += n_ret;
       written += n_ret;
     }
@@ -135,7 +146,8 @@ std::streamsize POSIX::write(int                       fd,
     auto const now = system_clock::now();
     if (now < end_time) {
       auto const time_left = duration_cast<milliseconds>(end_time - now);
-      if (output_ready(fd, time_left))
+      if (IOStats::timed(stats ? &stats->wait : nullptr,
+                         [&] { return output_ready(fd, time_left); }))
         continue; // write some more
     }
     t_o = true;
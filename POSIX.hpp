@@ -7,6 +7,8 @@
 
 #include <unistd.h>
 
+#include "IOStats.hpp"
+
 constexpr void null_hook(void) {}
 
 class POSIX {
@@ -19,18 +21,21 @@ public:
   static bool input_ready(int fd_in, std::chrono::milliseconds wait);
   static bool output_ready(int fd_out, std::chrono::milliseconds wait);
 
+  // If stats is given, the calls, sizes and waits are added to it.
   static std::streamsize read(int                       fd,
                               char*                     s,
                               std::streamsize           n,
                               std::function<void(void)> read_hook,
                               std::chrono::milliseconds timeout,
-                              bool&                     t_o);
+                              bool&                     t_o,
+                              IOStats::stats*           stats = nullptr);
 
   static std::streamsize write(int                       fd,
                                const char*               s,
                                std::streamsize           n,
                                std::chrono::milliseconds timeout,
-                               bool&                     t_o);
+                               bool&                     t_o,
+                               IOStats::stats*           stats = nullptr);
 };
 
 #endif // POSIX_DOT_HPP
@@ -0,0 +1,21 @@
+#include "Pill.hpp"
+
+#include "Bench.hpp"
+#include "Now.hpp"
+
+int main(int argc, char* argv[])
+{
+  Bench::suite suite("Pill", argc, argv);
+
+  // One of each for every message received.
+  suite.run("Pill", [](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i)
+      Bench::keep(Pill{});
+  });
+  suite.run("Now", [](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i)
+      Bench::keep(Now{});
+  });
+
+  return suite.finish();
+}
@@ -4,6 +4,7 @@
 #include <climits>
 #include <cstddef>
 #include <ostream>
+#include <string_view>
 
 // A pill is a unit of entropy.
 
@@ -14,6 +15,8 @@ public:
   bool operator==(Pill const& that) const { return this->s_ == that.s_; }
   bool operator!=(Pill const& that) const { return !(*this == that); }
 
+  std::string_view as_string_view() const { return {b32_str_, b32_ndigits_}; }
+
 private:
   unsigned long long s_;
 
@@ -0,0 +1,49 @@
+#include "QP.hpp"
+
+#include <glog/logging.h>
+
+namespace {
+std::string dec_chunked(std::string_view in, std::size_t chunk)
+{
+  std::string out;
+  QP::decoder d;
+  for (; !in.empty(); in.remove_prefix(std::min(chunk, in.size())))
+    d.put(in.substr(0, chunk), out);
+  d.finish(out);
+  return out;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  CHECK_EQ(QP::dec("caf=C3=A9"), "caf\xC3\xA9");
+  CHECK_EQ(QP::dec("caf=c3=a9"), "caf\xC3\xA9");
+  CHECK_EQ(QP::dec("soft=\r\nbreak"), "softbreak");
+  CHECK_EQ(QP::dec("soft=  \r\nbreak"), "softbreak");
+  CHECK_EQ(QP::dec("soft=\nbreak"), "softbreak");
+  CHECK_EQ(QP::dec("trailing  \r\nspace\t\r\n"), "trailing\r\nspace\r\n");
+  CHECK_EQ(QP::dec("kept =20\r\n"), "kept  \r\n");
+  CHECK_EQ(QP::dec("a = b"), "a = b");
+  CHECK_EQ(QP::dec("=ZZ=4"), "=ZZ=4");
+  CHECK_EQ(QP::dec("end="), "end");
+  CHECK_EQ(QP::dec("end  "), "end");
+
+  auto const text = "Now's the time =\r\n"
+                    "for all folk to come=\r\n"
+                    " to the aid of their country.   \r\n"
+                    "Caf=C3=A9 =3D =E2=98=95\t\r\n"
+                    "a = b=  \r\n"
+                    "\r\n"
+                    "The end.";
+  auto const plain = "Now's the time "
+                     "for all folk to come"
+                     " to the aid of their country.\r\n"
+                     "Caf\xC3\xA9 = \xE2\x98\x95\r\n"
+                     "a = b"
+                     "\r\n"
+                     "The end.";
+
+  CHECK_EQ(QP::dec(text), plain);
+  for (auto chunk = 1u; chunk < 20; ++chunk)
+    CHECK_EQ(dec_chunked(text, chunk), plain);
+}
@@ -0,0 +1,170 @@
+#include "QP.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+bool is_wsp(char ch) { return (ch == ' ') || (ch == '\t'); }
+
+bool special(char ch)
+{
+  switch (ch) {
+  case '=':
+  case ' ':
+  case '\t':
+  case '\r':
+  case '\n': return true;
+  }
+  return false;
+}
+
+int hex(char ch)
+{
+  if ((ch >= '0') && (ch <= '9'))
+    return ch - '0';
+  if ((ch >= 'A') && (ch <= 'F'))
+    return ch - 'A' + 10;
+  if ((ch >= 'a') && (ch <= 'f')) // not allowed, but seen
+    return ch - 'a' + 10;
+  return -1;
+}
+
+// Length of the run at p that decodes to itself.
+std::size_t plain_run(char const* p, std::size_t n)
+{
+  std::size_t i = 0;
+
+#if defined(__SSE2__)
+  auto const eq = _mm_set1_epi8('=');
+  auto const sp = _mm_set1_epi8(' ');
+  auto const ht = _mm_set1_epi8('\t');
+  auto const cr = _mm_set1_epi8('\r');
+  auto const lf = _mm_set1_epi8('\n');
+
+  for (; i + 16 <= n; i += 16) {
+    auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+    auto const m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, eq), _mm_cmpeq_epi8(v, sp)),
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, ht), _mm_cmpeq_epi8(v, cr)),
+                     _mm_cmpeq_epi8(v, lf)));
+
+    auto const mask = _mm_movemask_epi8(m);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; i < n; ++i) {
+    if (special(p[i]))
+      return i;
+  }
+  return n;
+}
+} // namespace
+
+namespace QP {
+
+void decoder::put(std::string_view in, std::string& out)
+{
+  for (std::size_t i = 0; i < in.size();) {
+    auto const ch = in[i];
+
+    if (soft_cr_) {
+      soft_cr_ = false;
+      if (ch == '\n') {
+        ++i;
+        continue;
+      }
+    }
+
+    if (!esc_.empty()) {
+      auto const padding = (esc_.size() == 1) || is_wsp(esc_[1]);
+
+      if ((esc_.size() == 2) && !padding && (hex(ch) >= 0)) {
+        out += static_cast<char>(hex(esc_[1]) * 16 + hex(ch));
+        esc_.clear();
+        ++i;
+      }
+      else if ((esc_.size() == 1) && (hex(ch) >= 0)) {
+        esc_ += ch;
+        ++i;
+      }
+      else if (padding && is_wsp(ch)) {
+        esc_ += ch; // white space after a soft line break's '='
+        ++i;
+      }
+      else if (padding && ((ch == '\r') || (ch == '\n'))) {
+        esc_.clear(); // a soft line break
+        soft_cr_ = ch == '\r';
+        ++i;
+      }
+      else {
+        // Not an escape after all: the '=' stands for itself, and ch
+        // is looked at again.
+        out += '=';
+        if (padding)
+          ws_ = esc_.substr(1);
+        else
+          out += esc_[1];
+        esc_.clear();
+      }
+      continue;
+    }
+
+    switch (ch) {
+    case '=':
+      out += ws_;
+      ws_.clear();
+      esc_ = ch;
+      ++i;
+      break;
+
+    case ' ':
+    case '\t':
+      ws_ += ch;
+      ++i;
+      break;
+
+    case '\r':
+    case '\n':
+      ws_.clear(); // white space at the end of a line goes
+      out += ch;
+      ++i;
+      break;
+
+    default: {
+      out += ws_;
+      ws_.clear();
+      auto const n = plain_run(in.data() + i, in.size() - i);
+      out.append(in.data() + i, n);
+      i += n;
+    }
+    }
+  }
+}
+
+void decoder::finish(std::string& out)
+{
+  // An '=' at the very end is a soft line break with no line after it;
+  // one with a single hex digit after it stands for itself.
+  if ((esc_.size() == 2) && !is_wsp(esc_[1]))
+    out += esc_;
+  esc_.clear();
+  ws_.clear();
+  soft_cr_ = false;
+}
+
+std::string dec(std::string_view in)
+{
+  std::string out;
+  out.reserve(in.size());
+
+  decoder d;
+  d.put(in, out);
+  d.finish(out);
+
+  return out;
+}
+
+} // namespace QP
@@ -0,0 +1,31 @@
+#ifndef QP_DOT_HPP
+#define QP_DOT_HPP
+
+// Quoted-printable decoding, RFC 2045 section 6.7.
+
+#include <string>
+#include <string_view>
+
+namespace QP {
+
+// Soft line breaks are removed, as is white space at the end of a line;
+// an '=' that doesn't start a soft line break or a pair of hex digits
+// is kept as it is, as the RFC suggests.
+std::string dec(std::string_view in);
+
+// The same, a piece at a time, with the output of each call appended
+// to out.  Output is the same however the input is split.
+class decoder {
+public:
+  void put(std::string_view in, std::string& out);
+  void finish(std::string& out);
+
+private:
+  std::string esc_; // an '=' and what's followed it so far
+  std::string ws_;  // white space that may yet end a line
+  bool        soft_cr_{false}; // a soft line break's CR, LF to follow
+};
+
+} // namespace QP
+
+#endif // QP_DOT_HPP
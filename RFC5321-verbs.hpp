@@ -0,0 +1,67 @@
+#ifndef RFC5321_VERBS_DOT_HPP
+#define RFC5321_VERBS_DOT_HPP
+
+// SMTP commands by their first four octets, which are enough to tell
+// them apart: every verb we take is four letters, but for STARTTLS,
+// which goes by "STAR".
+
+#include <cstdint>
+#include <string_view>
+
+#include "phash.hpp"
+
+namespace RFC5321 {
+
+// clang-format off
+enum class verb : std::uint8_t {
+  helo,
+  ehlo,
+  mail,
+  rcpt,
+  data,
+  bdat,
+  rset,
+  noop,
+  vrfy,
+  help,
+  starttls,
+  quit,
+  auth,
+
+  unknown,
+};
+
+inline constexpr phash verb_names{std::array<std::string_view, 13>{
+  "HELO",
+  "EHLO",
+  "MAIL",
+  "RCPT",
+  "DATA",
+  "BDAT",
+  "RSET",
+  "NOOP",
+  "VRFY",
+  "HELP",
+  "STAR",
+  "QUIT",
+  "AUTH",
+}};
+// clang-format on
+
+static_assert(verb_names.size() == static_cast<std::size_t>(verb::unknown));
+
+// From the start of a command line.
+constexpr verb verb_of(std::string_view line) noexcept
+{
+  if (line.size() < 4)
+    return verb::unknown;
+  return static_cast<verb>(verb_names.find(line.substr(0, 4)));
+}
+
+static_assert(verb_of("ehlo example.com\r\n") == verb::ehlo);
+static_assert(verb_of("StartTLS\r\n") == verb::starttls);
+static_assert(verb_of("EXPN x\r\n") == verb::unknown);
+
+} // namespace RFC5321
+
+#endif // RFC5321_VERBS_DOT_HPP
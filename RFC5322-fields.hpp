@@ -0,0 +1,136 @@
+#ifndef RFC5322_FIELDS_DOT_HPP
+#define RFC5322_FIELDS_DOT_HPP
+
+// The header field names we have a use for, RFC 5322 and the MIME,
+// DKIM, ARC and trace fields, each as an enum found by perfect hash.
+
+#include <cstdint>
+#include <string_view>
+
+#include "phash.hpp"
+
+namespace RFC5322 {
+
+// clang-format off
+enum class field : std::uint8_t {
+  // Trace fields
+  return_path,
+  received,
+  received_spf,
+  authentication_results,
+  delivered_to,
+
+  // Signatures
+  dkim_signature,
+  arc_seal,
+  arc_message_signature,
+  arc_authentication_results,
+
+  // Originator fields
+  date,
+  from,
+  sender,
+  reply_to,
+
+  // Destination address fields
+  to,
+  cc,
+  bcc,
+
+  // Identification fields
+  message_id,
+  in_reply_to,
+  references,
+
+  // Informational fields
+  subject,
+  comments,
+  keywords,
+
+  // Resent fields
+  resent_date,
+  resent_from,
+  resent_sender,
+  resent_to,
+  resent_cc,
+  resent_bcc,
+  resent_message_id,
+
+  // MIME fields
+  mime_version,
+  content_type,
+  content_transfer_encoding,
+  content_id,
+  content_description,
+  content_disposition,
+
+  unknown, // none of the above
+};
+
+inline constexpr phash field_names{std::array<std::string_view, 35>{
+  "Return-Path",
+  "Received",
+  "Received-SPF",
+  "Authentication-Results",
+  "Delivered-To",
+
+  "DKIM-Signature",
+  "ARC-Seal",
+  "ARC-Message-Signature",
+  "ARC-Authentication-Results",
+
+  "Date",
+  "From",
+  "Sender",
+  "Reply-To",
+
+  "To",
+  "Cc",
+  "Bcc",
+
+  "Message-ID",
+  "In-Reply-To",
+  "References",
+
+  "Subject",
+  "Comments",
+  "Keywords",
+
+  "Resent-Date",
+  "Resent-From",
+  "Resent-Sender",
+  "Resent-To",
+  "Resent-Cc",
+  "Resent-Bcc",
+  "Resent-Message-ID",
+
+  "MIME-Version",
+  "Content-Type",
+  "Content-Transfer-Encoding",
+  "Content-ID",
+  "Content-Description",
+  "Content-Disposition",
+}};
+// clang-format on
+
+static_assert(field_names.size() == static_cast<std::size_t>(field::unknown));
+
+constexpr field field_of(std::string_view name) noexcept
+{
+  return static_cast<field>(field_names.find(name));
+}
+
+// The name as it's usually written; "" for unknown.
+constexpr std::string_view name_of(field f) noexcept
+{
+  return (f == field::unknown) ? std::string_view{}
+                               : field_names[static_cast<std::size_t>(f)];
+}
+
+static_assert(field_of("from") == field::from);
+static_assert(field_of("CONTENT-DISPOSITION") == field::content_disposition);
+static_assert(field_of("X-Mailer") == field::unknown);
+
+} // namespace RFC5322
+
+#endif // RFC5322_FIELDS_DOT_HPP
@@ -0,0 +1,808 @@
+#include "SPF-eval.hpp"
+
+#include "DNS-fcrdns.hpp"
+#include "Domain.hpp"
+#include "IP4.hpp"
+#include "IP6.hpp"
+#include "iequal.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include <fmt/format.h>
+
+#include <glog/logging.h>
+
+namespace SPF {
+
+struct Eval::mechanism {
+  char        qualifier{'+'};
+  std::string name; // all, include, a, mx, ptr, ip4, ip6 or exists
+  std::string arg;  // domain-spec or address
+  int         cidr4{32};
+  int         cidr6{128};
+};
+
+struct Eval::record {
+  std::vector<mechanism>     mechs;
+  std::optional<std::string> redirect;
+};
+
+namespace {
+Result qualifier_result(char qualifier)
+{
+  switch (qualifier) {
+  case '-': return Result::FAIL;
+  case '~': return Result::SOFTFAIL;
+  case '?': return Result::NEUTRAL;
+  }
+  return Result::PASS;
+}
+
+std::string lower(std::string_view s)
+{
+  std::string ret(s);
+  std::transform(begin(ret), end(ret), begin(ret),
+                 [](unsigned char c) { return std::tolower(c); });
+  return ret;
+}
+
+// RFC 7208 section 4.3: a malformed or single label domain gets none.
+bool valid_domain(std::string_view dom)
+{
+  dom = Domain::remove_trailing_dot(dom);
+  if (dom.empty() || dom.length() > 253 || dom.find('.') == dom.npos)
+    return false;
+  while (!dom.empty()) {
+    auto const dot   = dom.find('.');
+    auto const label = dom.substr(0, dot);
+    if (label.empty() || label.length() > 63)
+      return false;
+    if (dot == dom.npos)
+      break;
+    dom.remove_prefix(dot + 1);
+  }
+  return true;
+}
+
+bool is_spf1(std::string_view txt)
+{
+  return istarts_with(txt, "v=spf1") &&
+         ((txt.length() == 6) || (txt[6] == ' '));
+}
+
+bool parse_cidr(std::string_view s, int max, int& cidr)
+{
+  if (s.empty() || s.length() > 3 ||
+      !std::all_of(begin(s), end(s),
+                   [](unsigned char c) { return std::isdigit(c); }))
+    return false;
+  if (s.length() > 1 && s[0] == '0')
+    return false;
+  cidr = std::stoi(std::string(s));
+  return cidr <= max;
+}
+
+bool is_modifier_name(std::string_view name)
+{
+  return !name.empty() && std::isalpha(static_cast<unsigned char>(name[0])) &&
+         std::all_of(begin(name), end(name), [](unsigned char c) {
+           return std::isalnum(c) || c == '-' || c == '_' || c == '.';
+         });
+}
+} // namespace
+
+Eval::Eval(DNS::Resolver& res, std::string_view receiver, SharedCache* cache)
+  : res_(res)
+  , receiver_(receiver)
+  , cache_(cache)
+{
+}
+
+void Eval::set_ip_str(char const* ip)
+{
+  ip_ = ip;
+  if (IP4::is_address(ip)) {
+    ip6_ = false;
+    CHECK_EQ(inet_pton(AF_INET, ip, ip_bin_), 1);
+  }
+  else if (IP6::is_address(ip)) {
+    ip6_ = true;
+    CHECK_EQ(inet_pton(AF_INET6, ip, ip_bin_), 1);
+  }
+  else {
+    LOG(FATAL) << "non IP address passed to set_ip_str: " << ip;
+  }
+}
+
+void Eval::set_helo_dom(char const* dom) { helo_ = dom; }
+
+void Eval::set_env_from(char const* frm) { env_from_ = frm; }
+
+Result Eval::check()
+{
+  lookups_         = 0;
+  voids_           = 0;
+  uses_local_part_ = false;
+  used_ptr_        = false;
+  answers_.clear();
+  error_msg_.clear();
+
+  // RFC 7208 section 2.4, with a null reverse-path use the HELO.
+  auto sender = env_from_.empty() ? fmt::format("postmaster@{}", helo_)
+                                  : env_from_;
+  auto const at = sender.rfind('@');
+  if (at == sender.npos) {
+    sender_local_ = "postmaster";
+    sender_dom_   = sender;
+  }
+  else {
+    sender_local_ = at ? sender.substr(0, at) : "postmaster";
+    sender_dom_   = sender.substr(at + 1);
+  }
+  env_from_ = fmt::format("{}@{}", sender_local_, sender_dom_);
+
+  if (from_cache_())
+    return result_;
+
+  result_ = check_host_(lower(Domain::remove_trailing_dot(sender_dom_)));
+
+  set_comments_();
+  to_cache_();
+
+  return result_;
+}
+
+Result Eval::check_host_(std::string const& domain)
+{
+  if (!valid_domain(domain))
+    return Result::NONE;
+
+  record rec;
+  if (!fetch_record_(domain, rec))
+    return error_;
+
+  prefetch_(rec, domain);
+
+  for (auto const& mech : rec.mechs) {
+    switch (eval_(mech, domain)) {
+    case match::yes: return qualifier_result(mech.qualifier);
+    case match::no: break;
+    case match::error: return error_;
+    }
+  }
+
+  if (rec.redirect) {
+    if (!count_lookup_())
+      return error_;
+    auto const target = expand_(*rec.redirect, domain);
+    if (!target) {
+      error_msg_ = "invalid macro";
+      return Result::PERMERROR;
+    }
+    auto const result = check_host_(*target);
+    if (result == Result::NONE) {
+      error_msg_ = fmt::format("no SPF record at redirect {}", *target);
+      return Result::PERMERROR;
+    }
+    return result;
+  }
+
+  return Result::NEUTRAL;
+}
+
+Eval::match Eval::eval_(mechanism const& mech, std::string const& domain)
+{
+  if (mech.name == "all")
+    return match::yes;
+
+  if (mech.name == "ip4")
+    return (!ip6_ && ip_match_(mech.arg, mech.cidr4)) ? match::yes : match::no;
+
+  if (mech.name == "ip6")
+    return (ip6_ && ip_match_(mech.arg, mech.cidr6)) ? match::yes : match::no;
+
+  // Everything else costs a lookup.
+  if (!count_lookup_())
+    return match::error;
+
+  auto const target = target_(mech, domain);
+  if (!target) {
+    error_     = Result::PERMERROR;
+    error_msg_ = fmt::format("invalid macro in {}", mech.name);
+    return match::error;
+  }
+
+  if (mech.name == "include") {
+    switch (auto const result = check_host_(*target); Result::value_t(result)) {
+    case Result::PASS: return match::yes;
+    case Result::FAIL:
+    case Result::SOFTFAIL:
+    case Result::NEUTRAL: return match::no;
+    case Result::TEMPERROR:
+      error_ = Result::TEMPERROR;
+      return match::error;
+    default:
+      error_ = Result::PERMERROR;
+      if (result == Result::NONE)
+        error_msg_ = fmt::format("no SPF record at include {}", *target);
+      return match::error;
+    }
+  }
+
+  if (mech.name == "exists") {
+    auto& q = query_(DNS::RR_type::A, *target);
+    if (q.bogus_or_indeterminate()) {
+      error_     = Result::TEMPERROR;
+      error_msg_ = fmt::format("DNS failure for {}", *target);
+      return match::error;
+    }
+    if (!count_void_(q))
+      return match::error;
+    return q.has_record() ? match::yes : match::no;
+  }
+
+  if (mech.name == "a") {
+    auto& q = query_(ip6_ ? DNS::RR_type::AAAA : DNS::RR_type::A, *target);
+    if (q.bogus_or_indeterminate()) {
+      error_     = Result::TEMPERROR;
+      error_msg_ = fmt::format("DNS failure for {}", *target);
+      return match::error;
+    }
+    if (!count_void_(q))
+      return match::error;
+    return ip_match_(q, mech.cidr4, mech.cidr6) ? match::yes : match::no;
+  }
+
+  if (mech.name == "mx") {
+    auto& q = query_(DNS::RR_type::MX, *target);
+    if (q.bogus_or_indeterminate()) {
+      error_     = Result::TEMPERROR;
+      error_msg_ = fmt::format("DNS failure for {}", *target);
+      return match::error;
+    }
+    if (!count_void_(q))
+      return match::error;
+
+    std::vector<std::string> exchanges;
+    for (auto const& rr : q.get_records()) {
+      if (std::holds_alternative<DNS::RR_MX>(rr))
+        exchanges.push_back(lower(std::get<DNS::RR_MX>(rr).exchange()));
+    }
+    if (exchanges.size() > std::size_t(Config::spf_max_mx_names)) {
+      error_     = Result::PERMERROR;
+      error_msg_ = fmt::format("too many MX names for {}", *target);
+      return match::error;
+    }
+
+    // Ask for all the exchange addresses at once.
+    auto const type = ip6_ ? DNS::RR_type::AAAA : DNS::RR_type::A;
+    std::vector<DNS::Query::question> qs;
+    for (auto const& exchange : exchanges) {
+      if (!answers_.count({type, exchange}))
+        qs.emplace_back(type, exchange);
+    }
+    if (!qs.empty()) {
+      auto queries = DNS::Query::batch(res_, qs);
+      for (auto i = 0u; i < qs.size(); ++i)
+        answers_[qs[i]] = std::move(queries[i]);
+    }
+
+    for (auto const& exchange : exchanges) {
+      if (ip_match_(query_(type, exchange), mech.cidr4, mech.cidr6))
+        return match::yes;
+    }
+    return match::no;
+  }
+
+  if (mech.name == "ptr") {
+    used_ptr_ = true;
+
+    auto const names = DNS::fcrdns(res_, ip_);
+    auto       n     = 0;
+    for (auto const& name : names) {
+      if (++n > Config::spf_max_ptr_names)
+        break;
+      auto const nm = Domain::remove_trailing_dot(name);
+      if (iequal(nm, *target) || iends_with(nm, "." + *target))
+        return match::yes;
+    }
+    return match::no;
+  }
+
+  LOG(FATAL) << "unknown mechanism " << mech.name;
+  return match::error;
+}
+
+bool Eval::fetch_record_(std::string const& domain, record& rec)
+{
+  auto& q = query_(DNS::RR_type::TXT, domain);
+  if (q.bogus_or_indeterminate()) {
+    error_     = Result::TEMPERROR;
+    error_msg_ = fmt::format("DNS failure for {}", domain);
+    return false;
+  }
+
+  std::vector<std::string> spf_recs;
+  for (auto const& txt : q.get_strings()) {
+    if (is_spf1(txt))
+      spf_recs.push_back(txt);
+  }
+
+  if (spf_recs.empty()) {
+    error_ = Result::NONE;
+    return false;
+  }
+  if (spf_recs.size() > 1) {
+    error_     = Result::PERMERROR;
+    error_msg_ = fmt::format("multiple SPF records for {}", domain);
+    return false;
+  }
+
+  if (!parse_record_(spf_recs[0], rec)) {
+    error_ = Result::PERMERROR;
+    return false;
+  }
+  return true;
+}
+
+bool Eval::parse_record_(std::string_view txt, record& rec)
+{
+  txt.remove_prefix(6); // "v=spf1"
+
+  auto exp = false;
+
+  while (!txt.empty()) {
+    auto const sp = txt.find(' ');
+    auto       term = txt.substr(0, sp);
+    txt.remove_prefix(sp == txt.npos ? txt.length() : sp + 1);
+    if (term.empty())
+      continue;
+
+    auto const sep = term.find_first_of(":/=");
+    if (sep != term.npos && term[sep] == '=' &&
+        is_modifier_name(term.substr(0, sep))) {
+      auto const name  = term.substr(0, sep);
+      auto const value = term.substr(sep + 1);
+      if (iequal(name, "redirect")) {
+        if (rec.redirect || value.empty()) {
+          error_msg_ = "bad redirect modifier";
+          return false;
+        }
+        rec.redirect = std::string(value);
+      }
+      else if (iequal(name, "exp")) {
+        if (exp) {
+          error_msg_ = "duplicate exp modifier";
+          return false;
+        }
+        exp = true;
+      }
+      // unknown modifiers are ignored
+      continue;
+    }
+
+    mechanism mech;
+    if (std::strchr("+-~?", term[0])) {
+      mech.qualifier = term[0];
+      term.remove_prefix(1);
+    }
+
+    auto const name_end = term.find_first_of(":/");
+    mech.name           = lower(term.substr(0, name_end));
+    term.remove_prefix(name_end == term.npos ? term.length() : name_end);
+
+    auto const is = [&mech](char const* name) { return mech.name == name; };
+
+    if (!(is("all") || is("include") || is("a") || is("mx") || is("ptr") ||
+          is("ip4") || is("ip6") || is("exists"))) {
+      error_msg_ = fmt::format("unknown mechanism {}", mech.name);
+      return false;
+    }
+
+    if (!term.empty() && term[0] == ':') {
+      term.remove_prefix(1);
+      auto const slash = term.find('/');
+      mech.arg         = std::string(term.substr(0, slash));
+      term.remove_prefix(slash == term.npos ? term.length() : slash);
+      if (mech.arg.empty()) {
+        error_msg_ = fmt::format("empty argument to {}", mech.name);
+        return false;
+      }
+    }
+
+    if (!term.empty()) { // CIDR length(s)
+      auto ok = false;
+      if (is("ip4")) {
+        ok = parse_cidr(term.substr(1), 32, mech.cidr4);
+      }
+      else if (is("ip6")) {
+        ok = parse_cidr(term.substr(1), 128, mech.cidr6);
+      }
+      else if (is("a") || is("mx")) {
+        // "/24", "//64" or "/24//64"
+        auto const dbl = term.find("//");
+        auto const v4  = term.substr(0, dbl);
+        ok             = true;
+        if (!v4.empty())
+          ok = parse_cidr(v4.substr(1), 32, mech.cidr4);
+        if (ok && dbl != term.npos)
+          ok = parse_cidr(term.substr(dbl + 2), 128, mech.cidr6);
+      }
+      if (!ok) {
+        error_msg_ = fmt::format("bad CIDR length for {}", mech.name);
+        return false;
+      }
+    }
+
+    auto const needs_arg =
+        is("include") || is("exists") || is("ip4") || is("ip6");
+    if ((needs_arg && mech.arg.empty()) || (is("all") && !mech.arg.empty())) {
+      error_msg_ = fmt::format("bad argument to {}", mech.name);
+      return false;
+    }
+
+    if ((is("ip4") && !IP4::is_address(mech.arg)) ||
+        (is("ip6") && !IP6::is_address(mech.arg))) {
+      error_msg_ = fmt::format("bad address {}", mech.arg);
+      return false;
+    }
+
+    rec.mechs.push_back(std::move(mech));
+  }
+
+  return true;
+}
+
+// Ask for everything this record might need in one go, up to what is
+// left of the lookup limit.  A match early in the record means some
+// answers go unused; that is cheaper than waiting on them in turn.
+void Eval::prefetch_(record const& rec, std::string const& domain)
+{
+  auto budget = Config::spf_max_lookups - lookups_;
+
+  std::vector<DNS::Query::question> qs;
+
+  auto const want = [&](DNS::RR_type type, std::optional<std::string> name) {
+    if (!name || !valid_domain(*name))
+      return;
+    DNS::Query::question qn{type, lower(*name)};
+    if (answers_.count(qn) || std::count(begin(qs), end(qs), qn))
+      return;
+    qs.push_back(std::move(qn));
+  };
+
+  auto const addr_type = ip6_ ? DNS::RR_type::AAAA : DNS::RR_type::A;
+
+  for (auto const& mech : rec.mechs) {
+    if (mech.name == "all" || mech.name == "ip4" || mech.name == "ip6")
+      continue;
+    if (budget-- <= 0)
+      break;
+    if (mech.name == "include")
+      want(DNS::RR_type::TXT, target_(mech, domain));
+    else if (mech.name == "a")
+      want(addr_type, target_(mech, domain));
+    else if (mech.name == "mx")
+      want(DNS::RR_type::MX, target_(mech, domain));
+    else if (mech.name == "exists")
+      want(DNS::RR_type::A, target_(mech, domain));
+  }
+  if (rec.redirect && budget > 0)
+    want(DNS::RR_type::TXT, expand_(*rec.redirect, domain));
+
+  if (qs.size() < 2) // nothing to be gained
+    return;
+
+  auto queries = DNS::Query::batch(res_, qs);
+  for (auto i = 0u; i < qs.size(); ++i)
+    answers_[qs[i]] = std::move(queries[i]);
+}
+
+DNS::Query& Eval::query_(DNS::RR_type type, std::string const& name)
+{
+  auto& q = answers_[{type, lower(name)}];
+  if (!q)
+    q = std::make_unique<DNS::Query>(res_, type, name);
+  return *q;
+}
+
+bool Eval::count_lookup_()
+{
+  if (++lookups_ > Config::spf_max_lookups) {
+    error_     = Result::PERMERROR;
+    error_msg_ = "too many DNS lookups";
+    return false;
+  }
+  return true;
+}
+
+bool Eval::count_void_(DNS::Query& q)
+{
+  if ((q.nx_domain() || !q.has_record()) &&
+      (++voids_ > Config::spf_max_void_lookups)) {
+    error_     = Result::PERMERROR;
+    error_msg_ = "too many void DNS lookups";
+    return false;
+  }
+  return true;
+}
+
+bool Eval::ip_match_(DNS::Query& q, int cidr4, int cidr6)
+{
+  for (auto const& rr : q.get_records()) {
+    if (!ip6_ && std::holds_alternative<DNS::RR_A>(rr)) {
+      if (ip_match_(std::get<DNS::RR_A>(rr).c_str(), cidr4))
+        return true;
+    }
+    else if (ip6_ && std::holds_alternative<DNS::RR_AAAA>(rr)) {
+      if (ip_match_(std::get<DNS::RR_AAAA>(rr).c_str(), cidr6))
+        return true;
+    }
+  }
+  return false;
+}
+
+bool Eval::ip_match_(std::string_view addr, int cidr) const
+{
+  std::string const addr_str(addr);
+  unsigned char     bin[sizeof(ip_bin_)];
+  if (inet_pton(ip6_ ? AF_INET6 : AF_INET, addr_str.c_str(), bin) != 1)
+    return false;
+
+  auto const whole = cidr / 8;
+  if (std::memcmp(bin, ip_bin_, whole))
+    return false;
+  if (auto const bits = cidr % 8; bits) {
+    auto const mask = static_cast<unsigned char>(0xFF << (8 - bits));
+    return (bin[whole] & mask) == (ip_bin_[whole] & mask);
+  }
+  return true;
+}
+
+std::optional<std::string> Eval::target_(mechanism const&   mech,
+                                         std::string const& domain) const
+{
+  if (mech.arg.empty())
+    return domain;
+  return expand_(mech.arg, domain);
+}
+
+// RFC 7208 section 7, macros.
+std::optional<std::string> Eval::expand_(std::string_view   macro_string,
+                                         std::string const& domain) const
+{
+  std::string out;
+
+  for (auto i = 0u; i < macro_string.length(); ++i) {
+    auto const ch = macro_string[i];
+    if (ch != '%') {
+      out += ch;
+      continue;
+    }
+    if (++i == macro_string.length())
+      return {};
+
+    switch (macro_string[i]) {
+    case '%': out += '%'; continue;
+    case '_': out += ' '; continue;
+    case '-': out += "%20"; continue;
+    case '{': break;
+    default: return {};
+    }
+
+    auto const close = macro_string.find('}', i);
+    if (close == macro_string.npos || close == i + 1)
+      return {};
+    auto spec = macro_string.substr(i + 1, close - i - 1);
+    i         = close;
+
+    auto const letter = spec[0];
+    spec.remove_prefix(1);
+
+    std::string value;
+    switch (std::tolower(static_cast<unsigned char>(letter))) {
+    case 's':
+      value            = env_from_;
+      uses_local_part_ = true;
+      break;
+    case 'l':
+      value            = sender_local_;
+      uses_local_part_ = true;
+      break;
+    case 'o': value = sender_dom_; break;
+    case 'd': value = domain; break;
+    case 'h': value = helo_; break;
+    case 'p': value = "unknown"; break;
+    case 'v': value = ip6_ ? "ip6" : "in-addr"; break;
+    case 'c': value = ip_; break;
+    case 'r': value = receiver_; break;
+    case 't': value = std::to_string(std::time(nullptr)); break;
+    case 'i':
+      if (ip6_) {
+        for (auto b : ip_bin_) {
+          value += fmt::format("{:x}.{:x}.", b >> 4, b & 0xF);
+        }
+        value.pop_back();
+      }
+      else {
+        value = ip_;
+      }
+      break;
+    default: return {};
+    }
+
+    // transformers: *DIGIT [ "r" ], then delimiters
+    std::size_t digits = 0;
+    while (digits < spec.length() &&
+           std::isdigit(static_cast<unsigned char>(spec[digits])))
+      ++digits;
+    auto keep = 0u;
+    if (digits) {
+      keep = std::stoul(std::string(spec.substr(0, digits)));
+      if (keep == 0)
+        return {};
+    }
+    spec.remove_prefix(digits);
+    auto const reverse = !spec.empty() && (spec[0] == 'r' || spec[0] == 'R');
+    if (reverse)
+      spec.remove_prefix(1);
+    if (spec.find_first_not_of(".-+,/_=") != spec.npos)
+      return {};
+    auto const delims = spec.empty() ? std::string_view(".") : spec;
+
+    std::vector<std::string_view> parts;
+    std::string_view              v(value);
+    for (;;) {
+      auto const d = v.find_first_of(delims);
+      parts.push_back(v.substr(0, d));
+      if (d == v.npos)
+        break;
+      v.remove_prefix(d + 1);
+    }
+    if (reverse)
+      std::reverse(begin(parts), end(parts));
+    if (keep && keep < parts.size())
+      parts.erase(begin(parts), end(parts) - keep);
+
+    std::string expanded;
+    for (auto const& part : parts) {
+      if (!expanded.empty())
+        expanded += '.';
+      expanded += part;
+    }
+
+    if (std::isupper(static_cast<unsigned char>(letter))) {
+      std::string escaped;
+      for (unsigned char c : expanded) {
+        if (std::isalnum(c) || std::strchr("-._~", c))
+          escaped += c;
+        else
+          escaped += fmt::format("%{:02X}", c);
+      }
+      expanded = std::move(escaped);
+    }
+
+    out += expanded;
+  }
+
+  // Drop labels from the left until it fits.
+  while (out.length() > 253) {
+    auto const dot = out.find('.');
+    if (dot == out.npos)
+      return {};
+    out.erase(0, dot + 1);
+  }
+
+  return out;
+}
+
+// Same wording as libspf2, so headers don't change with the evaluator.
+void Eval::set_comments_()
+{
+  switch (result_) {
+  case Result::PASS:
+    header_comment_ =
+        fmt::format("{}: domain of {} designates {} as permitted sender",
+                    receiver_, sender_dom_, ip_);
+    break;
+  case Result::FAIL:
+    header_comment_ = fmt::format(
+        "{}: domain of {} does not designate {} as permitted sender",
+        receiver_, sender_dom_, ip_);
+    break;
+  case Result::SOFTFAIL:
+    header_comment_ =
+        fmt::format("{}: transitioning domain of {} does not designate {} as "
+                    "permitted sender",
+                    receiver_, sender_dom_, ip_);
+    break;
+  case Result::NEUTRAL:
+    header_comment_ =
+        fmt::format("{}: {} is neither permitted nor denied by domain of {}",
+                    receiver_, ip_, sender_dom_);
+    break;
+  case Result::NONE:
+    header_comment_ = fmt::format(
+        "{}: domain of {} does not designate permitted sender hosts",
+        receiver_, sender_dom_);
+    break;
+  default:
+    header_comment_ =
+        fmt::format("{}: error in processing during lookup of {}: {}",
+                    receiver_, sender_dom_, error_msg_);
+    break;
+  }
+
+  received_spf_ = fmt::format(
+      "Received-SPF: {} ({}) client-ip={}; envelope-from=\"{}\"; helo={};",
+      result_.c_str(), header_comment_, ip_, env_from_, helo_);
+}
+
+std::string Eval::cache_key_() const
+{
+  return fmt::format("{}\t{}\t{}", ip_, lower(sender_dom_), lower(helo_));
+}
+
+// The cached value is the result followed by the header comment; the
+// Received-SPF field is rebuilt with this message's envelope-from.
+bool Eval::from_cache_()
+{
+  if (!cache_)
+    return false;
+
+  auto const val = cache_->get(cache_key_());
+  if (!val)
+    return false;
+
+  auto const sp = val->find(' ');
+  if (sp == val->npos)
+    return false;
+
+  result_         = Result::value_t(std::stoi(val->substr(0, sp)));
+  header_comment_ = val->substr(sp + 1);
+
+  received_spf_ = fmt::format(
+      "Received-SPF: {} ({}) client-ip={}; envelope-from=\"{}\"; helo={};",
+      result_.c_str(), header_comment_, ip_, env_from_, helo_);
+
+  LOG(INFO) << "SPF result for " << sender_dom_ << " from cache";
+  return true;
+}
+
+void Eval::to_cache_() const
+{
+  if (!cache_ || uses_local_part_ || (result_ == Result::TEMPERROR))
+    return;
+
+  auto const ttl = ttl_();
+  if (ttl.count() <= 0)
+    return;
+
+  cache_->put(cache_key_(),
+              fmt::format("{} {}", int(Result::value_t(result_)),
+                          header_comment_),
+              ttl);
+}
+
+std::chrono::seconds Eval::ttl_() const
+{
+  std::chrono::seconds ttl = Config::spf_cache_max_ttl;
+  if (used_ptr_)
+    ttl = std::min<std::chrono::seconds>(ttl, Config::spf_cache_neg_ttl);
+  for (auto const& [question, q] : answers_) {
+    auto const t = q->min_ttl();
+    if (q->bogus_or_indeterminate())
+      return std::chrono::seconds(0);
+    ttl = std::min<std::chrono::seconds>(
+        ttl, t ? std::chrono::seconds(t) : Config::spf_cache_neg_ttl);
+  }
+  return ttl;
+}
+
+} // namespace SPF
@@ -0,0 +1,121 @@
+#ifndef SPF_EVAL_DOT_HPP
+#define SPF_EVAL_DOT_HPP
+
+// An RFC 7208 check_host() that does its lookups through our own
+// DNS::Resolver.  The DNS terms of each record (include, a, mx,
+// exists, redirect) are asked for in one pipelined batch, so the
+// nameserver resolves them concurrently rather than one at a time.
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "DNS.hpp"
+#include "SPF.hpp"
+#include "SharedCache.hpp"
+
+namespace Config {
+constexpr int spf_max_lookups      = 10; // RFC 7208 section 4.6.4
+constexpr int spf_max_void_lookups = 2;
+constexpr int spf_max_mx_names     = 10;
+constexpr int spf_max_ptr_names    = 10;
+
+// Results are cached for the smallest TTL of the records consulted,
+// but no longer than max; negative answers count as neg_ttl.
+constexpr auto spf_cache_max_ttl = std::chrono::hours(1);
+constexpr auto spf_cache_neg_ttl = std::chrono::minutes(5);
+} // namespace Config
+
+namespace SPF {
+
+class Eval {
+public:
+  Eval(Eval const&) = delete;
+  Eval& operator=(Eval const&) = delete;
+
+  // The receiver is the name used in the comments, as with Server.
+  // With a cache, results are shared by (client IP, sender domain,
+  // HELO) with other sessions.
+  Eval(DNS::Resolver&   res,
+       std::string_view receiver,
+       SharedCache*     cache = nullptr);
+
+  void set_ip_str(char const* ip);
+  void set_helo_dom(char const* dom);
+  void set_env_from(char const* frm);
+
+  Result check();
+
+  Result             result() const { return result_; }
+  std::string const& sender_dom() const { return sender_dom_; }
+  std::string const& header_comment() const { return header_comment_; }
+  std::string const& received_spf() const { return received_spf_; }
+
+private:
+  struct mechanism;
+  struct record;
+
+  enum class match { yes, no, error };
+
+  Result check_host_(std::string const& domain);
+  match  eval_(mechanism const& mech, std::string const& domain);
+
+  bool fetch_record_(std::string const& domain, record& rec);
+  bool parse_record_(std::string_view txt, record& rec);
+  void prefetch_(record const& rec, std::string const& domain);
+
+  DNS::Query& query_(DNS::RR_type type, std::string const& name);
+  bool        count_lookup_();
+  bool        count_void_(DNS::Query& q);
+
+  bool ip_match_(DNS::Query& q, int cidr4, int cidr6);
+  bool ip_match_(std::string_view addr, int cidr) const;
+
+  std::optional<std::string> expand_(std::string_view   macro_string,
+                                     std::string const& domain) const;
+  std::optional<std::string> target_(mechanism const&   mech,
+                                     std::string const& domain) const;
+
+  void set_comments_();
+
+  std::string          cache_key_() const;
+  bool                 from_cache_();
+  void                 to_cache_() const;
+  std::chrono::seconds ttl_() const;
+
+  DNS::Resolver& res_;
+  std::string    receiver_;
+  SharedCache*   cache_;
+
+  std::string   ip_;
+  bool          ip6_{false};
+  unsigned char ip_bin_[16]{};
+  std::string   helo_;
+  std::string   env_from_;
+  std::string   sender_local_;
+  std::string   sender_dom_;
+
+  int lookups_{0};
+  int voids_{0};
+
+  // The result depends on the local-part, or on lookups we can't
+  // time, so it can't be shared.
+  mutable bool uses_local_part_{false};
+  bool         used_ptr_{false};
+
+  Result      result_;
+  Result      error_;     // set when eval_ returns match::error
+  std::string error_msg_; // for the header comment
+  std::string header_comment_;
+  std::string received_spf_;
+
+  std::map<std::pair<DNS::RR_type, std::string>, std::unique_ptr<DNS::Query>>
+      answers_;
+};
+
+} // namespace SPF
+
+#endif // SPF_EVAL_DOT_HPP
@@ -1,5 +1,8 @@
 #include "SPF.hpp"
 
+#include "SPF-eval.hpp"
+#include "osutil.hpp"
+
 #include <iostream>
 
 int main(int argc, char const* argv[])
@@ -66,6 +69,23 @@ int main(int argc, char const* argv[])
                                          "ip=10.1.1.1&receiver=Example.com : "
                                          "Reason: mechanism"));
 
+  // The native evaluator must agree with libspf2.
+  DNS::Resolver dns_res{osutil::get_config_dir()};
+
+  SPF::Eval ev{dns_res, "Example.com"};
+  ev.set_ip_str("108.83.36.113");
+  ev.set_helo_dom("digilicious.com");
+  ev.set_env_from("postmaster@digilicious.com");
+  CHECK_EQ(ev.check(), SPF::Result::PASS);
+  CHECK_EQ(ev.header_comment(), res.header_comment());
+  CHECK_EQ(ev.received_spf(), pass_new);
+  CHECK_EQ(ev.sender_dom(), "digilicious.com");
+
+  ev.set_ip_str("10.1.1.1");
+  CHECK_EQ(ev.check(), SPF::Result::FAIL);
+  CHECK_EQ(ev.header_comment(), res2.header_comment());
+  CHECK_EQ(ev.received_spf(), fail_new);
+
   SPF::Request req3{srv};
   req3.set_ipv6_str("2600:1700:c281:3070:6a1c:a2ff:fe12:4ae6");
   req3.set_helo_dom("digilicious.com");
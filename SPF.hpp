@@ -39,6 +39,11 @@ public:
   static constexpr auto PERMERROR = value_t::PERMERROR;
   // clang-format on
 
+  Result(value_t value)
+    : value_(value)
+  {
+  }
+
   static char const* c_str(value_t value);
 
   char const* c_str() const { return c_str(value_); }
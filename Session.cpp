@@ -1,16 +1,17 @@
 #include <algorithm>
 #include <charconv>
-#include <iomanip>
 #include <iostream>
 #include <string>
 #include <vector>
 
 #include "DNS.hpp"
 #include "Domain.hpp"
+#include "EventLog.hpp"
 #include "IP.hpp"
 #include "IP4.hpp"
 #include "IP6.hpp"
 #include "MessageStore.hpp"
+#include "SPF-eval.hpp"
 #include "Session.hpp"
 #include "esc.hpp"
 #include "iequal.hpp"
@@ -168,6 +169,13 @@ constexpr int  max_unrecognized_cmds      = 20;
 // section 4.5.3.2.7.
 constexpr auto read_timeout  = std::chrono::minutes{5};
 constexpr auto write_timeout = std::chrono::seconds{30};
+
+// 4096 one kilobyte slots, shared by all smtp processes.
+constexpr char const* spf_cache_name  = "/ghsmtp-spf";
+constexpr size_t      spf_cache_slots = 4096;
+
+// Read out by smtp-metrics.
+constexpr char const* metrics_name = "/ghsmtp-metrics";
 } // namespace Config
 
 DEFINE_bool(immortal, false, "don't set process timout");
@@ -194,6 +202,8 @@ Session::Session(fs::path                  config_path,
   : config_path_(config_path)
   , res_(config_path)
   , sock_(fd_in, fd_out, read_hook, Config::read_timeout, Config::write_timeout)
+  , spf_cache_(Config::spf_cache_name, Config::spf_cache_slots)
+  , metrics_(Config::metrics_name)
 //, send_(config_path, "smtp")
 //, srs_(config_path)
 {
@@ -242,6 +252,13 @@ Session::Session(fs::path                  config_path,
   max_msg_size(Config::max_msg_size_initial);
 }
 
+// For when smtp returns from main(); exit_() does the same.
+Session::~Session()
+{
+  metrics_.add(sock_.io_stats());
+  res_.log_trace();
+}
+
 void Session::max_msg_size(size_t max)
 {
   max_msg_size_ = max; // number to advertise via RFC 1870
@@ -287,6 +304,7 @@ void Session::reset_()
   if (msg_) {
     msg_.reset();
   }
+  msg_parse_.reset();
 
   max_msg_size(max_msg_size());
 
@@ -341,6 +359,7 @@ void Session::greeting()
     if (!(ip_allowed_ || fcrdns_allowed_)) {
       if (sock_.input_ready(Config::greeting_wait)) {
         out_() << "421 4.3.2 not accepting network messages\r\n" << std::flush;
+        metrics_.count(Metrics::outcome::early_talker);
         LOG(INFO) << "input before any greeting from " << client_;
         bad_host_("input before any greeting");
       }
@@ -348,14 +367,17 @@ void Session::greeting()
       out_() << "220-" << server_id_() << " ESMTP - ghsmtp\r\n" << std::flush;
       if (sock_.input_ready(Config::greeting_wait)) {
         out_() << "421 4.3.2 not accepting network messages\r\n" << std::flush;
+        metrics_.count(Metrics::outcome::early_talker);
         LOG(INFO) << "input before full greeting from " << client_;
         bad_host_("input before full greeting");
       }
     }
-    LOG(INFO) << "connect from " << client_;
+    EventLog::log(EventLog::event::connect, client_);
   }
 
   out_() << "220 " << server_id_() << " ESMTP - ghsmtp\r\n" << std::flush;
+  metrics_.record(Metrics::phase::greeting,
+                  std::chrono::steady_clock::now() - accepted_);
 
   if ((!FLAGS_immortal) && (getenv("GHSMTP_IMMORTAL") == nullptr)) {
     alarm(2 * 60); // initial alarm
@@ -382,6 +404,8 @@ void Session::check_for_pipeline_error_(std::string_view verb)
 
 void Session::lo_(char const* verb, std::string_view client_identity)
 {
+  Metrics::timer t(metrics_, Metrics::phase::helo);
+
   last_in_group_(verb);
   reset_();
 
@@ -391,6 +415,7 @@ void Session::lo_(char const* verb, std::string_view client_identity)
     std::string error_msg;
     if (!verify_client_(client_identity_, error_msg)) {
       LOG(INFO) << "client identity blocked: " << error_msg;
+      metrics_.count(Metrics::outcome::client_rejected);
       bad_host_(error_msg.c_str());
     }
   }
@@ -442,19 +467,21 @@ void Session::lo_(char const* verb, std::string_view client_identity)
   }
 
   out_() << std::flush;
+  t.stop();
 
   if (sock_.has_peername()) {
     if (std::find(begin(client_fcrdns_), end(client_fcrdns_),
                   client_identity_) != end(client_fcrdns_)) {
-      LOG(INFO) << verb << " " << client_identity << " from "
-                << sock_.them_address_literal();
+      EventLog::log(EventLog::event::helo_from, verb, client_identity,
+                    sock_.them_address_literal());
     }
     else {
-      LOG(INFO) << verb << " " << client_identity << " from " << client_;
+      EventLog::log(EventLog::event::helo_from, verb, client_identity,
+                    client_);
     }
   }
   else {
-    LOG(INFO) << verb << " " << client_identity;
+    EventLog::log(EventLog::event::helo, verb, client_identity);
   }
 }
 
@@ -499,6 +526,7 @@ void Session::mail_from(Mailbox&& reverse_path, parameters_t const& parameters)
   std::string error_msg;
   if (!verify_sender_(reverse_path, error_msg)) {
     LOG(INFO) << "verify sender failed: " << error_msg;
+    metrics_.count(Metrics::outcome::sender_rejected);
     bad_host_(error_msg.c_str());
   }
 
@@ -516,7 +544,8 @@ void Session::mail_from(Mailbox&& reverse_path, parameters_t const& parameters)
       fmt::format_to(params, "={}", value);
     }
   }
-  LOG(INFO) << "MAIL FROM:<" << reverse_path_ << ">" << fmt::to_string(params);
+  EventLog::log(EventLog::event::mail_from, reverse_path_.as_string(),
+                fmt::to_string(params));
 
   state_ = xact_step::rcpt;
 }
@@ -618,11 +647,15 @@ void Session::rcpt_to(Mailbox&& forward_path, parameters_t const& parameters)
     return;
   }
 
+  Metrics::timer t(metrics_, Metrics::phase::rcpt);
+
   if (!verify_rcpt_params_(parameters))
     return;
 
-  if (!verify_recipient_(forward_path))
+  if (!verify_recipient_(forward_path)) {
+    metrics_.count(Metrics::outcome::recipient_rejected);
     return;
+  }
 
   if (!smtputf8_ && !is_ascii(forward_path.local_part())) {
     LOG(WARNING) << "non ascii forward_path \"" << forward_path
@@ -631,6 +664,7 @@ void Session::rcpt_to(Mailbox&& forward_path, parameters_t const& parameters)
 
   if (forward_path_.size() >= Config::max_recipients_per_message) {
     out_() << "452 4.5.3 too many recipients\r\n" << std::flush;
+    metrics_.count(Metrics::outcome::too_many_recipients);
     LOG(WARNING) << "too many recipients <" << forward_path << ">";
     return;
   }
@@ -639,7 +673,7 @@ void Session::rcpt_to(Mailbox&& forward_path, parameters_t const& parameters)
 
   Mailbox const& rcpt_to_mbx = forward_path_.back();
 
-  LOG(INFO) << "RCPT TO:<" << rcpt_to_mbx << ">";
+  EventLog::log(EventLog::event::rcpt_to, rcpt_to_mbx.as_string());
 
   // auto const rcpt_to_str = rcpt_to_mbx.as_string();
 
@@ -715,17 +749,11 @@ std::string Session::added_headers_(MessageStore const& msg)
 }
 
 namespace {
+// The domain lists are built with cdb-gen --normalize, which writes
+// each name as its lower case A-labels: Domain::ascii(), nothing else.
 bool lookup_domain(CDB& cdb, Domain const& domain)
 {
-  if (!domain.empty()) {
-    if (cdb.contains(domain.ascii())) {
-      return true;
-    }
-    if (domain.is_unicode() && cdb.contains(domain.utf8())) {
-      return true;
-    }
-  }
-  return false;
+  return !domain.empty() && cdb.contains(domain.ascii());
 }
 } // namespace
 
@@ -823,8 +851,11 @@ bool Session::msg_new()
 
   auto const& [status, reason]{spam_status_()};
 
-  LOG(INFO) << ((status == SpamStatus::ham) ? "ham since " : "spam since ")
-            << reason;
+  EventLog::log(EventLog::event::spam_verdict,
+                (status == SpamStatus::ham) ? "ham" : "spam", reason);
+  metrics_.count((status == SpamStatus::ham) ? Metrics::outcome::ham
+                                             : Metrics::outcome::spam);
+  msg_started_ = std::chrono::steady_clock::now();
 
   // All sources of ham get a fresh 5 minute timeout per message.
   if (status == SpamStatus::ham) {
@@ -832,7 +863,10 @@ bool Session::msg_new()
       alarm(5 * 60);
   }
 
-  msg_ = std::make_unique<MessageStore>();
+  msg_       = std::make_unique<MessageStore>();
+  msg_parse_ = std::make_unique<message::stream>(
+      message::stream::body_fn{},
+      [this](std::vector<message::header> const&) { msg_headers_(); });
 
   if (!FLAGS_max_write)
     FLAGS_max_write = max_msg_size();
@@ -848,9 +882,8 @@ bool Session::msg_new()
     //                ((status == SpamStatus::spam) ? "Yes" : "No"), reason);
     // msg_->write(spam_status.data(), spam_status.size());
 
-    LOG(INFO) << "Spam-Status: "
-              << ((status == SpamStatus::spam) ? "Yes" : "No") << ", "
-              << reason;
+    EventLog::log(EventLog::event::spam_status,
+                  (status == SpamStatus::spam) ? "Yes" : "No", reason);
 
     return true;
   }
@@ -895,6 +928,9 @@ bool Session::msg_write(char const* s, std::streamsize count)
   if (!msg_)
     return false;
 
+  if (msg_parse_)
+    msg_parse_->feed(std::string_view(s, count));
+
   try {
     if (msg_->write(s, count))
       return true;
@@ -999,7 +1035,7 @@ bool Session::data_start()
   }
 
   out_() << "354 go, end with <CR><LF>.<CR><LF>\r\n" << std::flush;
-  LOG(INFO) << "DATA";
+  EventLog::log(EventLog::event::data);
   return true;
 }
 
@@ -1125,10 +1161,24 @@ bool Session::data_start()
 //   return true;
 // }
 
+// The header section is complete, the body yet to come.
+void Session::msg_headers_()
+{
+  EventLog::log(EventLog::event::message_id,
+                msg_parse_->get_header("Message-ID"));
+  EventLog::log(EventLog::event::from, msg_parse_->get_header("From"));
+}
+
 bool Session::do_deliver_()
 {
   CHECK(msg_);
 
+  Metrics::timer t(metrics_, Metrics::phase::deliver);
+
+  // A message that ends in its header section only now has one.
+  if (msg_parse_)
+    msg_parse_->eom();
+
   // auto const sender   = server_identity_.ascii().c_str();
   // auto const selector = FLAGS_selector.c_str();
   // auto const key_file =
@@ -1136,13 +1186,12 @@ bool Session::do_deliver_()
   // CHECK(fs::exists(key_file)) << "can't find key file " << key_file;
 
   try {
-    // auto const msg_data = msg_->freeze();
-
     // message::parsed msg;
 
     // // Only deal in RFC-5322 Mail Objects.
-    // bool const message_parsed = msg.parse(msg_data);
+    // bool const message_parsed = !msg_parse_->error();
     // if (message_parsed) {
+    //   msg_parse_->fill(msg, body);
 
     //   // remove any Return-Path
     //   message::remove_delivery_headers(msg);
@@ -1176,6 +1225,7 @@ bool Session::do_deliver_()
     // }
 
     msg_->close();
+    metrics_.count(Metrics::outcome::delivered);
   }
   catch (std::system_error const& e) {
     switch (errno) {
@@ -1204,6 +1254,9 @@ void Session::data_done()
 {
   CHECK((state_ == xact_step::data));
 
+  metrics_.record(Metrics::phase::data,
+                  std::chrono::steady_clock::now() - msg_started_);
+
   if (msg_ && msg_->size_error()) {
     data_size_error();
     return;
@@ -1227,13 +1280,13 @@ void Session::data_done()
       if (regex_match(fp.local_part(), what, rex) ||
           regex_match(fp.local_part(), what, all_rex)) {
         auto const str = what[secs_].str();
-        LOG(INFO) << "waiting at DATA " << str << " seconds";
+        EventLog::log(EventLog::event::waiting, "DATA", str);
         long value = 0;
         std::from_chars(str.data(), str.data() + str.size(), value);
-        google::FlushLogFiles(google::INFO);
+        EventLog::flush();
         out_() << std::flush;
         sleep(value);
-        LOG(INFO) << "done waiting";
+        EventLog::log(EventLog::event::done_waiting);
       }
     }
   }
@@ -1241,8 +1294,8 @@ void Session::data_done()
   do_deliver_();
 
   out_() << "250 2.0.0 DATA OK\r\n" << std::flush;
-  LOG(INFO) << "message delivered, " << msg_->size() << " octets, with id "
-            << msg_->id();
+  EventLog::log(EventLog::event::delivered, msg_->size(),
+                msg_->id().as_string_view());
   reset_();
 }
 
@@ -1253,6 +1306,7 @@ void Session::data_size_error()
   if (msg_) {
     msg_->trash();
   }
+  metrics_.count(Metrics::outcome::size_exceeded);
   LOG(WARNING) << "DATA size error";
   reset_();
 }
@@ -1323,10 +1377,13 @@ void Session::bdat_done(size_t n, bool last)
 
   if (!last) {
     out_() << "250 2.0.0 BDAT " << n << " OK\r\n" << std::flush;
-    LOG(INFO) << "BDAT " << n;
+    EventLog::log(EventLog::event::bdat, n);
     return;
   }
 
+  metrics_.record(Metrics::phase::bdat,
+                  std::chrono::steady_clock::now() - msg_started_);
+
   // Check for and act on magic "wait" address.
   {
     using namespace boost::xpressive;
@@ -1338,13 +1395,13 @@ void Session::bdat_done(size_t n, bool last)
       if (regex_match(fp.local_part(), what, rex) ||
           regex_match(fp.local_part(), what, all_rex)) {
         auto const str = what[secs_].str();
-        LOG(INFO) << "waiting at BDAT " << str << " seconds";
+        EventLog::log(EventLog::event::waiting, "BDAT", str);
         long value = 0;
         std::from_chars(str.data(), str.data() + str.size(), value);
-        google::FlushLogFiles(google::INFO);
+        EventLog::flush();
         out_() << std::flush;
         sleep(value);
-        LOG(INFO) << "done waiting";
+        EventLog::log(EventLog::event::done_waiting);
       }
     }
   }
@@ -1352,9 +1409,9 @@ void Session::bdat_done(size_t n, bool last)
   do_deliver_();
 
   out_() << "250 2.0.0 BDAT " << n << " LAST OK\r\n" << std::flush;
-  LOG(INFO) << "BDAT " << n << " LAST";
-  LOG(INFO) << "message delivered, " << msg_->size() << " octets, with id "
-            << msg_->id();
+  EventLog::log(EventLog::event::bdat_last, n);
+  EventLog::log(EventLog::event::delivered, msg_->size(),
+                msg_->id().as_string_view());
   reset_();
 }
 
@@ -1365,6 +1422,7 @@ void Session::bdat_size_error()
   if (msg_) {
     msg_->trash();
   }
+  metrics_.count(Metrics::outcome::size_exceeded);
   LOG(WARNING) << "BDAT size error";
   reset_();
 }
@@ -1395,7 +1453,7 @@ void Session::rset()
 {
   out_() << "250 2.1.5 RSET OK\r\n";
   // No flush RFC-2920 section 3.1, this could be part of a command group.
-  LOG(INFO) << "RSET";
+  EventLog::log(EventLog::event::rset);
   reset_();
 }
 
@@ -1424,12 +1482,13 @@ void Session::quit()
   // send_.quit();
   // last_in_group_("QUIT");
   out_() << "221 2.0.0 closing connection\r\n" << std::flush;
-  LOG(INFO) << "QUIT";
+  EventLog::log(EventLog::event::quit);
   exit_();
 }
 
 void Session::auth()
 {
+  metrics_.count(Metrics::outcome::auth);
   out_() << "454 4.7.0 authentication failure\r\n" << std::flush;
   LOG(INFO) << "AUTH";
   bad_host_("auth");
@@ -1450,6 +1509,7 @@ void Session::cmd_unrecognized(std::string_view cmd)
     out_() << "500 5.5.1 command unrecognized: \"" << escaped
            << "\" exceeds limit\r\n"
            << std::flush;
+    metrics_.count(Metrics::outcome::unrecognized_commands);
     LOG(WARNING) << n_unrecognized_cmds_
                  << " unrecognized commands is too many";
     exit_();
@@ -1463,6 +1523,7 @@ void Session::bare_lf()
 {
   // Error code used by Office 365.
   out_() << "554 5.6.11 bare LF\r\n" << std::flush;
+  metrics_.count(Metrics::outcome::bare_lf);
   LOG(WARNING) << "bare LF";
   exit_();
 }
@@ -1470,6 +1531,7 @@ void Session::bare_lf()
 void Session::max_out()
 {
   out_() << "552 5.3.4 message size limit exceeded\r\n" << std::flush;
+  metrics_.count(Metrics::outcome::size_exceeded);
   LOG(WARNING) << "message size maxed out";
   exit_();
 }
@@ -1477,6 +1539,7 @@ void Session::max_out()
 void Session::time_out()
 {
   out_() << "421 4.4.2 time-out\r\n" << std::flush;
+  metrics_.count(Metrics::outcome::time_out);
   LOG(WARNING) << "time-out" << (sock_.has_peername() ? " from " : "")
                << client_;
   exit_();
@@ -1510,12 +1573,14 @@ void Session::starttls()
 void Session::exit_()
 {
   // sock_.log_totals();
+  metrics_.add(sock_.io_stats());
+  res_.log_trace();
 
   timespec time_used{};
   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time_used);
 
-  LOG(INFO) << "CPU time " << time_used.tv_sec << "." << std::setw(9)
-            << std::setfill('0') << time_used.tv_nsec << " seconds";
+  EventLog::log(EventLog::event::cpu_time, time_used.tv_sec,
+                time_used.tv_nsec);
 
   std::exit(EXIT_SUCCESS);
 }
@@ -1534,6 +1599,7 @@ bool Session::verify_ip_address_(std::string& error_msg)
     error_msg =
         fmt::format("IP address {} on static blocklist", sock_.them_c_str());
     out_() << "554 5.7.1 " << error_msg << "\r\n" << std::flush;
+    metrics_.count(Metrics::outcome::ip_blocklisted);
     return false;
   }
 
@@ -1555,7 +1621,9 @@ bool Session::verify_ip_address_(std::string& error_msg)
     return true;
   }
 
-  auto const fcrdns = DNS::fcrdns(res_, sock_.them_c_str());
+  Metrics::timer fcrdns_t(metrics_, Metrics::phase::fcrdns);
+  auto const     fcrdns = DNS::fcrdns(res_, sock_.them_c_str());
+  fcrdns_t.stop();
   for (auto const& fcr : fcrdns) {
     client_fcrdns_.emplace_back(fcr);
   }
@@ -1585,6 +1653,7 @@ bool Session::verify_ip_address_(std::string& error_msg)
         error_msg =
             fmt::format("FCrDNS {} on static blocklist", client_fcrdns.ascii());
         out_() << "554 5.7.1 blocklisted\r\n" << std::flush;
+        metrics_.count(Metrics::outcome::fcrdns_blocklisted);
         return false;
       }
 
@@ -1594,6 +1663,7 @@ bool Session::verify_ip_address_(std::string& error_msg)
           error_msg = fmt::format(
               "FCrDNS registered domain {} on static blocklist", tld);
           out_() << "554 5.7.1 blocklisted\r\n" << std::flush;
+          metrics_.count(Metrics::outcome::fcrdns_blocklisted);
           return false;
         }
       }
@@ -1649,7 +1719,9 @@ bool Session::verify_ip_address_(std::string& error_msg)
 
     for (auto bl : Config::bls) {
 
-      DNS::Query q(res_, DNS::RR_type::A, reversed + bl);
+      Metrics::timer dnsbl_t(metrics_, Metrics::phase::dnsbl);
+      DNS::Query     q(res_, DNS::RR_type::A, reversed + bl);
+      dnsbl_t.stop();
       if (q.has_record()) {
         auto const as = q.get_strings()[0];
         if (as == "127.0.1.1") {
@@ -1668,6 +1740,7 @@ bool Session::verify_ip_address_(std::string& error_msg)
           error_msg = fmt::format("IP address {} blocked: {} returned {}",
                                   sock_.them_c_str(), bl, as);
           out_() << "554 5.7.1 " << error_msg << "\r\n" << std::flush;
+          metrics_.count(Metrics::outcome::dnsbl_listed);
           return false;
         }
       }
@@ -1675,7 +1748,7 @@ bool Session::verify_ip_address_(std::string& error_msg)
     // LOG(INFO) << "IP address " << sock_.them_c_str() << " cleared by dnsbls";
   }
 
-  LOG(INFO) << "IP address okay";
+  EventLog::log(EventLog::event::ip_okay);
   return true;
 }
 
@@ -1789,8 +1862,7 @@ bool Session::verify_sender_(Mailbox const& sender, std::string& error_msg)
 
   if (sock_.them_address_literal() != sock_.us_address_literal()) {
     if ((accept_domains_.is_open() &&
-         (accept_domains_.contains(sender.domain().ascii()) ||
-          accept_domains_.contains(sender.domain().utf8()))) ||
+         lookup_domain(accept_domains_, sender.domain())) ||
         (sender.domain() == server_identity_)) {
 
       // Ease up in test mode.
@@ -1881,44 +1953,42 @@ void Session::do_spf_check_(Mailbox const& sender)
     return;
   }
 
-  auto const spf_srv     = SPF::Server{server_id_().c_str()};
-  auto       spf_request = SPF::Request{spf_srv};
-
-  if (IP4::is_address(sock_.them_c_str())) {
-    spf_request.set_ipv4_str(sock_.them_c_str());
-  }
-  else if (IP6::is_address(sock_.them_c_str())) {
-    spf_request.set_ipv6_str(sock_.them_c_str());
-  }
-  else {
+  if (!IP4::is_address(sock_.them_c_str()) &&
+      !IP6::is_address(sock_.them_c_str())) {
     LOG(FATAL) << "bogus address " << sock_.them_address_literal() << ", "
                << sock_.them_c_str();
   }
 
   auto const from{static_cast<std::string>(sender)};
 
-  spf_request.set_env_from(from.c_str());
-  spf_request.set_helo_dom(client_identity_.ascii().c_str());
+  SPF::Eval spf_res{res_, server_id_(), &spf_cache_};
+  spf_res.set_ip_str(sock_.them_c_str());
+  spf_res.set_env_from(from.c_str());
+  spf_res.set_helo_dom(client_identity_.ascii().c_str());
+
+  Metrics::timer t(metrics_, Metrics::phase::spf);
+  spf_result_ = spf_res.check();
+  t.stop();
 
-  auto const spf_res{SPF::Response{spf_request}};
-  spf_result_        = spf_res.result();
   spf_received_      = spf_res.received_spf();
-  spf_sender_domain_ = spf_request.get_sender_dom();
+  spf_sender_domain_ = spf_res.sender_dom();
 
-  LOG(INFO) << "spf_received_ == " << spf_received_;
+  using Metrics::outcome;
+  metrics_.count((spf_result_ == SPF::Result::PASS)   ? outcome::spf_pass
+                 : (spf_result_ == SPF::Result::FAIL) ? outcome::spf_fail
+                                                      : outcome::spf_other);
 
-  if (spf_result_ == SPF::Result::FAIL) {
-    LOG(INFO) << "FAIL " << spf_res.header_comment();
-  }
-  else if (spf_result_ == SPF::Result::NEUTRAL) {
-    LOG(INFO) << "NEUTRAL " << spf_res.header_comment();
-  }
-  else if (spf_result_ == SPF::Result::PASS) {
-    LOG(INFO) << "PASS " << spf_res.header_comment();
-  }
-  else {
-    LOG(INFO) << "INVALID/SOFTFAIL/NONE/xERROR " << spf_res.header_comment();
-  }
+  EventLog::log(EventLog::event::spf_received, spf_received_);
+
+  auto const result = [this] {
+    switch (spf_result_) {
+    case SPF::Result::FAIL: return "FAIL";
+    case SPF::Result::NEUTRAL: return "NEUTRAL";
+    case SPF::Result::PASS: return "PASS";
+    default: return "INVALID/SOFTFAIL/NONE/xERROR";
+    }
+  }();
+  EventLog::log(EventLog::event::spf_result, result, spf_res.header_comment());
 }
 
 bool Session::verify_from_params_(parameters_t const& parameters)
@@ -2026,8 +2096,7 @@ bool Session::verify_recipient_(Mailbox const& recipient)
 
     // Domains we accept mail for.
     if (accept_domains_.is_open()) {
-      if (accept_domains_.contains(recipient.domain().ascii()) ||
-          accept_domains_.contains(recipient.domain().utf8())) {
+      if (lookup_domain(accept_domains_, recipient.domain())) {
         return true;
       }
     }
@@ -2096,13 +2165,13 @@ bool Session::verify_recipient_(Mailbox const& recipient)
     if (regex_match(recipient.local_part(), what, rex) ||
         regex_match(recipient.local_part(), what, all_rex)) {
       auto const str = what[secs_].str();
-      LOG(INFO) << "waiting at RCPT TO " << str << " seconds";
+      EventLog::log(EventLog::event::waiting, "RCPT TO", str);
       long value = 0;
       std::from_chars(str.data(), str.data() + str.size(), value);
-      google::FlushLogFiles(google::INFO);
+      EventLog::flush();
       out_() << std::flush;
       sleep(value);
-      LOG(INFO) << "done waiting";
+      EventLog::log(EventLog::event::done_waiting);
     }
   }
 
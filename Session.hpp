@@ -1,6 +1,7 @@
 #ifndef SESSION_DOT_HPP
 #define SESSION_DOT_HPP
 
+#include <chrono>
 #include <random>
 #include <string>
 #include <string_view>
@@ -11,10 +12,13 @@
 #include "DNS-fcrdns.hpp"
 #include "Domain.hpp"
 #include "Mailbox.hpp"
+#include "Metrics.hpp"
 #include "MessageStore.hpp"
 #include "SPF.hpp"
+#include "SharedCache.hpp"
 #include "Sock.hpp"
 #include "TLD.hpp"
+#include "message-stream.hpp"
 #include "message.hpp"
 
 namespace Config {
@@ -36,6 +40,7 @@ public:
       std::function<void(void)> read_hook = []() {},
       int                       fd_in     = STDIN_FILENO,
       int                       fd_out    = STDOUT_FILENO);
+  ~Session();
 
   void greeting();
   void ehlo(std::string_view client_identity) { lo_("EHLO", client_identity); }
@@ -84,6 +89,8 @@ public:
 
   void log_stats() { sock_.log_stats(); }
 
+  void capture(fs::path const& dir) { sock_.capture_on(dir); }
+
   enum class SpamStatus : bool { ham, spam };
 
 private:
@@ -104,6 +111,7 @@ private:
   // bool reply_to_(Reply::from_to const& reply_info, Mailbox const& rcpt_to);
   // bool do_forward_(message::parsed& msg);
   // bool do_reply_(message::parsed& msg);
+  void msg_headers_();
   bool do_deliver_();
 
   // clear per transaction data, preserve per connection data
@@ -129,6 +137,10 @@ private:
   void exit_() __attribute__((noreturn));
 
 private:
+  // First, so it's set before anything else is constructed.
+  std::chrono::steady_clock::time_point accepted_{
+      std::chrono::steady_clock::now()};
+
   fs::path      config_path_;
   DNS::Resolver res_;
   Sock          sock_;
@@ -153,8 +165,21 @@ private:
   std::string                   spf_received_;
   std::unique_ptr<MessageStore> msg_;
 
+  // The message's header fields, parsed as the data arrives, so what
+  // depends on them needn't wait for the end of the message.
+  std::unique_ptr<message::stream> msg_parse_;
+
   TLD tld_db_;
 
+  // SPF results, shared with the other smtp processes.
+  SharedCache spf_cache_;
+
+  // Phase timings and outcome counts, likewise shared.
+  Metrics::store metrics_;
+
+  // When the message data started, at DATA or the first BDAT.
+  std::chrono::steady_clock::time_point msg_started_;
+
   std::random_device random_device_;
 
   // Allow and block lists for domains.
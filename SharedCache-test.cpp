@@ -0,0 +1,111 @@
+#include "SharedCache.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+namespace {
+// By hand, as a writer stopped half way through a put would leave it:
+// odd seq, and pid and time in the writer field.
+void stall(char* slot, pid_t pid, std::time_t since)
+{
+  auto const seq = reinterpret_cast<std::uint32_t*>(slot);
+  if ((*seq & 1) == 0)
+    ++*seq;
+  *reinterpret_cast<std::uint64_t*>(slot + 24) =
+      (std::uint64_t(std::uint32_t(pid)) << 32) | std::uint32_t(since);
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  auto const name = "/SharedCache-test-"s + std::to_string(getpid());
+
+  {
+    SharedCache cache(name.c_str(), 64);
+    CHECK(cache.is_open());
+
+    CHECK(!cache.get("foo"));
+
+    cache.put("foo", "bar", std::chrono::seconds(60));
+    CHECK_EQ(*cache.get("foo"), "bar");
+
+    cache.put("foo", "baz", std::chrono::seconds(60));
+    CHECK_EQ(*cache.get("foo"), "baz");
+
+    std::chrono::seconds ttl{0};
+    CHECK(cache.get("foo", &ttl));
+    CHECK_GT(ttl.count(), 58);
+    CHECK_LE(ttl.count(), 60);
+
+    cache.put("expired", "value", std::chrono::seconds(0));
+    CHECK(!cache.get("expired"));
+
+    cache.put("big", std::string(SharedCache::max_entry_size(), 'x'),
+              std::chrono::seconds(60));
+    CHECK(!cache.get("big"));
+
+    // A second mapping, as another process would have, sees the same.
+    SharedCache other(name.c_str(), 64);
+    CHECK_EQ(*other.get("foo"), "baz");
+
+    // A writer that died, or has sat on its slot too long, loses it.
+    {
+      auto const fd = shm_open(name.c_str(), O_RDWR, 0);
+      PCHECK(fd != -1);
+      auto const sz = 64 * 1024;
+      auto const p  = static_cast<char*>(
+          mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+      PCHECK(p != MAP_FAILED);
+      close(fd);
+
+      char* slot = nullptr;
+      for (auto s = p; s < p + sz; s += 1024) {
+        if (std::memcmp(s + 32, "foobaz", 6) == 0)
+          slot = s;
+      }
+      CHECK_NOTNULL(slot);
+
+      auto const dead = fork();
+      if (dead == 0)
+        _exit(0);
+      CHECK_EQ(waitpid(dead, nullptr, 0), dead);
+
+      stall(slot, dead, std::time(nullptr));
+      CHECK(!cache.get("foo"));
+      cache.put("foo", "qux", std::chrono::seconds(60));
+      CHECK_EQ(*cache.get("foo"), "qux");
+
+      stall(slot, getpid(), std::time(nullptr));
+      cache.put("foo", "quux", std::chrono::seconds(60));
+      CHECK(!cache.get("foo"));
+
+      stall(slot, getpid(), std::time(nullptr) - 60);
+      cache.put("foo", "quux", std::chrono::seconds(60));
+      CHECK_EQ(*cache.get("foo"), "quux");
+
+      munmap(p, sz);
+    }
+
+    // Must agree on the geometry.
+    SharedCache wrong_size(name.c_str(), 128);
+    CHECK(!wrong_size.is_open());
+
+    // Overfill; the newest entries must still be there.
+    for (auto i = 0; i < 1000; ++i)
+      cache.put(std::to_string(i), std::to_string(i), std::chrono::seconds(i));
+    CHECK_EQ(*cache.get("999"), "999");
+  }
+
+  shm_unlink(name.c_str());
+}
@@ -0,0 +1,209 @@
+#include "SharedCache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+namespace {
+constexpr std::size_t slot_size = 1024;
+constexpr std::size_t n_ways    = 4;
+
+std::uint64_t hash(std::string_view key)
+{
+  std::uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+  for (auto ch : key) {
+    h ^= static_cast<unsigned char>(ch);
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+std::int64_t now()
+{
+  using namespace std::chrono;
+  return duration_cast<seconds>(system_clock::now().time_since_epoch())
+      .count();
+}
+
+// The writer of a slot: pid above, low 32 bits of the time it took the
+// slot below.  Zero when nobody is writing.
+std::uint64_t writer(std::int64_t t)
+{
+  return (std::uint64_t(std::uint32_t(getpid())) << 32) | std::uint32_t(t);
+}
+
+bool is_stuck(std::uint64_t w, std::int64_t t)
+{
+  auto const pid   = pid_t(w >> 32);
+  auto const since = std::uint32_t(w);
+  auto const held  = std::uint32_t(std::uint32_t(t) - since);
+  if (held > Config::shared_cache_write_timeout.count())
+    return true;
+  return (kill(pid, 0) == -1) && (errno == ESRCH);
+}
+} // namespace
+
+struct SharedCache::slot {
+  std::atomic<std::uint32_t> seq; // odd while being written
+  std::uint16_t              key_len;
+  std::uint16_t              val_len;
+  std::uint64_t              hash;
+  std::int64_t               expires;
+  std::atomic<std::uint64_t> writer; // see writer() above
+
+  char data[slot_size - 32]; // key then value
+
+  static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+  static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+};
+
+std::size_t SharedCache::max_entry_size() { return sizeof(slot::data); }
+
+SharedCache::SharedCache(char const* name, std::size_t n_slots)
+{
+  static_assert(sizeof(slot) == slot_size);
+
+  n_slots = ((n_slots + n_ways - 1) / n_ways) * n_ways;
+
+  auto const sz = n_slots * sizeof(slot);
+
+  auto const fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+  if (fd == -1) {
+    PLOG(WARNING) << "shm_open " << name << " failed";
+    return;
+  }
+
+  struct stat st;
+  PCHECK(fstat(fd, &st) == 0);
+
+  // A new segment is zero filled, which is a cache full of empty
+  // slots.  The size stands in for a version check.
+  if ((st.st_size == 0) && (ftruncate(fd, sz) == -1)) {
+    PLOG(WARNING) << "ftruncate " << name << " failed";
+    close(fd);
+    return;
+  }
+  if (st.st_size && (std::size_t(st.st_size) != sz)) {
+    LOG(WARNING) << "shared cache " << name << " is " << st.st_size
+                 << " octets, expecting " << sz << "; not using it";
+    close(fd);
+    return;
+  }
+
+  auto const p = mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    PLOG(WARNING) << "mmap " << name << " failed";
+    return;
+  }
+
+  slots_   = static_cast<slot*>(p);
+  n_slots_ = n_slots;
+}
+
+SharedCache::~SharedCache()
+{
+  if (slots_)
+    munmap(slots_, n_slots_ * sizeof(slot));
+}
+
+std::optional<std::string> SharedCache::get(std::string_view      key,
+                                            std::chrono::seconds* ttl) const
+{
+  if (!is_open())
+    return {};
+
+  auto const h   = hash(key);
+  auto const set = slots_ + (h % (n_slots_ / n_ways)) * n_ways;
+  auto const t   = now();
+
+  for (auto way = 0u; way < n_ways; ++way) {
+    auto& s = set[way];
+
+    auto const seq = s.seq.load(std::memory_order_acquire);
+    if ((seq & 1) || (s.hash != h) || (s.expires <= t))
+      continue;
+
+    auto const key_len = std::min<std::size_t>(s.key_len, sizeof(s.data));
+    auto const val_len =
+        std::min<std::size_t>(s.val_len, sizeof(s.data) - key_len);
+
+    std::string k(s.data, key_len);
+    std::string v(s.data + key_len, val_len);
+    auto const  expires = s.expires;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s.seq.load(std::memory_order_relaxed) != seq)
+      continue; // changed under us
+
+    if (k == key) {
+      if (ttl)
+        *ttl = std::chrono::seconds(expires - t);
+      return v;
+    }
+  }
+
+  return {};
+}
+
+void SharedCache::put(std::string_view     key,
+                      std::string_view     value,
+                      std::chrono::seconds ttl)
+{
+  if (!is_open() || (key.size() + value.size() > sizeof(slot::data)))
+    return;
+
+  auto const h   = hash(key);
+  auto const set = slots_ + (h % (n_slots_ / n_ways)) * n_ways;
+  auto const t   = now();
+
+  // Same key, else the one that expires first (empty slots have
+  // expired at the epoch).
+  auto victim = set;
+  for (auto way = 0u; way < n_ways; ++way) {
+    if (set[way].hash == h) {
+      victim = set + way;
+      break;
+    }
+    if (set[way].expires < victim->expires)
+      victim = set + way;
+  }
+
+  // The writer field is the lock; seq only tells readers to keep off.
+  // A slot taken back from a stuck writer goes to the next odd seq, so
+  // that writer can't make it even again should it ever wake up.
+  auto w = victim->writer.load(std::memory_order_relaxed);
+  if ((w && !is_stuck(w, t)) ||
+      !victim->writer.compare_exchange_strong(w, writer(t),
+                                              std::memory_order_acquire))
+    return; // someone else is writing it
+
+  auto       seq = victim->seq.load(std::memory_order_relaxed);
+  auto const odd = (seq & 1) ? seq + 2 : seq + 1;
+  victim->seq.store(odd, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  victim->key_len = static_cast<std::uint16_t>(key.size());
+  victim->val_len = static_cast<std::uint16_t>(value.size());
+  victim->hash    = h;
+  victim->expires = t + ttl.count();
+  std::memcpy(victim->data, key.data(), key.size());
+  std::memcpy(victim->data + key.size(), value.data(), value.size());
+
+  seq = odd;
+  if (victim->seq.compare_exchange_strong(seq, odd + 1,
+                                          std::memory_order_release)) {
+    w = writer(t);
+    victim->writer.compare_exchange_strong(w, 0, std::memory_order_release);
+  }
+}
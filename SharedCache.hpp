@@ -0,0 +1,55 @@
+#ifndef SHAREDCACHE_DOT_HPP
+#define SHAREDCACHE_DOT_HPP
+
+// A small cache of short strings with expiry times, kept in a POSIX
+// shared memory segment so every smtp process sees what the others
+// have already worked out.
+//
+// Slots are grouped into four-way sets.  Each slot is guarded by a
+// sequence counter: readers never block and simply miss if a write
+// is in progress, writers take the slot with a compare-and-swap and
+// give up if another writer has it.  A writer records its pid and the
+// time with the slot it takes, so a slot whose writer died, or has had
+// it past Config::shared_cache_write_timeout, is taken back by the next
+// put.  Nothing here is precious; a lost update only costs a repeated
+// lookup.
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace Config {
+constexpr auto shared_cache_write_timeout = std::chrono::seconds(5);
+} // namespace Config
+
+class SharedCache {
+public:
+  SharedCache(SharedCache const&) = delete;
+  SharedCache& operator=(SharedCache const&) = delete;
+
+  // The name is as for shm_open(3), e.g. "/ghsmtp-spf".
+  SharedCache(char const* name, std::size_t n_slots);
+  ~SharedCache();
+
+  bool is_open() const { return slots_ != nullptr; }
+
+  // With ttl, how much longer the entry has.
+  std::optional<std::string> get(std::string_view      key,
+                                 std::chrono::seconds* ttl = nullptr) const;
+
+  void put(std::string_view key, std::string_view value,
+           std::chrono::seconds ttl);
+
+  // Key plus value must fit in a slot.
+  static std::size_t max_entry_size();
+
+private:
+  struct slot;
+
+  slot*       slots_{nullptr};
+  std::size_t n_slots_{0};
+};
+
+#endif // SHAREDCACHE_DOT_HPP
@@ -38,6 +38,9 @@ Sock::Sock(int                       fd_in,
     // Ignore ENOTSOCK errors from getsockname, useful for testing.
     PLOG_IF(WARNING, ENOTSOCK != errno) << "getsockname failed";
   }
+  else if (us_addr_.addr.sa_family == AF_UNIX) {
+    // A socketpair(2), from smtp-replay say; no address, like a pipe.
+  }
   else {
     switch (us_addr_len_) {
     case sizeof(sockaddr_in):
@@ -64,6 +67,9 @@ Sock::Sock(int                       fd_in,
     // Ignore ENOTSOCK errors from getpeername, useful for testing.
     PLOG_IF(WARNING, ENOTSOCK != errno) << "getpeername failed";
   }
+  else if (them_addr_.addr.sa_family == AF_UNIX) {
+    // No address here either.
+  }
   else {
     switch (them_addr_len_) {
     case sizeof(sockaddr_in):
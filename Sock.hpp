@@ -65,6 +65,10 @@ public:
   void log_data_on() { iostream_->log_data_on(); }
   void log_data_off() { iostream_->log_data_off(); }
 
+  void capture_on(fs::path const& dir) { iostream_->capture_on(dir); }
+
+  IOStats::stats const& io_stats() { return iostream_->io_stats(); }
+
   void log_stats() { iostream_->log_stats(); }
   void log_totals() { iostream_->log_totals(); }
 
@@ -2,6 +2,8 @@
 
 #include "esc.hpp"
 
+#include <fmt/format.h>
+
 #include <glog/logging.h>
 
 #include <gflags/gflags.h>
@@ -20,7 +22,7 @@ SockBuffer::SockBuffer(int                       fd_in,
   , read_timeout_(read_timeout)
   , write_timeout_(write_timeout)
   , starttls_timeout_(starttls_timeout)
-  , tls_(read_hook_)
+  , tls_(read_hook_, &stats_)
 {
   POSIX::set_nonblocking(fd_in_);
   POSIX::set_nonblocking(fd_out_);
@@ -36,7 +38,8 @@ SockBuffer::SockBuffer(SockBuffer const& that)
   , starttls_timeout_(that.starttls_timeout_)
   , limit_read_(that.limit_read_)
   , log_data_(that.log_data_)
-  , tls_(that.read_hook_)
+  , capture_(that.capture_)
+  , tls_(that.read_hook_, &stats_)
 {
   CHECK(!that.timed_out_);
   CHECK(!that.tls_active_);
@@ -54,7 +57,7 @@ std::streamsize SockBuffer::read(char* s, std::streamsize n)
   }
   auto read = tls_active_ ? tls_.read(s, n, read_timeout_, timed_out_)
                           : POSIX::read(fd_in_, s, n, read_hook_, read_timeout_,
-                                        timed_out_);
+                                        timed_out_, &stats_);
   if (read != static_cast<std::streamsize>(-1)) {
     octets_read_ += read;
     total_octets_read_ += read;
@@ -70,6 +73,9 @@ std::streamsize SockBuffer::read(char* s, std::streamsize n)
     LOG(INFO) << "< «" << esc(str, esc_line_option::multi) << "»";
   }
 
+  if (capture_ && (read > 0))
+    capture_->write(Capture::direction::client, s, read);
+
   return read;
 }
 
@@ -77,7 +83,8 @@ std::streamsize SockBuffer::write(const char* s, std::streamsize n)
 {
   auto written = tls_active_
                      ? tls_.write(s, n, write_timeout_, timed_out_)
-                     : POSIX::write(fd_out_, s, n, write_timeout_, timed_out_);
+                     : POSIX::write(fd_out_, s, n, write_timeout_, timed_out_,
+                                    &stats_);
   if (written != static_cast<std::streamsize>(-1)) {
     octets_written_ += written;
     total_octets_written_ += written;
@@ -88,15 +95,51 @@ std::streamsize SockBuffer::write(const char* s, std::streamsize n)
     LOG(INFO) << "> «" << esc(str, esc_line_option::multi) << "»";
   }
 
+  if (capture_ && (written > 0))
+    capture_->write(Capture::direction::server, s, written);
+
   return written;
 }
 
+namespace {
+// "1029 octets in 3 calls, <16:1 <1024:2", each bucket by its limit.
+std::string to_string(IOStats::sizes const& sz)
+{
+  fmt::memory_buffer buf;
+  fmt::format_to(buf, "{} octets in {} calls{}", sz.octets, sz.calls,
+                 sz.calls ? "," : "");
+  for (std::size_t b = 0; b < IOStats::n_buckets; ++b) {
+    if (sz.buckets[b])
+      fmt::format_to(buf, " <{}:{}", IOStats::bucket_max(b) + 1,
+                     sz.buckets[b]);
+  }
+  return fmt::to_string(buf);
+}
+
+std::string to_string(IOStats::timing const& t)
+{
+  using namespace std::chrono;
+  return fmt::format("{} us in {} calls",
+                     duration_cast<microseconds>(t.total).count(), t.calls);
+}
+} // namespace
+
 void SockBuffer::log_stats() const
 {
   LOG(INFO) << "read_limit_==" << (read_limit_ ? "true" : "false");
   LOG(INFO) << "octets_read_==" << octets_read_;
   LOG(INFO) << "octets_written_==" << octets_written_;
   log_totals();
+  LOG(INFO) << "reads: " << to_string(stats_.reads);
+  LOG(INFO) << "writes: " << to_string(stats_.writes);
+  if (stats_.records_in.calls || stats_.records_out.calls) {
+    LOG(INFO) << "TLS records in: " << to_string(stats_.records_in);
+    LOG(INFO) << "TLS records out: " << to_string(stats_.records_out);
+  }
+  LOG(INFO) << "EAGAIN " << stats_.again << ", WANT_READ "
+            << stats_.want_read << ", WANT_WRITE " << stats_.want_write;
+  LOG(INFO) << "wait: " << to_string(stats_.wait);
+  LOG(INFO) << "read_hook: " << to_string(stats_.read_hook);
   if (tls()) {
     LOG(INFO) << tls_info();
   }
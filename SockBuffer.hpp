@@ -4,9 +4,12 @@
 #include <cerrno>
 #include <chrono>
 #include <cstdlib>
+#include <memory>
 #include <streambuf>
 #include <string>
 
+#include "Capture.hpp"
+#include "IOStats.hpp"
 #include "POSIX.hpp"
 #include "TLS-OpenSSL.hpp"
 
@@ -56,8 +59,11 @@ public:
 
   bool starttls_server(fs::path config_path)
   {
-    return tls_active_ = tls_.starttls_server(config_path, fd_in_, fd_out_,
-                                              starttls_timeout_);
+    tls_active_ = tls_.starttls_server(config_path, fd_in_, fd_out_,
+                                       starttls_timeout_);
+    if (tls_active_ && capture_)
+      capture_->write(Capture::direction::tls, nullptr, 0);
+    return tls_active_;
   }
   bool starttls_client(fs::path                  config_path,
                        char const*               client_name,
@@ -84,6 +90,14 @@ public:
   void log_data_on() { log_data_ = true; }
   void log_data_off() { log_data_ = false; }
 
+  // Record the session, as the server side of it, to a new file in dir.
+  void capture_on(fs::path const& dir)
+  {
+    capture_ = std::make_shared<Capture::writer>(dir);
+  }
+
+  IOStats::stats const& io_stats() const { return stats_; }
+
   void log_stats() const;
   void log_totals() const;
 
@@ -116,6 +130,10 @@ private:
   bool limit_read_{false};
   bool log_data_{false};
 
+  std::shared_ptr<Capture::writer> capture_;
+
+  IOStats::stats stats_;
+
   TLS tls_;
 };
 
@@ -58,11 +58,29 @@ auto bin2hexstring(uint8_t const* data, size_t length)
   return ret;
 }
 
-TLS::TLS(std::function<void(void)> read_hook)
+TLS::TLS(std::function<void(void)> read_hook, IOStats::stats* stats)
   : read_hook_(read_hook)
+  , stats_(stats)
 {
 }
 
+// Sees the header of every record sent or received, to count them.
+static void count_record(int         write_p,
+                         int         version,
+                         int         content_type,
+                         void const* buf,
+                         size_t      len,
+                         SSL*        ssl,
+                         void*       arg)
+{
+  if ((content_type != SSL3_RT_HEADER) || (len != SSL3_RT_HEADER_LENGTH))
+    return;
+  auto const hdr    = static_cast<unsigned char const*>(buf);
+  auto const length = (hdr[3] << 8) | hdr[4];
+  auto const stats  = static_cast<IOStats::stats*>(arg);
+  (write_p ? stats->records_out : stats->records_in).add(length);
+}
+
 TLS::~TLS()
 {
   for (auto& ctx : cert_ctx_) {
@@ -316,6 +334,11 @@ bool TLS::starttls_client(fs::path                  config_path,
   SSL_set_rfd(ssl_, fd_in);
   SSL_set_wfd(ssl_, fd_out);
 
+  if (stats_) {
+    SSL_set_msg_callback(ssl_, count_record);
+    SSL_set_msg_callback_arg(ssl_, stats_);
+  }
+
   // LOG(INFO) << "tlsa_rrs.size() == " << tlsa_rrs.size();
 
   if (tlsa_rrs.size()) {
@@ -411,9 +434,13 @@ bool TLS::starttls_client(fs::path                  config_path,
       ERR_clear_error();
       continue; // try SSL_accept again
 
+    // The server reset or closed the connection: no TLS session, and
+    // the caller can try another.
     case SSL_ERROR_SYSCALL:
-      LOG(WARNING) << "errno == " << errno << ": " << strerror(errno);
-      [[fallthrough]];
+      LOG(WARNING) << "SSL_connect failed, errno == " << errno << ": "
+                   << strerror(errno);
+      ERR_clear_error();
+      return false;
 
     default: ssl_error(n_get_err);
     }
@@ -646,6 +673,11 @@ bool TLS::starttls_server(fs::path                  config_path,
   SSL_set_rfd(ssl_, fd_in);
   SSL_set_wfd(ssl_, fd_out);
 
+  if (stats_) {
+    SSL_set_msg_callback(ssl_, count_record);
+    SSL_set_msg_callback_arg(ssl_, stats_);
+  }
+
   if (session_context_index < 0) {
     session_context_index =
         SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
@@ -757,7 +789,8 @@ std::streamsize TLS::io_tls_(char const*                          fn,
                              char*                                s,
                              std::streamsize                      n,
                              std::chrono::milliseconds            timeout,
-                             bool&                                t_o)
+                             bool&                                t_o,
+                             IOStats::sizes*                      sizes)
 {
   auto const start    = std::chrono::system_clock::now();
   auto const end_time = start + timeout;
@@ -782,8 +815,11 @@ std::streamsize TLS::io_tls_(char const*                          fn,
     case SSL_ERROR_WANT_READ: {
       int fd = SSL_get_rfd(ssl_);
       CHECK_NE(-1, fd);
-      read_hook_();
-      if (POSIX::input_ready(fd, time_left)) {
+      if (stats_)
+        ++stats_->want_read;
+      IOStats::timed(stats_ ? &stats_->read_hook : nullptr, read_hook_);
+      if (IOStats::timed(stats_ ? &stats_->wait : nullptr,
+                         [&] { return POSIX::input_ready(fd, time_left); })) {
         ERR_clear_error();
         continue; // try io_fnc again
       }
@@ -795,7 +831,10 @@ std::streamsize TLS::io_tls_(char const*                          fn,
     case SSL_ERROR_WANT_WRITE: {
       int fd = SSL_get_wfd(ssl_);
       CHECK_NE(-1, fd);
-      if (POSIX::output_ready(fd, time_left)) {
+      if (stats_)
+        ++stats_->want_write;
+      if (IOStats::timed(stats_ ? &stats_->wait : nullptr,
+                         [&] { return POSIX::output_ready(fd, time_left); })) {
         ERR_clear_error();
         continue; // try io_fnc again
       }
@@ -804,9 +843,22 @@ std::streamsize TLS::io_tls_(char const*                          fn,
       return static_cast<std::streamsize>(-1);
     }
 
+    // The peer reset the connection, or closed it without a
+    // close_notify: a failed read or write, for the caller to deal
+    // with, and not an error in the TLS layer.
     case SSL_ERROR_SYSCALL:
-      LOG(WARNING) << "errno == " << errno << ": " << strerror(errno);
-      [[fallthrough]];
+      LOG(WARNING) << fn << " failed, errno == " << errno << ": "
+                   << strerror(errno);
+      ERR_clear_error();
+      return static_cast<std::streamsize>(-1);
+
+    case SSL_ERROR_SSL:
+      if (unexpected_eof_()) {
+        LOG(WARNING) << fn << " hit an unexpected EOF";
+        ERR_clear_error();
+        return static_cast<std::streamsize>(-1);
+      }
+      ssl_error(n_get_err);
 
     default: ssl_error(n_get_err);
     }
@@ -823,13 +875,32 @@ std::streamsize TLS::io_tls_(char const*                          fn,
       LOG(INFO) << fn << " returned SSL_ERROR_ZERO_RETURN";
       break;
 
+    // Before OpenSSL 3, an EOF without close_notify.
+    case SSL_ERROR_SYSCALL:
+      LOG(WARNING) << fn << " returned zero, EOF without close_notify";
+      ERR_clear_error();
+      return static_cast<std::streamsize>(-1);
+
     default: LOG(INFO) << fn << " returned zero"; ssl_error(n_get_err);
     }
   }
 
+  if (sizes)
+    sizes->add(n_ret);
+
   return static_cast<std::streamsize>(n_ret);
 }
 
+// OpenSSL 3 reports an EOF without close_notify as SSL_ERROR_SSL.
+bool TLS::unexpected_eof_()
+{
+#ifdef SSL_R_UNEXPECTED_EOF_WHILE_READING
+  return ERR_GET_REASON(ERR_peek_error()) == SSL_R_UNEXPECTED_EOF_WHILE_READING;
+#else
+  return false;
+#endif
+}
+
 void TLS::ssl_error(int n_get_err)
 {
   LOG(WARNING) << "n_get_err == " << n_get_err;
@@ -3,6 +3,7 @@
 
 #include "DNS-rrs.hpp"
 #include "Domain.hpp"
+#include "IOStats.hpp"
 #include "fs.hpp"
 
 #include <chrono>
@@ -23,7 +24,9 @@ public:
   TLS(TLS const&) = delete;
   TLS& operator=(const TLS&) = delete;
 
-  explicit TLS(std::function<void(void)> read_hook);
+  // If stats is given, the calls, records and waits are added to it.
+  explicit TLS(std::function<void(void)> read_hook,
+               IOStats::stats*           stats = nullptr);
   ~TLS();
 
   bool starttls_client(fs::path                  config_path,
@@ -44,7 +47,8 @@ public:
   std::streamsize
   read(char* s, std::streamsize n, std::chrono::milliseconds wait, bool& t_o)
   {
-    return io_tls_("SSL_read", SSL_read, s, n, wait, t_o);
+    return io_tls_("SSL_read", SSL_read, s, n, wait, t_o,
+                   stats_ ? &stats_->reads : nullptr);
   }
   std::streamsize write(const char*               c_s,
                         std::streamsize           n,
@@ -52,7 +56,8 @@ public:
                         bool&                     t_o)
   {
     auto s = const_cast<char*>(c_s);
-    return io_tls_("SSL_write", SSL_write, s, n, wait, t_o);
+    return io_tls_("SSL_write", SSL_write, s, n, wait, t_o,
+                   stats_ ? &stats_->writes : nullptr);
   }
 
   std::string info() const;
@@ -77,8 +82,10 @@ private:
                           char*                                s,
                           std::streamsize                      n,
                           std::chrono::milliseconds            wait,
-                          bool&                                t_o);
+                          bool&                                t_o,
+                          IOStats::sizes*                      sizes);
 
+  static bool unexpected_eof_();
   static void ssl_error(int n_err) __attribute__((noreturn));
 
 private:
@@ -88,6 +95,8 @@ private:
 
   std::function<void(void)> read_hook_;
 
+  IOStats::stats* stats_;
+
   std::string verified_peername_;
   bool        verified_{false};
 };
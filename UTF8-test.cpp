@@ -0,0 +1,129 @@
+#include "UTF8.hpp"
+
+#include <random>
+#include <string>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+namespace {
+// Just enough of a PEGTL input to run the rules.
+struct input {
+  std::string_view s;
+
+  char const* current() const { return s.data(); }
+  std::size_t size(std::size_t) const { return s.size(); }
+  void        bump_in_this_line(std::size_t n) { s.remove_prefix(n); }
+};
+
+template <typename Rule>
+std::size_t match(std::string_view s)
+{
+  input in{s};
+  return Rule::match(in) ? s.size() - in.s.size() : 0;
+}
+
+// Decode and check the code point, RFC 3629 section 3.
+std::size_t reference_length(std::string_view s)
+{
+  auto const c = static_cast<unsigned char>(s[0]);
+
+  std::size_t len;
+  char32_t    cp;
+  if ((c & 0xE0) == 0xC0) {
+    len = 2;
+    cp  = c & 0x1F;
+  }
+  else if ((c & 0xF0) == 0xE0) {
+    len = 3;
+    cp  = c & 0x0F;
+  }
+  else if ((c & 0xF8) == 0xF0) {
+    len = 4;
+    cp  = c & 0x07;
+  }
+  else {
+    return 0;
+  }
+  if (s.size() < len)
+    return 0;
+  for (auto i = 1u; i < len; ++i) {
+    auto const t = static_cast<unsigned char>(s[i]);
+    if ((t & 0xC0) != 0x80)
+      return 0;
+    cp = (cp << 6) | (t & 0x3F);
+  }
+
+  char32_t const min[]{0, 0, 0x80, 0x800, 0x10000};
+  if ((cp < min[len]) || (cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF)))
+    return 0;
+  return len;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  CHECK(UTF8::is_valid("Any ASCII string"));
+  CHECK(UTF8::is_valid("Any “non-ASCII” string"));
+  CHECK(UTF8::is_valid("Ünïcödé 🙂 "s + std::string(40, 'x') + "🙂"));
+  CHECK(!UTF8::is_valid("\xC0\x80"));         // overlong NUL
+  CHECK(!UTF8::is_valid("\xED\xA0\x80"));     // surrogate
+  CHECK(!UTF8::is_valid("\xF4\x90\x80\x80")); // past U+10FFFF
+  CHECK(!UTF8::is_valid("\xE2\x82"));         // cut short
+  CHECK_EQ(UTF8::valid_prefix("abc\xE2\x82\xAC\xFFxyz"), 6);
+
+  // Every two-octet and three-octet lead and tail, by the reference.
+  for (auto a = 0x80u; a < 0x100; ++a) {
+    for (auto b = 0u; b < 0x100; ++b) {
+      for (auto c : {0x00u, 0x80u, 0xBFu, 0xC0u}) {
+        std::string const s{char(a), char(b), char(c), '\x80'};
+        CHECK_EQ(UTF8::sequence_length(s.data(), s.size()),
+                 reference_length(s))
+            << std::hex << a << ' ' << b << ' ' << c;
+      }
+    }
+  }
+
+  // The fast scans, with the odd octet at every position.
+  for (auto pos = 0u; pos < 64; ++pos) {
+    std::string s(64, 'a');
+    s[pos] = '\xE9';
+    CHECK_EQ(ascii_prefix(s.data(), s.size()), pos);
+    CHECK(!is_ascii(s));
+    s[pos] = '\r';
+    CHECK(is_ascii(s));
+    CHECK_EQ(UTF8::text_prefix(s.data(), s.size()), pos);
+    s[pos] = '\t';
+    CHECK_EQ(UTF8::text_prefix(s.data(), s.size()), s.size());
+    s[pos] = '\x7F';
+    CHECK_EQ(UTF8::text_prefix(s.data(), s.size()), pos);
+  }
+
+  std::mt19937 gen;
+  for (auto i = 0; i < 10000; ++i) {
+    std::string s;
+    for (auto n = gen() % 40; n; --n)
+      s += (gen() % 8) ? char('a' + gen() % 26) : char(gen());
+    std::size_t ref = 0;
+    while (ref < s.size()) {
+      if (isascii(s[ref]))
+        ++ref;
+      else if (auto const len = reference_length(s.substr(ref)); len)
+        ref += len;
+      else
+        break;
+    }
+    CHECK_EQ(UTF8::valid_prefix(s), ref);
+  }
+
+  // The rules.
+  CHECK_EQ(match<UTF8::non_ascii>("é!"), 2);
+  CHECK_EQ(match<UTF8::non_ascii>("e!"), 0);
+  CHECK_EQ(match<UTF8::text_run>("Hello,  world!  \r\n"), 14);
+  CHECK_EQ(match<UTF8::text_run>(" Hello"), 0);
+  CHECK_EQ(match<UTF8::text_run>("Hello wörld"), 7);
+  CHECK_EQ(match<UTF8::atext_run>("first.last@example.com"), 5);
+  CHECK_EQ(match<UTF8::atext_run>("x+tag=1@example.com"), 7);
+  CHECK_EQ(match<UTF8::atext_run>("\"quoted\""), 0);
+}
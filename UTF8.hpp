@@ -0,0 +1,186 @@
+#ifndef UTF8_DOT_HPP
+#define UTF8_DOT_HPP
+
+// UTF-8 validation (RFC 3629) that takes ASCII 16 octets at a time, and
+// PEGTL rules built on it, so the grammars only go an octet at a time
+// where there's something other than plain ASCII to look at.
+
+#include <cstddef>
+#include <string_view>
+
+#include "is_ascii.hpp"
+
+namespace UTF8 {
+
+// Length of the well-formed multi-octet sequence at p, or 0; the byte
+// ranges are those of RFC 3629 section 4.
+inline std::size_t sequence_length(char const* p, std::size_t n) noexcept
+{
+  auto const b = [p](std::size_t i) {
+    return static_cast<unsigned char>(p[i]);
+  };
+  auto const tail = [&](std::size_t i) { return (b(i) & 0xC0) == 0x80; };
+
+  if (n == 0)
+    return 0;
+  auto const c = b(0);
+
+  if ((c >= 0xC2) && (c <= 0xDF))
+    return ((n >= 2) && tail(1)) ? 2 : 0;
+
+  if ((c >= 0xE0) && (c <= 0xEF)) {
+    unsigned char const lo = (c == 0xE0) ? 0xA0 : 0x80;
+    unsigned char const hi = (c == 0xED) ? 0x9F : 0xBF;
+    return ((n >= 3) && (b(1) >= lo) && (b(1) <= hi) && tail(2)) ? 3 : 0;
+  }
+
+  if ((c >= 0xF0) && (c <= 0xF4)) {
+    unsigned char const lo = (c == 0xF0) ? 0x90 : 0x80;
+    unsigned char const hi = (c == 0xF4) ? 0x8F : 0xBF;
+    return ((n >= 4) && (b(1) >= lo) && (b(1) <= hi) && tail(2) && tail(3))
+               ? 4
+               : 0;
+  }
+
+  return 0;
+}
+
+// Length of the well-formed prefix of s.
+inline std::size_t valid_prefix(std::string_view s) noexcept
+{
+  std::size_t i = 0;
+  for (;;) {
+    i += ascii_prefix(s.data() + i, s.size() - i);
+    if (i == s.size())
+      return i;
+    auto const len = sequence_length(s.data() + i, s.size() - i);
+    if (!len)
+      return i;
+    i += len;
+  }
+}
+
+inline bool is_valid(std::string_view s) noexcept
+{
+  return valid_prefix(s) == s.size();
+}
+
+constexpr bool is_wsp(char ch) noexcept { return (ch == ' ') || (ch == '\t'); }
+
+// Length of the run at p of VCHAR and WSP, that is printable ASCII,
+// SP and HT.
+inline std::size_t text_prefix(char const* p, std::size_t n) noexcept
+{
+  std::size_t i = 0;
+
+#if defined(__SSE2__)
+  auto const us  = _mm_set1_epi8(0x1F);
+  auto const del = _mm_set1_epi8(0x7F);
+  auto const ht  = _mm_set1_epi8('\t');
+
+  for (; i + 16 <= n; i += 16) {
+    // Signed compares, so octets from 0x80 up are out of range too.
+    auto const v  = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+    auto const ok = _mm_or_si128(
+        _mm_and_si128(_mm_cmpgt_epi8(v, us), _mm_cmplt_epi8(v, del)),
+        _mm_cmpeq_epi8(v, ht));
+
+    auto const mask = _mm_movemask_epi8(ok) ^ 0xFFFF;
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; i < n; ++i) {
+    auto const c = static_cast<unsigned char>(p[i]);
+    if (((c < 0x20) || (c > 0x7E)) && (c != '\t'))
+      break;
+  }
+  return i;
+}
+
+// RFC 5322 section 3.2.3, the ASCII part.
+constexpr bool is_atext(char ch) noexcept
+{
+  if (((ch >= 'A') && (ch <= 'Z')) || ((ch >= 'a') && (ch <= 'z')) ||
+      ((ch >= '0') && (ch <= '9')))
+    return true;
+  switch (ch) {
+  case '!':
+  case '#':
+  case '$':
+  case '%':
+  case '&':
+  case '\'':
+  case '*':
+  case '+':
+  case '-':
+  case '/':
+  case '=':
+  case '?':
+  case '^':
+  case '_':
+  case '`':
+  case '{':
+  case '|':
+  case '}':
+  case '~': return true;
+  }
+  return false;
+}
+
+// PEGTL rules.  None of these match a line ending, so they all bump the
+// input within the line.  The runs look only at what a buffered input
+// already holds, in.size(1), and never wait to read more; a run cut
+// short is picked up again by the plus<> or star<> around it.
+
+// One well-formed non-ASCII character; sor<UTF8_2, UTF8_3, UTF8_4>.
+struct non_ascii {
+  template <typename Input>
+  static bool match(Input& in)
+  {
+    auto const len = sequence_length(in.current(), in.size(4));
+    if (!len)
+      return false;
+    in.bump_in_this_line(len);
+    return true;
+  }
+};
+
+// What *([FWS] VCHAR) matches within a line: a VCHAR, then any mix of
+// VCHAR and WSP that ends in a VCHAR.
+struct text_run {
+  template <typename Input>
+  static bool match(Input& in)
+  {
+    auto const p = in.current();
+    auto       n = text_prefix(p, in.size(1));
+    while (n && is_wsp(p[n - 1]))
+      --n;
+    if (!n || is_wsp(p[0]))
+      return false;
+    in.bump_in_this_line(n);
+    return true;
+  }
+};
+
+// plus<atext>, for ASCII atext.
+struct atext_run {
+  template <typename Input>
+  static bool match(Input& in)
+  {
+    auto const  p = in.current();
+    auto const  n = in.size(1);
+    std::size_t i = 0;
+    while ((i < n) && is_atext(p[i]))
+      ++i;
+    if (!i)
+      return false;
+    in.bump_in_this_line(i);
+    return true;
+  }
+};
+
+} // namespace UTF8
+
+#endif // UTF8_DOT_HPP
@@ -1,3 +1,4 @@
+#include "Batch.hpp"
 #include "Mailbox.hpp"
 #include "OpenARC.hpp"
 #include "OpenDKIM.hpp"
@@ -11,6 +12,7 @@
 
 #include <cstring>
 #include <map>
+#include <stdexcept>
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
@@ -22,6 +24,7 @@ using namespace std::string_literals;
 
 DEFINE_string(signer, "digilicious.com", "signing domain");
 DEFINE_string(selector, "ghsmtp", "DKIM selector");
+DECLARE_uint64(jobs); // in Batch.cpp
 
 bool arc_sign(message::parsed& msg,
               char const*      sender,
@@ -140,6 +143,32 @@ int main(int argc, char* argv[])
 
   auto const dom_signer{Domain(FLAGS_signer)};
 
+  if (FLAGS_jobs) {
+    Batch::run(
+        Batch::files(argc, argv), FLAGS_jobs,
+        [&](unsigned, fs::path const& file) {
+          boost::iostreams::mapped_file_source f(file.string());
+          message::parsed                      msg;
+          if (!msg.parse(std::string_view(f.data(), f.size())))
+            throw std::runtime_error("message failed to parse");
+
+          auto const verified =
+              arc_sign(msg, dom_signer.ascii().c_str(), selector, key_file,
+                       server_identity.c_str());
+
+          fmt::memory_buffer seal;
+          for (auto const& hdr : msg.arc_hdrs) {
+            fmt::format_to(seal, "{}{}", seal.size() ? "," : "",
+                           Batch::json_str(hdr));
+          }
+          return fmt::format(R"({{"file":{},"verified":{},"seal":[{}]}})",
+                             Batch::json_str(file.string()), verified,
+                             fmt::to_string(seal));
+        },
+        std::cout);
+    return 0;
+  }
+
   for (int a = 1; a < argc; ++a) {
     if (!fs::exists(argv[a]))
       LOG(FATAL) << "can't find mail file " << argv[a];
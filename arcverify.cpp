@@ -1,7 +1,7 @@
+#include "AuthCache.hpp"
+#include "Batch.hpp"
+#include "DKIM-verify.hpp"
 #include "Mailbox.hpp"
-#include "OpenARC.hpp"
-#include "OpenDKIM.hpp"
-#include "OpenDMARC.hpp"
 #include "esc.hpp"
 #include "fs.hpp"
 #include "iequal.hpp"
@@ -11,6 +11,9 @@
 
 #include <cstring>
 #include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
@@ -20,24 +23,42 @@
 
 using namespace std::string_literals;
 
-bool arc_verify(message::parsed& msg)
+DECLARE_uint64(jobs); // in Batch.cpp
+
+// The chain status, "none", "pass" or "fail", and the custody.
+std::pair<std::string, std::string> arc_verify(message::parsed& msg,
+                                               AuthCache&       auth)
 {
   CHECK(!msg.headers.empty());
 
   // ARC
 
-  OpenARC::verify arv;
+  DKIM::verify dkv([&auth](char const* selector, char const* domain) {
+    return auth.dkim_key_record(selector, domain);
+  });
   for (auto const& header : msg.headers) {
-    arv.header(header.as_view());
+    dkv.header(header.as_view());
   }
-  arv.eoh();
-  arv.body(msg.body);
-  arv.eom();
+  dkv.body(msg.body);
+  dkv.eom();
+
+  LOG(INFO) << "ARC status  == " << dkv.arc_status();
+  LOG(INFO) << "ARC custody == " << dkv.arc_custody();
 
-  LOG(INFO) << "ARC status  == " << arv.chain_status_str();
-  LOG(INFO) << "ARC custody == " << arv.chain_custody_str();
+  return {dkv.arc_status(), dkv.arc_custody()};
+}
+
+std::string check(fs::path const& file, AuthCache& auth)
+{
+  boost::iostreams::mapped_file_source f(file.string());
+  message::parsed                      msg;
+  if (!msg.parse(std::string_view(f.data(), f.size())))
+    throw std::runtime_error("message failed to parse");
 
-  return "fail"s != arv.chain_status_str();
+  auto const [status, custody] = arc_verify(msg, auth);
+  return fmt::format(R"({{"file":{},"arc":{},"custody":{}}})",
+                     Batch::json_str(file.string()), Batch::json_str(status),
+                     Batch::json_str(custody));
 }
 
 int main(int argc, char* argv[])
@@ -59,6 +80,33 @@ int main(int argc, char* argv[])
 
   auto const config_path = osutil::get_config_dir();
 
+  SharedCache auth_shared{Config::auth_cache_name, Config::auth_cache_slots};
+
+  if (FLAGS_jobs) {
+    // The resolver isn't thread safe: one, and one AuthCache, per thread.
+    struct per_thread {
+      std::unique_ptr<DNS::Resolver> res;
+      std::unique_ptr<AuthCache>     auth;
+    };
+    std::vector<per_thread> threads(FLAGS_jobs);
+
+    Batch::run(
+        Batch::files(argc, argv), FLAGS_jobs,
+        [&](unsigned thread, fs::path const& file) {
+          auto& t = threads[thread];
+          if (!t.auth) {
+            t.res  = std::make_unique<DNS::Resolver>(config_path);
+            t.auth = std::make_unique<AuthCache>(*t.res, &auth_shared);
+          }
+          return check(file, *t.auth);
+        },
+        std::cout);
+    return 0;
+  }
+
+  DNS::Resolver res{config_path};
+  AuthCache     auth{res, &auth_shared};
+
   for (int a = 1; a < argc; ++a) {
     if (!fs::exists(argv[a]))
       LOG(FATAL) << "can't find mail file " << argv[a];
@@ -66,7 +114,7 @@ int main(int argc, char* argv[])
     file.open(argv[a]);
     message::parsed msg;
     CHECK(msg.parse(std::string_view(file.data(), file.size())));
-    arc_verify(msg);
+    arc_verify(msg, auth);
     // std::cout << msg.as_string();
   }
 }
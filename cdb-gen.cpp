@@ -1,15 +1,301 @@
-#include <iostream>
+// Build a constant database, and its Bloom filter sidecar, from a list
+// of keys, one per line.
+//
+// Usage: cdb-gen [--normalize] [--bloom] [--jobs N] list list.cdb
+//
+// This writes the cdb(5) file format directly rather than feeding
+// cdbmake text to cdb(1).  Input is split across threads that
+// normalize and hash the keys; the sorted, de-duplicated result is
+// written to temp files that are renamed into place, so a reader never
+// sees a partial database.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "Bloom.hpp"
+#include "Domain.hpp"
+#include "IP4.hpp"
+#include "IP6.hpp"
+#include "fs.hpp"
+
+DEFINE_bool(bloom, true, "also write a <db>.bloom filter sidecar");
+DEFINE_uint64(jobs, 0, "worker threads, 0 for one per core");
+DEFINE_bool(normalize,
+            false,
+            "canonicalize addresses and lower-case/IDNA domain names");
+
+namespace {
+struct entry {
+  std::string   key;
+  std::uint32_t hash;
+
+  bool operator<(entry const& rhs) const { return key < rhs.key; }
+  bool operator==(entry const& rhs) const { return key == rhs.key; }
+};
+
+// From cdb(5): h = ((h << 5) + h) ^ c, starting with 5381.
+std::uint32_t cdb_hash(std::string_view key)
+{
+  std::uint32_t h = 5381;
+  for (auto ch : key)
+    h = ((h << 5) + h) ^ static_cast<unsigned char>(ch);
+  return h;
+}
+
+std::string canonical_address(int af, std::string_view addr)
+{
+  std::string const addr_str(addr);
+  unsigned char     bin[sizeof(in6_addr)];
+  char              str[INET6_ADDRSTRLEN];
+  if ((inet_pton(af, addr_str.c_str(), bin) != 1) ||
+      (inet_ntop(af, bin, str, sizeof(str)) == nullptr))
+    return addr_str;
+  return str;
+}
+
+// Keys are looked up in the form Session uses: bare addresses as
+// inet_ntop(3) would print them, domain names as lower case A-labels.
+std::string normalize(std::string_view key)
+{
+  if (IP4::is_address(key))
+    return canonical_address(AF_INET, key);
+  if (IP6::is_address(key))
+    return canonical_address(AF_INET6, key);
+  if (IP4::is_address_literal(key))
+    return canonical_address(AF_INET, IP4::as_address(key));
+  if (IP6::is_address_literal(key))
+    return canonical_address(AF_INET6, IP6::as_address(key));
+
+  try {
+    return Domain(key).ascii();
+  }
+  catch (std::exception const& ex) {
+    LOG(WARNING) << "using \"" << key << "\" as is: " << ex.what();
+    return std::string(key);
+  }
+}
 
-int main(int argc, char const* argv[])
+void trim(std::string_view& line)
 {
-  std::string line;
-  while (std::getline(std::cin, line)) {
+  while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back())))
+    line.remove_suffix(1);
+  while (!line.empty() && std::isspace(static_cast<unsigned char>(line[0])))
+    line.remove_prefix(1);
+}
 
-    /* From cdb(1) man page, section Input/Output Format:
-        +klen,vlen:key->val\n
-    */
-    std::cout << "+" << line.length() << ",1:" << line << "->1\n";
+// Work on the lines in [begin, end), which starts at a line boundary.
+void gen_entries(char const*         begin,
+                 char const*         end,
+                 std::vector<entry>& out)
+{
+  while (begin < end) {
+    auto nl = static_cast<char const*>(std::memchr(begin, '\n', end - begin));
+    if (!nl)
+      nl = end;
+
+    std::string_view line(begin, nl - begin);
+    begin = nl + 1;
+
+    if (FLAGS_normalize) {
+      trim(line);
+      if (line.empty() || line[0] == '#')
+        continue;
+    }
+    else if (line.empty()) {
+      continue;
+    }
+
+    auto key = FLAGS_normalize ? normalize(line) : std::string(line);
+    auto h   = cdb_hash(key);
+    out.push_back(entry{std::move(key), h});
   }
-  std::cout << "\n";
+  std::sort(out.begin(), out.end());
+}
+
+void put_u32(std::ofstream& out, std::uint32_t v)
+{
+  unsigned char const b[4]{
+      static_cast<unsigned char>(v),
+      static_cast<unsigned char>(v >> 8),
+      static_cast<unsigned char>(v >> 16),
+      static_cast<unsigned char>(v >> 24),
+  };
+  out.write(reinterpret_cast<char const*>(b), sizeof(b));
+}
+
+bool write_cdb(fs::path path, std::vector<entry> const& entries)
+{
+  std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out) {
+    LOG(ERROR) << "can't create " << path;
+    return false;
+  }
+
+  auto constexpr n_tables = 256;
+  auto constexpr hdr_size = n_tables * 8;
+
+  struct slot {
+    std::uint32_t hash;
+    std::uint32_t pos;
+  };
+  std::vector<std::vector<slot>> tables(n_tables);
+
+  out.seekp(hdr_size);
+
+  std::uint64_t pos = hdr_size;
+  for (auto const& e : entries) {
+    tables[e.hash % n_tables].push_back(slot{e.hash, std::uint32_t(pos)});
+    put_u32(out, e.key.size());
+    put_u32(out, 1);
+    out.write(e.key.data(), e.key.size());
+    out.put('1');
+    pos += 8 + e.key.size() + 1;
+    CHECK_LT(pos, std::numeric_limits<std::uint32_t>::max())
+        << "database too large";
+  }
+
+  std::vector<std::uint32_t> hdr;
+  hdr.reserve(n_tables * 2);
+
+  std::vector<slot> tbl;
+  for (auto const& bucket : tables) {
+    auto const n_slots = bucket.size() * 2;
+    hdr.push_back(std::uint32_t(pos));
+    hdr.push_back(std::uint32_t(n_slots));
+
+    tbl.assign(n_slots, slot{0, 0});
+    for (auto const& s : bucket) {
+      auto i = (s.hash / n_tables) % n_slots;
+      while (tbl[i].pos)
+        i = (i + 1) % n_slots;
+      tbl[i] = s;
+    }
+    for (auto const& s : tbl) {
+      put_u32(out, s.hash);
+      put_u32(out, s.pos);
+    }
+    pos += n_slots * 8;
+    CHECK_LT(pos, std::numeric_limits<std::uint32_t>::max())
+        << "database too large";
+  }
+
+  out.seekp(0);
+  for (auto v : hdr)
+    put_u32(out, v);
+
+  out.flush();
+  if (!out) {
+    LOG(ERROR) << "write to " << path << " failed";
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  { // Need to work with either namespace.
+    using namespace gflags;
+    using namespace google;
+    ParseCommandLineFlags(&argc, &argv, true);
+  }
+
+  if (argc != 3)
+    LOG(FATAL) << "usage: cdb-gen [--normalize] [--bloom] [--jobs N] list "
+                  "list.cdb";
+
+  fs::path const list_path{argv[1]};
+  fs::path const db_path{argv[2]};
+
+  error_code ec;
+  auto const list_size = fs::file_size(list_path, ec);
+  if (ec) {
+    LOG(ERROR) << "can't read " << list_path << ": " << ec.message();
+    return 1;
+  }
+
+  boost::iostreams::mapped_file_source list;
+  if (list_size)
+    list.open(list_path.string());
+
+  auto const data = list.is_open() ? list.data() : "";
+  auto const size = list.is_open() ? list.size() : 0;
+
+  auto n_jobs = FLAGS_jobs ? FLAGS_jobs : std::thread::hardware_concurrency();
+  n_jobs      = std::clamp<std::uint64_t>(n_jobs, 1, 1 + size / (64 * 1024));
+
+  // Split the input into one line-aligned range per thread.
+  std::vector<char const*> cuts{data};
+  for (auto j = 1u; j < n_jobs; ++j) {
+    auto p  = std::max(cuts.back(), data + (size * j) / n_jobs);
+    auto nl = static_cast<char const*>(std::memchr(p, '\n', data + size - p));
+    cuts.push_back(nl ? nl + 1 : data + size);
+  }
+  cuts.push_back(data + size);
+
+  std::vector<std::vector<entry>> parts(n_jobs);
+  std::vector<std::thread>        workers;
+  for (auto j = 0u; j < n_jobs; ++j)
+    workers.emplace_back(gen_entries, cuts[j], cuts[j + 1], std::ref(parts[j]));
+  for (auto& w : workers)
+    w.join();
+
+  std::vector<entry> entries = std::move(parts[0]);
+  for (auto j = 1u; j < n_jobs; ++j) {
+    auto const mid = entries.size();
+    std::move(parts[j].begin(), parts[j].end(), std::back_inserter(entries));
+    std::inplace_merge(entries.begin(), entries.begin() + mid, entries.end());
+  }
+  entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+  auto db_tmp = db_path;
+  db_tmp += ".tmp";
+  if (!write_cdb(db_tmp, entries))
+    return 1;
+
+  fs::rename(db_tmp, db_path, ec);
+  if (ec) {
+    LOG(ERROR) << "rename " << db_tmp << " to " << db_path
+               << " failed: " << ec.message();
+    return 1;
+  }
+
+  // The sidecar must not be older than the database it describes, so
+  // it is written after the database is in place; the builder does its
+  // own temp file and rename.
+  auto bloom_path = db_path;
+  bloom_path.replace_extension(".bloom");
+  if (FLAGS_bloom) {
+    Bloom::builder bloom(entries.size());
+    for (auto const& e : entries)
+      bloom.add(e.key);
+    if (!bloom.write(bloom_path))
+      return 1;
+  }
+  else {
+    fs::remove(bloom_path, ec);
+    if (ec) {
+      LOG(ERROR) << "remove " << bloom_path << " failed: " << ec.message();
+      return 1;
+    }
+  }
+
+  LOG(INFO) << db_path.string() << ": " << entries.size() << " keys";
 }
@@ -0,0 +1,384 @@
+// Runs ./dns-pool against an upstream stubbed out here: a DNS over TLS
+// server with a certificate made for the test, trusted by way of
+// SSL_CERT_FILE.  The stub answers each query with its own question and
+// no records, holding a query a little to see if another comes, and
+// answering what it has in reverse order.  A query for close.test has
+// it hang up; one for slow.test it never answers.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <csignal>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include <glog/logging.h>
+
+#include "POSIX.hpp"
+#include "Sock.hpp"
+#include "fs.hpp"
+
+using namespace std::string_literals;
+using std::chrono::milliseconds;
+
+namespace {
+constexpr auto upstream_name = "upstream.test";
+
+// How long the stub waits for more queries before it answers.
+constexpr auto gather = milliseconds(200);
+
+// A self-signed certificate for upstream_name, as cert and key files
+// where TLS::starttls_server looks for them.
+void make_cert(fs::path const& dir)
+{
+  std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx(
+      EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr), EVP_PKEY_CTX_free);
+  CHECK_EQ(EVP_PKEY_keygen_init(ctx.get()), 1);
+  CHECK_EQ(EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx.get(),
+                                                  NID_X9_62_prime256v1),
+           1);
+  EVP_PKEY* key = nullptr;
+  CHECK_EQ(EVP_PKEY_keygen(ctx.get(), &key), 1);
+
+  auto const x509 = CHECK_NOTNULL(X509_new());
+  CHECK_EQ(X509_set_version(x509, 2), 1);
+  ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+  X509_gmtime_adj(X509_getm_notBefore(x509), -60);
+  X509_gmtime_adj(X509_getm_notAfter(x509), 60 * 60);
+  CHECK_EQ(X509_set_pubkey(x509, key), 1);
+
+  auto const name = X509_get_subject_name(x509);
+  X509_NAME_add_entry_by_txt(
+      name, "CN", MBSTRING_ASC,
+      reinterpret_cast<unsigned char const*>(upstream_name), -1, -1, 0);
+  CHECK_EQ(X509_set_issuer_name(x509, name), 1);
+
+  X509V3_CTX v3;
+  X509V3_set_ctx(&v3, x509, x509, nullptr, nullptr, 0);
+  for (auto const& [nid, value] :
+       {std::pair{NID_basic_constraints, "critical,CA:TRUE"s},
+        std::pair{NID_subject_alt_name, "DNS:"s + upstream_name}}) {
+    auto const ext = CHECK_NOTNULL(
+        X509V3_EXT_conf_nid(nullptr, &v3, nid, value.c_str()));
+    CHECK_EQ(X509_add_ext(x509, ext, -1), 1);
+    X509_EXTENSION_free(ext);
+  }
+  CHECK_GT(X509_sign(x509, key, EVP_sha256()), 0);
+
+  auto const cert_path = (dir / upstream_name).replace_extension(".pem");
+  auto const key_path  = (dir / upstream_name).replace_extension(".key");
+
+  auto f = CHECK_NOTNULL(fopen(cert_path.c_str(), "w"));
+  CHECK_EQ(PEM_write_X509(f, x509), 1);
+  fclose(f);
+  f = CHECK_NOTNULL(fopen(key_path.c_str(), "w"));
+  CHECK_EQ(PEM_write_PrivateKey(f, key, nullptr, nullptr, 0, nullptr, nullptr),
+           1);
+  fclose(f);
+
+  X509_free(x509);
+  EVP_PKEY_free(key);
+}
+
+uint16_t get_id(std::string_view msg)
+{
+  return (uint16_t(uint8_t(msg[0])) << 8) | uint8_t(msg[1]);
+}
+
+int rcode(std::string_view msg) { return msg[3] & 0x0f; }
+
+// An A query for name, with recursion desired.
+std::string query(uint16_t id, std::string_view name)
+{
+  std::string q{char(id >> 8), char(id & 0xff), 0x01, 0x00, 0, 1, 0, 0, 0,
+                0,             0,               0};
+  while (!name.empty()) {
+    auto const dot   = name.find('.');
+    auto const label = name.substr(0, dot);
+    q += char(label.size());
+    q += label;
+    name.remove_prefix(dot == std::string_view::npos ? name.size() : dot + 1);
+  }
+  q += std::string{0, 0, 1, 0, 1};
+  return q;
+}
+
+// a answers q: the same id, and q's question.
+bool answers(std::string_view a, std::string_view q)
+{
+  return (a.size() >= q.size()) && (get_id(a) == get_id(q))
+         && (uint8_t(a[2]) & 0x80) && (a.substr(12, q.size() - 12) == q.substr(12));
+}
+
+std::string frame(std::string_view msg)
+{
+  return std::string{char(msg.size() >> 8), char(msg.size() & 0xff)}
+         + std::string(msg);
+}
+
+class upstream {
+public:
+  explicit upstream(fs::path dir)
+    : dir_(dir)
+  {
+    lfd_ = socket(AF_INET, SOCK_STREAM, 0);
+    PCHECK(lfd_ >= 0);
+
+    auto in4{sockaddr_in{}};
+    in4.sin_family      = AF_INET;
+    in4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    PCHECK(bind(lfd_, reinterpret_cast<sockaddr*>(&in4), sizeof in4) == 0);
+    PCHECK(listen(lfd_, 8) == 0);
+
+    socklen_t len = sizeof in4;
+    PCHECK(getsockname(lfd_, reinterpret_cast<sockaddr*>(&in4), &len) == 0);
+    port_ = ntohs(in4.sin_port);
+
+    std::thread([this] { accept_(); }).detach();
+  }
+
+  uint16_t port() const { return port_; }
+  int      connections() const { return connections_; }
+
+private:
+  void accept_()
+  {
+    for (;;) {
+      auto const fd = accept(lfd_, nullptr, nullptr);
+      PCHECK(fd >= 0);
+      ++connections_;
+      std::thread([this, fd] { serve_(fd); }).detach();
+    }
+  }
+
+  void serve_(int fd)
+  {
+    Sock sock(fd, fd);
+    CHECK(sock.starttls_server(dir_));
+
+    // Ids the pool has outstanding on this connection.
+    std::unordered_set<uint16_t> ids;
+
+    for (;;) {
+      std::vector<std::string> qs;
+      do {
+        char sz[2];
+        if (!sock.in().read(sz, sizeof sz))
+          return;
+        std::string q((uint8_t(sz[0]) << 8) | uint8_t(sz[1]), '\0');
+        if (!sock.in().read(q.data(), q.size()))
+          return;
+        CHECK(ids.insert(get_id(q)).second)
+            << "id " << get_id(q) << " used twice on one connection";
+        qs.push_back(std::move(q));
+      } while ((sock.in().rdbuf()->in_avail() > 0)
+               || sock.input_ready(gather));
+
+      for (auto it = qs.rbegin(); it != qs.rend(); ++it) {
+        auto& q = *it;
+        if (q.find("\5close") != std::string::npos) {
+          sock.close_fds();
+          return;
+        }
+        if (q.find("\4slow") != std::string::npos)
+          continue;
+        ids.erase(get_id(q));
+        q[2] = char(q[2] | 0x80);
+        q[3] = char(q[3] & 0xf0);
+        sock.out() << frame(q);
+      }
+      sock.out().flush();
+    }
+  }
+
+  fs::path         dir_;
+  int              lfd_;
+  uint16_t         port_;
+  std::atomic<int> connections_{0};
+};
+
+// An smtp session's side of the pool's socket.
+class client {
+public:
+  explicit client(fs::path const& path)
+  {
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    PCHECK(fd_ >= 0);
+    auto un{sockaddr_un{}};
+    un.sun_family = AF_UNIX;
+    CHECK_LT(path.native().size(), sizeof(un.sun_path));
+    strcpy(un.sun_path, path.c_str());
+    connected_ = connect(fd_, reinterpret_cast<sockaddr*>(&un), sizeof un) == 0;
+  }
+  ~client() { close(fd_); }
+
+  bool connected() const { return connected_; }
+
+  void send(std::string_view msg)
+  {
+    auto const f = frame(msg);
+    CHECK_EQ(write(fd_, f.data(), f.size()), ssize_t(f.size()));
+  }
+
+  // The next answer, or false if the pool hangs up or none comes in
+  // time.
+  bool receive(std::string& msg, milliseconds wait = milliseconds(2'000))
+  {
+    unsigned char sz[2];
+    if (!read_(sz, sizeof sz, wait))
+      return false;
+    msg.resize((sz[0] << 8) | sz[1]);
+    return read_(msg.data(), msg.size(), wait);
+  }
+
+private:
+  bool read_(void* data, std::size_t n, milliseconds wait)
+  {
+    auto p = static_cast<char*>(data);
+    while (n) {
+      if (!POSIX::input_ready(fd_, wait))
+        return false;
+      auto const r = read(fd_, p, n);
+      if (r <= 0)
+        return false;
+      p += r;
+      n -= r;
+    }
+    return true;
+  }
+
+  int  fd_;
+  bool connected_;
+};
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  signal(SIGPIPE, SIG_IGN);
+
+  auto const dir = fs::temp_directory_path()
+                   / ("dns-pool-test-"s + std::to_string(getpid()));
+  fs::create_directories(dir);
+  make_cert(dir);
+
+  upstream up(dir);
+
+  auto const sock_path = dir / "pool.sock";
+  auto const socket_flag = "--socket="s + sock_path.string();
+  auto const upstreams_flag = "--upstreams=127.0.0.1@"s
+                              + std::to_string(up.port()) + '#'
+                              + upstream_name;
+
+  auto const pid = fork();
+  PCHECK(pid != -1);
+  if (pid == 0) {
+    auto const cert = (dir / upstream_name).replace_extension(".pem");
+    setenv("SSL_CERT_FILE", cert.c_str(), 1);
+    execl("./dns-pool", "dns-pool", socket_flag.c_str(),
+          upstreams_flag.c_str(), "--connections=1", nullptr);
+    PLOG(FATAL) << "exec ./dns-pool failed";
+  }
+
+  // Up once it answers.
+  auto const ask = [&](std::string_view name, uint16_t id) {
+    for (auto tries = 0; tries < 40; ++tries) {
+      client     c(sock_path);
+      auto const q = query(id, name);
+      std::string a;
+      if (c.connected()) {
+        c.send(q);
+        if (c.receive(a)) {
+          CHECK(answers(a, q));
+          return true;
+        }
+      }
+      std::this_thread::sleep_for(milliseconds(250));
+    }
+    return false;
+  };
+  CHECK(ask("first.test", 1));
+  CHECK_EQ(up.connections(), 1);
+
+  // Two clients using the same id: the stub checks each query it has
+  // outstanding has its own, and each client gets its own answer.
+  {
+    client      c1(sock_path), c2(sock_path);
+    auto const  q1 = query(7, "a.test"), q2 = query(7, "b.test");
+    std::string a1, a2;
+    c1.send(q1);
+    c2.send(q2);
+    CHECK(c1.receive(a1));
+    CHECK(c2.receive(a2));
+    CHECK(answers(a1, q1));
+    CHECK(answers(a2, q2));
+    CHECK_EQ(rcode(a1), 0);
+    CHECK_EQ(rcode(a2), 0);
+  }
+
+  // Pipelined queries, answered in the reverse order.
+  {
+    client      c(sock_path);
+    auto const  q1 = query(1, "one.test"), q2 = query(2, "two.test");
+    std::string a1, a2;
+    c.send(q1);
+    c.send(q2);
+    CHECK(c.receive(a2));
+    CHECK(c.receive(a1));
+    CHECK(answers(a2, q2));
+    CHECK(answers(a1, q1));
+  }
+
+  // The upstream hangs up: the query it took gets SERVFAIL, clients are
+  // hung up on while there's no connection, and the pool opens a new
+  // one.
+  {
+    client      c(sock_path);
+    auto const  q = query(3, "close.test");
+    std::string a;
+    c.send(q);
+    CHECK(c.receive(a));
+    CHECK(answers(a, q));
+    CHECK_EQ(rcode(a), 2);
+  }
+  {
+    client      c(sock_path);
+    std::string a;
+    c.send(query(5, "down.test"));
+    CHECK(!c.receive(a));
+  }
+  CHECK(ask("again.test", 6));
+  CHECK_EQ(up.connections(), 2);
+
+  // No answer within dns-pool's query_timeout: SERVFAIL.
+  {
+    client      c(sock_path);
+    auto const  q = query(4, "slow.test");
+    std::string a;
+    c.send(q);
+    CHECK(c.receive(a, milliseconds(15'000)));
+    CHECK(answers(a, q));
+    CHECK_EQ(rcode(a), 2);
+  }
+
+  kill(pid, SIGTERM);
+  waitpid(pid, nullptr, 0);
+  fs::remove_all(dir);
+}
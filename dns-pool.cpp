@@ -0,0 +1,809 @@
+// A long-lived helper that keeps DNS over TLS connections to the
+// upstream resolvers open, so that smtp sessions don't each pay for a
+// TCP connect and TLS handshake before their first query.
+//
+// Usage: dns-pool [--socket /run/ghsmtp-dns.sock] [--upstreams list]
+//                 [--connections n]
+//
+// Point the resolver at it with --nameserver or GHSMTP_NAMESERVER set
+// to the socket's path; it's then asked first, with the usual list
+// behind it for when the pool is down.
+//
+// The upstreams are a comma separated list of addr[@port]#name, as
+// unbound writes them, the name being the one to verify the server's
+// certificate against; the port defaults to 853.  Without the flag,
+// they're the DNS over TLS servers in the Resolver's list.  Each gets
+// --connections connections, opened at start and opened again when one
+// closes or is reset, backing off while they fail.  Other errors in the
+// TLS layer are fatal, as they are everywhere here, so run it under
+// something that will start it again.
+//
+// Clients speak the DNS over TCP framing of RFC 1035 section 4.2.2 on
+// the Unix socket, and may send any number of queries before reading
+// the answers, which come back as they arrive.  Each query goes to the
+// best upstream by DNS::health, on whichever of its connections has the
+// fewest queries outstanding, with its id replaced by one unique on
+// that connection; the client's id is put back in the answer.  A query
+// sent and not answered in time gets SERVFAIL.  When no upstream is up
+// to take a query, the client is hung up on instead, so its Resolver
+// moves on down its list; so is a client that doesn't read its answers.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <csignal>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "DNS-health.hpp"
+#include "DNS-nameservers.hpp"
+#include "IP4.hpp"
+#include "IP6.hpp"
+#include "POSIX.hpp"
+#include "Sock.hpp"
+#include "fs.hpp"
+#include "osutil.hpp"
+
+DEFINE_string(socket, "/run/ghsmtp-dns.sock", "Unix socket to listen on");
+DEFINE_string(upstreams, "", "DNS over TLS servers, as addr[@port]#name,...");
+DEFINE_uint64(connections, 2, "connections kept open to each upstream");
+
+namespace Config {
+constexpr auto query_timeout = std::chrono::seconds(10);
+constexpr auto reconnect_min = std::chrono::seconds(1);
+constexpr auto reconnect_max = std::chrono::seconds(60);
+
+// How long a read waits for more of a TLS record; a partial answer is
+// kept until the rest arrives.
+constexpr auto read_wait = std::chrono::milliseconds(50);
+
+// How often a connection looks for queries that have timed out.
+constexpr auto tick = std::chrono::milliseconds(500);
+
+// How much may be waiting for a client that isn't reading its answers
+// before it's dropped.
+constexpr std::size_t client_max_queued = 64 * 1024;
+
+constexpr int listen_backlog = 64;
+} // namespace Config
+
+namespace {
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+constexpr std::size_t header_sz = 12;
+
+struct upstream {
+  std::string addr;
+  std::string port{"853"};
+  std::string name;
+  std::string key; // in DNS::health
+};
+
+std::vector<upstream> parse_upstreams(std::string const& list)
+{
+  std::vector<upstream> ups;
+
+  std::string::size_type pos = 0;
+  while (pos <= list.size()) {
+    auto end = list.find(',', pos);
+    if (end == std::string::npos)
+      end = list.size();
+    auto spec = list.substr(pos, end - pos);
+    pos       = end + 1;
+    if (spec.empty())
+      continue;
+
+    upstream up;
+
+    auto const hash = spec.find('#');
+    CHECK_NE(hash, std::string::npos) << "upstream " << spec << " has no name";
+    up.name = spec.substr(hash + 1);
+    spec.erase(hash);
+
+    auto const at = spec.find('@');
+    if (at != std::string::npos) {
+      up.port = spec.substr(at + 1);
+      spec.erase(at);
+    }
+
+    CHECK(IP4::is_address(spec) || IP6::is_address(spec))
+        << "upstream " << spec << " must be an IP address";
+    up.addr = spec;
+    up.key  = DNS::health::key(
+        up.addr, osutil::get_port(up.port.c_str(), "tcp"), "tls");
+
+    ups.push_back(std::move(up));
+  }
+
+  return ups;
+}
+
+// The DNS over TLS servers from the Resolver's list.
+std::vector<upstream> default_upstreams()
+{
+  std::vector<upstream> ups;
+  for (auto const& ns : Config::nameservers) {
+    if ((ns.typ != Config::sock_type::stream)
+        || (std::strcmp(ns.port, "domain-s") != 0))
+      continue;
+    upstream up;
+    up.addr = ns.addr;
+    up.port = ns.port;
+    up.name = ns.host;
+    up.key  = DNS::health::key(
+        up.addr, osutil::get_port(up.port.c_str(), "tcp"), "tls");
+    ups.push_back(std::move(up));
+  }
+  return ups;
+}
+
+uint16_t get_id(std::string_view msg)
+{
+  return (uint16_t(uint8_t(msg[0])) << 8) | uint8_t(msg[1]);
+}
+
+void set_id(std::string& msg, uint16_t id)
+{
+  msg[0] = char(id >> 8);
+  msg[1] = char(id & 0xff);
+}
+
+// The query, turned around as an answer with RCODE 2.
+std::string servfail(std::string msg)
+{
+  msg[2] = char(msg[2] | 0x80);          // QR
+  msg[3] = char((msg[3] & 0xf0) | 0x02); // SERVFAIL
+  return msg;
+}
+
+// One smtp session's connection to us, read and written by its serve()
+// thread alone.  Answers come from the upstream connections' threads,
+// which only queue them and wake that thread, so a client that stops
+// reading holds up no one else; once more than Config::client_max_queued
+// octets are waiting for it, it's hung up on.
+class client {
+public:
+  client(client const&) = delete;
+  client& operator=(client const&) = delete;
+
+  explicit client(int fd)
+    : fd_(fd)
+  {
+    PCHECK(pipe2(wake_, O_NONBLOCK | O_CLOEXEC) == 0);
+    POSIX::set_nonblocking(fd_);
+  }
+  ~client()
+  {
+    close(fd_);
+    close(wake_[0]);
+    close(wake_[1]);
+  }
+
+  // The next whole query, writing out answers while it waits; false once
+  // the client has gone or been hung up on.
+  bool receive(std::string& msg);
+
+  // An answer, from any thread.
+  void send(std::string_view msg)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (gone_)
+      return;
+    if (out_.size() + 2 + msg.size() > Config::client_max_queued) {
+      LOG(WARNING) << "client not reading, dropped";
+      hang_up_();
+      return;
+    }
+    out_ += char(msg.size() >> 8);
+    out_ += char(msg.size() & 0xff);
+    out_.append(msg);
+    wake_up_();
+  }
+
+  // No answer is coming: the Resolver is to ask elsewhere.
+  void hang_up()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hang_up_();
+  }
+
+private:
+  void hang_up_()
+  {
+    gone_ = true;
+    shutdown(fd_, SHUT_RDWR);
+    wake_up_();
+  }
+
+  // A full pipe is a wake-up already pending.
+  void wake_up_()
+  {
+    char const ch = 0;
+    (void)!write(wake_[1], &ch, 1);
+  }
+
+  bool flush_();
+
+  int fd_;
+  int wake_[2];
+
+  std::mutex  mutex_;
+  std::string out_; // answers, framed, not yet written
+  bool        gone_{false};
+
+  std::string in_; // queries read, not yet whole
+};
+
+bool client::receive(std::string& msg)
+{
+  for (;;) {
+    if (in_.size() >= 2) {
+      auto const sz = (std::size_t(uint8_t(in_[0])) << 8) | uint8_t(in_[1]);
+      if (in_.size() >= 2 + sz) {
+        msg = in_.substr(2, sz);
+        in_.erase(0, 2 + sz);
+        return true;
+      }
+    }
+
+    if (!flush_())
+      return false;
+
+    short out_events = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!out_.empty())
+        out_events = POLLOUT;
+    }
+    pollfd fds[]{{fd_, short(POLLIN | out_events), 0}, {wake_[0], POLLIN, 0}};
+    if (poll(fds, std::size(fds), -1) == -1) {
+      PCHECK(errno == EINTR) << "poll failed";
+      continue;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      char buf[64];
+      while (read(wake_[0], buf, sizeof buf) > 0)
+        ;
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      char       buf[4096];
+      auto const r = ::read(fd_, buf, sizeof buf);
+      if (r == 0)
+        return false;
+      if (r == -1) {
+        if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK))
+          continue;
+        PLOG(WARNING) << "read from client failed";
+        return false;
+      }
+      in_.append(buf, r);
+    }
+  }
+}
+
+// As much of the queued answers as the socket will take without
+// blocking; false if the client has gone.
+bool client::flush_()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (!gone_ && !out_.empty()) {
+    auto const w
+        = ::send(fd_, out_.data(), out_.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (w == -1) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        break;
+      PLOG(WARNING) << "write to client failed";
+      hang_up_();
+      break;
+    }
+    out_.erase(0, w);
+  }
+  return !gone_;
+}
+
+// One connection to an upstream, and the thread that owns it: all the
+// TLS reading and writing is done there.  Queries to send are handed
+// over in a queue, with a write to a pipe to wake the thread.
+class connection {
+public:
+  connection(connection const&) = delete;
+  connection& operator=(connection const&) = delete;
+
+  connection(upstream const& up, std::size_t index, fs::path config_path,
+             DNS::health& health)
+    : up_(up)
+    , index_(index)
+    , config_path_(config_path)
+    , health_(health)
+  {
+    PCHECK(pipe(wake_) == 0);
+  }
+
+  void start()
+  {
+    std::thread([this] { run_(); }).detach();
+  }
+
+  std::size_t index() const { return index_; }
+  bool        is_up() const { return is_up_; }
+  std::size_t outstanding() const { return outstanding_; }
+
+  void forward(std::string&& query, std::shared_ptr<client> const& c)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back({std::move(query), c});
+    }
+    char const ch = 0;
+    PCHECK(write(wake_[1], &ch, 1) == 1);
+  }
+
+private:
+  struct queued {
+    std::string             query;
+    std::shared_ptr<client> from;
+  };
+
+  struct pending {
+    std::weak_ptr<client>    from;
+    uint16_t                 id; // the client's
+    steady_clock::time_point sent;
+    std::string              query;
+  };
+
+  void run_();
+  bool connect_();
+  void drop_(char const* why);
+  void fail_queued_();
+  bool wait_();
+  bool closed_() const;
+  bool read_answers_();
+  bool send_queued_();
+  void expire_();
+
+  upstream const& up_;
+  std::size_t     index_;
+  fs::path        config_path_;
+  DNS::health&    health_;
+
+  int wake_[2];
+
+  std::mutex          mutex_;
+  std::vector<queued> queue_;
+
+  std::unique_ptr<Sock>                 sock_;
+  int                                   fd_{-1};
+  std::string                           in_; // a partial answer
+  std::unordered_map<uint16_t, pending> pending_;
+  uint16_t                              next_id_{0};
+
+  std::atomic<bool>        is_up_{false};
+  std::atomic<std::size_t> outstanding_{0};
+};
+
+void connection::run_()
+{
+  auto backoff = duration_cast<milliseconds>(Config::reconnect_min);
+
+  for (;;) {
+    if (!sock_) {
+      if (!connect_()) {
+        health_.failure(up_.key);
+        fail_queued_();
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min<milliseconds>(2 * backoff, Config::reconnect_max);
+        continue;
+      }
+      backoff = Config::reconnect_min;
+      LOG(INFO) << "connected to " << up_.name << '[' << up_.addr << "]:"
+                << up_.port;
+      is_up_ = true;
+    }
+
+    // Read first: if the server has closed the connection, better to
+    // find out before writing to it.
+    if (wait_() && !read_answers_()) {
+      drop_("connection closed");
+    }
+    else if (!send_queued_()) {
+      drop_("write failed");
+    }
+    else {
+      expire_();
+      continue;
+    }
+
+    // A server that closes on us may be on its way down: connecting
+    // again straight away would only be turned away.
+    std::this_thread::sleep_for(Config::reconnect_min);
+  }
+}
+
+bool connection::connect_()
+{
+  auto const port = osutil::get_port(up_.port.c_str(), "tcp");
+
+  if (IP4::is_address(up_.addr)) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    PCHECK(fd_ >= 0) << "socket() failed";
+
+    auto in4{sockaddr_in{}};
+    in4.sin_family = AF_INET;
+    in4.sin_port   = htons(port);
+    CHECK_EQ(inet_pton(AF_INET, up_.addr.c_str(), &in4.sin_addr), 1);
+    if (connect(fd_, reinterpret_cast<sockaddr const*>(&in4), sizeof(in4))) {
+      PLOG(WARNING) << "connect failed " << up_.name << '[' << up_.addr
+                    << "]:" << up_.port;
+      close(fd_);
+      fd_ = -1;
+      return false;
+    }
+  }
+  else {
+    fd_ = socket(AF_INET6, SOCK_STREAM, 0);
+    PCHECK(fd_ >= 0) << "socket() failed";
+
+    auto in6{sockaddr_in6{}};
+    in6.sin6_family = AF_INET6;
+    in6.sin6_port   = htons(port);
+    CHECK_EQ(inet_pton(AF_INET6, up_.addr.c_str(), &in6.sin6_addr), 1);
+    if (connect(fd_, reinterpret_cast<sockaddr const*>(&in6), sizeof(in6))) {
+      PLOG(WARNING) << "connect failed " << up_.name << '[' << up_.addr
+                    << "]:" << up_.port;
+      close(fd_);
+      fd_ = -1;
+      return false;
+    }
+  }
+
+  POSIX::set_nonblocking(fd_);
+  sock_ = std::make_unique<Sock>(fd_, fd_, [] {}, Config::read_wait);
+
+  DNS::RR_collection tlsa_rrs; // none, the name is checked
+  if (!sock_->starttls_client(config_path_, nullptr, up_.name.c_str(),
+                              tlsa_rrs, false)
+      || !sock_->verified()) {
+    LOG(WARNING) << up_.name << '[' << up_.addr << "] failed to verify";
+    sock_->close_fds();
+    sock_.reset();
+    fd_ = -1;
+    return false;
+  }
+
+  return true;
+}
+
+// Queries sent and not answered get SERVFAIL; those still queued wait
+// for the connection to be opened again.
+void connection::drop_(char const* why)
+{
+  if (sock_) {
+    LOG(WARNING) << up_.name << '[' << up_.addr << "]: " << why;
+    sock_->close_fds();
+    sock_.reset();
+    fd_ = -1;
+  }
+  is_up_ = false;
+  in_.clear();
+
+  for (auto& [id, p] : pending_) {
+    if (auto const c = p.from.lock(); c) {
+      set_id(p.query, p.id);
+      c->send(servfail(std::move(p.query)));
+    }
+  }
+  pending_.clear();
+  outstanding_ = 0;
+}
+
+// Queries waiting for a connection that couldn't be opened: there's
+// no knowing when one will be, so their clients go elsewhere.
+void connection::fail_queued_()
+{
+  std::vector<queued> queue;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue.swap(queue_);
+  }
+  for (auto& q : queue)
+    q.from->hang_up();
+}
+
+// True if there's an answer to read.  An answer may already be sitting
+// in the stream's buffer, where select(2) can't see it.
+bool connection::wait_()
+{
+  if (sock_->in().rdbuf()->in_avail() > 0)
+    return true;
+
+  auto fds{fd_set{}};
+  FD_ZERO(&fds);
+  FD_SET(fd_, &fds);
+  FD_SET(wake_[0], &fds);
+
+  auto tv{timeval{}};
+  tv.tv_usec = duration_cast<microseconds>(Config::tick).count();
+
+  // TLS may have decrypted more than was asked for last time.
+  if (sock_->input_ready(milliseconds(0)))
+    return true;
+
+  PCHECK(select(std::max(fd_, wake_[0]) + 1, &fds, nullptr, nullptr, &tv)
+         != -1);
+
+  if (FD_ISSET(wake_[0], &fds)) {
+    char buf[64];
+    PCHECK(read(wake_[0], buf, sizeof buf) > 0);
+  }
+
+  return FD_ISSET(fd_, &fds);
+}
+
+// A server closing the connection and a read that timed out look the
+// same from the stream; the socket itself can tell them apart.  Should
+// an answer be left in the TLS layer's buffer when the server closes,
+// it's lost, and its query gets SERVFAIL.
+bool connection::closed_() const
+{
+  char       ch;
+  auto const r = recv(fd_, &ch, 1, MSG_PEEK | MSG_DONTWAIT);
+  return (r == 0)
+         || ((r == -1) && (errno != EAGAIN) && (errno != EWOULDBLOCK)
+             && (errno != EINTR));
+}
+
+// Takes in what has arrived, which may be part of an answer or none at
+// all: a readable socket might only hold TLS session tickets.
+bool connection::read_answers_()
+{
+  do {
+    char buf[4096];
+    auto n = sock_->in().readsome(buf, sizeof buf);
+    if (n <= 0) {
+      // Nothing buffered, so through the TLS layer for one octet; look
+      // first, and spare it a read of the EOF.
+      if (closed_())
+        return false;
+      if (!sock_->in().get(buf[0])) {
+        sock_->in().clear();
+        if (closed_())
+          return false;
+        break;
+      }
+      n = 1;
+    }
+    in_.append(buf, n);
+  } while ((sock_->in().rdbuf()->in_avail() > 0)
+           || sock_->input_ready(milliseconds(0)));
+
+  while (in_.size() >= 2) {
+    auto const sz = (std::size_t(uint8_t(in_[0])) << 8) | uint8_t(in_[1]);
+    if (in_.size() < 2 + sz)
+      break;
+    auto msg = in_.substr(2, sz);
+    in_.erase(0, 2 + sz);
+
+    if (msg.size() < header_sz) {
+      LOG(WARNING) << up_.name << " sent a short message";
+      continue;
+    }
+
+    auto const it = pending_.find(get_id(msg));
+    if (it == pending_.end()) {
+      LOG(WARNING) << up_.name << " sent an answer to no query";
+      continue;
+    }
+
+    auto& p = it->second;
+    health_.sample(up_.key,
+                   duration_cast<microseconds>(steady_clock::now() - p.sent));
+    if (auto const c = p.from.lock(); c) {
+      set_id(msg, p.id);
+      c->send(msg);
+    }
+    pending_.erase(it);
+  }
+
+  outstanding_ = pending_.size();
+  return true;
+}
+
+// RFC 7766 section 6.2.1.1, query pipelining: all that's queued goes
+// out in one flush.
+bool connection::send_queued_()
+{
+  std::vector<queued> queue;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue.swap(queue_);
+  }
+  if (queue.empty())
+    return true;
+
+  if (closed_()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.insert(queue_.begin(), std::make_move_iterator(queue.begin()),
+                  std::make_move_iterator(queue.end()));
+    return false;
+  }
+
+  for (auto& q : queue) {
+    if (pending_.size() > std::numeric_limits<uint16_t>::max()) {
+      q.from->send(servfail(std::move(q.query)));
+      continue;
+    }
+    while (pending_.count(next_id_))
+      ++next_id_;
+
+    auto const id = get_id(q.query);
+    set_id(q.query, next_id_);
+
+    unsigned char const sz[2]{uint8_t(q.query.size() >> 8),
+                              uint8_t(q.query.size() & 0xff)};
+    sock_->out().write(reinterpret_cast<char const*>(sz), sizeof sz);
+    sock_->out().write(q.query.data(), q.query.size());
+
+    pending_.emplace(next_id_, pending{q.from, id, steady_clock::now(),
+                                       std::move(q.query)});
+    ++next_id_;
+  }
+  sock_->out().flush();
+
+  outstanding_ = pending_.size();
+
+  // A reset as the queries went out fails the write in the TLS layer;
+  // the stream doesn't show that, but the socket does.
+  return bool(sock_->out()) && !closed_();
+}
+
+void connection::expire_()
+{
+  auto const now = steady_clock::now();
+  for (auto it = pending_.begin(); it != pending_.end();) {
+    auto& p = it->second;
+    if (now - p.sent < Config::query_timeout) {
+      ++it;
+      continue;
+    }
+    LOG(WARNING) << up_.name << " timed out";
+    health_.failure(up_.key);
+    if (auto const c = p.from.lock(); c) {
+      set_id(p.query, p.id);
+      c->send(servfail(std::move(p.query)));
+    }
+    it = pending_.erase(it);
+  }
+  outstanding_ = pending_.size();
+}
+
+// The best upstream that has a connection up, and of its connections
+// the least busy.
+connection* choose(std::vector<std::unique_ptr<connection>> const& conns,
+                   std::vector<std::string> const&                 keys,
+                   DNS::health const&                              health)
+{
+  for (auto const u : health.rank(keys)) {
+    connection* best = nullptr;
+    for (auto const& c : conns) {
+      if ((c->index() == u) && c->is_up()
+          && (!best || (c->outstanding() < best->outstanding())))
+        best = c.get();
+    }
+    if (best)
+      return best;
+  }
+  return nullptr;
+}
+
+void serve(std::shared_ptr<client>                         c,
+           std::vector<std::unique_ptr<connection>> const& conns,
+           std::vector<std::string> const&                 keys,
+           DNS::health const&                              health)
+{
+  std::string query;
+  while (c->receive(query)) {
+    if (query.size() < header_sz) {
+      LOG(WARNING) << "short query from client";
+      break;
+    }
+    if (auto const conn = choose(conns, keys, health); conn) {
+      conn->forward(std::move(query), c);
+    }
+    else {
+      LOG(WARNING) << "no upstream up, hanging up on client";
+      break;
+    }
+  }
+  c->hang_up(); // answers still to come are dropped
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  { // Need to work with either namespace.
+    using namespace gflags;
+    using namespace google;
+    ParseCommandLineFlags(&argc, &argv, true);
+  }
+
+  // A client or upstream that hangs up shows as a failed write.
+  signal(SIGPIPE, SIG_IGN);
+
+  auto const ups = FLAGS_upstreams.empty() ? default_upstreams()
+                                           : parse_upstreams(FLAGS_upstreams);
+  CHECK(!ups.empty()) << "no upstreams; the nameserver list has no DNS over "
+                         "TLS servers, so give --upstreams";
+
+  std::vector<std::string> keys;
+  for (auto const& up : ups)
+    keys.push_back(up.key);
+
+  auto const  config_path = osutil::get_config_dir();
+  DNS::health health;
+
+  std::vector<std::unique_ptr<connection>> conns;
+  for (std::size_t i = 0; i < ups.size(); ++i) {
+    for (auto n = 0u; n < FLAGS_connections; ++n)
+      conns.push_back(
+          std::make_unique<connection>(ups[i], i, config_path, health));
+  }
+  for (auto& c : conns)
+    c->start();
+
+  auto const lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  PCHECK(lfd >= 0) << "socket() failed";
+
+  auto un{sockaddr_un{}};
+  un.sun_family = AF_UNIX;
+  CHECK_LT(FLAGS_socket.size(), sizeof(un.sun_path))
+      << "socket path too long";
+  std::strcpy(un.sun_path, FLAGS_socket.c_str());
+
+  unlink(FLAGS_socket.c_str());
+  PCHECK(bind(lfd, reinterpret_cast<sockaddr const*>(&un), sizeof(un)) == 0)
+      << "bind " << FLAGS_socket << " failed";
+  PCHECK(listen(lfd, Config::listen_backlog) == 0);
+
+  LOG(INFO) << "listening on " << FLAGS_socket;
+
+  for (;;) {
+    auto const fd = accept(lfd, nullptr, nullptr);
+    if (fd == -1) {
+      PCHECK(errno == EINTR || errno == ECONNABORTED) << "accept failed";
+      continue;
+    }
+    auto const c = std::make_shared<client>(fd);
+    std::thread(serve, c, std::cref(conns), std::cref(keys), std::cref(health))
+        .detach();
+  }
+}
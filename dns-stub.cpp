@@ -0,0 +1,536 @@
+// A DNS server for tests and benchmarks, answering from a zone file
+// rather than the Internet, so runs are repeatable and work offline.
+//
+// Usage: dns-stub [--zone dns-fixture.zone] [--address a] [--port n]
+//                 [--latency_ms n] [--jitter_ms n]
+//                 [--drop p] [--truncate p] [--seed n]
+//
+// Point the resolver at it with --nameserver or GHSMTP_NAMESERVER set
+// to 127.0.0.1@5353/udp, or /tcp.
+//
+// It listens on UDP and TCP both, and answers any name in the zone
+// file as a recursive resolver would: records of the type asked for,
+// CNAMEs followed, NXDOMAIN for names not in the file, and the file's
+// SOA in the authority section of negative answers.  The file is in
+// the usual master file format, read by ldns, with absolute names from
+// any number of domains; there are no wildcards or delegations.
+//
+// Each reply is held for --latency_ms, plus or minus up to --jitter_ms,
+// without holding up others.  A --drop fraction of queries get no
+// reply at all, and a --truncate fraction of UDP replies are sent with
+// TC set and nothing but the question, as are any too big for the
+// client's buffer.  The random choices come from a PRNG seeded with
+// --seed, so the same queries see the same faults.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <csignal>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdbool> // needs to be above ldns includes
+#include <ldns/ldns.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+DEFINE_string(zone, "dns-fixture.zone", "zone file to answer from");
+DEFINE_string(address, "127.0.0.1", "address to listen on");
+DEFINE_uint32(port, 5353, "port to listen on, UDP and TCP");
+
+DEFINE_uint64(latency_ms, 0, "milliseconds to hold each reply");
+DEFINE_uint64(jitter_ms, 0, "plus or minus up to this many milliseconds");
+DEFINE_double(drop, 0.0, "fraction of queries not to answer");
+DEFINE_double(truncate, 0.0, "fraction of UDP replies to truncate");
+DEFINE_uint64(seed, 1, "seed for the latency and fault choices");
+
+DEFINE_bool(authentic_data, true, "set AD, as a validating resolver would");
+
+namespace Config {
+// RFC 1035 section 2.3.4, for clients that don't say otherwise.
+constexpr std::size_t udp_sz_no_edns = 512;
+
+constexpr std::size_t edns_udp_sz = 4 * 1024;
+
+// Longest CNAME chain followed.
+constexpr int max_cnames = 8;
+
+constexpr int listen_backlog = 64;
+} // namespace Config
+
+namespace {
+
+using std::chrono::steady_clock;
+
+using wire_t = std::vector<unsigned char>;
+
+// The lower case presentation form of a name, used as the index key.
+std::string key(ldns_rdf const* dname)
+{
+  auto const canon = ldns_rdf_clone(dname);
+  ldns_dname2canonical(canon);
+  auto const str = ldns_rdf2str(canon);
+  std::string ret{str};
+  free(str);
+  ldns_rdf_deep_free(canon);
+  return ret;
+}
+
+class zone {
+public:
+  zone(zone const&) = delete;
+  zone& operator=(zone const&) = delete;
+
+  explicit zone(char const* path);
+  ~zone() { ldns_zone_deep_free(zone_); }
+
+  // The answer to query, or nothing for a query not worth answering.
+  wire_t answer(ldns_pkt const* query, bool udp, bool truncate) const;
+
+private:
+  ldns_pkt* reply_(ldns_pkt const* query, bool with_records) const;
+
+  ldns_zone* zone_{nullptr};
+
+  // Owner names, and the names above them, empty non-terminals, that
+  // get NODATA rather than NXDOMAIN.
+  std::unordered_map<std::string, std::vector<ldns_rr const*>> names_;
+  std::unordered_set<std::string>                              ents_;
+};
+
+zone::zone(char const* path)
+{
+  auto const fp = fopen(path, "r");
+  PCHECK(fp) << "can't open " << path;
+
+  int        line_nr = 0;
+  auto const status  = ldns_zone_new_frm_fp_l(&zone_, fp, nullptr, 3600,
+                                              LDNS_RR_CLASS_IN, &line_nr);
+  fclose(fp);
+  CHECK_EQ(status, LDNS_STATUS_OK)
+      << path << ':' << line_nr << ": " << ldns_get_errorstr_by_id(status);
+
+  auto const rrs = ldns_zone_rrs(zone_);
+  for (std::size_t i = 0; i < ldns_rr_list_rr_count(rrs); ++i) {
+    auto const rr    = ldns_rr_list_rr(rrs, i);
+    auto const owner = ldns_rr_owner(rr);
+    names_[key(owner)].push_back(rr);
+
+    auto up = ldns_dname_left_chop(owner);
+    while (up && ldns_dname_label_count(up)) {
+      ents_.insert(key(up));
+      auto const next = ldns_dname_left_chop(up);
+      ldns_rdf_deep_free(up);
+      up = next;
+    }
+    if (up)
+      ldns_rdf_deep_free(up);
+  }
+
+  LOG(INFO) << "read " << ldns_rr_list_rr_count(rrs) << " records for "
+            << names_.size() << " names from " << path;
+}
+
+ldns_pkt* zone::reply_(ldns_pkt const* query, bool with_records) const
+{
+  auto const q = ldns_rr_list_rr(ldns_pkt_question(query), 0);
+
+  auto const a = ldns_pkt_new();
+  ldns_pkt_set_id(a, ldns_pkt_id(query));
+  ldns_pkt_set_qr(a, true);
+  ldns_pkt_set_opcode(a, ldns_pkt_get_opcode(query));
+  ldns_pkt_set_rd(a, ldns_pkt_rd(query));
+  ldns_pkt_set_cd(a, ldns_pkt_cd(query));
+  ldns_pkt_set_ra(a, true);
+  ldns_pkt_set_ad(a, FLAGS_authentic_data);
+  if (ldns_pkt_edns(query)) {
+    ldns_pkt_set_edns_udp_size(a, Config::edns_udp_sz);
+    ldns_pkt_set_edns_do(a, ldns_pkt_edns_do(query));
+  }
+  ldns_pkt_push_rr(a, LDNS_SECTION_QUESTION, ldns_rr_clone(q));
+
+  if (!with_records)
+    return a;
+
+  auto const type = ldns_rr_get_type(q);
+  auto       name = key(ldns_rr_owner(q));
+
+  auto found = false;
+  for (auto cnames = 0; cnames < Config::max_cnames; ++cnames) {
+    auto const rrs = names_.find(name);
+    if (rrs == names_.end()) {
+      if (!found && !ents_.count(name))
+        ldns_pkt_set_rcode(a, LDNS_RCODE_NXDOMAIN);
+      break;
+    }
+    found = true;
+
+    auto answered = false;
+    for (auto rr : rrs->second) {
+      if ((type == ldns_rr_get_type(rr)) || (type == LDNS_RR_TYPE_ANY)) {
+        ldns_pkt_push_rr(a, LDNS_SECTION_ANSWER, ldns_rr_clone(rr));
+        answered = true;
+      }
+    }
+    if (answered)
+      break;
+
+    auto const cname
+        = std::find_if(rrs->second.begin(), rrs->second.end(), [](auto rr) {
+            return ldns_rr_get_type(rr) == LDNS_RR_TYPE_CNAME;
+          });
+    if (cname == rrs->second.end())
+      break;
+    ldns_pkt_push_rr(a, LDNS_SECTION_ANSWER, ldns_rr_clone(*cname));
+    name = key(ldns_rr_rdf(*cname, 0));
+  }
+
+  if (!ldns_pkt_ancount(a) && ldns_zone_soa(zone_))
+    ldns_pkt_push_rr(a, LDNS_SECTION_AUTHORITY,
+                     ldns_rr_clone(ldns_zone_soa(zone_)));
+
+  return a;
+}
+
+wire_t zone::answer(ldns_pkt const* query, bool udp, bool truncate) const
+{
+  if (ldns_pkt_qr(query) || (ldns_pkt_qdcount(query) != 1)) {
+    LOG(WARNING) << "not a query we answer";
+    return {};
+  }
+
+  auto const to_wire = [](ldns_pkt* pkt) {
+    std::uint8_t* data = nullptr;
+    std::size_t   sz   = 0;
+    CHECK_EQ(ldns_pkt2wire(&data, pkt, &sz), LDNS_STATUS_OK);
+    wire_t wire(data, data + sz);
+    free(data);
+    ldns_pkt_free(pkt);
+    return wire;
+  };
+
+  if (!truncate) {
+    auto wire = to_wire(reply_(query, true));
+    if (!udp)
+      return wire;
+    auto const max_sz = ldns_pkt_edns(query) ? ldns_pkt_edns_udp_size(query)
+                                             : Config::udp_sz_no_edns;
+    if (wire.size() <= max_sz)
+      return wire;
+  }
+
+  auto const a = reply_(query, false);
+  ldns_pkt_set_tc(a, true);
+  return to_wire(a);
+}
+
+// A reply waiting out its latency.
+struct reply {
+  steady_clock::time_point due;
+
+  int           fd;
+  std::uint64_t conn; // TCP connection serial, zero for UDP
+
+  sockaddr_storage peer;
+  socklen_t        peer_len;
+
+  wire_t wire;
+
+  bool operator>(reply const& rhs) const { return due > rhs.due; }
+};
+
+// A TCP connection, and the part of a query not yet read.
+struct connection {
+  std::uint64_t serial;
+  wire_t        bfr;
+};
+
+class server {
+public:
+  server(server const&) = delete;
+  server& operator=(server const&) = delete;
+
+  explicit server(zone const& z);
+
+  [[noreturn]] void run();
+
+private:
+  void listen_();
+  void query_(int fd, std::uint64_t conn, sockaddr_storage const& peer,
+              socklen_t peer_len, unsigned char const* data, std::size_t sz);
+  void read_udp_();
+  void accept_();
+  void read_tcp_(int fd);
+  void send_due_();
+
+  zone const& zone_;
+
+  int udp_fd_{-1};
+  int tcp_fd_{-1};
+
+  std::map<int, connection> conns_;
+  std::uint64_t             serial_{0};
+
+  std::priority_queue<reply, std::vector<reply>, std::greater<>> pending_;
+
+  std::mt19937_64                        rng_;
+  std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+};
+
+server::server(zone const& z)
+  : zone_(z)
+  , rng_(FLAGS_seed)
+{
+  listen_();
+}
+
+void server::listen_()
+{
+  auto addr{sockaddr_storage{}};
+  auto len{socklen_t{}};
+
+  auto const in4 = reinterpret_cast<sockaddr_in*>(&addr);
+  auto const in6 = reinterpret_cast<sockaddr_in6*>(&addr);
+  if (inet_pton(AF_INET, FLAGS_address.c_str(), &in4->sin_addr) == 1) {
+    in4->sin_family = AF_INET;
+    in4->sin_port   = htons(FLAGS_port);
+    len             = sizeof(*in4);
+  }
+  else if (inet_pton(AF_INET6, FLAGS_address.c_str(), &in6->sin6_addr) == 1) {
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port   = htons(FLAGS_port);
+    len              = sizeof(*in6);
+  }
+  else {
+    LOG(FATAL) << "--address " << FLAGS_address << " is not an IP address";
+  }
+
+  auto const sa = reinterpret_cast<sockaddr const*>(&addr);
+
+  udp_fd_ = socket(addr.ss_family, SOCK_DGRAM, 0);
+  PCHECK(udp_fd_ >= 0) << "socket() failed";
+  PCHECK(bind(udp_fd_, sa, len) == 0)
+      << "can't bind UDP " << FLAGS_address << '@' << FLAGS_port;
+
+  tcp_fd_ = socket(addr.ss_family, SOCK_STREAM, 0);
+  PCHECK(tcp_fd_ >= 0) << "socket() failed";
+  int const on = 1;
+  PCHECK(setsockopt(tcp_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0);
+  PCHECK(bind(tcp_fd_, sa, len) == 0)
+      << "can't bind TCP " << FLAGS_address << '@' << FLAGS_port;
+  PCHECK(listen(tcp_fd_, Config::listen_backlog) == 0);
+
+  LOG(INFO) << "listening on " << FLAGS_address << '@' << FLAGS_port;
+}
+
+void server::query_(int                     fd,
+                    std::uint64_t           conn,
+                    sockaddr_storage const& peer,
+                    socklen_t               peer_len,
+                    unsigned char const*    data,
+                    std::size_t             sz)
+{
+  auto const udp = (conn == 0);
+
+  // Make the same draws for every query, so one fault doesn't shift
+  // the choices made for all that follow.
+  auto const drop     = uniform_(rng_) < FLAGS_drop;
+  auto const truncate = udp && (uniform_(rng_) < FLAGS_truncate);
+  auto const jitter   = static_cast<double>(FLAGS_jitter_ms)
+                      * (2 * uniform_(rng_) - 1);
+
+  ldns_pkt* q = nullptr;
+  if (ldns_wire2pkt(&q, data, sz) != LDNS_STATUS_OK) {
+    LOG(WARNING) << "can't parse query of " << sz << " octets";
+    return;
+  }
+  if (drop) {
+    VLOG(1) << "dropping query " << ldns_pkt_id(q);
+    ldns_pkt_free(q);
+    return;
+  }
+  auto wire = zone_.answer(q, udp, truncate);
+  ldns_pkt_free(q);
+  if (wire.empty())
+    return;
+
+  if (!udp) {
+    // RFC 1035 section 4.2.2, the two octet length prefix.
+    auto const len = wire.size();
+    wire.insert(wire.begin(), {static_cast<unsigned char>(len >> 8),
+                               static_cast<unsigned char>(len & 0xFF)});
+  }
+
+  auto const delay_ms
+      = std::max(0.0, static_cast<double>(FLAGS_latency_ms) + jitter);
+
+  reply r;
+  r.due = steady_clock::now()
+        + std::chrono::duration_cast<steady_clock::duration>(
+              std::chrono::duration<double, std::milli>(delay_ms));
+  r.fd       = fd;
+  r.conn     = conn;
+  r.peer     = peer;
+  r.peer_len = peer_len;
+  r.wire     = std::move(wire);
+  pending_.push(std::move(r));
+}
+
+void server::read_udp_()
+{
+  unsigned char bfr[Config::edns_udp_sz];
+
+  auto peer{sockaddr_storage{}};
+  auto peer_len{socklen_t{sizeof(peer)}};
+
+  auto const n = recvfrom(udp_fd_, bfr, sizeof(bfr), 0,
+                          reinterpret_cast<sockaddr*>(&peer), &peer_len);
+  if (n < 0) {
+    PLOG(WARNING) << "recvfrom() failed";
+    return;
+  }
+  query_(udp_fd_, 0, peer, peer_len, bfr, n);
+}
+
+void server::accept_()
+{
+  auto const fd = accept(tcp_fd_, nullptr, nullptr);
+  if (fd < 0) {
+    PLOG(WARNING) << "accept() failed";
+    return;
+  }
+  conns_[fd] = connection{++serial_, {}};
+}
+
+void server::read_tcp_(int fd)
+{
+  auto& conn = conns_[fd];
+
+  unsigned char bfr[16 * 1024];
+
+  auto const n = read(fd, bfr, sizeof(bfr));
+  if (n <= 0) {
+    if (n < 0)
+      PLOG(WARNING) << "read() failed";
+    close(fd);
+    conns_.erase(fd);
+    return;
+  }
+  conn.bfr.insert(conn.bfr.end(), bfr, bfr + n);
+
+  // Answer every whole query read so far; pipelined queries, RFC 7766
+  // section 6.2.1.1, are answered as each one's latency runs out.
+  std::size_t pos = 0;
+  while (conn.bfr.size() - pos >= 2) {
+    std::size_t const sz = (conn.bfr[pos] << 8) + conn.bfr[pos + 1];
+    if (conn.bfr.size() - pos - 2 < sz)
+      break;
+    query_(fd, conn.serial, sockaddr_storage{}, 0, conn.bfr.data() + pos + 2,
+           sz);
+    pos += 2 + sz;
+  }
+  conn.bfr.erase(conn.bfr.begin(), conn.bfr.begin() + pos);
+}
+
+void server::send_due_()
+{
+  auto const now = steady_clock::now();
+  while (!pending_.empty() && (pending_.top().due <= now)) {
+    auto const& r = pending_.top();
+    if (r.conn == 0) {
+      if (sendto(r.fd, r.wire.data(), r.wire.size(), 0,
+                 reinterpret_cast<sockaddr const*>(&r.peer), r.peer_len)
+          < 0)
+        PLOG(WARNING) << "sendto() failed";
+    }
+    else {
+      // Only to the connection the query came in on, not some later one
+      // that happens to have been given the same fd.
+      auto const conn = conns_.find(r.fd);
+      if ((conn != conns_.end()) && (conn->second.serial == r.conn)) {
+        std::size_t done = 0;
+        while (done < r.wire.size()) {
+          auto const n
+              = write(r.fd, r.wire.data() + done, r.wire.size() - done);
+          if (n <= 0) {
+            PLOG(WARNING) << "write() failed";
+            break;
+          }
+          done += n;
+        }
+      }
+    }
+    pending_.pop();
+  }
+}
+
+void server::run()
+{
+  for (;;) {
+    std::vector<pollfd> fds{{udp_fd_, POLLIN, 0}, {tcp_fd_, POLLIN, 0}};
+    for (auto const& [fd, conn] : conns_)
+      fds.push_back({fd, POLLIN, 0});
+
+    auto timeout_ms = -1;
+    if (!pending_.empty()) {
+      auto const wait = pending_.top().due - steady_clock::now();
+      timeout_ms      = std::max<long>(
+          0, std::chrono::ceil<std::chrono::milliseconds>(wait).count());
+    }
+
+    if (poll(fds.data(), fds.size(), timeout_ms) < 0) {
+      PCHECK(errno == EINTR) << "poll() failed";
+      continue;
+    }
+
+    for (auto const& pfd : fds) {
+      if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+      if (pfd.fd == udp_fd_)
+        read_udp_();
+      else if (pfd.fd == tcp_fd_)
+        accept_();
+      else
+        read_tcp_(pfd.fd);
+    }
+
+    send_due_();
+  }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  { // Need to work with either namespace.
+    using namespace gflags;
+    using namespace google;
+    ParseCommandLineFlags(&argc, &argv, true);
+  }
+
+  CHECK((FLAGS_drop >= 0) && (FLAGS_drop <= 1)) << "--drop is a fraction";
+  CHECK((FLAGS_truncate >= 0) && (FLAGS_truncate <= 1))
+      << "--truncate is a fraction";
+
+  // A client that hangs up shows as a failed write.
+  signal(SIGPIPE, SIG_IGN);
+
+  zone   z(FLAGS_zone.c_str());
+  server s(z);
+  s.run();
+}
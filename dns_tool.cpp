@@ -14,6 +14,10 @@
 
 #include <fmt/format.h>
 
+#include <gflags/gflags.h>
+
+DEFINE_bool(trace, false, "print a line for each DNS query made");
+
 void check_dnsrbl(DNS::Resolver& res, char const* a)
 {
   char const* rbls[]{
@@ -164,6 +168,12 @@ void do_domain(DNS::Resolver& res, char const* dom_cp)
 
 int main(int argc, char* argv[])
 {
+  { // Need to work with either namespace.
+    using namespace gflags;
+    using namespace google;
+    ParseCommandLineFlags(&argc, &argv, true);
+  }
+
   fs::path      config_path = osutil::get_config_dir();
   DNS::Resolver res(config_path);
 
@@ -176,4 +186,9 @@ int main(int argc, char* argv[])
       do_domain(res, arg);
     }
   }
+
+  if (FLAGS_trace) {
+    for (auto const& tr : res.trace())
+      std::cout << tr << '\n';
+  }
 }
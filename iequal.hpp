@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstddef>
 #include <string_view>
 
 // Like boost, but ASCII only.  Only C locale required.
@@ -50,6 +51,27 @@ struct ci_less {
   }
 };
 
+// For unordered containers keyed without regard to case: FNV-1a over
+// the upper-cased octets.
+struct ci_hash {
+  std::size_t operator()(std::string_view s) const
+  {
+    std::size_t h = 14695981039346656037ull;
+    for (auto ch : s) {
+      h ^= std::toupper(static_cast<unsigned char>(ch));
+      h *= 1099511628211ull;
+    }
+    return h;
+  }
+};
+
+struct ci_equal {
+  bool operator()(std::string_view a, std::string_view b) const
+  {
+    return iequal(a, b);
+  }
+};
+
 // Ahh, the olden days of loops and pointers...
 
 // inline bool iequal(char const* a, char const* b)
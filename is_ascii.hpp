@@ -1,13 +1,53 @@
+#ifndef IS_ASCII_DOT_HPP
+#define IS_ASCII_DOT_HPP
+
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <string_view>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 constexpr bool isascii(auto c) noexcept
 {
   return (static_cast<unsigned char>(c) & 0x80) == 0;
 }
 
+// Length of the ASCII run at p: 16 octets at a time with SSE2, 8 at a
+// time without.
+inline std::size_t ascii_prefix(char const* p, std::size_t n) noexcept
+{
+  std::size_t i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+    auto const mask = _mm_movemask_epi8(v);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; i + 8 <= n; i += 8) {
+    std::uint64_t w;
+    std::memcpy(&w, p + i, sizeof(w));
+    if (w & 0x8080808080808080)
+      break;
+  }
+  while ((i < n) && isascii(p[i]))
+    ++i;
+  return i;
+}
+
 constexpr bool is_ascii(std::string_view str) noexcept
 {
-  return !std::any_of(std::begin(str), std::end(str),
-                      [](auto ch) { return !isascii(ch); });
+  if (std::is_constant_evaluated())
+    return std::all_of(std::begin(str), std::end(str),
+                       [](auto ch) { return isascii(ch); });
+  return ascii_prefix(str.data(), str.size()) == str.size();
 }
+
+#endif // IS_ASCII_DOT_HPP
@@ -0,0 +1,163 @@
+#include "message.hpp"
+
+#include "Base64.hpp"
+#include "Bench.hpp"
+#include "DKIM-test-keys.hpp"
+#include "DKIM-verify.hpp"
+#include "DkimSigner.hpp"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <openssl/evp.h>
+
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+namespace {
+// A message as it might arrive: a few hops of trace fields, the usual
+// originator fields, and some kilobytes of text.
+std::vector<std::string> corpus_headers()
+{
+  std::vector<std::string> headers;
+  for (auto i = 0; i < 6; ++i) {
+    headers.push_back(fmt::format(
+        "Received: from hop{0}.example.net (hop{0}.example.net "
+        "[192.0.2.{0}])\r\n\tby hop{1}.example.net with ESMTPS id "
+        "abc{0}def;\r\n\tMon, 18 Oct 2021 10:0{0}:00 -0700\r\n",
+        i, i + 1));
+  }
+  headers.push_back("From: Alice Example <alice@example.com>\r\n");
+  headers.push_back("To: Bob Example <bob@digilicious.com>\r\n");
+  headers.push_back("Subject: The quarterly numbers, again\r\n");
+  headers.push_back("Date: Mon, 18 Oct 2021 10:07:00 -0700\r\n");
+  headers.push_back("Message-ID: <20211018170700.ABC123@example.com>\r\n");
+  headers.push_back("MIME-Version: 1.0\r\n");
+  headers.push_back("Content-Type: text/plain; charset=utf-8\r\n");
+  return headers;
+}
+
+std::string corpus_body()
+{
+  std::string body;
+  for (auto i = 0; i < 64; ++i)
+    body += fmt::format("Line {:02} of the body,  with some  white space "
+                        "to canonicalize.\t \r\n",
+                        i);
+  return body;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Bench::suite suite("message", argc, argv);
+
+  auto       headers = corpus_headers();
+  auto const body    = corpus_body();
+
+  auto const dir      = fs::temp_directory_path();
+  auto const pid      = std::to_string(getpid());
+  auto const rsa_file = dir / ("message-bench-rsa-"s + pid);
+  auto const ed_file  = dir / ("message-bench-ed-"s + pid);
+
+  auto const rsa_key = gen_key(EVP_PKEY_RSA);
+  auto const ed_key  = gen_key(EVP_PKEY_ED25519);
+  write_key(rsa_key, rsa_file);
+  write_key(ed_key, ed_file);
+
+  DkimSigner signer;
+  signer.add_key("rsa", rsa_file);
+  signer.add_key("ed", ed_file);
+  fs::remove(rsa_file);
+  fs::remove(ed_file);
+
+  std::map<std::string, std::string, std::less<>> const keys{
+      {"rsa", key_record(rsa_key)},
+      {"ed", key_record(ed_key)},
+  };
+
+  DkimSigner::input in;
+  for (auto const& h : headers)
+    in.headers.emplace_back(h);
+  in.body.emplace_back(body);
+
+  suite.run("dkim_sign/rsa", [&](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i)
+      Bench::keep(signer.sign("rsa", "example.com", in));
+  });
+  suite.run("dkim_sign/ed25519", [&](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i)
+      Bench::keep(signer.sign("ed", "example.com", in));
+  });
+
+  auto const rsa_sig = signer.sign("rsa", "example.com", in);
+  auto const ed_sig  = signer.sign("ed", "example.com", in);
+
+  auto const verify = [&](std::vector<std::string> const& fields) {
+    DKIM::verify v([&keys](char const* selector, char const* domain) {
+      auto const key = keys.find(selector);
+      return (key == keys.end()) ? ""s : key->second;
+    });
+    for (auto const& field : fields)
+      v.header(field);
+    v.body(body);
+    v.eom();
+    auto passed = 0;
+    v.foreach_sig([&passed](char const*, bool pass, char const*, char const*,
+                            char const*) { passed += pass; });
+    return passed;
+  };
+
+  auto one_sig = headers;
+  one_sig.insert(one_sig.begin(), "DKIM-Signature: " + rsa_sig + "\r\n");
+  CHECK_EQ(verify(one_sig), 1);
+
+  auto two_sigs = one_sig;
+  two_sigs.insert(two_sigs.begin(), "DKIM-Signature: " + ed_sig + "\r\n");
+  CHECK_EQ(verify(two_sigs), 2);
+
+  suite.run("dkim_verify/rsa", [&](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i)
+      Bench::keep(verify(one_sig));
+  });
+  suite.run("dkim_verify/rsa+ed25519", [&](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i)
+      Bench::keep(verify(two_sigs));
+  });
+
+  std::string text;
+  for (auto const& field : two_sigs)
+    text += field;
+  text += "\r\n";
+  text += body;
+
+  std::string hdrs_only;
+  for (auto const& field : two_sigs)
+    hdrs_only += field;
+  hdrs_only += "\r\n";
+
+  suite.run("parse", [&](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i) {
+      message::parsed msg;
+      Bench::keep(msg.parse(text));
+    }
+  });
+  suite.run("parse_headers", [&](std::uint64_t n) {
+    for (std::uint64_t i = 0; i < n; ++i) {
+      message::parsed msg;
+      Bench::keep(msg.parse_headers(hdrs_only));
+    }
+  });
+
+  EVP_PKEY_free(rsa_key);
+  EVP_PKEY_free(ed_key);
+
+  return suite.finish();
+}
@@ -0,0 +1,124 @@
+#include "message-stream.hpp"
+
+#include <random>
+#include <string>
+
+#include <glog/logging.h>
+
+using namespace std::string_literals;
+
+namespace {
+struct result {
+  std::vector<std::pair<std::string, std::string>> fields;
+  std::string                                      body;
+  bool                                             ok;
+};
+
+// Feed text in pieces of at most chunk octets.
+result run(std::string_view text, std::size_t chunk)
+{
+  result res;
+
+  auto headers_seen = false;
+
+  message::stream s(
+      [&](std::string_view piece, std::size_t offset) {
+        CHECK(headers_seen);
+        CHECK_EQ(offset, res.body.size());
+        res.body += piece;
+      },
+      [&](std::vector<message::header> const& hdrs) {
+        CHECK(!headers_seen);
+        headers_seen = true;
+      });
+
+  res.ok = true;
+  while (!text.empty()) {
+    res.ok = s.feed(text.substr(0, chunk)) && res.ok;
+    text.remove_prefix(std::min(chunk, text.size()));
+  }
+  res.ok = s.eom() && res.ok;
+
+  if (res.ok) {
+    CHECK(s.headers_done());
+    CHECK_EQ(s.body_size(), res.body.size());
+    for (auto const& h : s.headers())
+      res.fields.emplace_back(h.name, h.value);
+  }
+  return res;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  auto const text = "Received: from a\r\n"
+                    "\tby b; Mon, 1 Jan 2024 00:00:00 +0000\r\n"
+                    "From: Alice <alice@example.com>\r\n"
+                    "Subject:  Hello \r\n"
+                    "\r\n"
+                    "Body line 1\r\n"
+                    "\r\n"
+                    "Body line 3\r\n"s;
+
+  auto const whole = run(text, text.size());
+  CHECK(whole.ok);
+  CHECK_EQ(whole.fields.size(), 3u);
+  CHECK_EQ(whole.fields[0].first, "Received");
+  CHECK_EQ(whole.fields[0].second,
+           " from a\r\n\tby b; Mon, 1 Jan 2024 00:00:00 +0000");
+  CHECK_EQ(whole.fields[2].second, "  Hello ");
+  CHECK_EQ(whole.body, "Body line 1\r\n\r\nBody line 3\r\n");
+
+  // Any way it's cut up, the answer's the same.
+  for (auto chunk = 1u; chunk < text.size(); ++chunk) {
+    auto const res = run(text, chunk);
+    CHECK(res.ok);
+    CHECK(res.fields == whole.fields) << "chunk " << chunk;
+    CHECK_EQ(res.body, whole.body) << "chunk " << chunk;
+  }
+
+  std::mt19937                               gen(1);
+  std::uniform_int_distribution<std::size_t> piece(1, 20);
+  for (auto i = 0; i < 200; ++i) {
+    auto const res = run(text, piece(gen));
+    CHECK(res.fields == whole.fields);
+    CHECK_EQ(res.body, whole.body);
+  }
+
+  // Header records outlive the input.
+  message::stream s;
+  {
+    auto const tmp = "X-Test: value\r\n\r\n"s;
+    CHECK(s.feed(tmp));
+  }
+  CHECK_EQ(s.get_header("x-test"), "value");
+  CHECK(s.get_header("X-None").empty());
+
+  // The same records, and a body kept by the caller, as a parsed
+  // message.
+  message::parsed msg;
+  s.fill(msg, "body\r\n");
+  CHECK_EQ(msg.headers.size(), 1u);
+  CHECK_EQ(msg.headers[0].name, "X-Test");
+  CHECK_EQ(msg.headers[0].value, " value");
+  CHECK_EQ(msg.body, "body\r\n");
+
+  // Headers only, with or without a last line ending; bare LF.
+  CHECK_EQ(run("Subject: hi\r\n", 4).fields.size(), 1u);
+  CHECK_EQ(run("Subject: hi", 4).fields.size(), 1u);
+  auto const lf = run("A: 1\nB: 2\n\nbody\n", 3);
+  CHECK_EQ(lf.fields.size(), 2u);
+  CHECK_EQ(lf.body, "body\n");
+
+  // No header fields at all.
+  auto const empty = run("\r\nbody", 1);
+  CHECK(empty.ok);
+  CHECK(empty.fields.empty());
+  CHECK_EQ(empty.body, "body");
+
+  // Bad header sections.
+  CHECK(!run("No colon here\r\n\r\n", 5).ok);
+  CHECK(!run(" Leading: space\r\n\r\n", 5).ok);
+  CHECK(!run("Bad name: x\r\n\r\n", 5).ok);
+  CHECK(!run(std::string(Config::max_header_section + 1, 'x'), 4096).ok);
+}
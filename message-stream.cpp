@@ -0,0 +1,159 @@
+#include "message-stream.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "iequal.hpp"
+
+namespace {
+auto constexpr npos = std::string_view::npos;
+
+bool is_wsp(char ch) { return (ch == ' ') || (ch == '\t'); }
+
+// RFC 5322 section 2.2, as in message.cpp's grammar.
+bool is_ftext(char ch) { return (ch >= 33) && (ch <= 126) && (ch != ':'); }
+
+std::string_view trim(std::string_view s)
+{
+  auto const ws = [](char ch) {
+    return is_wsp(ch) || (ch == '\r') || (ch == '\n');
+  };
+  while (!s.empty() && ws(s.front()))
+    s.remove_prefix(1);
+  while (!s.empty() && ws(s.back()))
+    s.remove_suffix(1);
+  return s;
+}
+} // namespace
+
+namespace message {
+
+stream::stream(body_fn on_body, headers_fn on_headers)
+  : on_body_(std::move(on_body))
+  , on_headers_(std::move(on_headers))
+{
+}
+
+bool stream::feed(std::string_view chunk)
+{
+  if (error_)
+    return false;
+  if (done_) {
+    body_(chunk);
+    return true;
+  }
+
+  // Lines end in CRLF or, as the grammar also allows, a bare LF; the
+  // first empty one ends the header section.
+  auto pos = text_.size();
+  text_.append(chunk);
+  for (std::size_t nl; (nl = text_.find('\n', pos)) != std::string::npos;) {
+    auto len = nl - line_;
+    if (len && (text_[nl - 1] == '\r'))
+      --len;
+    if (!len)
+      return end_headers_(nl + 1);
+    pos = line_ = nl + 1;
+  }
+
+  if (text_.size() > Config::max_header_section) {
+    LOG(WARNING) << "header section over " << Config::max_header_section
+                 << " octets";
+    error_ = true;
+    text_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool stream::eom()
+{
+  if (!done_ && !error_) {
+    line_ = text_.size(); // the last line needn't end
+    end_headers_(text_.size());
+  }
+  return !error_;
+}
+
+std::string_view stream::get_header(std::string_view name) const
+{
+  auto const f   = RFC5322::field_of(name);
+  auto const hdr = std::find_if(
+      headers_.begin(), headers_.end(), [f, name](auto const& h) {
+        return (f == RFC5322::field::unknown) ? iequal(h.name, name)
+                                              : (h.field == f);
+      });
+  return (hdr == headers_.end()) ? std::string_view{} : trim(hdr->value);
+}
+
+void stream::fill(parsed& msg, std::string_view body) const
+{
+  msg.headers = headers_;
+  msg.body    = body;
+  msg.headers_changed();
+}
+
+// The header section is text_ up to line_, and the body starts at
+// body_start.  The header section goes into a string of its own that
+// will never change, so the header records can point into it.
+bool stream::end_headers_(std::size_t body_start)
+{
+  std::string all(text_, 0, line_);
+  std::swap(all, text_);
+
+  if (!split_fields_()) {
+    LOG(WARNING) << "malformed header section";
+    error_ = true;
+    headers_.clear();
+    return false;
+  }
+  done_ = true;
+
+  if (on_headers_)
+    on_headers_(headers_);
+  body_(std::string_view(all).substr(body_start));
+  return true;
+}
+
+bool stream::split_fields_()
+{
+  std::string_view const text = text_;
+
+  for (std::size_t pos = 0; pos < text.size();) {
+    // A field is a line and any continuation lines, those that start
+    // with white space.
+    auto const start = pos;
+    auto       end   = pos;
+    do {
+      auto const nl = text.find('\n', pos);
+      if (nl == npos) {
+        end = pos = text.size();
+        break;
+      }
+      end = ((nl > pos) && (text[nl - 1] == '\r')) ? nl - 1 : nl;
+      pos = nl + 1;
+    } while ((pos < text.size()) && is_wsp(text[pos]));
+
+    auto const field = text.substr(start, end - start);
+    auto const colon = field.find(':');
+    if ((colon == npos) || (colon == 0))
+      return false;
+    auto const name = field.substr(0, colon);
+    if (!std::all_of(name.begin(), name.end(), is_ftext))
+      return false;
+
+    headers_.emplace_back(name, field.substr(colon + 1));
+  }
+  return true;
+}
+
+void stream::body_(std::string_view piece)
+{
+  if (on_body_ && !piece.empty())
+    on_body_(piece, body_size_);
+  body_size_ += piece.size();
+}
+
+} // namespace message
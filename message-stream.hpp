@@ -0,0 +1,80 @@
+#ifndef MESSAGE_STREAM_DOT_HPP
+#define MESSAGE_STREAM_DOT_HPP
+
+// An RFC 5322 parser fed a piece at a time, as DATA and BDAT deliver a
+// message, where message::parsed needs the whole thing in one piece.
+// The header section is kept, and split into the same header records
+// once it is complete; the body is only passed along.
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "message.hpp"
+
+namespace Config {
+constexpr std::size_t max_header_section = 1024 * 1024;
+} // namespace Config
+
+namespace message {
+
+class stream {
+public:
+  // Each piece of the body as it arrives, at offset octets into it.
+  using body_fn =
+      std::function<void(std::string_view piece, std::size_t offset)>;
+
+  // Once, when the header section is complete.
+  using headers_fn = std::function<void(std::vector<header> const& hdrs)>;
+
+  explicit stream(body_fn on_body = {}, headers_fn on_headers = {});
+
+  stream(stream const&) = delete;
+  stream& operator=(stream const&) = delete;
+
+  // Any piece of the message, split anywhere.  False once the header
+  // section has turned out to be bad or too big; after that the rest
+  // is ignored.
+  bool feed(std::string_view chunk);
+
+  // The end of the message: a header section without a body, or
+  // without even the final line ending, is complete now.
+  bool eom();
+
+  bool error() const { return error_; }
+  bool headers_done() const { return done_; }
+
+  // Valid once headers_done(), for as long as this object lives.
+  std::vector<header> const& headers() const { return headers_; }
+  std::string_view           get_header(std::string_view name) const;
+
+  std::size_t body_size() const { return body_size_; }
+
+  // The header records as a message::parsed, with body, the caller's
+  // own copy of what on_body was given, if it kept one.  Valid for as
+  // long as this object and body are.
+  void fill(parsed& msg, std::string_view body = {}) const;
+
+private:
+  bool end_headers_(std::size_t body_start);
+  bool split_fields_();
+  void body_(std::string_view piece);
+
+  body_fn    on_body_;
+  headers_fn on_headers_;
+
+  std::string         text_; // the header section
+  std::vector<header> headers_;
+
+  std::size_t line_{0}; // start of the line being read, in text_
+  std::size_t body_size_{0};
+
+  bool done_{false};
+  bool error_{false};
+};
+
+} // namespace message
+
+#endif // MESSAGE_STREAM_DOT_HPP
@@ -1,6 +1,8 @@
 #include "message.hpp"
 
+#include "DKIM-body.hpp"
 #include "Now.hpp"
+#include "OpenDKIM.hpp"
 #include "Pill.hpp"
 #include "Reply.hpp"
 #include "esc.hpp"
@@ -20,6 +22,7 @@
 constexpr char srs_secret[] = "Not a real secret, of course.";
 
 DEFINE_bool(arc, false, "check ARC set");
+DEFINE_bool(bh, false, "check body hashes against OpenDKIM");
 DEFINE_bool(dkim, false, "check DKIM sigs");
 DEFINE_bool(print_from, false, "print envelope froms");
 
@@ -56,6 +59,36 @@ int main(int argc, char* argv[])
                                               authservid, ar_result));
   CHECK_EQ(authservid, "digilicious.com");
 
+  // Header lookups, headers only, and lots of Received: fields.
+  {
+    std::string text;
+    for (auto i = 0; i < 300; ++i)
+      text += fmt::format("Received: from hop{}\r\n", i);
+    text += "from: a@example.com\r\n"
+            "Subject: hi\r\n"
+            "Received: last\r\n"
+            "\r\n"
+            "body\r\n";
+
+    message::parsed msg;
+    CHECK(msg.parse_headers(text));
+    CHECK_EQ(msg.body, "body\r\n");
+    CHECK_EQ(msg.header_positions("RECEIVED").size(), 301u);
+    CHECK_EQ(msg.get_header(message::From), "a@example.com");
+    CHECK(msg.find_header("X-Nothing") == nullptr);
+
+    msg.remove_headers("Received",
+                       [](auto const& hdr) { return hdr.value == " last"; });
+    CHECK_EQ(msg.header_positions("Received").size(), 300u);
+    CHECK_EQ(msg.headers.size(), 302u);
+
+    CHECK(msg.parse_hdr("Subject: again"));
+    auto const& subjects = msg.header_positions(message::Subject);
+    CHECK_EQ(subjects.size(), 2u);
+    CHECK_EQ(subjects.front(), 0u);
+    CHECK_EQ(msg.get_header(message::Subject), "again");
+  }
+
   auto const dom_from{Domain(server_identity)};
   auto const dom_to{Domain(server_identity)};
 
@@ -147,6 +180,43 @@ int main(int argc, char* argv[])
     return 0;
   }
 
+  if (FLAGS_bh) {
+    boost::iostreams::mapped_file_source priv;
+    priv.open(key_file);
+    auto const key_str = std::string(priv.data(), priv.size());
+
+    for (int a = 1; a < argc; ++a) {
+      if (!fs::exists(argv[a]))
+        LOG(FATAL) << "can't find mail file " << argv[a];
+      boost::iostreams::mapped_file_source file;
+      file.open(argv[a]);
+      message::parsed msg;
+      CHECK(msg.parse(std::string_view(file.data(), file.size())));
+
+      for (auto typ : {OpenDKIM::sign::body_type::text,
+                       OpenDKIM::sign::body_type::binary}) {
+        OpenDKIM::sign dks(key_str.c_str(), selector, server_identity.c_str(),
+                           typ);
+        for (auto const& header : msg.headers)
+          dks.header(header.as_view());
+        dks.eoh();
+        dks.body(msg.body);
+        dks.eom();
+
+        auto const sig = dks.getsighdr();
+        auto       bh  = std::string_view(sig).substr(sig.find("bh=") + 3);
+        bh             = bh.substr(0, bh.find(';'));
+
+        DKIM::body_hash ours(typ == OpenDKIM::sign::body_type::text
+                                 ? DKIM::canon::relaxed
+                                 : DKIM::canon::simple);
+        ours.update(msg.body);
+        CHECK_EQ(ours.final(), bh) << argv[a];
+      }
+    }
+    return 0;
+  }
+
   if (FLAGS_dkim) {
     for (int a = 1; a < argc; ++a) {
       if (!fs::exists(argv[a]))
@@ -11,17 +11,24 @@
 
 #include "message.hpp"
 
+#include "AuthCache.hpp"
+#include "DKIM-verify.hpp"
+#include "DkimSigner.hpp"
 #include "Mailbox.hpp"
 #include "OpenARC.hpp"
 #include "OpenDKIM.hpp"
 #include "OpenDMARC.hpp"
+#include "UTF8.hpp"
 #include "esc.hpp"
 #include "fs.hpp"
 #include "iequal.hpp"
 #include "imemstream.hpp"
+#include "osutil.hpp"
 
 #include <cstring>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <unordered_set>
 
 #include <fmt/format.h>
@@ -90,22 +97,8 @@ using colon = one<':'>;
 
 // clang-format off
 
-struct UTF8_tail        : range<'\x80', '\xBF'> {};
-
-struct UTF8_1           : range<0x00, 0x7F> {};
-
-struct UTF8_2           : seq<range<'\xC2', '\xDF'>, UTF8_tail> {};
-
-struct UTF8_3           : sor<seq<one<'\xE0'>, range<'\xA0', '\xBF'>, UTF8_tail>,
-                              seq<range<'\xE1', '\xEC'>, rep<2, UTF8_tail>>,
-                              seq<one<'\xED'>, range<'\x80', '\x9F'>, UTF8_tail>,
-                              seq<range<'\xEE', '\xEF'>, rep<2, UTF8_tail>>> {};
-
-struct UTF8_4           : sor<seq<one<'\xF0'>, range<'\x90', '\xBF'>, rep<2, UTF8_tail>>,
-                              seq<range<'\xF1', '\xF3'>, rep<3, UTF8_tail>>,
-                              seq<one<'\xF4'>, range<'\x80', '\x8F'>, rep<2, UTF8_tail>>> {};
-
-struct UTF8_non_ascii   : sor<UTF8_2, UTF8_3, UTF8_4> {};
+// RFC 3629 section 4, checked in one go rather than by the grammar.
+struct UTF8_non_ascii   : UTF8::non_ascii {};
 
 struct VUCHAR           : sor<VCHAR, UTF8_non_ascii> {};
 
@@ -117,8 +110,9 @@ struct field_name       : plus<ftext> {};
 
 struct FWS              : seq<opt<seq<star<WSP>, eol>>, plus<WSP>> {};
 
-// *([FWS] VCHAR) *WSP
-struct field_value      : seq<star<seq<opt<FWS>, VUCHAR>>, star<WSP>> {};
+// *([FWS] VCHAR) *WSP, with ASCII runs taken whole
+struct field_value      : seq<star<seq<opt<FWS>, sor<UTF8::text_run, VUCHAR>>>,
+                              star<WSP>> {};
 
 struct field            : seq<field_name, one<':'>, field_value, eol> {};
 
@@ -130,6 +124,8 @@ struct body             : until<eof> {};
 
 struct message          : seq<fields, opt<seq<eol, body>>, eof> {};
 
+struct message_headers  : seq<fields, opt<eol>> {};
+
 //.............................................................................
 
 // <https://tools.ietf.org/html/rfc2047>
@@ -237,9 +233,9 @@ struct atext            : sor<ALPHA, DIGIT,
                                   '~'>,
                               UTF8_non_ascii> {};
 
-struct atom             : seq<opt<CFWS>, plus<atext>, opt<CFWS>> {};
+struct atom             : seq<opt<CFWS>, plus<sor<UTF8::atext_run, atext>>, opt<CFWS>> {};
 
-struct dot_atom_text    : list<plus<atext>, dot> {};
+struct dot_atom_text    : list<plus<sor<UTF8::atext_run, atext>>, dot> {};
 
 struct dot_atom         : seq<opt<CFWS>, dot_atom_text, opt<CFWS>> {};
 
@@ -841,6 +837,18 @@ static void spf_result_to_dmarc(OpenDMARC::policy&            dmp,
   }
 }
 
+// Key and policy records for authentication() when the caller has no
+// lookups of its own.  The resolver isn't thread safe: one, and one
+// AuthCache, per thread, all sharing the one SharedCache.
+static AuthCache& default_auth()
+{
+  static SharedCache shared{Config::auth_cache_name,
+                            Config::auth_cache_slots};
+  thread_local DNS::Resolver res{osutil::get_config_dir()};
+  thread_local AuthCache     auth{res, &shared};
+  return auth;
+}
+
 namespace message {
 
 bool authentication_results_parse(std::string_view input,
@@ -853,43 +861,46 @@ bool authentication_results_parse(std::string_view input,
                            RFC5322::ar_action>(in, authservid, ar_results);
 }
 
-bool authentication(message::parsed& msg,
-                    char const*      sender,
-                    char const*      selector,
-                    fs::path         key_file)
+bool authentication(message::parsed&                 msg,
+                    char const*                      sender,
+                    char const*                      selector,
+                    fs::path                         key_file,
+                    DKIM::verify::key_lookup         dkim_keys,
+                    OpenDMARC::policy::record_lookup dmarc_records)
 {
   LOG(INFO) << "add_authentication_results";
   CHECK(!msg.headers.empty());
 
   // Remove any redundant Authentication-Results headers
-  msg.headers.erase(
-      std::remove_if(msg.headers.begin(), msg.headers.end(),
-                     [sender](auto const& hdr) {
-                       if (hdr == Authentication_Results) {
-                         std::string authservid;
-                         std::string ar_results;
-                         if (message::authentication_results_parse(
-                                 hdr.as_view(), authservid, ar_results)) {
-                           return Domain::match(authservid, sender);
-                         }
-                         LOG(WARNING) << "failed to parse " << hdr.as_string();
-                       }
-                       return false;
-                     }),
-      msg.headers.end());
+  msg.remove_headers(Authentication_Results, [sender](auto const& hdr) {
+    std::string authservid;
+    std::string ar_results;
+    if (message::authentication_results_parse(hdr.as_view(), authservid,
+                                              ar_results)) {
+      return Domain::match(authservid, sender);
+    }
+    LOG(WARNING) << "failed to parse " << hdr.as_string();
+    return false;
+  });
 
-  // Run our message through OpenDKIM verify
+  if (!dkim_keys) {
+    dkim_keys = [](char const* selector, char const* domain) {
+      return default_auth().dkim_key_record(selector, domain);
+    };
+  }
+  if (!dmarc_records) {
+    dmarc_records = [](char const* domain, std::string& org_domain) {
+      return default_auth().dmarc_record(domain, org_domain);
+    };
+  }
 
-  OpenDKIM::verify dkv;
+  // DKIM and ARC are checked together, and in parallel.
+
+  DKIM::verify dkv(std::move(dkim_keys));
   for (auto const& header : msg.headers) {
-    auto const hv = header.as_view();
-    dkv.header(hv);
+    dkv.header(header.as_view());
   }
-  dkv.eoh();
-
-  // LOG(INFO) << "body «" << msg.body << "»";
   dkv.body(msg.body);
-
   dkv.eom();
 
   OpenDMARC::policy dmp;
@@ -900,72 +911,71 @@ bool authentication(message::parsed& msg,
   std::unordered_set<Domain> validated_doms;
 
   // Grab SPF records
-  for (auto hdr : msg.headers) {
-    if (hdr == Received_SPF) {
-      RFC5322::received_spf_parsed spf_parsed;
-      if (!spf_parsed.parse(hdr.value)) {
-        LOG(WARNING) << "failed to parse SPF record: " << hdr.value;
-        continue;
-      }
+  for (auto pos : msg.header_positions(RFC5322::field::received_spf)) {
+    auto const&                  hdr = msg.headers[pos];
+    RFC5322::received_spf_parsed spf_parsed;
+    if (!spf_parsed.parse(hdr.value)) {
+      LOG(WARNING) << "failed to parse SPF record: " << hdr.value;
+      continue;
+    }
 
-      LOG(INFO) << "SPF record parsed";
-      if (!sender_comment(spf_parsed.comment, sender)) {
-        LOG(INFO) << "comment == \"" << spf_parsed.comment << "\" not by "
-                  << sender;
-        continue;
-      }
+    LOG(INFO) << "SPF record parsed";
+    if (!sender_comment(spf_parsed.comment, sender)) {
+      LOG(INFO) << "comment == \"" << spf_parsed.comment << "\" not by "
+                << sender;
+      continue;
+    }
 
-      if (!Mailbox::validate(spf_parsed.kv_map[envelope_from])) {
-        LOG(WARNING) << "invalid mailbox: " << spf_parsed.kv_map[envelope_from];
-        continue;
-      }
+    if (!Mailbox::validate(spf_parsed.kv_map[envelope_from])) {
+      LOG(WARNING) << "invalid mailbox: " << spf_parsed.kv_map[envelope_from];
+      continue;
+    }
 
-      if (!Domain::validate(spf_parsed.kv_map[helo])) {
-        LOG(WARNING) << "invalid helo domain: " << spf_parsed.kv_map[helo];
-        continue;
-      }
+    if (!Domain::validate(spf_parsed.kv_map[helo])) {
+      LOG(WARNING) << "invalid helo domain: " << spf_parsed.kv_map[helo];
+      continue;
+    }
+
+    Mailbox env_from(spf_parsed.kv_map[envelope_from]);
+    Domain  helo_dom(spf_parsed.kv_map[helo]);
+
+    if (iequal(env_from.local_part(), "Postmaster") &&
+        env_from.domain() == helo_dom) {
+      if (validated_doms.count(helo_dom) == 0) {
+        fmt::format_to(bfr, ";\r\n\tspf={}", spf_parsed.result);
+        fmt::format_to(bfr, " {}", spf_parsed.comment);
+        fmt::format_to(bfr, " smtp.helo={}", helo_dom.ascii());
+        validated_doms.emplace(helo_dom);
 
-      Mailbox env_from(spf_parsed.kv_map[envelope_from]);
-      Domain  helo_dom(spf_parsed.kv_map[helo]);
-
-      if (iequal(env_from.local_part(), "Postmaster") &&
-          env_from.domain() == helo_dom) {
-        if (validated_doms.count(helo_dom) == 0) {
-          fmt::format_to(bfr, ";\r\n\tspf={}", spf_parsed.result);
-          fmt::format_to(bfr, " {}", spf_parsed.comment);
-          fmt::format_to(bfr, " smtp.helo={}", helo_dom.ascii());
-          validated_doms.emplace(helo_dom);
-
-          if (spf_parsed.kv_map.contains(client_ip)) {
-            std::string ip = make_string(spf_parsed.kv_map[client_ip]);
-            dmp.connect(ip.c_str());
-          }
-          spf_result_to_dmarc(dmp, spf_parsed);
+        if (spf_parsed.kv_map.contains(client_ip)) {
+          std::string ip = make_string(spf_parsed.kv_map[client_ip]);
+          dmp.connect(ip.c_str());
         }
+        spf_result_to_dmarc(dmp, spf_parsed);
       }
-      else {
-        if (validated_doms.count(env_from.domain()) == 0) {
-          fmt::format_to(bfr, ";\r\n\tspf={}", spf_parsed.result);
-          fmt::format_to(bfr, " {}", spf_parsed.comment);
-          fmt::format_to(bfr, " smtp.mailfrom={}",
-                         env_from.as_string(Mailbox::domain_encoding::ascii));
-          validated_doms.emplace(env_from.domain());
-
-          if (spf_parsed.kv_map.contains(client_ip)) {
-            std::string ip = make_string(spf_parsed.kv_map[client_ip]);
-            dmp.connect(ip.c_str());
-          }
-          spf_result_to_dmarc(dmp, spf_parsed);
+    }
+    else {
+      if (validated_doms.count(env_from.domain()) == 0) {
+        fmt::format_to(bfr, ";\r\n\tspf={}", spf_parsed.result);
+        fmt::format_to(bfr, " {}", spf_parsed.comment);
+        fmt::format_to(bfr, " smtp.mailfrom={}",
+                       env_from.as_string(Mailbox::domain_encoding::ascii));
+        validated_doms.emplace(env_from.domain());
+
+        if (spf_parsed.kv_map.contains(client_ip)) {
+          std::string ip = make_string(spf_parsed.kv_map[client_ip]);
+          dmp.connect(ip.c_str());
         }
+        spf_result_to_dmarc(dmp, spf_parsed);
       }
     }
   }
 
   LOG(INFO) << "fetching From: header";
   // Should be only one From:
-  if (auto hdr = std::find(begin(msg.headers), end(msg.headers), From);
-      hdr != end(msg.headers)) {
-    auto const from_str = make_string(hdr->value);
+  if (auto const& froms = msg.header_positions(RFC5322::field::from);
+      !froms.empty()) {
+    auto const from_str = make_string(msg.headers[froms.front()].value);
 
     memory_input<> from_in(from_str, "from");
     if (!parse<RFC5322::mailbox_list_only, RFC5322::mailbox_list_action>(
@@ -973,12 +983,9 @@ bool authentication(message::parsed& msg,
       LOG(WARNING) << "failed to parse From:" << from_str;
     }
 
-    for (auto hdr_next = std::next(hdr); hdr_next != end(msg.headers);
-         hdr_next      = std::next(hdr_next)) {
-      if (*hdr_next == From) {
-        LOG(WARNING) << "additional RFC5322.From header found: "
-                     << hdr_next->as_string();
-      }
+    for (auto i = 1u; i < froms.size(); ++i) {
+      LOG(WARNING) << "additional RFC5322.From header found: "
+                   << msg.headers[froms[i]].as_string();
     }
   }
 
@@ -1024,28 +1031,37 @@ bool authentication(message::parsed& msg,
 
   // Check each DKIM sig, inform DMARC processor, put in AR
 
-  dkv.foreach_sig([&dmp, &bfr](char const* domain, bool passed,
-                               char const* identity, char const* sel,
-                               char const* b) {
-    int const  result       = passed ? DMARC_POLICY_DKIM_OUTCOME_PASS
-                                     : DMARC_POLICY_DKIM_OUTCOME_FAIL;
-    auto const human_result = (passed ? "pass" : "fail");
+  auto const dkim_result = [&dmp, &bfr](char const* domain,
+                                        char const* human_result,
+                                        char const* identity, char const* sel,
+                                        char const* b) {
+    int const result = iequal(human_result, "pass")
+                           ? DMARC_POLICY_DKIM_OUTCOME_PASS
+                       : iequal(human_result, "temperror")
+                           ? DMARC_POLICY_DKIM_OUTCOME_TMPFAIL
+                           : DMARC_POLICY_DKIM_OUTCOME_FAIL;
 
     LOG(INFO) << "DKIM check for " << domain << " " << human_result;
 
-    dmp.store_dkim(domain, sel, result, human_result);
+    // A field too broken to name its signer is for the AR header only.
+    if (*domain)
+      dmp.store_dkim(domain, sel, result, human_result);
 
     auto bs = std::string_view(b, strlen(b)).substr(0, 8);
 
     fmt::format_to(bfr, ";\r\n\tdkim={}", human_result);
-    fmt::format_to(bfr, " header.i={}", identity);
-    fmt::format_to(bfr, " header.s={}", sel);
+    if (*domain)
+      fmt::format_to(bfr, " header.i={}", identity);
+    if (*sel)
+      fmt::format_to(bfr, " header.s={}", sel);
     fmt::format_to(bfr, " header.b=\"{}\"", bs);
-  });
+  };
+  dkv.foreach_result(dkim_result);
 
   // Set DMARC status in AR
 
-  auto const dmarc_passed = dmp.query_dmarc(msg.dmarc_from_domain.c_str());
+  auto const dmarc_passed =
+      dmp.query_dmarc(msg.dmarc_from_domain.c_str(), dmarc_records);
 
   auto const dmarc_result = (dmarc_passed ? "pass" : "fail");
   LOG(INFO) << "DMARC " << dmarc_result;
@@ -1055,18 +1071,9 @@ bool authentication(message::parsed& msg,
 
   // ARC
 
-  OpenARC::verify arv;
-  for (auto const& header : msg.headers) {
-    arv.header(header.as_view());
-  }
-  arv.eoh();
-  arv.body(msg.body);
-  arv.eom();
-
-  LOG(INFO) << "ARC status  == " << arv.chain_status_str();
-  LOG(INFO) << "ARC custody == " << arv.chain_custody_str();
-
-  auto const arc_status = arv.chain_status_str();
+  auto const arc_status = dkv.arc_status();
+  LOG(INFO) << "ARC status  == " << arc_status;
+  LOG(INFO) << "ARC custody == " << dkv.arc_custody();
 
   fmt::format_to(bfr, ";\r\n\tarc={}", arc_status);
 
@@ -1144,7 +1151,7 @@ void print_spf_envelope_froms(char const* file, message::parsed& msg)
 {
   CHECK(!msg.headers.empty());
   for (auto const& hdr : msg.headers) {
-    if (hdr == Received_SPF) {
+    if (hdr == RFC5322::field::received_spf) {
       RFC5322::received_spf_parsed spf_parsed;
       if (spf_parsed.parse(hdr.value)) {
         std::cout << spf_parsed.kv_map[envelope_from] << '\n';
@@ -1161,14 +1168,10 @@ void remove_delivery_headers(message::parsed& msg)
 {
   // Remove headers that are added by the "delivery agent"
   // aka (Session::added_headers_)
-  msg.headers.erase(
-      std::remove(msg.headers.begin(), msg.headers.end(), Return_Path),
-      msg.headers.end());
+  msg.remove_headers(Return_Path);
 
   // just in case, but right now this header should not exist.
-  msg.headers.erase(
-      std::remove(msg.headers.begin(), msg.headers.end(), Delivered_To),
-      msg.headers.end());
+  msg.remove_headers(Delivered_To);
 }
 
 void dkim_check(message::parsed& msg, char const* domain)
@@ -1208,12 +1211,25 @@ void dkim_check(message::parsed& msg, char const* domain)
 
 bool parsed::parse(std::string_view input)
 {
+  headers_changed();
   auto in{memory_input<>(input.data(), input.size(), "message")};
   return tao::pegtl::parse<RFC5322::message, RFC5322::msg_action>(in, *this);
 }
 
+bool parsed::parse_headers(std::string_view input)
+{
+  headers_changed();
+  auto in{memory_input<>(input.data(), input.size(), "message")};
+  if (!tao::pegtl::parse<RFC5322::message_headers, RFC5322::msg_action>(in,
+                                                                       *this))
+    return false;
+  body = std::string_view(in.current(), in.end() - in.current());
+  return true;
+}
+
 bool parsed::parse_hdr(std::string_view input)
 {
+  headers_changed();
   auto in{memory_input<>(input.data(), input.size(), "message")};
   if (tao::pegtl::parse<RFC5322::raw_field, RFC5322::msg_action>(in, *this)) {
     std::rotate(headers.rbegin(), headers.rbegin() + 1, headers.rend());
@@ -1251,15 +1267,105 @@ std::string header::as_string() const
   return fmt::format("{}:{}", name, value);
 }
 
+void parsed::build_index_() const
+{
+  if (indexed_ && (indexed_size_ == headers.size()))
+    return;
+
+  for (auto& k : known_)
+    k.clear();
+  index_.clear();
+  for (std::uint32_t i = 0; i < headers.size(); ++i) {
+    auto const f = headers[i].field;
+    if (f == RFC5322::field::unknown)
+      index_[headers[i].name].push_back(i);
+    else
+      known_[static_cast<std::size_t>(f)].push_back(i);
+  }
+
+  indexed_size_ = headers.size();
+  indexed_      = true;
+}
+
+std::vector<std::uint32_t> const&
+parsed::header_positions(std::string_view name) const
+{
+  static std::vector<std::uint32_t> const none;
+
+  if (auto const f = RFC5322::field_of(name); f != RFC5322::field::unknown)
+    return header_positions(f);
+
+  build_index_();
+  auto const pos = index_.find(name);
+  return (pos == index_.end()) ? none : pos->second;
+}
+
+std::vector<std::uint32_t> const&
+parsed::header_positions(RFC5322::field f) const
+{
+  static std::vector<std::uint32_t> const none;
+
+  if (f == RFC5322::field::unknown)
+    return none;
+
+  build_index_();
+  return known_[static_cast<std::size_t>(f)];
+}
+
+header const* parsed::find_header(std::string_view name) const
+{
+  auto const& pos = header_positions(name);
+  return pos.empty() ? nullptr : &headers[pos.front()];
+}
+
 std::string_view parsed::get_header(std::string_view name) const
 {
-  if (auto hdr = std::find(begin(headers), end(headers), name);
-      hdr != end(headers)) {
+  if (auto const hdr = find_header(name))
     return trim(hdr->value);
-  }
   return "";
 }
 
+void parsed::remove_headers(std::string_view                   name,
+                            std::function<bool(header const&)> pred)
+{
+  std::vector<bool> drop(headers.size());
+  auto              any = false;
+  for (auto i : header_positions(name)) {
+    if (!pred || pred(headers[i]))
+      drop[i] = any = true;
+  }
+  if (!any)
+    return;
+
+  std::size_t keep = 0;
+  for (std::size_t i = 0; i < headers.size(); ++i) {
+    if (!drop[i])
+      headers[keep++] = headers[i];
+  }
+  headers.erase(headers.begin() + keep, headers.end());
+  headers_changed();
+}
+
+// Keys are read and parsed once, then kept.  A selector may name a
+// different key file from one call to the next, so the signers are
+// kept by both; they're shared by the threads of the --jobs tools.
+static DkimSigner& signer_for(char const* selector, fs::path const& key_file)
+{
+  static std::mutex mtx;
+  static std::map<std::pair<std::string, std::string>,
+                  std::unique_ptr<DkimSigner>>
+      signers;
+
+  std::lock_guard<std::mutex> lock(mtx);
+
+  auto& signer = signers[{selector, key_file.string()}];
+  if (!signer) {
+    signer = std::make_unique<DkimSigner>();
+    signer->add_key(selector, key_file);
+  }
+  return *signer;
+}
+
 void dkim_sign(message::parsed& msg,
                char const*      sender,
                char const*      selector,
@@ -1267,22 +1373,15 @@ void dkim_sign(message::parsed& msg,
 {
   CHECK(msg.sig_str.empty());
 
-  boost::iostreams::mapped_file_source priv;
-  priv.open(key_file);
-
-  auto const key_str = std::string(priv.data(), priv.size());
+  auto& signer = signer_for(selector, key_file);
 
-  // Run our message through DKIM::sign
-  OpenDKIM::sign dks(key_str.c_str(), // textual data
-                     selector, sender, OpenDKIM::sign::body_type::text);
+  DkimSigner::input in;
   for (auto const& header : msg.headers) {
-    dks.header(header.as_view());
+    in.headers.push_back(header.as_view());
   }
-  dks.eoh();
-  dks.body(msg.body);
-  dks.eom();
+  in.body.push_back(msg.body);
 
-  auto const sig = dks.getsighdr();
+  auto const sig = signer.sign(selector, sender, in);
 
   msg.sig_str = fmt::format("DKIM-Signature: {}", sig);
   CHECK(msg.parse_hdr(msg.sig_str));
@@ -1300,17 +1399,14 @@ void rewrite_from_to(message::parsed& msg,
   remove_delivery_headers(msg);
 
   if (!mail_from.empty()) {
-    msg.headers.erase(std::remove(msg.headers.begin(), msg.headers.end(), From),
-                      msg.headers.end());
+    msg.remove_headers(From);
 
     msg.from_str = mail_from;
     CHECK(msg.parse_hdr(msg.from_str));
   }
 
   if (!reply_to.empty()) {
-    msg.headers.erase(
-        std::remove(msg.headers.begin(), msg.headers.end(), Reply_To),
-        msg.headers.end());
+    msg.remove_headers(Reply_To);
 
     msg.reply_to_str = reply_to;
     CHECK(msg.parse_hdr(msg.reply_to_str));
@@ -1,13 +1,21 @@
 #ifndef MESSAGE_DOT_HPP_INCLUDED
 #define MESSAGE_DOT_HPP_INCLUDED
 
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
+#include "DKIM-verify.hpp"
 #include "Mailbox.hpp"
+#include "OpenDMARC.hpp"
+#include "RFC5322-fields.hpp"
 #include "fs.hpp"
 #include "iequal.hpp"
 
@@ -38,6 +46,7 @@ struct header {
   header(std::string_view n, std::string_view v)
     : name(n)
     , value(v)
+    , field(RFC5322::field_of(n))
   {
   }
 
@@ -52,9 +61,11 @@ struct header {
   }
 
   bool operator==(std::string_view n) const { return iequal(n, name); }
+  bool operator==(RFC5322::field f) const { return field == f; }
 
   std::string_view name;
   std::string_view value;
+  RFC5322::field   field; // unknown for any other name
 };
 
 struct name_addr {
@@ -71,13 +82,33 @@ struct parsed {
   bool parse(std::string_view input);
   bool parse_hdr(std::string_view input);
 
+  // Just the header fields; body is set to whatever follows them
+  // without being looked at.
+  bool parse_headers(std::string_view input);
+
   std::string as_string() const;
 
   bool write(std::ostream& out) const;
 
   std::vector<header> headers;
 
+  // Lookups by name go through an index of headers, built on first use
+  // and dropped by the parse functions and remove_headers().  Anything
+  // else that changes headers must call headers_changed().
   std::string_view get_header(std::string_view hdr) const;
+  header const*    find_header(std::string_view name) const;
+
+  // Positions in headers of every field with this name, top to bottom.
+  std::vector<std::uint32_t> const&
+  header_positions(std::string_view name) const;
+  std::vector<std::uint32_t> const&
+  header_positions(RFC5322::field f) const;
+
+  // Remove the fields with this name, or just those pred is true for.
+  void remove_headers(std::string_view                   name,
+                      std::function<bool(header const&)> pred = {});
+
+  void headers_changed() { indexed_ = false; }
 
   std::string_view field_name;
   std::string_view field_value;
@@ -103,16 +134,37 @@ struct parsed {
 
   // Added ARC headers
   std::vector<std::string> arc_hdrs;
+
+private:
+  void build_index_() const;
+
+  using header_index = std::unordered_map<std::string_view,
+                                          std::vector<std::uint32_t>,
+                                          ci_hash,
+                                          ci_equal>;
+
+  using known_index =
+      std::array<std::vector<std::uint32_t>,
+                 static_cast<std::size_t>(RFC5322::field::unknown)>;
+
+  mutable known_index  known_; // known fields, by enum
+  mutable header_index index_; // the rest, by name
+  mutable std::size_t  indexed_size_{0};
+  mutable bool         indexed_{false};
 };
 
 bool authentication_results_parse(std::string_view input,
                                   std::string&     authservid,
                                   std::string&     ar_results);
 
-bool authentication(message::parsed& msg,
-                    char const*      sender,
-                    char const*      selector,
-                    fs::path         key_file);
+// The lookups supply DKIM keys and DMARC records; by default they come
+// from a per-thread AuthCache.
+bool authentication(message::parsed&                 msg,
+                    char const*                      sender,
+                    char const*                      selector,
+                    fs::path                         key_file,
+                    DKIM::verify::key_lookup         dkim_keys     = {},
+                    OpenDMARC::policy::record_lookup dmarc_records = {});
 
 void dkim_check(message::parsed& msg, char const* domain);
 
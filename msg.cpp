@@ -6,8 +6,15 @@ namespace gflags {
 }
 
 DEFINE_bool(selftest, false, "run a self test");
+DECLARE_uint64(jobs); // in Batch.cpp
+DEFINE_bool(parts, false, "list the MIME parts of each message");
+DEFINE_bool(save_parts,
+            false,
+            "keep an index of the MIME parts in a dot file beside each"
+            " message");
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -21,9 +28,13 @@ DEFINE_bool(selftest, false, "run a self test");
 
 #include <iostream>
 
+#include "AuthCache.hpp"
+#include "Batch.hpp"
+#include "MIME.hpp"
 #include "Mailbox.hpp"
 #include "OpenDKIM.hpp"
 #include "OpenDMARC.hpp"
+#include "RFC5322-fields.hpp"
 #include "SPF.hpp"
 #include "esc.hpp"
 #include "fs.hpp"
@@ -46,69 +57,32 @@ constexpr std::size_t countof(T const (&)[N]) noexcept
 
 namespace RFC5322 {
 
-constexpr char const* defined_fields[]{
-
-    // Trace Fields
-    "Return-Path",
-    "Received",
-    "Received-SPF", // RFC 7208 added trace field
-
-    // Sig
-    "DKIM-Signature", // RFC 7489
-
-    // Originator Fields
-    "Date",
-    "From",
-    "Sender",
-    "Reply-To",
-
-    // Destination Address Fields
-    "To",
-    "Cc",
-    "Bcc",
-
-    // Identification Fields
-    "Message-ID",
-    "In-Reply-To",
-    "References",
-
-    // Informational Fields
-    "Subject",
-    "Comments",
-    "Keywords",
-
-    // Resent Fields
-    "Resent-Date",
-    "Resent-From",
-    "Resent-Sender",
-    "Resent-To",
-    "Resent-Cc",
-    "Resent-Bcc",
-    "Resent-Message-ID",
-
-    // MIME Fields
-    "MIME-Version",
-
-    "Content-Type",
-    "Content-Transfer-Encoding",
-    "Content-ID",
-    "Content-Description",
-};
+// The fields the grammar below has rules for; the rest, though known
+// to RFC5322-fields.hpp, are parsed as optional fields.
+constexpr bool is_defined(field f) noexcept
+{
+  switch (f) {
+  case field::authentication_results:
+  case field::delivered_to:
+  case field::arc_seal:
+  case field::arc_message_signature:
+  case field::arc_authentication_results:
+  case field::content_disposition:
+  case field::unknown: return false;
+  default: return true;
+  }
+}
 
 bool is_defined_field(std::string_view name)
 {
-  return std::find_if(std::begin(defined_fields), std::end(defined_fields),
-                      [=](std::string_view v) { return iequal(name, v); })
-         != std::end(defined_fields);
+  return is_defined(field_of(name));
 }
 
+// The name as it's usually written, NUL terminated.
 char const* defined_field(std::string_view name)
 {
-  auto df = std::find_if(std::begin(defined_fields), std::end(defined_fields),
-                         [=](std::string_view v) { return iequal(name, v); });
-  if (df != std::end(defined_fields))
-    return *df;
-  return "";
+  auto const f = field_of(name);
+  return is_defined(f) ? name_of(f).data() : "";
 }
 
 struct ci_less {
@@ -119,7 +93,15 @@ struct ci_less {
 };
 
 struct Ctx {
-  OpenDKIM::verify dkv;
+  AuthCache* auth{nullptr}; // DKIM keys and DMARC records, if set
+
+  OpenDKIM::verify dkv{
+      [this](char const* selector,
+             char const* domain) -> std::optional<std::string> {
+        if (auth)
+          return auth->dkim_key(selector, domain);
+        return {};
+      }};
 
   OpenDMARC::policy dmp;
 
@@ -161,6 +143,16 @@ struct Ctx {
   std::vector<std::pair<std::string, std::string>> ct_parameters;
 
   std::vector<std::string> msg_errors;
+
+  // Results, for batch mode.
+  struct dkim_result {
+    std::string domain;
+    std::string selector;
+    bool        passed;
+  };
+  std::string              from_domain;
+  std::vector<dkim_result> dkim_results;
+  bool                     dmarc_passed{false};
 };
 
 // clang-format off
@@ -1549,6 +1541,7 @@ struct action<message> {
       // }
     }
 
+    ctx.from_domain = from_domain.ascii();
     ctx.dmp.store_from_domain(from_domain.ascii().c_str());
 
     ctx.dkv.foreach_sig([&ctx](char const* domain, bool passed,
@@ -1561,9 +1554,17 @@ struct action<message> {
                           : DMARC_POLICY_DKIM_OUTCOME_FAIL;
 
       ctx.dmp.store_dkim(domain, selector, result, "I am human");
+      ctx.dkim_results.push_back({domain, selector, passed});
     });
 
-    ctx.dmp.query_dmarc(from_domain.ascii().c_str());
+    ctx.dmarc_passed = ctx.dmp.query_dmarc(
+        from_domain.ascii().c_str(),
+        [&ctx](char const* domain,
+               std::string& org_domain) -> std::optional<std::string> {
+          if (ctx.auth)
+            return ctx.auth->dmarc_record(domain, org_domain);
+          return {};
+        });
 
     // LOG(INFO) << "Message-ID: " << ctx.message_id;
     // LOG(INFO) << "Final DMARC advice for " << from_domain << ": "
@@ -1648,6 +1649,67 @@ void display(RFC5322::Ctx const& ctx)
   // }
 }
 
+// The MIME parts of a message, from its index if that's newer than the
+// message, and saved to one if asked.
+std::vector<MIME::part> mime_parts(fs::path const& file, std::string_view text)
+{
+  std::error_code ec;
+  auto const      idx_time = fs::last_write_time(MIME::index_path(file), ec);
+  if (!ec && (idx_time >= fs::last_write_time(file))) {
+    if (auto parts = MIME::read_index(file); parts)
+      return *parts;
+  }
+
+  auto parts = MIME::walk(text);
+  if (FLAGS_save_parts)
+    MIME::write_index(file, parts);
+  return parts;
+}
+
+// One JSON line for a message, for batch mode.
+std::string check(fs::path const& file, AuthCache& auth)
+{
+  auto const f{boost::iostreams::mapped_file_source(file.string())};
+  auto       in{memory_input<>(f.data(), f.size(), file.string())};
+
+  RFC5322::Ctx ctx;
+  ctx.auth = &auth;
+  if (!parse<RFC5322::message, RFC5322::action>(in, ctx))
+    throw std::runtime_error("message failed to parse");
+
+  fmt::memory_buffer parts;
+  if (FLAGS_parts || FLAGS_save_parts) {
+    for (auto const& p : mime_parts(file, std::string_view(f.data(), f.size())))
+      fmt::format_to(parts,
+                     R"({}{{"offset":{},"length":{},"body":{},"depth":{},)"
+                     R"("type":{},"encoding":{}}})",
+                     parts.size() ? "," : "", p.offset, p.length,
+                     p.body_offset, p.depth, Batch::json_str(p.content_type),
+                     Batch::json_str(p.encoding));
+  }
+
+  fmt::memory_buffer dkim;
+  for (auto const& r : ctx.dkim_results) {
+    fmt::format_to(dkim, R"({}{{"d":{},"s":{},"pass":{}}})",
+                   dkim.size() ? "," : "", Batch::json_str(r.domain),
+                   Batch::json_str(r.selector), r.passed);
+  }
+
+  fmt::memory_buffer errors;
+  for (auto const& e : ctx.msg_errors) {
+    fmt::format_to(errors, "{}{}", errors.size() ? "," : "",
+                   Batch::json_str(e));
+  }
+
+  return fmt::format(
+      R"({{"file":{},"from":{},"dkim":[{}],"dmarc":{},"errors":[{}]{}}})",
+      Batch::json_str(file.string()), Batch::json_str(ctx.from_domain),
+      fmt::to_string(dkim), ctx.dmarc_passed ? R"("pass")" : R"("fail")",
+      fmt::to_string(errors),
+      FLAGS_parts ? fmt::format(R"(,"parts":[{}])", fmt::to_string(parts))
+                  : "");
+}
+
 void selftest()
 {
   const char* name_addr_list_bad[]{
@@ -1684,6 +1746,9 @@ void selftest()
 
   CHECK(RFC5322::is_defined_field("Subject"));
   CHECK(!RFC5322::is_defined_field("X-Subject"));
+  CHECK(!RFC5322::is_defined_field("ARC-Seal"));
+  CHECK_EQ(std::string_view(RFC5322::defined_field("message-id")),
+           "Message-ID");
 
   const char* ip_list[]{
       "2607:f8b0:4001:c0b::22a",
@@ -1776,14 +1841,52 @@ int main(int argc, char* argv[])
     return 0;
   }
 
+  SharedCache auth_shared{Config::auth_cache_name, Config::auth_cache_slots};
+
+  if (FLAGS_jobs) {
+    // The resolver isn't thread safe: one, and one AuthCache, per thread.
+    struct per_thread {
+      std::unique_ptr<DNS::Resolver> res;
+      std::unique_ptr<AuthCache>     auth;
+    };
+    std::vector<per_thread> threads(FLAGS_jobs);
+
+    Batch::run(
+        Batch::files(argc, argv), FLAGS_jobs,
+        [&](unsigned thread, fs::path const& file) {
+          auto& t = threads[thread];
+          if (!t.auth) {
+            t.res  = std::make_unique<DNS::Resolver>(osutil::get_config_dir());
+            t.auth = std::make_unique<AuthCache>(*t.res, &auth_shared);
+          }
+          return check(file, *t.auth);
+        },
+        std::cout);
+    return 0;
+  }
+
+  DNS::Resolver res{osutil::get_config_dir()};
+  AuthCache     auth{res, &auth_shared};
+
   for (auto i{1}; i < argc; ++i) {
     auto fn{argv[i]};
     auto name{fs::path(fn)};
     auto f{boost::iostreams::mapped_file_source(name)};
     auto in{memory_input<>(f.data(), f.size(), fn)};
     LOG(INFO) << "#### file: " << fn;
+    if (FLAGS_parts || FLAGS_save_parts) {
+      auto const parts = mime_parts(name, std::string_view(f.data(), f.size()));
+      if (FLAGS_parts) {
+        for (auto const& p : parts) {
+          std::cout << std::string(2 * p.depth, ' ') << p.content_type << ' '
+                    << p.encoding << ' ' << p.body_length() << " octets at "
+                    << p.body_offset << '\n';
+        }
+      }
+    }
     try {
       RFC5322::Ctx ctx;
+      ctx.auth = &auth;
       // ctx.defined_hdrs.reserve(countof(RFC5322::defined_fields));
       if (!parse<RFC5322::message, RFC5322::action>(in, ctx)) {
         LOG(ERROR) << "parse returned false";
@@ -0,0 +1,42 @@
+#include "RFC5321-verbs.hpp"
+#include "RFC5322-fields.hpp"
+
+#include <cctype>
+#include <string>
+
+#include <glog/logging.h>
+
+int main(int argc, char* argv[])
+{
+  // Every name finds itself, in any case.
+  for (std::size_t i = 0; i < RFC5322::field_names.size(); ++i) {
+    auto const name = RFC5322::field_names[i];
+    CHECK_EQ(RFC5322::field_names.find(name), i);
+
+    std::string lower{name};
+    for (auto& ch : lower)
+      ch = std::tolower(static_cast<unsigned char>(ch));
+    CHECK_EQ(RFC5322::field_names.find(lower), i);
+
+    CHECK(RFC5322::name_of(RFC5322::field_of(name)) == name);
+  }
+
+  // Near misses are unknown.
+  CHECK(RFC5322::field_of("") == RFC5322::field::unknown);
+  CHECK(RFC5322::field_of("Fro") == RFC5322::field::unknown);
+  CHECK(RFC5322::field_of("From ") == RFC5322::field::unknown);
+  CHECK(RFC5322::field_of("X-Original-To") == RFC5322::field::unknown);
+  CHECK(RFC5322::name_of(RFC5322::field::unknown).empty());
+
+  CHECK(RFC5322::field_of("message-id") == RFC5322::field::message_id);
+  CHECK(RFC5322::field_of("Received-Spf") == RFC5322::field::received_spf);
+
+  CHECK(RFC5321::verb_of("MAIL FROM:<>\r\n") == RFC5321::verb::mail);
+  CHECK(RFC5321::verb_of("rcpt to:<x@example.com>\r\n")
+        == RFC5321::verb::rcpt);
+  CHECK(RFC5321::verb_of("BDAT 100 LAST\r\n") == RFC5321::verb::bdat);
+  CHECK(RFC5321::verb_of("STARTTLS\r\n") == RFC5321::verb::starttls);
+  CHECK(RFC5321::verb_of("QUI") == RFC5321::verb::unknown);
+  CHECK(RFC5321::verb_of("EXPN postmaster\r\n") == RFC5321::verb::unknown);
+  CHECK(RFC5321::verb_of("GET / HTTP/1.1\r\n") == RFC5321::verb::unknown);
+}
@@ -0,0 +1,93 @@
+#ifndef PHASH_DOT_HPP
+#define PHASH_DOT_HPP
+
+// A perfect hash over a fixed set of names, found at compile time, that
+// matches without regard to ASCII case.  A lookup is one hash and at
+// most one compare, where a scan with iequal() is a compare per name.
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+template <std::size_t N>
+class phash {
+public:
+  static constexpr std::size_t npos = N;
+
+  constexpr explicit phash(std::array<std::string_view, N> const& keys)
+    : keys_(keys)
+  {
+    for (seed_ = 0; seed_ < max_seeds; ++seed_) {
+      if (fill_())
+        return;
+    }
+    throw "no perfect hash for these keys"; // at compile time, an error
+  }
+
+  // The index of key, or npos.
+  constexpr std::size_t find(std::string_view key) const noexcept
+  {
+    auto const i = slots_[hash_(key, seed_) & mask];
+    return ((i != npos) && equal_(keys_[i], key)) ? i : npos;
+  }
+
+  constexpr std::string_view operator[](std::size_t i) const
+  {
+    return keys_[i];
+  }
+  constexpr std::size_t size() const { return N; }
+
+private:
+  // At a load of a quarter or less a seed turns up within a few dozen
+  // tries.
+  static constexpr std::size_t   n_slots   = std::bit_ceil(4 * N);
+  static constexpr std::size_t   mask      = n_slots - 1;
+  static constexpr std::uint32_t max_seeds = 10'000;
+
+  static constexpr char upper_(char ch)
+  {
+    return ((ch >= 'a') && (ch <= 'z')) ? (ch - 'a' + 'A') : ch;
+  }
+
+  // FNV-1a, seeded, with the high bits folded into the low.
+  static constexpr std::uint32_t hash_(std::string_view s, std::uint32_t seed)
+  {
+    std::uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (auto ch : s) {
+      h ^= static_cast<unsigned char>(upper_(ch));
+      h *= 16777619u;
+    }
+    return h ^ (h >> 16);
+  }
+
+  static constexpr bool equal_(std::string_view a, std::string_view b)
+  {
+    if (a.size() != b.size())
+      return false;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      if (upper_(a[i]) != upper_(b[i]))
+        return false;
+    }
+    return true;
+  }
+
+  constexpr bool fill_()
+  {
+    slots_.fill(npos);
+    for (std::size_t i = 0; i < N; ++i) {
+      auto& slot = slots_[hash_(keys_[i], seed_) & mask];
+      if (slot != npos)
+        return false;
+      slot = i;
+    }
+    return true;
+  }
+
+  std::array<std::string_view, N>    keys_;
+  std::array<std::uint16_t, n_slots> slots_{};
+  std::uint32_t                      seed_{0};
+};
+
+#endif // PHASH_DOT_HPP
@@ -0,0 +1,683 @@
+// Load generator for smtp: keeps --connections sessions going at once,
+// each sending --messages messages, then reports the throughput and
+// the latency quantiles of each phase of the SMTP conversation.
+//
+// Usage: smtp-bench [--host h] [--service s | --exec ./smtp]
+//                   [--connections n] [--messages n] [--per_connection n]
+//                   [--sizes n,...] [--recipients n,...]
+//                   [--pipelining] [--chunking] [--starttls]
+//
+// With --exec, each connection is a socketpair to an smtp forked
+// for it, as ouroboros.sh does with snd, so no listener is needed.  Each
+// message's size and recipient count are picked from the --sizes and
+// --recipients lists by a PRNG seeded from --seed, so a run with the
+// same flags sends the same mail.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <csignal>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fmt/format.h>
+
+#include "Metrics.hpp"
+#include "Now.hpp"
+#include "Pill.hpp"
+#include "Sock.hpp"
+#include "osutil.hpp"
+
+DEFINE_string(host, "localhost", "server to connect to");
+DEFINE_string(service, "smtp-test", "service name or port number");
+DEFINE_string(exec, "", "fork and exec this smtp for each connection");
+
+DEFINE_uint64(connections, 8, "connections open at once");
+DEFINE_uint64(messages, 100, "messages to send over each of the connections");
+DEFINE_uint64(per_connection, 1, "messages sent before reconnecting");
+
+DEFINE_string(sizes, "4096", "body sizes in octets, picked from at random");
+DEFINE_string(recipients, "1", "recipients per message, picked from at random");
+DEFINE_uint64(seed, 1, "seed for picking sizes and recipient counts");
+
+DEFINE_bool(pipelining, true, "use PIPELINING if offered");
+DEFINE_bool(chunking, true, "use CHUNKING if offered");
+DEFINE_bool(starttls, false, "use STARTTLS if offered");
+
+DEFINE_string(client_id, "", "name for EHLO, if not our hostname");
+DEFINE_string(from, "bench@example.com", "MAIL FROM address");
+DEFINE_string(to, "postmaster@localhost", "RCPT TO addresses, used in turn");
+
+namespace Config {
+constexpr auto read_timeout  = std::chrono::seconds(30);
+constexpr auto write_timeout = std::chrono::seconds(30);
+
+// Body lines, a bit short of the 78 suggested by RFC 5322.
+constexpr std::size_t line_length = 76;
+} // namespace Config
+
+namespace {
+
+using std::chrono::steady_clock;
+
+// clang-format off
+enum class phase {
+  connect,    // connect(2), or socketpair(2) and fork(2)
+  greeting,   // to the 220 greeting
+  ehlo,       // EHLO, through the reply
+  starttls,   // STARTTLS, the handshake and the second EHLO
+  mail,       // MAIL FROM, through the reply
+  rcpt,       // each RCPT TO, through the reply
+  data,       // DATA or BDAT, through the final reply
+  message,    // MAIL FROM, through the final reply
+  quit,       // QUIT, through the reply
+
+  end,
+};
+
+constexpr std::string_view phase_names[]{
+  "connect",
+  "greeting",
+  "ehlo",
+  "starttls",
+  "mail",
+  "rcpt",
+  "data",
+  "message",
+  "quit",
+};
+// clang-format on
+
+constexpr auto n_phases = static_cast<std::size_t>(phase::end);
+static_assert(std::size(phase_names) == n_phases);
+
+// What each thread keeps, summed at the end.  The histograms are the
+// ones smtp keeps for itself, so the two can be read side by side.
+struct stats {
+  std::array<Metrics::histogram, n_phases> phases;
+
+  std::uint64_t messages{0};
+  std::uint64_t octets{0};
+  std::uint64_t rejected{0};
+  std::uint64_t failed{0}; // lost with the connection they were on
+
+  void record(phase p, steady_clock::duration d)
+  {
+    using namespace std::chrono;
+    auto const us = static_cast<std::uint64_t>(
+        std::max<std::int64_t>(0, duration_cast<microseconds>(d).count()));
+
+    auto& h = phases[static_cast<std::size_t>(p)];
+    ++h.buckets[Metrics::bucket_of(us)];
+    ++h.count;
+    h.sum_us += us;
+  }
+
+  stats& operator+=(stats const& that)
+  {
+    for (std::size_t i = 0; i < n_phases; ++i) {
+      for (std::size_t b = 0; b < Metrics::n_buckets; ++b)
+        phases[i].buckets[b] += that.phases[i].buckets[b];
+      phases[i].count += that.phases[i].count;
+      phases[i].sum_us += that.phases[i].sum_us;
+    }
+    messages += that.messages;
+    octets += that.octets;
+    rejected += that.rejected;
+    failed += that.failed;
+    return *this;
+  }
+};
+
+// Everything the threads share, read only once they're started.
+struct plan {
+  std::vector<std::uint64_t> sizes;
+  std::vector<std::uint64_t> recipients;
+  std::vector<std::string>   to;
+  std::string                client_id;
+  std::string                date;
+  fs::path                   config_path;
+};
+
+std::vector<std::string> split(std::string_view s)
+{
+  std::vector<std::string> parts;
+  while (!s.empty()) {
+    auto const comma = s.find(',');
+    if (auto const part = s.substr(0, comma); !part.empty())
+      parts.emplace_back(part);
+    if (comma == std::string_view::npos)
+      break;
+    s.remove_prefix(comma + 1);
+  }
+  return parts;
+}
+
+std::vector<std::uint64_t> split_numbers(char const* flag, std::string_view s)
+{
+  std::vector<std::uint64_t> numbers;
+  for (auto const& part : split(s)) {
+    char*      ep = nullptr;
+    auto const n  = strtoull(part.c_str(), &ep, 10);
+    if (!ep || *ep || !n)
+      LOG(FATAL) << "--" << flag << ": bad number " << part;
+    numbers.push_back(n);
+  }
+  CHECK(!numbers.empty()) << "--" << flag << " is empty";
+  return numbers;
+}
+
+// A body of just so many octets, in lines of text that never start
+// with a '.', so it goes as DATA unchanged.
+std::string make_body(std::size_t size)
+{
+  constexpr std::string_view text{
+      "Now is the time for all good men to come to the aid of the party. "};
+
+  std::string body;
+  body.reserve(size);
+  while (body.size() + 2 < size) {
+    auto const n = std::min(Config::line_length, size - body.size() - 2);
+    for (std::size_t i = 0; i < n; ++i)
+      body.push_back(text[i % text.size()]);
+    body += "\r\n";
+  }
+  if (body.empty())
+    body = "\r\n";
+  return body;
+}
+
+std::string make_header(plan const& pl)
+{
+  return fmt::format("Date: {}\r\n"
+                     "From: <{}>\r\n"
+                     "To: <{}>\r\n"
+                     "Subject: smtp-bench\r\n"
+                     "Message-ID: <{}@{}>\r\n"
+                     "\r\n",
+                     pl.date, FLAGS_from, pl.to.front(),
+                     Pill{}.as_string_view(), pl.client_id);
+}
+
+// Read a reply, of however many lines, and return its code, or zero
+// if the connection is gone or the reply makes no sense.  The text of
+// each line goes to lines, if given.
+int read_reply(Sock& sock, std::vector<std::string>* lines = nullptr)
+{
+  std::string line;
+  for (;;) {
+    if (!std::getline(sock.in(), line))
+      return 0;
+    if (!line.empty() && (line.back() == '\r'))
+      line.pop_back();
+    if ((line.size() < 3) || !std::all_of(line.begin(), line.begin() + 3,
+                                          [](char c) { return isdigit(c); }))
+      return 0;
+    if (lines)
+      lines->emplace_back(line.size() > 4 ? line.substr(4) : "");
+    if ((line.size() == 3) || (line[3] == ' '))
+      return std::stoi(line.substr(0, 3));
+    if (line[3] != '-')
+      return 0;
+  }
+}
+
+struct extensions {
+  bool chunking{false};
+  bool pipelining{false};
+  bool size{false};
+  bool starttls{false};
+};
+
+extensions parse_ehlo(std::vector<std::string> const& lines)
+{
+  extensions ext;
+  for (std::size_t i = 1; i < lines.size(); ++i) {
+    auto kw = lines[i].substr(0, lines[i].find(' '));
+    std::transform(kw.begin(), kw.end(), kw.begin(),
+                   [](unsigned char c) { return toupper(c); });
+    if (kw == "CHUNKING")
+      ext.chunking = true;
+    else if (kw == "PIPELINING")
+      ext.pipelining = true;
+    else if (kw == "SIZE")
+      ext.size = true;
+    else if (kw == "STARTTLS")
+      ext.starttls = true;
+  }
+  return ext;
+}
+
+// A socket to the server, or to a child smtp of our own.
+class connection {
+public:
+  connection(connection const&) = delete;
+  connection& operator=(connection const&) = delete;
+
+  connection()
+  {
+    if (FLAGS_exec.empty())
+      connect_();
+    else
+      spawn_();
+    if (fd_in_ != -1)
+      sock_ = std::make_unique<Sock>(fd_in_, fd_out_, []() {},
+                                     Config::read_timeout,
+                                     Config::write_timeout);
+  }
+
+  ~connection()
+  {
+    sock_.reset();
+    if (fd_out_ != fd_in_)
+      close(fd_out_);
+    if (fd_in_ != -1)
+      close(fd_in_);
+    if (pid_ != -1)
+      waitpid(pid_, nullptr, 0);
+  }
+
+  bool  ok() const { return sock_ != nullptr; }
+  Sock& sock() { return *sock_; }
+
+private:
+  void connect_();
+  void spawn_();
+
+  int                   fd_in_{-1};
+  int                   fd_out_{-1};
+  pid_t                 pid_{-1};
+  std::unique_ptr<Sock> sock_;
+};
+
+void connection::connect_()
+{
+  auto const port = std::to_string(
+      osutil::get_port(FLAGS_service.c_str(), "tcp"));
+
+  addrinfo hints{};
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo* res = nullptr;
+  if (auto const err
+      = getaddrinfo(FLAGS_host.c_str(), port.c_str(), &hints, &res)) {
+    LOG(WARNING) << FLAGS_host << ": " << gai_strerror(err);
+    return;
+  }
+  for (auto ai = res; ai; ai = ai->ai_next) {
+    auto const fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                           ai->ai_protocol);
+    if (fd == -1)
+      continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      // Time the server, not Nagle's algorithm.
+      int const one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      fd_in_ = fd_out_ = fd;
+      break;
+    }
+    PLOG(WARNING) << "connect to " << FLAGS_host << ':' << port << " failed";
+    close(fd);
+  }
+  freeaddrinfo(res);
+}
+
+// A socketpair, the smtp's end as its stdin and stdout, as from inetd.
+void connection::spawn_()
+{
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+    PLOG(WARNING) << "socketpair failed";
+    return;
+  }
+
+  pid_ = fork();
+  if (pid_ == 0) {
+    // The other threads may hold locks; nothing but system calls here.
+    signal(SIGPIPE, SIG_DFL);
+    dup2(sv[1], STDIN_FILENO);
+    dup2(sv[1], STDOUT_FILENO);
+    execl(FLAGS_exec.c_str(), FLAGS_exec.c_str(), nullptr);
+    _exit(127);
+  }
+
+  close(sv[1]);
+  if (pid_ == -1) {
+    PLOG(WARNING) << "fork failed";
+    close(sv[0]);
+    return;
+  }
+
+  fd_in_ = fd_out_ = sv[0];
+}
+
+enum class result {
+  sent,
+  rejected,
+  broken, // the connection is no use
+};
+
+class worker {
+public:
+  worker(plan const& pl, unsigned id)
+    : pl_(pl)
+    , rng_(FLAGS_seed + id)
+  {
+  }
+
+  void run();
+
+  stats const& results() const { return stats_; }
+
+private:
+  // One connection, over which to send up to n messages.
+  void session_(std::uint64_t n);
+
+  result send_(Sock& sock, extensions const& ext);
+  result reset_(Sock& sock);
+
+  std::string const& body_(std::uint64_t size);
+
+  template <typename T>
+  T pick_(std::vector<T> const& v)
+  {
+    return v[rng_() % v.size()];
+  }
+
+  plan const&     pl_;
+  std::mt19937_64 rng_;
+  stats           stats_;
+
+  std::unordered_map<std::uint64_t, std::string> bodies_;
+};
+
+void worker::run()
+{
+  auto left = FLAGS_messages;
+  while (left) {
+    auto const n = std::min(left, FLAGS_per_connection);
+    session_(n);
+    left -= n;
+  }
+}
+
+void worker::session_(std::uint64_t n)
+{
+  auto const start = steady_clock::now();
+  connection cnn;
+  stats_.record(phase::connect, steady_clock::now() - start);
+  if (!cnn.ok()) {
+    stats_.failed += n;
+    return;
+  }
+  auto& sock = cnn.sock();
+
+  auto const greet = read_reply(sock);
+  stats_.record(phase::greeting, steady_clock::now() - start);
+  if (greet != 220) {
+    LOG(WARNING) << "greeting was " << greet;
+    stats_.failed += n;
+    return;
+  }
+
+  std::vector<std::string> lines;
+
+  auto mark = steady_clock::now();
+  sock.out() << "EHLO " << pl_.client_id << "\r\n" << std::flush;
+  if (read_reply(sock, &lines) != 250) {
+    LOG(WARNING) << "EHLO failed";
+    stats_.failed += n;
+    return;
+  }
+  stats_.record(phase::ehlo, steady_clock::now() - mark);
+  auto ext = parse_ehlo(lines);
+
+  if (FLAGS_starttls) {
+    if (!ext.starttls) {
+      LOG_FIRST_N(WARNING, 1) << "no STARTTLS, carrying on in the clear";
+    }
+    else {
+      mark = steady_clock::now();
+      sock.out() << "STARTTLS\r\n" << std::flush;
+      if ((read_reply(sock) != 220)
+          || !sock.starttls_client(pl_.config_path, pl_.client_id.c_str(),
+                                   FLAGS_host.c_str(), {}, false)) {
+        LOG(WARNING) << "STARTTLS failed";
+        stats_.failed += n;
+        return;
+      }
+      lines.clear();
+      sock.out() << "EHLO " << pl_.client_id << "\r\n" << std::flush;
+      if (read_reply(sock, &lines) != 250) {
+        LOG(WARNING) << "EHLO after STARTTLS failed";
+        stats_.failed += n;
+        return;
+      }
+      stats_.record(phase::starttls, steady_clock::now() - mark);
+      ext = parse_ehlo(lines);
+    }
+  }
+
+  if (FLAGS_pipelining && !ext.pipelining)
+    LOG_FIRST_N(WARNING, 1) << "no PIPELINING, sending in lockstep";
+  if (FLAGS_chunking && !ext.chunking)
+    LOG_FIRST_N(WARNING, 1) << "no CHUNKING, sending with DATA";
+
+  for (std::uint64_t i = 0; i < n; ++i) {
+    switch (send_(sock, ext)) {
+    case result::sent: ++stats_.messages; break;
+    case result::rejected: ++stats_.rejected; break;
+    case result::broken: stats_.failed += n - i; return;
+    }
+  }
+
+  mark = steady_clock::now();
+  sock.out() << "QUIT\r\n" << std::flush;
+  if (read_reply(sock) == 221)
+    stats_.record(phase::quit, steady_clock::now() - mark);
+}
+
+// Without PIPELINING each phase is timed from its command to its reply.
+// With it, the commands go out together, so the MAIL FROM is timed from
+// the write, and each reply after it from the reply before.
+result worker::send_(Sock& sock, extensions const& ext)
+{
+  auto const pipelining = FLAGS_pipelining && ext.pipelining;
+  auto const chunking   = FLAGS_chunking && ext.chunking;
+
+  auto const  n_rcpt = pick_(pl_.recipients);
+  auto const  hdr    = make_header(pl_);
+  auto const& body   = body_(pick_(pl_.sizes));
+  auto const  total  = hdr.size() + body.size();
+
+  auto& out = sock.out();
+
+  auto const start = steady_clock::now();
+  auto       mark  = start;
+  auto       ok    = true;
+
+  // False if the connection is gone.
+  auto const reply = [&](phase p, int want) {
+    auto const code = read_reply(sock);
+    auto const now  = steady_clock::now();
+    stats_.record(p, now - mark);
+    mark = now;
+    ok   = ok && (code == want);
+    return code != 0;
+  };
+
+  out << "MAIL FROM:<" << FLAGS_from << '>';
+  if (ext.size)
+    out << " SIZE=" << total;
+  out << "\r\n";
+  if (!pipelining) {
+    out << std::flush;
+    if (!reply(phase::mail, 250))
+      return result::broken;
+    if (!ok)
+      return reset_(sock);
+  }
+
+  for (std::uint64_t i = 0; i < n_rcpt; ++i) {
+    if (!pipelining)
+      mark = steady_clock::now();
+    out << "RCPT TO:<" << pl_.to[i % pl_.to.size()] << ">\r\n";
+    if (!pipelining) {
+      out << std::flush;
+      if (!reply(phase::rcpt, 250))
+        return result::broken;
+      if (!ok)
+        return reset_(sock);
+    }
+  }
+
+  if (!pipelining)
+    mark = steady_clock::now();
+  if (chunking) {
+    out << "BDAT " << total << " LAST\r\n";
+    out.write(hdr.data(), hdr.size());
+    out.write(body.data(), body.size());
+  }
+  else {
+    out << "DATA\r\n";
+  }
+  out << std::flush;
+
+  if (pipelining) {
+    if (!reply(phase::mail, 250))
+      return result::broken;
+    for (std::uint64_t i = 0; i < n_rcpt; ++i) {
+      if (!reply(phase::rcpt, 250))
+        return result::broken;
+    }
+  }
+
+  if (!chunking) {
+    auto const code = read_reply(sock);
+    if (!code)
+      return result::broken;
+    if (code != 354)
+      return reset_(sock);
+    out.write(hdr.data(), hdr.size());
+    out.write(body.data(), body.size());
+    out << ".\r\n" << std::flush;
+  }
+
+  if (!reply(phase::data, 250))
+    return result::broken;
+  if (!ok)
+    return reset_(sock);
+
+  stats_.record(phase::message, steady_clock::now() - start);
+  stats_.octets += total;
+  return result::sent;
+}
+
+result worker::reset_(Sock& sock)
+{
+  sock.out() << "RSET\r\n" << std::flush;
+  return (read_reply(sock) == 250) ? result::rejected : result::broken;
+}
+
+std::string const& worker::body_(std::uint64_t size)
+{
+  auto it = bodies_.find(size);
+  if (it == bodies_.end())
+    it = bodies_.emplace(size, make_body(size)).first;
+  return it->second;
+}
+
+void print_results(stats const& st, steady_clock::duration elapsed)
+{
+  using namespace std::chrono;
+  auto const secs = duration<double>(elapsed).count();
+
+  std::cout << fmt::format("{:<10} {:>10} {:>10} {:>10} {:>10} {:>10}\n",
+                           "phase", "count", "p50 ms", "p99 ms", "p99.9 ms",
+                           "max ms");
+  for (std::size_t i = 0; i < n_phases; ++i) {
+    auto const& h = st.phases[i];
+    if (!h.count)
+      continue;
+    std::cout << fmt::format(
+        "{:<10} {:>10} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}\n",
+        phase_names[i], h.count, h.quantile(0.5) / 1e3,
+        h.quantile(0.99) / 1e3, h.quantile(0.999) / 1e3,
+        h.quantile(1.0) / 1e3);
+  }
+
+  std::cout << fmt::format("\n{} messages sent, {} rejected, {} failed, "
+                           "in {:.3f} seconds\n"
+                           "{:.1f} messages/second, {:.3f} MiB/second\n",
+                           st.messages, st.rejected, st.failed, secs,
+                           st.messages / secs,
+                           st.octets / secs / (1024 * 1024));
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  { // Need to work with either namespace.
+    using namespace gflags;
+    using namespace google;
+    ParseCommandLineFlags(&argc, &argv, true);
+  }
+
+  CHECK(FLAGS_connections) << "--connections must be at least 1";
+  CHECK(FLAGS_per_connection) << "--per_connection must be at least 1";
+
+  plan pl;
+  pl.sizes       = split_numbers("sizes", FLAGS_sizes);
+  pl.recipients  = split_numbers("recipients", FLAGS_recipients);
+  pl.to          = split(FLAGS_to);
+  pl.client_id   = FLAGS_client_id.empty() ? osutil::get_hostname()
+                                           : FLAGS_client_id;
+  pl.date        = Now{}.c_str();
+  pl.config_path = osutil::get_config_dir();
+  CHECK(!pl.to.empty()) << "--to is empty";
+
+  // A server that hangs up shows as a failed write, not a dead bench.
+  signal(SIGPIPE, SIG_IGN);
+
+  std::vector<std::unique_ptr<worker>> workers;
+  for (unsigned i = 0; i < FLAGS_connections; ++i)
+    workers.push_back(std::make_unique<worker>(pl, i));
+
+  auto const start = steady_clock::now();
+
+  std::vector<std::thread> threads;
+  for (auto& w : workers)
+    threads.emplace_back(&worker::run, w.get());
+  for (auto& t : threads)
+    t.join();
+
+  auto const elapsed = steady_clock::now() - start;
+
+  stats total;
+  for (auto const& w : workers)
+    total += w->results();
+
+  print_results(total, elapsed);
+
+  return (total.rejected || total.failed) ? 1 : 0;
+}
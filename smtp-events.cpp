@@ -0,0 +1,81 @@
+// Print the events smtp has written with --event_log as the log lines
+// they stand for, one per line, in the order they were written.
+//
+// Usage: smtp-events [--pid N] file...
+//
+// Each line starts the way glog's do, severity, date and time, and the
+// process ID, so the output reads like, and sorts with, the INFO logs.
+
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <string_view>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fmt/format.h>
+
+#include "EventLog.hpp"
+#include "fs.hpp"
+
+DEFINE_uint64(pid, 0, "only the events of this process");
+
+namespace {
+void print(EventLog::record const& rec)
+{
+  auto const secs = static_cast<std::time_t>(rec.time_ns / 1'000'000'000);
+  auto const usec = (rec.time_ns % 1'000'000'000) / 1'000;
+
+  std::tm tm;
+  localtime_r(&secs, &tm);
+
+  std::cout << fmt::format("I{:02}{:02} {:02}:{:02}:{:02}.{:06} {:5}] {}\n",
+                           tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min,
+                           tm.tm_sec, usec, rec.pid,
+                           EventLog::render(rec.type, rec.args()));
+}
+
+bool decode_file(fs::path const& path)
+{
+  if (!fs::file_size(path))
+    return true;
+
+  boost::iostreams::mapped_file_source file(path.string());
+  std::string_view buf(file.data(), file.size());
+
+  EventLog::record rec;
+  while (!buf.empty()) {
+    auto const n = EventLog::decode(buf, rec);
+    if (!n) {
+      LOG(WARNING) << path << ": not an event at offset "
+                   << (file.size() - buf.size());
+      return false;
+    }
+    if (!FLAGS_pid || (rec.pid == FLAGS_pid))
+      print(rec);
+    buf.remove_prefix(n);
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  { // Need to work with either namespace.
+    using namespace gflags;
+    using namespace google;
+    ParseCommandLineFlags(&argc, &argv, true);
+  }
+
+  if (argc < 2)
+    LOG(FATAL) << "usage: smtp-events [--pid N] file...";
+
+  auto ok = true;
+  for (auto i = 1; i < argc; ++i)
+    ok = decode_file(argv[i]) && ok;
+
+  return ok ? 0 : 1;
+}
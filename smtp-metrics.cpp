@@ -0,0 +1,95 @@
+// Print the latency histograms and outcome counts that the smtp
+// processes keep in shared memory, in the Prometheus text format.
+//
+// Usage: smtp-metrics [--textfile path [--interval secs]] [--quantiles]
+//
+// With --textfile the output goes to a temp file that's renamed into
+// place, as node_exporter's textfile collector expects, and --interval
+// does that again every so many seconds.  --quantiles prints a table
+// for people instead.
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fmt/format.h>
+
+#include "Metrics.hpp"
+#include "fs.hpp"
+
+DEFINE_string(name, "/ghsmtp-metrics", "shared memory segment, as smtp uses");
+DEFINE_string(textfile, "", "write to this file rather than stdout");
+DEFINE_uint64(interval, 0, "with --textfile, rewrite every this many seconds");
+DEFINE_bool(quantiles, false, "print a table of quantiles per phase");
+
+namespace {
+void write_textfile(Metrics::store const& store, fs::path const& path)
+{
+  auto tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream ofs(tmp);
+    store.write_prometheus(ofs);
+    if (!ofs.flush()) {
+      LOG(ERROR) << "can't write " << tmp;
+      return;
+    }
+  }
+  fs::rename(tmp, path);
+}
+
+void print_quantiles(Metrics::store const& store)
+{
+  std::cout << fmt::format("{:<10} {:>10} {:>10} {:>10} {:>10} {:>10}\n",
+                           "phase", "count", "p50 ms", "p90 ms", "p99 ms",
+                           "max ms");
+  for (std::size_t i = 0; i < Metrics::n_phases; ++i) {
+    auto const p = static_cast<Metrics::phase>(i);
+    auto const h = store.get(p);
+    std::cout << fmt::format(
+        "{:<10} {:>10} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}\n",
+        Metrics::name_of(p), h.count, h.quantile(0.5) / 1e3,
+        h.quantile(0.9) / 1e3, h.quantile(0.99) / 1e3, h.quantile(1.0) / 1e3);
+  }
+  std::cout << '\n';
+  for (std::size_t i = 0; i < Metrics::n_outcomes; ++i) {
+    auto const o = static_cast<Metrics::outcome>(i);
+    std::cout << fmt::format("{:<22} {:>10}\n", Metrics::name_of(o),
+                             store.get(o));
+  }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  { // Need to work with either namespace.
+    using namespace gflags;
+    using namespace google;
+    ParseCommandLineFlags(&argc, &argv, true);
+  }
+
+  Metrics::store store(FLAGS_name.c_str());
+  if (!store.is_open())
+    return 1;
+
+  if (FLAGS_quantiles) {
+    print_quantiles(store);
+    return 0;
+  }
+
+  if (FLAGS_textfile.empty()) {
+    store.write_prometheus(std::cout);
+    return 0;
+  }
+
+  for (;;) {
+    write_textfile(store, FLAGS_textfile);
+    if (!FLAGS_interval)
+      return 0;
+    std::this_thread::sleep_for(std::chrono::seconds(FLAGS_interval));
+  }
+}
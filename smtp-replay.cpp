@@ -0,0 +1,453 @@
+// Replay sessions captured by smtp --capture_dir into an smtp of our
+// own, and check that its replies match the ones captured.
+//
+// Usage: smtp-replay [--exec ./smtp] [--speed x] [--jobs n] [--show n]
+//                    capture-or-directory ...
+//
+// Each capture is fed to an smtp forked for it, over a socketpair.  The
+// client's data goes at the times it was captured, divided by --speed:
+// 1 for the original pace, 10 for ten times that, 0 for as fast as the
+// smtp will take it.  Sessions start at their captured times relative
+// to the first one, scaled the same, with at most --jobs running at
+// once; if that's too few to keep up, the report says how far behind
+// the replay fell.
+//
+// Before sending each piece of client data, the replies the capture
+// has before it are read, and each one's code and enhanced status code
+// compared with the captured reply's.  The text after the codes, with
+// host names, dates and ids, is not compared.  A session that used
+// STARTTLS gets a TLS handshake at the same point.
+//
+// Over a socketpair the smtp has no client address, so it skips the
+// checks based on one, as it does for any local client.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <csignal>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fmt/format.h>
+
+#include "Capture.hpp"
+#include "Metrics.hpp"
+#include "Sock.hpp"
+#include "esc.hpp"
+#include "fs.hpp"
+#include "osutil.hpp"
+
+DEFINE_string(exec, "./smtp", "smtp to fork and exec for each session");
+DEFINE_double(speed, 1.0, "times the captured pace, 0 for flat out");
+DEFINE_uint64(jobs, 64, "sessions replayed at once");
+DEFINE_uint64(show, 10, "differences to print, at most");
+
+namespace Config {
+constexpr auto read_timeout  = std::chrono::seconds(30);
+constexpr auto write_timeout = std::chrono::seconds(30);
+} // namespace Config
+
+namespace {
+
+using std::chrono::steady_clock;
+
+enum class outcome {
+  same,
+  differ, // a reply's code didn't match
+  failed, // the smtp went away, or STARTTLS didn't work
+};
+
+// The records are read when the session is replayed, and let go
+// after, so only those being replayed are held.
+struct session {
+  Capture::capture cap;
+
+  outcome     result{outcome::same};
+  std::string difference;
+
+  std::uint64_t octets{0};
+  std::uint64_t replies{0};
+
+  steady_clock::duration behind{0}; // the most a write was late
+
+  Metrics::histogram reply_us; // last write to each reply
+};
+
+// The code and enhanced status code that start a reply line, as in
+// "250 2.1.5"; the line is the last of its reply.
+std::string codes_of(std::string_view line)
+{
+  auto const code = line.substr(0, 3);
+  if (line.size() < 5)
+    return std::string(code);
+
+  auto const text = line.substr(4);
+  auto const end  = text.find(' ');
+  auto const enh  = text.substr(0, end);
+  auto const is_enh
+      = (enh.size() >= 5) && isdigit(enh[0]) && (enh[1] == '.')
+        && std::all_of(enh.begin(), enh.end(),
+                       [](char c) { return isdigit(c) || (c == '.'); });
+
+  return is_enh ? fmt::format("{} {}", code, enh) : std::string(code);
+}
+
+// The last line of each whole reply in octets, carrying a line not yet
+// finished over in partial.
+void reply_lines(std::string const&       octets,
+                 std::string&             partial,
+                 std::deque<std::string>& lines)
+{
+  partial += octets;
+  std::string::size_type pos = 0;
+  for (;;) {
+    auto const eol = partial.find("\r\n", pos);
+    if (eol == std::string::npos)
+      break;
+    auto const line = std::string_view(partial).substr(pos, eol - pos);
+    if ((line.size() == 3) || ((line.size() > 3) && (line[3] == ' ')))
+      lines.emplace_back(line);
+    pos = eol + 2;
+  }
+  partial.erase(0, pos);
+}
+
+// Read one reply, returning its last line, or nothing at all if the
+// connection is gone.
+std::string read_reply(Sock& sock)
+{
+  std::string line;
+  for (;;) {
+    if (!std::getline(sock.in(), line))
+      return "";
+    if (!line.empty() && (line.back() == '\r'))
+      line.pop_back();
+    if ((line.size() <= 3) || (line[3] != '-'))
+      return line;
+  }
+}
+
+// An smtp of our own, talking over a socketpair.
+class child {
+public:
+  child(child const&) = delete;
+  child& operator=(child const&) = delete;
+
+  child();
+  ~child();
+
+  bool  ok() const { return sock_ != nullptr; }
+  Sock& sock() { return *sock_; }
+
+private:
+  int                   fd_{-1};
+  pid_t                 pid_{-1};
+  std::unique_ptr<Sock> sock_;
+};
+
+child::child()
+{
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+    PLOG(WARNING) << "socketpair failed";
+    return;
+  }
+
+  pid_ = fork();
+  if (pid_ == 0) {
+    // The other threads may hold locks; nothing but system calls here.
+    signal(SIGPIPE, SIG_DFL);
+    dup2(sv[1], STDIN_FILENO);
+    dup2(sv[1], STDOUT_FILENO);
+    execl(FLAGS_exec.c_str(), FLAGS_exec.c_str(), nullptr);
+    _exit(127);
+  }
+
+  close(sv[1]);
+  if (pid_ == -1) {
+    PLOG(WARNING) << "fork failed";
+    close(sv[0]);
+    return;
+  }
+
+  fd_   = sv[0];
+  sock_ = std::make_unique<Sock>(fd_, fd_, []() {}, Config::read_timeout,
+                                 Config::write_timeout);
+}
+
+child::~child()
+{
+  sock_.reset();
+  if (fd_ != -1)
+    close(fd_);
+  if (pid_ > 0)
+    waitpid(pid_, nullptr, 0);
+}
+
+class replayer {
+public:
+  replayer(session& s, fs::path const& config_path)
+    : s_(s)
+    , config_path_(config_path)
+  {
+  }
+
+  void run(steady_clock::time_point start);
+
+private:
+  bool replies_(Sock& sock);
+
+  session&        s_;
+  fs::path const& config_path_;
+
+  std::deque<std::string> expected_;
+  std::string             partial_;
+
+  steady_clock::time_point last_write_;
+};
+
+// Read the replies the capture has up to here, and compare.
+bool replayer::replies_(Sock& sock)
+{
+  while (!expected_.empty()) {
+    auto const line = read_reply(sock);
+    if (line.empty()) {
+      s_.result     = outcome::failed;
+      s_.difference = fmt::format("reply {}: connection lost, expected «{}»",
+                                  s_.replies + 1, esc(expected_.front()));
+      return false;
+    }
+
+    using namespace std::chrono;
+    auto const us = static_cast<std::uint64_t>(
+        duration_cast<microseconds>(steady_clock::now() - last_write_)
+            .count());
+    ++s_.reply_us.buckets[Metrics::bucket_of(us)];
+    ++s_.reply_us.count;
+    s_.reply_us.sum_us += us;
+    ++s_.replies;
+
+    if (codes_of(line) != codes_of(expected_.front())) {
+      s_.result     = outcome::differ;
+      s_.difference = fmt::format("reply {}: expected «{}», got «{}»",
+                                  s_.replies, esc(expected_.front()),
+                                  esc(line));
+      return false;
+    }
+    expected_.pop_front();
+  }
+  return true;
+}
+
+void replayer::run(steady_clock::time_point start)
+{
+  child c;
+  if (!c.ok()) {
+    s_.result     = outcome::failed;
+    s_.difference = "can't start smtp";
+    return;
+  }
+  auto& sock  = c.sock();
+  last_write_ = steady_clock::now();
+
+  for (auto const& rec : s_.cap.records) {
+    switch (rec.dir) {
+    case Capture::direction::server:
+      reply_lines(rec.data, partial_, expected_);
+      break;
+
+    case Capture::direction::client: {
+      if (!replies_(sock))
+        return;
+      if (FLAGS_speed > 0) {
+        auto const due
+            = start
+              + std::chrono::duration_cast<steady_clock::duration>(
+                  rec.offset / FLAGS_speed);
+        auto const now = steady_clock::now();
+        if (now < due)
+          std::this_thread::sleep_until(due);
+        else
+          s_.behind = std::max(s_.behind, now - due);
+      }
+      sock.out().write(rec.data.data(), rec.data.size());
+      sock.out().flush();
+      last_write_ = steady_clock::now();
+      s_.octets += rec.data.size();
+      break;
+    }
+
+    case Capture::direction::tls:
+      if (!replies_(sock))
+        return;
+      if (!sock.starttls_client(config_path_, nullptr, "localhost", {},
+                                false)) {
+        s_.result     = outcome::failed;
+        s_.difference = "STARTTLS failed";
+        return;
+      }
+      break;
+    }
+  }
+  replies_(sock);
+}
+
+void add_captures(fs::path const& path, std::vector<session>& sessions)
+{
+  if (fs::is_directory(path)) {
+    for (auto const& entry : fs::directory_iterator(path))
+      if (entry.path().extension() == ".cap")
+        add_captures(entry.path(), sessions);
+    return;
+  }
+  session s;
+  if (Capture::read_header(path, s.cap))
+    sessions.push_back(std::move(s));
+}
+
+void print_results(std::vector<session> const& sessions,
+                   steady_clock::duration      elapsed)
+{
+  using namespace std::chrono;
+
+  std::uint64_t          counts[3]{};
+  std::uint64_t          octets  = 0;
+  std::uint64_t          replies = 0;
+  steady_clock::duration behind{0};
+  Metrics::histogram     reply_us;
+  std::uint64_t          shown = 0;
+
+  for (auto const& s : sessions) {
+    ++counts[static_cast<int>(s.result)];
+    octets += s.octets;
+    replies += s.replies;
+    behind = std::max(behind, s.behind);
+    for (std::size_t b = 0; b < Metrics::n_buckets; ++b)
+      reply_us.buckets[b] += s.reply_us.buckets[b];
+    reply_us.count += s.reply_us.count;
+    reply_us.sum_us += s.reply_us.sum_us;
+
+    if ((s.result != outcome::same) && (shown++ < FLAGS_show))
+      std::cout << s.cap.path.string() << ": " << s.difference << '\n';
+  }
+
+  auto const secs = duration<double>(elapsed).count();
+
+  std::cout << fmt::format(
+      "\n{} sessions: {} the same, {} different, {} failed, in {:.3f} "
+      "seconds\n"
+      "{:.1f} sessions/second, {} replies, {:.3f} MiB from clients\n",
+      sessions.size(), counts[0], counts[1], counts[2], secs,
+      sessions.size() / secs, replies, octets / (1024.0 * 1024));
+
+  if (reply_us.count) {
+    std::cout << fmt::format("reply ms: p50 {:.3f}, p99 {:.3f}, p99.9 {:.3f},"
+                             " max {:.3f}\n",
+                             reply_us.quantile(0.5) / 1e3,
+                             reply_us.quantile(0.99) / 1e3,
+                             reply_us.quantile(0.999) / 1e3,
+                             reply_us.quantile(1.0) / 1e3);
+  }
+
+  if (FLAGS_speed > 0) {
+    std::cout << fmt::format(
+        "fell behind the captured pace by {:.3f} ms at most\n",
+        duration<double, std::milli>(behind).count());
+  }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  { // Need to work with either namespace.
+    using namespace gflags;
+    using namespace google;
+    ParseCommandLineFlags(&argc, &argv, true);
+  }
+
+  CHECK_GE(FLAGS_speed, 0) << "--speed can't be negative";
+  CHECK(FLAGS_jobs) << "--jobs must be at least 1";
+
+  std::vector<session> sessions;
+  for (auto i = 1; i < argc; ++i)
+    add_captures(argv[i], sessions);
+  if (sessions.empty()) {
+    LOG(WARNING) << "no captures to replay";
+    return 1;
+  }
+
+  std::sort(sessions.begin(), sessions.end(), [](auto const& a, auto const& b) {
+    return a.cap.start < b.cap.start;
+  });
+  auto const first = sessions.front().cap.start;
+
+  auto const config_path = osutil::get_config_dir();
+
+  // An smtp that dies shows as a failed write, not a dead replay.
+  signal(SIGPIPE, SIG_IGN);
+
+  // The replayed sessions mustn't be captured again, on top of the
+  // originals.  Set here, before any thread, for each child to inherit.
+  unsetenv("GHSMTP_CAPTURE_DIR");
+
+  auto const start = steady_clock::now();
+
+  std::atomic<std::size_t> next{0};
+  auto const               work = [&]() {
+    for (;;) {
+      auto const i = next.fetch_add(1);
+      if (i >= sessions.size())
+        return;
+      auto& s = sessions[i];
+
+      auto session_start = steady_clock::now();
+      if (FLAGS_speed > 0) {
+        session_start
+            = start
+              + std::chrono::duration_cast<steady_clock::duration>(
+                  (s.cap.start - first) / FLAGS_speed);
+        std::this_thread::sleep_until(session_start);
+      }
+      if (Capture::read(s.cap.path, s.cap)) {
+        replayer(s, config_path).run(session_start);
+      }
+      else {
+        s.result     = outcome::failed;
+        s.difference = "can't read the capture";
+      }
+      s.cap.records = {};
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (std::uint64_t j = 0; j < std::min<std::uint64_t>(FLAGS_jobs,
+                                                         sessions.size());
+       ++j)
+    threads.emplace_back(work);
+  for (auto& t : threads)
+    t.join();
+
+  print_results(sessions, steady_clock::now() - start);
+
+  auto const all_same
+      = std::all_of(sessions.begin(), sessions.end(),
+                    [](auto const& s) { return s.result == outcome::same; });
+  return all_same ? 0 : 1;
+}
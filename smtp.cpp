@@ -8,9 +8,16 @@ DEFINE_uint64(data_bfr_size, 64 * 1024, "data parser buffer size");
 
 DEFINE_uint64(max_xfer_size, 64 * 1024, "maximum BDAT transfer size");
 
+DEFINE_string(event_log, "", "append session events to this file");
+
+DEFINE_string(capture_dir, "", "record each session to a file in here");
+
 #include <fstream>
 
+#include "EventLog.hpp"
+#include "RFC5321-verbs.hpp"
 #include "Session.hpp"
+#include "UTF8.hpp"
 #include "esc.hpp"
 #include "fs.hpp"
 #include "iobuffer.hpp"
@@ -48,22 +55,8 @@ struct Ctx {
 
 // clang-format off
 
-struct UTF8_tail : range<'\x80', '\xBF'> {};
-
-struct UTF8_1 : range<'\x00', '\x7F'> {};
-
-struct UTF8_2 : seq<range<'\xC2', '\xDF'>, UTF8_tail> {};
-
-struct UTF8_3 : sor<seq<one<'\xE0'>, range<'\xA0', '\xBF'>, UTF8_tail>,
-                    seq<range<'\xE1', '\xEC'>, rep<2, UTF8_tail>>,
-                    seq<one<'\xED'>, range<'\x80', '\x9F'>, UTF8_tail>,
-                    seq<range<'\xEE', '\xEF'>, rep<2, UTF8_tail>>> {};
-
-struct UTF8_4 : sor<seq<one<'\xF0'>, range<'\x90', '\xBF'>, rep<2, UTF8_tail>>,
-                    seq<range<'\xF1', '\xF3'>, rep<3, UTF8_tail>>,
-                    seq<one<'\xF4'>, range<'\x80', '\x8F'>, rep<2, UTF8_tail>>> {};
-
-struct UTF8_non_ascii : sor<UTF8_2, UTF8_3, UTF8_4> {};
+// RFC 3629 section 4, checked in one go rather than by the grammar.
+struct UTF8_non_ascii : UTF8::non_ascii {};
 
 struct quoted_pair : seq<one<'\\'>, sor<VCHAR, WSP>> {};
 
@@ -167,7 +160,7 @@ struct atext : sor<ALPHA, DIGIT,
                        '~'>,
                    UTF8_non_ascii> {};
 
-struct atom : plus<atext> {};
+struct atom : plus<sor<UTF8::atext_run, atext>> {};
 
 struct dot_string : list<atom, dot> {};
 
@@ -329,23 +322,57 @@ struct auth : seq<TAO_PEGTL_ISTRING("AUTH"), SP, sasl_mech,
 struct bogus_cmd_short : seq<rep_min_max<0, 3, not_one<'\r', '\n'>>, CRLF> {};
 struct bogus_cmd_long : seq<rep_min_max<4, 1000, not_one<'\r', '\n'>>, CRLF> {};
 
-// commands in size order
+// The verb picks the one command rule to try, rather than trying each
+// in turn.
+
+struct verb_cmd {
+  template <typename Rule,
+            apply_mode A,
+            rewind_mode M,
+            template <typename...> class Action,
+            template <typename...> class Control,
+            typename Input,
+            typename... States>
+  static bool as(Input& in, States&&... st)
+  {
+    return Control<Rule>::template match<A, M, Action, Control>(in, st...);
+  }
+
+  template <apply_mode A,
+            rewind_mode M,
+            template <typename...> class Action,
+            template <typename...> class Control,
+            typename Input,
+            typename... States>
+  static bool match(Input& in, States&&... st)
+  {
+    if (in.size(4) < 4)
+      return false;
+
+    using RFC5321::verb;
+    switch (RFC5321::verb_of({in.current(), 4})) {
+    case verb::helo:     return as<helo,      A, M, Action, Control>(in, st...);
+    case verb::ehlo:     return as<ehlo,      A, M, Action, Control>(in, st...);
+    case verb::mail:     return as<mail_from, A, M, Action, Control>(in, st...);
+    case verb::rcpt:     return as<rcpt_to,   A, M, Action, Control>(in, st...);
+    case verb::data:     return as<data,      A, M, Action, Control>(in, st...);
+    case verb::bdat:     return as<sor<bdat, bdat_last>,
+                                   A, M, Action, Control>(in, st...);
+    case verb::rset:     return as<rset,      A, M, Action, Control>(in, st...);
+    case verb::noop:     return as<noop,      A, M, Action, Control>(in, st...);
+    case verb::vrfy:     return as<vrfy,      A, M, Action, Control>(in, st...);
+    case verb::help:     return as<help,      A, M, Action, Control>(in, st...);
+    case verb::starttls: return as<starttls,  A, M, Action, Control>(in, st...);
+    case verb::quit:     return as<quit,      A, M, Action, Control>(in, st...);
+    case verb::auth:     return as<auth,      A, M, Action, Control>(in, st...);
+    case verb::unknown:  break;
+    }
+    return false;
+  }
+};
 
 struct any_cmd : seq<sor<bogus_cmd_short,
-                         data,
-                         quit,
-                         rset,
-                         noop,
-                         vrfy,
-                         help,
-                         helo,
-                         ehlo,
-                         bdat,
-                         bdat_last,
-                         starttls,
-                         rcpt_to,
-                         mail_from,
-                         auth,
+                         verb_cmd,
                          bogus_cmd_long,
                          anything_else>,
                      discard> {};
@@ -734,6 +761,7 @@ void timeout(int signum)
 {
   const char errmsg[] = "421 4.4.2 time-out\r\n";
   write(STDOUT_FILENO, errmsg, sizeof errmsg - 1);
+  EventLog::flush_for_exit();
   _Exit(1);
 }
 
@@ -763,6 +791,10 @@ int main(int argc, char* argv[])
 
   google::InitGoogleLogging(argv[0]);
 
+  // Without it, the events go to the INFO log as text.
+  if (!FLAGS_event_log.empty())
+    EventLog::open(FLAGS_event_log.c_str());
+
   std::unique_ptr<RFC5321::Ctx> ctx;
 
   // Don't wait for STARTTLS to fail if no cert.
@@ -773,6 +805,13 @@ int main(int argc, char* argv[])
   auto const read_hook{[&ctx]() { ctx->session.flush(); }};
   ctx = std::make_unique<RFC5321::Ctx>(config_path, read_hook);
 
+  // For smtp-replay.
+  auto const capture_dir{getenv("GHSMTP_CAPTURE_DIR")};
+  if (!FLAGS_capture_dir.empty())
+    ctx->session.capture(FLAGS_capture_dir);
+  else if (capture_dir)
+    ctx->session.capture(capture_dir);
+
   ctx->session.greeting();
 
   istream_input<eol::crlf, 1> in{ctx->session.in(), FLAGS_cmd_bfr_size,
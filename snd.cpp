@@ -84,6 +84,7 @@ DEFINE_string(dkim_key_file, "", "DKIM key file");
 #include "Base64.hpp"
 #include "DNS-fcrdns.hpp"
 #include "DNS.hpp"
+#include "DkimSigner.hpp"
 #include "Domain.hpp"
 #include "IP4.hpp"
 #include "IP6.hpp"
@@ -1290,28 +1291,31 @@ void sign_eml(Eml&                        eml,
               std::string const&          from_dom,
               std::vector<content> const& bodies)
 {
-  auto const body_type = (bodies[0].type() == data_type::binary)
-                             ? OpenDKIM::sign::body_type::binary
-                             : OpenDKIM::sign::body_type::text;
-
-  auto const    key_file = FLAGS_dkim_key_file.empty()
-                               ? (FLAGS_selector + ".private")
-                               : FLAGS_dkim_key_file;
-  std::ifstream keyfs(key_file.c_str());
-  CHECK(keyfs.good()) << "can't access " << key_file;
-  std::string    key(std::istreambuf_iterator<char>{keyfs}, {});
-  OpenDKIM::sign dks(key.c_str(), FLAGS_selector.c_str(), from_dom.c_str(),
-                     body_type);
-  eml.foreach_hdr([&dks](std::string const& name, std::string const& value) {
-    auto const header = name + ": "s + value;
-    dks.header(header.c_str());
+  // Keys are read and parsed once, then kept.
+  static DkimSigner signer;
+  if (!signer.has_key(FLAGS_selector)) {
+    auto const key_file = FLAGS_dkim_key_file.empty()
+                              ? (FLAGS_selector + ".private")
+                              : FLAGS_dkim_key_file;
+    CHECK(fs::exists(key_file)) << "can't access " << key_file;
+    signer.add_key(FLAGS_selector, key_file);
+  }
+
+  DkimSigner::input in;
+  in.typ = (bodies[0].type() == data_type::binary)
+               ? DkimSigner::body_type::binary
+               : DkimSigner::body_type::text;
+
+  std::vector<std::string> hdrs;
+  eml.foreach_hdr([&hdrs](std::string const& name, std::string const& value) {
+    hdrs.push_back(name + ": "s + value);
   });
-  dks.eoh();
+  in.headers.assign(hdrs.begin(), hdrs.end());
   for (auto const& body : bodies) {
-    dks.body(body);
+    in.body.push_back(body);
   }
-  dks.eom();
-  eml.add_hdr("DKIM-Signature"s, dks.getsighdr());
+
+  eml.add_hdr("DKIM-Signature"s, signer.sign(FLAGS_selector, from_dom, in));
 }
 
 template <typename Input>
@@ -0,0 +1,137 @@
+#ifndef TASK_POOL_DOT_HPP
+#define TASK_POOL_DOT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+// Threads kept for the life of the process to run batches of tasks,
+// so a batch doesn't pay for starting any.  The caller works on its
+// own tasks too, and several callers may share the workers.
+class task_pool {
+public:
+  task_pool(task_pool const&) = delete;
+  task_pool& operator=(task_pool const&) = delete;
+
+  explicit task_pool(unsigned workers)
+  {
+    for (auto j = 0u; j < workers; ++j)
+      workers_.emplace_back([this] { work_(); });
+  }
+
+  ~task_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& w : workers_)
+      w.join();
+  }
+
+  // Every task, returning once they're all done.  A task that throws
+  // is logged and counted as done, so no worker is left holding tasks.
+  void run(std::vector<std::function<void()>> const& tasks)
+  {
+    if (tasks.size() < 2) {
+      for (auto const& task : tasks)
+        run_task(task);
+      return;
+    }
+
+    auto const b = std::make_shared<batch>(tasks);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      batches_.push_back(b);
+    }
+    cv_.notify_all();
+
+    while (b->run_one())
+      ;
+
+    std::unique_lock<std::mutex> lock(b->mutex);
+    b->cv.wait(lock, [&b] { return b->done == b->size; });
+  }
+
+private:
+  static void run_task(std::function<void()> const& task)
+  {
+    try {
+      task();
+    }
+    catch (std::exception const& e) {
+      LOG(ERROR) << "task failed: " << e.what();
+    }
+    catch (...) {
+      LOG(ERROR) << "task failed";
+    }
+  }
+
+  struct batch {
+    explicit batch(std::vector<std::function<void()>> const& t)
+      : tasks(t)
+      , size(t.size())
+    {
+    }
+
+    // False once every task has been started.
+    bool run_one()
+    {
+      auto const i = next++;
+      if (i >= size)
+        return false;
+      run_task(tasks[i]);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++done;
+      }
+      cv.notify_all();
+      return true;
+    }
+
+    std::vector<std::function<void()>> const& tasks;
+    std::size_t const                         size;
+    std::atomic<std::size_t>                  next{0};
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::size_t             done{0};
+  };
+
+  void work_()
+  {
+    for (;;) {
+      std::shared_ptr<batch> b;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !batches_.empty(); });
+        if (stop_)
+          return;
+        b = batches_.front();
+      }
+      if (!b->run_one()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!batches_.empty() && (batches_.front() == b))
+          batches_.pop_front();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+
+  std::mutex                         mutex_;
+  std::condition_variable            cv_;
+  std::deque<std::shared_ptr<batch>> batches_; // with tasks not yet started
+  bool                               stop_{false};
+};
+
+#endif // TASK_POOL_DOT_HPP